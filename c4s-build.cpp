@@ -10,14 +10,25 @@ using namespace c4s;
 
 program_arguments args;
 
-const char *files_common = "directdatabase.cpp ddbrowset.cpp ddbpostgre.cpp ddbpostgrers.cpp"; // ddbmysql.cpp ddbmysqlrs.cpp";
-const char *files_win    = "ddbodbc.cpp ddbodbcrs.cpp";
+const char *files_common = "directdatabase.cpp ddbrowset.cpp ddbpostgre.cpp ddbpostgrers.cpp ddbforward.cpp ddbbatch.cpp ddbrouter.cpp ddbshard.cpp ddbarena.cpp ddbtable.cpp ddbsnapshot.cpp ddbshmcache.cpp ddbexport.cpp ddbimport.cpp ddbhedge.cpp ddbqueryexec.cpp ddbtypes.cpp ddbjson.cpp ddbidalloc.cpp"; // ddbmysql.cpp ddbmysqlrs.cpp";
+const char *files_odbc   = "ddbodbc.cpp ddbodbcrs.cpp";
+const char *files_firebird = "ddbfirebird.cpp ddbfirebirdrs.cpp ddbfirebirdbatch.cpp";
+const char *files_sqlite = "ddbsqlite.cpp ddbsqliters.cpp ddbsqlitepool.cpp ddbreplica.cpp";
+const char *files_coro   = "ddbcoro.cpp";
 
 // ============== LINUX ===============================================================================
 #if defined(__linux) || defined(__APPLE__)
 int Build(bool wxmode)
 {
     path_list cppFiles(files_common, ' ');
+    if(args.is_set("-sqlite"))
+        cppFiles.add(files_sqlite,' ');
+    if(args.is_set("-odbc"))
+        cppFiles.add(files_odbc,' ');
+    if(args.is_set("-firebird"))
+        cppFiles.add(files_firebird,' ');
+    if(args.is_set("-coro"))
+        cppFiles.add(files_coro,' ');
 
     int flags = BUILD_LIB;
     flags |= args.is_set("-deb") ? BUILD_DEBUG : BUILD_RELEASE;
@@ -28,6 +39,8 @@ int Build(bool wxmode)
     make.add_comp("-Wno-ctor-dtor-privacy -Wnon-virtual-dtor -I/usr/include/postgresql/ -I/usr/include/postgresql/libpq -I/usr/local/include/cpp4scripts");
     //make.add_comp("-I/usr/include/mysql");
     make.add_comp("-fno-rtti -DDDB_USESTL");
+    if(args.is_set("-coro"))
+        make.add_comp("-std=c++20");
     if(args.is_set("-deb"))
         make.add_comp("-DC4S_LOG_LEVEL=2");
     else
@@ -40,7 +53,7 @@ int Build(bool wxmode)
 int Build(bool wxmode)
 {
     path_list cppFiles(files_common, ' ');
-    //cppFiles.add(files_win,' ');
+    //cppFiles.add(files_odbc,' ');
 
     const char *subsys =  wxmode ? "wx":"stl";
     const char *wxopts = wxmode ? "":0;
@@ -147,6 +160,10 @@ int main(int argc, char **argv)
     args += argument("-rel",  false, "Sets the release mode");
     args += argument("-t",    true,  "Set the build type [WX|STL]");
     args += argument("-V",    false, "Enable verbose build mode");
+    args += argument("-sqlite", false, "Include the SQLite modules into the build.");
+    args += argument("-odbc", false, "Include the ODBC modules into the build (requires unixODBC on Linux).");
+    args += argument("-firebird", false, "Include the Firebird modules into the build.");
+    args += argument("-coro", false, "Include the C++20 coroutine interface into the build.");
     args += argument("-install", true, "Install library to given root.");
     args += argument("-clean",false, "Clean up build files.");
 
@@ -20,6 +20,13 @@ necessary definitions.
 // Enable following to include Firebird modules into the library and into the application.
 #define __DDB_FIREBIRD__
 
+// Enable following to include SQLite modules into the library and into the application.
+//#define __DDB_SQLITE__
+
+// Enable following to include ODBC modules into the library and into the application.
+// On Linux this requires unixODBC (libodbc).
+//#define __DDB_ODBC__
+
 // Win32 only ----------------------------------------------------------------------------------------
 #ifdef WIN32
 
@@ -0,0 +1,221 @@
+/*! \file ddbarena.cpp
+ * \brief Bump allocator and arena backed materialized query results. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#include "pch-stop.h"
+#include <stdlib.h>
+#include <cpp4scripts.hpp>
+#include "ddbarena.hpp"
+
+// ==================================================================================================
+DdbArena::DdbArena(size_t firstBlock)
+/*!
+  No memory is allocated until the first Alloc.
+  \param firstBlock Size of the first block.
+*/
+{
+    head = 0;
+    ptr = 0;
+    end = 0;
+    nextSize = firstBlock>256 ? firstBlock : 256;
+    used = 0;
+    mallocs = 0;
+}
+
+// ==================================================================================================
+DdbArena::~DdbArena()
+{
+    Release();
+}
+
+// ==================================================================================================
+bool DdbArena::Grow(size_t size)
+/*!
+  Adds a new block that can hold at least size bytes.
+*/
+{
+    size_t bsize = nextSize;
+    while(bsize < size + sizeof(double))
+        bsize *= 2;
+    Block *block = (Block*) malloc(sizeof(Block) + bsize);
+    if(!block) {
+        CS_VAPRT_ERRO("DdbArena::Grow - Unable to allocate %lu bytes.",(unsigned long)bsize);
+        return false;
+    }
+    mallocs++;
+    block->prev = head;
+    block->size = bsize;
+    head = block;
+    ptr = (char*)(block+1);
+    end = ptr + bsize;
+    nextSize = bsize*2;
+    return true;
+}
+
+// ==================================================================================================
+void* DdbArena::Alloc(size_t size, size_t align)
+/*!
+  Allocates memory from the arena.
+  \param size Number of bytes.
+  \param align Alignment. Must be a power of two.
+  \retval void* Pointer to the memory or null if out of memory.
+*/
+{
+    char *aligned = (char*)(((uintptr_t)ptr + align-1) & ~(uintptr_t)(align-1));
+    if(!head || aligned+size > end) {
+        if(!Grow(size+align))
+            return 0;
+        aligned = (char*)(((uintptr_t)ptr + align-1) & ~(uintptr_t)(align-1));
+    }
+    ptr = aligned + size;
+    used += size;
+    return aligned;
+}
+
+// ==================================================================================================
+const char* DdbArena::Copy(const char *str, size_t len)
+/*!
+  Copies the string into the arena and adds the terminating null.
+*/
+{
+    char *to = (char*) Alloc(len+1, 1);
+    if(!to)
+        return 0;
+    memcpy(to, str, len);
+    to[len] = 0;
+    return to;
+}
+
+// ==================================================================================================
+void DdbArena::Reset()
+/*!
+  Releases all allocations. A single block is kept for the following allocations. If the
+  arena had grown into several blocks they are replaced with one block of their total size
+  at the next Alloc, so that a repeated query of the same size fits into one block.
+*/
+{
+    if(!head)
+        return;
+    if(head->prev) {
+        size_t total = 0;
+        while(head) {
+            Block *prev = head->prev;
+            total += head->size;
+            free(head);
+            head = prev;
+        }
+        nextSize = total;
+        ptr = 0;
+        end = 0;
+    }
+    else {
+        ptr = (char*)(head+1);
+        end = ptr + head->size;
+        nextSize = head->size;
+    }
+    used = 0;
+}
+
+// ==================================================================================================
+void DdbArena::Release()
+/*!
+  Releases all memory back to the system.
+*/
+{
+    while(head) {
+        Block *prev = head->prev;
+        free(head);
+        head = prev;
+    }
+    ptr = 0;
+    end = 0;
+    used = 0;
+}
+
+// ==================================================================================================
+bool DdbResultRows::Setup(const std::vector<short> &types_in)
+/*!
+  Clears the result and computes the row layout for the given field types.
+  \retval bool False if the types include a type that can not be stored.
+*/
+{
+    Clear();
+    types = types_in;
+    offsets.clear();
+    size_t offset = 0;
+    for(std::vector<short>::iterator it=types.begin(); it!=types.end(); it++) {
+        size_t size;
+        // DDB_TYPE_USED
+        switch(*it) {
+        case DDBT_INT:  size = sizeof(int); break;
+        case DDBT_LONG: size = sizeof(int64_t); break;
+        case DDBT_NUM:  size = sizeof(double); break;
+        case DDBT_DEC:  size = sizeof(DdbDecimal); break;
+        case DDBT_UUID: size = sizeof(DdbUuid); break;
+        case DDBT_BOOL: size = sizeof(bool); break;
+        case DDBT_STR:
+        case DDBT_BLOB: size = sizeof(DdbStrRef); break;
+        case DDBT_TIME:
+        case DDBT_DAY:  size = sizeof(DDBTIME); break;
+#ifdef DDB_USESTL
+        case DDBT_CHR:  size = sizeof(char); break;
+#else
+        case DDBT_CHR:  size = sizeof(wxUniChar); break;
+#endif
+        default:
+            CS_VAPRT_ERRO("DdbResultRows::Setup - Type %d is not supported.",*it);
+            types.clear();
+            return false;
+        }
+        // Align each slot by its size, up to the double alignment.
+        size_t align = size>=sizeof(double) ? sizeof(double) : (size>=4 ? 4 : 1);
+        offset = (offset+align-1) & ~(align-1);
+        offsets.push_back(offset);
+        offset += size;
+    }
+    rowSize = offset + types.size();
+    return true;
+}
+
+// ==================================================================================================
+bool DdbResultRows::Reserve(int count)
+/*!
+  Reserves the row index and, for an empty result, an arena block that holds the given number
+  of rows.
+*/
+{
+    rows.reserve(rows.size()+count);
+    if(!rows.empty() || count<=0)
+        return true;
+    // Allocate and hand the space back so that the rows are carved from one block.
+    if(!arena.Alloc(rowSize*count))
+        return false;
+    arena.Reset();
+    return true;
+}
+
+// ==================================================================================================
+char* DdbResultRows::AddRow()
+/*!
+  Adds a zero filled row.
+  \retval char* Pointer to the row or null if out of memory.
+*/
+{
+    char *row = (char*) arena.Alloc(rowSize);
+    if(!row)
+        return 0;
+    memset(row, 0, rowSize);
+    rows.push_back(row);
+    return row;
+}
+
+// ==================================================================================================
+void DdbResultRows::Clear()
+/*!
+  Releases the rows and the strings at once. Memory is kept for the next result.
+*/
+{
+    rows.clear();
+    arena.Reset();
+}
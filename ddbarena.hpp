@@ -0,0 +1,137 @@
+/*! \file ddbarena.hpp
+ * \brief Bump allocator and arena backed materialized query results. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#ifndef DDB_ARENA_H_FILE
+#define DDB_ARENA_H_FILE
+
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+#include "directdatabase.hpp"
+
+//! Size of the first arena block. Following blocks double in size.
+#define DDB_ARENA_BLOCK 65536
+
+// ==================================================================================================
+//! Bump allocator. Memory is released all at once with Reset or Release.
+/*! Allocations are carved from large blocks. A block is allocated with malloc only when the
+    current one is full, so thousands of small allocations cost a handful of malloc calls.
+    Reset keeps one block for reuse so that a repeated query of similar size does not call
+    malloc at all. Destructors of the allocated objects are not called.
+ */
+class DdbArena
+{
+public:
+    DdbArena(size_t firstBlock=DDB_ARENA_BLOCK);
+    ~DdbArena();
+
+    void* Alloc(size_t size, size_t align=sizeof(double));
+    const char* Copy(const char *str, size_t len);
+    void Reset();
+    void Release();
+
+    //! Returns the number of bytes allocated from the arena since the last reset.
+    size_t GetUsed() { return used; }
+    //! Returns the number of malloc calls made by the arena since it was created.
+    int GetMallocCount() { return mallocs; }
+
+protected:
+    //! Memory block. Allocations follow the header.
+    struct Block {
+        Block *prev;
+        size_t size;        //!< Usable size after the header.
+    };
+    bool Grow(size_t size);
+
+    Block *head;            //!< Current block. Older blocks are linked through prev.
+    char *ptr;              //!< Next free byte in the current block.
+    char *end;              //!< End of the current block.
+    size_t nextSize;        //!< Size of the next block.
+    size_t used;
+    int mallocs;
+
+private:
+    DdbArena(const DdbArena&);
+    void operator=(const DdbArena&);
+};
+
+// ==================================================================================================
+//! String stored into an arena. Text is null terminated. Null value has null pointer.
+struct DdbStrRef
+{
+    const char *ptr;
+    size_t len;
+
+    bool IsNull() const { return ptr==0; }
+    //! Returns the text. Empty string for null values.
+    const char* c_str() const { return ptr ? ptr : ""; }
+    bool Equals(const char *str) const { return ptr && strlen(str)==len && memcmp(ptr,str,len)==0; }
+};
+
+// ==================================================================================================
+//! Query result materialized into an arena.
+/*! Rows are fixed size records in the arena. Each bound field has a slot whose type follows the
+    bound type: int, int64_t, double, DdbDecimal, DdbUuid, bool, char (wxUniChar), DDBTIME or
+    DdbStrRef for strings and binary values.
+    Null values are flagged per field. Strings point into the arena and stay valid until
+    Clear or destruction. Use DdbRowSet::Materialize to fill the object.
+    \code
+    DdbResultRows rows;
+    rs->Bind(DDBT_INT, &id);
+    rs->Bind(DDBT_STR, &name);
+    rs->Materialize("SELECT id, name FROM customer", rows);
+    for(int ndx=0; ndx<rows.GetRowCount(); ndx++)
+        printf("%d %s\n", rows.GetInt(ndx,0), rows.GetStr(ndx,1).c_str());
+    \endcode
+ */
+class DdbResultRows
+{
+public:
+    DdbResultRows() { rowSize = 0; }
+
+    bool Setup(const std::vector<short> &types);
+    char* AddRow();
+    bool Reserve(int count);
+    void Clear();
+
+    //! Returns the number of rows in the result.
+    int GetRowCount() { return (int)rows.size(); }
+    //! Returns the number of columns in a row.
+    int GetColumnCount() { return (int)types.size(); }
+    //! Returns the DDBT-type of the column.
+    short GetType(int col) { return types[col]; }
+    bool IsNull(int row, int col) { return rows[row][rowSize-types.size()+col] != 0; }
+    int GetInt(int row, int col) { return *(int*)Slot(row,col); }
+    int64_t GetLong(int row, int col) { return *(int64_t*)Slot(row,col); }
+    double GetDouble(int row, int col) { return *(double*)Slot(row,col); }
+    const DdbDecimal& GetDecimal(int row, int col) { return *(DdbDecimal*)Slot(row,col); }
+    const DdbUuid& GetUuid(int row, int col) { return *(DdbUuid*)Slot(row,col); }
+    bool GetBool(int row, int col) { return *(bool*)Slot(row,col); }
+    const DdbStrRef& GetStr(int row, int col) { return *(DdbStrRef*)Slot(row,col); }
+    const DDBTIME& GetTime(int row, int col) { return *(DDBTIME*)Slot(row,col); }
+    //! Returns a binary value. The bytes may contain nulls; use the length.
+    const DdbStrRef& GetBlob(int row, int col) { return *(DdbStrRef*)Slot(row,col); }
+#ifdef DDB_USESTL
+    char GetChar(int row, int col) { return *(char*)Slot(row,col); }
+#else
+    wxUniChar GetChar(int row, int col) { return *(wxUniChar*)Slot(row,col); }
+#endif
+
+    //! Returns pointer to the slot of the value. Intended for the rowset implementations.
+    char* Slot(int row, int col) { return rows[row] + offsets[col]; }
+    //! Returns pointer to the null flag of the value. Intended for the rowset implementations.
+    char* NullFlag(char *row, int col) { return row + rowSize - types.size() + col; }
+    char* Slot(char *row, int col) { return row + offsets[col]; }
+    DdbArena* GetArena() { return &arena; }
+
+protected:
+    DdbArena arena;
+    std::vector<short> types;
+    std::vector<size_t> offsets;   //!< Offset of each column in the row.
+    std::vector<char*> rows;
+    size_t rowSize;                //!< Row size including the null flags.
+};
+
+#endif
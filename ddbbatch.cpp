@@ -0,0 +1,192 @@
+/*! \file ddbbatch.cpp
+ * \brief Group commit of ExecuteModify calls. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#include "pch-stop.h"
+#include <cpp4scripts.hpp>
+#include "ddbbatch.hpp"
+
+using namespace std::chrono;
+
+// ==================================================================================================
+DdbTransactionBatcher::DdbTransactionBatcher(DirectDatabase *db_in)
+/*!
+    \param db_in Connected database. Batcher does not take the ownership.
+*/
+{
+    db = db_in;
+    transactOn = false;
+    commitUnknown = false;
+    commitCount = 100;
+    commitInterval = 100;
+    retryCount = 3;
+    callback = 0;
+    cbContext = 0;
+}
+
+// ==================================================================================================
+DdbTransactionBatcher::~DdbTransactionBatcher()
+/*!
+    Commits the pending statements.
+*/
+{
+    Flush();
+}
+
+// ==================================================================================================
+bool DdbTransactionBatcher::Begin()
+{
+    if(!db->StartTransaction())
+    {
+        CS_PRINT_ERRO("DdbTransactionBatcher::Begin - Unable to start transaction.");
+        return false;
+    }
+    transactOn = true;
+    started = steady_clock::now();
+    return true;
+}
+
+// ==================================================================================================
+int DdbTransactionBatcher::ExecuteModify(const DDBSTR &modify)
+/*!
+  Executes the statement within the batch transaction. Commits the batch if it is full or
+  the commit interval has passed.
+  \retval int Number of rows modified or -1 on error.
+*/
+{
+    // Caller's own transaction.
+    if(!transactOn && db->IsTransaction())
+        return db->ExecuteModify(modify);
+
+    if(!transactOn && !Begin())
+        return -1;
+    int rv = db->ExecuteModify(modify);
+    if(rv < 0)
+    {
+        // Failure aborts the transaction in some databases. Start again without this statement.
+        CS_VAPRT_WARN("DdbTransactionBatcher::ExecuteModify - Statement failed, replaying %d earlier statements.",
+                      (int)pending.size());
+        db->RollBack();
+        transactOn = false;
+        if(!pending.empty() && !Replay())
+        {
+            Notify(false);
+            pending.clear();
+        }
+        return -1;
+    }
+    pending.push_back(modify);
+    if((int)pending.size() >= commitCount)
+        Flush();
+    else
+        Poll();
+    return rv;
+}
+
+// ==================================================================================================
+bool DdbTransactionBatcher::Poll()
+/*!
+  Commits the batch if the commit interval has passed.
+  \retval bool False if the commit failed.
+*/
+{
+    if(!transactOn || commitInterval==0)
+        return true;
+    if(duration_cast<milliseconds>(steady_clock::now()-started).count() < commitInterval)
+        return true;
+    return Flush();
+}
+
+// ==================================================================================================
+bool DdbTransactionBatcher::Flush()
+/*!
+  Commits the pending statements now. Failed commit is retried by replaying the batch unless
+  the connection was lost during the commit.
+  \retval bool True if the statements were committed. False if the batch was given up or the
+    outcome of the commit is unknown (see IsCommitUnknown).
+*/
+{
+    if(!transactOn)
+        return true;
+    if(Commit())
+        return true;
+    for(int attempt=0; attempt<retryCount && !commitUnknown; attempt++)
+    {
+        CS_VAPRT_WARN("DdbTransactionBatcher::Flush - Commit failed, retry %d/%d.",attempt+1,retryCount);
+        if(Replay() && Commit())
+            return true;
+    }
+    if(commitUnknown)
+    {
+        CS_VAPRT_ERRO("DdbTransactionBatcher::Flush - Connection lost during commit. Batch of %d statements may have been committed and is not replayed.",
+                      (int)pending.size());
+        Notify(false);
+        pending.clear();
+        return false;
+    }
+    CS_VAPRT_ERRO("DdbTransactionBatcher::Flush - Batch of %d statements given up.",(int)pending.size());
+    Notify(false);
+    pending.clear();
+    return false;
+}
+
+// ==================================================================================================
+bool DdbTransactionBatcher::Commit()
+/*!
+  Commits the open transaction. If the connection is lost during the commit the server may
+  have committed it, so the outcome is flagged unknown.
+*/
+{
+    transactOn = false;
+    commitUnknown = false;
+    if(!db->Commit())
+    {
+        if(!db->IsConnectOK())
+        {
+            commitUnknown = true;
+            return false;
+        }
+        if(db->IsTransaction())
+            db->RollBack();
+        return false;
+    }
+    Notify(true);
+    pending.clear();
+    return true;
+}
+
+// ==================================================================================================
+bool DdbTransactionBatcher::Replay()
+/*!
+  Executes the pending statements in a new transaction. The connection is reset if it has been
+  lost.
+  \retval bool True if all statements succeeded. Transaction is then left open.
+*/
+{
+    if(!db->IsConnectOK() && !db->ResetConnection())
+    {
+        CS_PRINT_ERRO("DdbTransactionBatcher::Replay - Connection reset failed.");
+        return false;
+    }
+    if(!Begin())
+        return false;
+    for(std::vector<DDBSTR>::iterator it=pending.begin(); it!=pending.end(); it++)
+    {
+        if(db->ExecuteModify(*it) < 0)
+        {
+            CS_VAPRT_ERRO("DdbTransactionBatcher::Replay - Statement failed: %s",it->DATA());
+            db->RollBack();
+            transactOn = false;
+            return false;
+        }
+    }
+    return true;
+}
+
+// ==================================================================================================
+void DdbTransactionBatcher::Notify(bool committed)
+{
+    if(callback && !pending.empty())
+        callback(cbContext, (int)pending.size(), committed);
+}
@@ -0,0 +1,93 @@
+/*! \file ddbbatch.hpp
+ * \brief Group commit of ExecuteModify calls. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#ifndef DDB_BATCH_H_FILE
+#define DDB_BATCH_H_FILE
+
+#include <vector>
+#include <chrono>
+#include "directdatabase.hpp"
+
+//! Called after a batch has been committed (committed=true) or given up (committed=false).
+//! See DdbTransactionBatcher::IsCommitUnknown for a batch whose commit outcome is unknown.
+typedef void (*DdbCommitCallback)(void *context, int statements, bool committed);
+
+// ==================================================================================================
+//! Wraps autocommit modifications into transactions that are committed in groups.
+/*! ExecuteModify calls are executed immediately inside a transaction that the batcher starts.
+    The transaction is committed when it has N statements (SetCommitCount) or when it has been
+    open T milliseconds (SetCommitInterval), whichever comes first. One commit (and fsync) is
+    then shared by the whole group. The interval is checked on each ExecuteModify and on Poll.
+    No background thread is used, so call Poll or Flush when the application goes idle.
+
+    The return value of ExecuteModify is the row count of the statement. The change is durable
+    only after the commit; register a callback with SetCommitCallback to learn when.
+
+    If a statement fails the transaction is rolled back and the earlier statements of the
+    batch are replayed in a new transaction. Only the failing statement is lost. If the commit
+    fails the whole batch is replayed and committed again up to SetRetryCount times. The
+    connection is reset before a replay if it has been lost.
+
+    If the connection is lost during the commit, the database may have committed the batch
+    before the connection broke. Replaying it could then execute the statements twice, so the
+    batch is not replayed: Flush returns false, the callback is called with committed=false
+    and IsCommitUnknown returns true. The application should check from the database whether
+    the changes are there.
+
+    If the caller has started a transaction with DirectDatabase::StartTransaction the
+    statements are passed through as they are. The batcher is not thread safe.
+    Usage:
+    \code
+    DdbTransactionBatcher batcher(&pg);
+    batcher.SetCommitCount(500);
+    batcher.SetCommitInterval(20);
+    for(...)
+        batcher.ExecuteModify(insert);
+    batcher.Flush();
+    \endcode
+ */
+class DdbTransactionBatcher
+{
+public:
+    DdbTransactionBatcher(DirectDatabase *db);
+    ~DdbTransactionBatcher();
+
+    int ExecuteModify(const DDBSTR &modify);
+    bool Flush();
+    bool Poll();
+
+    //! Sets the maximum number of statements in one transaction. Default is 100.
+    void SetCommitCount(int count) { commitCount = count>0 ? count : 1; }
+    //! Sets the maximum time in milliseconds a transaction is kept open. Zero disables. Default is 100.
+    void SetCommitInterval(int ms) { commitInterval = ms>=0 ? ms : 0; }
+    //! Sets how many times a failed batch is replayed before it is given up. Default is 3.
+    void SetRetryCount(int count) { retryCount = count>=0 ? count : 0; }
+    void SetCommitCallback(DdbCommitCallback cb, void *context) { callback = cb; cbContext = context; }
+
+    //! Returns true if the latest commit failed because the connection was lost during it.
+    bool IsCommitUnknown() { return commitUnknown; }
+    //! Returns the number of statements waiting for the commit.
+    int GetPending() { return (int)pending.size(); }
+    DirectDatabase* GetDatabase() { return db; }
+
+protected:
+    bool Begin();
+    bool Replay();
+    bool Commit();
+    void Notify(bool committed);
+
+    DirectDatabase *db;
+    std::vector<DDBSTR> pending;    //!< Statements of the open transaction.
+    std::chrono::steady_clock::time_point started; //!< When the open transaction was started.
+    bool transactOn;                //!< True while the batcher has a transaction open.
+    bool commitUnknown;             //!< True if the connection was lost during the latest commit.
+    int commitCount;
+    int commitInterval;
+    int retryCount;
+    DdbCommitCallback callback;
+    void *cbContext;
+};
+
+#endif
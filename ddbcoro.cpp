@@ -0,0 +1,417 @@
+/*! \file ddbcoro.cpp
+ * \brief C++20 coroutine interface for asynchronous PostgreSQL queries. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#include "pch-stop.h"
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#ifdef __linux
+  #include <sys/epoll.h>
+  #include <sys/eventfd.h>
+  #include <unistd.h>
+#endif
+#include <cpp4scripts.hpp>
+#define __DDB_POSTGRE__
+#include "ddbcoro.hpp"
+
+#ifdef DDB_COROUTINES
+
+#ifdef __linux
+// ==================================================================================================
+DdbEpollExecutor::DdbEpollExecutor()
+{
+    stopped = false;
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+    if(epollFd < 0 || wakeFd < 0) {
+        CS_VAPRT_ERRO("DdbEpollExecutor - Unable to create epoll: %s", strerror(errno));
+        return;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = wakeFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+}
+
+// ==================================================================================================
+DdbEpollExecutor::~DdbEpollExecutor()
+{
+    if(epollFd >= 0)
+        close(epollFd);
+    if(wakeFd >= 0)
+        close(wakeFd);
+}
+
+// ==================================================================================================
+void DdbEpollExecutor::WaitSocket(int sock, bool write, std::coroutine_handle<> handle)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = (write ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT;
+    ev.data.fd = sock;
+    // Sockets are registered once and rearmed after each event. A closed socket leaves the set.
+    if(epoll_ctl(epollFd, EPOLL_CTL_MOD, sock, &ev)
+       && (errno != ENOENT || epoll_ctl(epollFd, EPOLL_CTL_ADD, sock, &ev)))
+    {
+        CS_VAPRT_ERRO("DdbEpollExecutor::WaitSocket - epoll_ctl failed: %s", strerror(errno));
+        // Resume anyway. The coroutine will find the socket in error.
+        Post(handle);
+        return;
+    }
+    waiters[sock] = handle;
+}
+
+// ==================================================================================================
+void DdbEpollExecutor::Post(std::coroutine_handle<> handle)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    posted.push_back(handle);
+    Wake();
+}
+
+// ==================================================================================================
+void DdbEpollExecutor::Stop()
+/*!
+  Makes Run return after the coroutines that are ready have been resumed. The waiting ones
+  stay suspended and continue on the next Run.
+*/
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stopped = true;
+    Wake();
+}
+
+// ==================================================================================================
+void DdbEpollExecutor::Wake()
+{
+    uint64_t one = 1;
+    ssize_t rv = write(wakeFd, &one, sizeof(one));
+    (void)rv;
+}
+
+// ==================================================================================================
+bool DdbEpollExecutor::Run()
+/*!
+  Resumes the posted coroutines and the ones whose sockets become ready until none is left
+  waiting or Stop is called.
+  \retval bool False if epoll failed.
+*/
+{
+    if(epollFd < 0 || wakeFd < 0)
+        return false;
+    struct epoll_event events[64];
+    std::deque<std::coroutine_handle<> > ready;
+    for(;;) {
+        bool more;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(stopped) {
+                stopped = false;
+                return true;
+            }
+            ready.swap(posted);
+        }
+        for(size_t ndx=0; ndx<ready.size(); ndx++)
+            ready[ndx].resume();
+        ready.clear();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            more = !posted.empty() || stopped;
+        }
+        if(!more && waiters.empty())
+            return true;
+        int count = epoll_wait(epollFd, events, 64, more ? 0 : -1);
+        if(count < 0) {
+            if(errno == EINTR)
+                continue;
+            CS_VAPRT_ERRO("DdbEpollExecutor::Run - epoll_wait failed: %s", strerror(errno));
+            return false;
+        }
+        for(int ndx=0; ndx<count; ndx++) {
+            int fd = events[ndx].data.fd;
+            if(fd == wakeFd) {
+                uint64_t val;
+                ssize_t rv = read(wakeFd, &val, sizeof(val));
+                (void)rv;
+                continue;
+            }
+            std::unordered_map<int, std::coroutine_handle<> >::iterator it = waiters.find(fd);
+            if(it == waiters.end())
+                continue;
+            std::coroutine_handle<> handle = it->second;
+            waiters.erase(it);
+            handle.resume();
+        }
+    }
+}
+#endif // __linux
+
+// ==================================================================================================
+DdbPgAsync::DdbPgAsync(DdbPostgre *db_in, DdbExecutor *executor_in)
+/*!
+  \param db_in Connected database. Must outlive this object.
+  \param executor_in Event loop that resumes the suspended queries.
+*/
+{
+    db = db_in;
+    executor = executor_in;
+    busy = false;
+}
+
+// ==================================================================================================
+DdbTask<bool> DdbPgAsync::Send(const char *query, bool singleRow)
+/*!
+  Sends the query without blocking and marks the connection busy.
+  \retval bool False if the connection is busy or the send failed.
+*/
+{
+    PGconn *conn = db->GetPGConn();
+    if(!conn) {
+        db->SetErrorId(5);
+        co_return false;
+    }
+    if(busy) {
+        CS_PRINT_WARN("DdbPgAsync::Send - Connection is busy with another query.");
+        db->SetErrorId(28);
+        co_return false;
+    }
+    busy = true;
+    db->SetRunning(true);
+    PQsetnonblocking(conn, 1);
+    if(!PQsendQuery(conn, query)) {
+        CS_VAPRT_ERRO("DdbPgAsync::Send failed: %s", PQerrorMessage(conn));
+        db->SetErrorId(19);
+        Finish();
+        co_return false;
+    }
+    if(singleRow)
+        PQsetSingleRowMode(conn);
+    int rv;
+    while((rv = PQflush(conn)) == 1)
+        co_await DdbSocketWait{ executor, PQsocket(conn), true };
+    if(rv < 0) {
+        CS_VAPRT_ERRO("DdbPgAsync::Send - Flush failed: %s", PQerrorMessage(conn));
+        db->SetErrorId(19);
+        Finish();
+        co_return false;
+    }
+    co_return true;
+}
+
+// ==================================================================================================
+DdbTask<PGresult*> DdbPgAsync::Receive()
+/*!
+  Waits for the next result of the running query.
+  \retval PGresult* Next result or null when all have been received.
+*/
+{
+    PGconn *conn = db->GetPGConn();
+    while(PQisBusy(conn)) {
+        co_await DdbSocketWait{ executor, PQsocket(conn), false };
+        if(!PQconsumeInput(conn)) {
+            CS_VAPRT_ERRO("DdbPgAsync::Receive failed: %s", PQerrorMessage(conn));
+            break;
+        }
+    }
+    co_return PQgetResult(conn);
+}
+
+// ==================================================================================================
+void DdbPgAsync::Finish()
+{
+    PGconn *conn = db->GetPGConn();
+    if(conn)
+        PQsetnonblocking(conn, 0);
+    db->SetRunning(false);
+    busy = false;
+}
+
+// ==================================================================================================
+DdbTask<DdbPgResult> DdbPgAsync::QueryAsync(const char *query)
+/*!
+  Executes a query asynchronously.
+  \param query Query to execute. Several statements may be given; the result of the last one
+    is returned unless an earlier one failed.
+  \retval DdbPgResult Result of the query. Check it with IsOk or as a bool. Holds a null
+    result if the query could not be sent.
+*/
+{
+    if(!co_await Send(query, false))
+        co_return DdbPgResult();
+    PGresult *last = 0;
+    PGresult *result;
+    while((result = co_await Receive()) != 0) {
+        ExecStatusType status = PQresultStatus(result);
+        if(status == PGRES_COPY_IN || status == PGRES_COPY_OUT || status == PGRES_COPY_BOTH) {
+            PQclear(last);
+            last = result;
+            break;
+        }
+        // As with PQexec an error result is kept over the results that follow it.
+        if(last && (PQresultStatus(last) == PGRES_FATAL_ERROR || PQresultStatus(last) == PGRES_BAD_RESPONSE))
+            PQclear(result);
+        else {
+            PQclear(last);
+            last = result;
+        }
+    }
+    Finish();
+    DdbPgResult answer(last);
+    if(!answer.IsOk()) {
+        CS_VAPRT_ERRO("DdbPgAsync::QueryAsync failed: %s", answer.GetError());
+        db->SetErrorId(19);
+    }
+    co_return answer;
+}
+
+// ==================================================================================================
+DdbTask<bool> DdbPgAsync::QueryAsync(DdbRowSet *rs, const char *query)
+/*!
+  Executes a query asynchronously into a rowset. When the task completes the rows are read
+  with GetNext into the bound variables as after DdbRowSet::Query.
+  \param rs Rowset created by the DdbPostgre of this object.
+  \param query Query to execute.
+  \retval bool True on success.
+*/
+{
+    DdbPgResult res = co_await QueryAsync(query);
+    if(!res.Get())
+        co_return false;
+    co_return ((DdbPosgtgreRowSet*)rs)->SetResult(res.Release());
+}
+
+// ==================================================================================================
+DdbTask<int> DdbPgAsync::ExecuteModifyAsync(const char *query)
+/*!
+  Executes an INSERT, UPDATE or DELETE asynchronously.
+  \retval int Number of rows affected or -1 on error.
+*/
+{
+    DdbPgResult res = co_await QueryAsync(query);
+    if(!res.Get() || PQresultStatus(res.Get()) != PGRES_COMMAND_OK) {
+        db->SetErrorId(18);
+        co_return -1;
+    }
+    co_return (int)strtol(PQcmdTuples(res.Get()), 0, 10);
+}
+
+// ==================================================================================================
+DdbPgRowStream DdbPgAsync::Rows(const char *query)
+/*!
+  Creates a stream over the rows of a query. The query is sent when the rows are first
+  requested. See DdbPgRowStream.
+  \param query Query to execute. It is copied.
+*/
+{
+    return DdbPgRowStream(this, query);
+}
+
+// ==================================================================================================
+DdbPgRowStream::DdbPgRowStream(DdbPgAsync *async_in, const char *query_in)
+    : async(async_in), query(query_in ? query_in : "")
+{
+    started = false;
+    finished = false;
+    failed = false;
+}
+
+// ==================================================================================================
+DdbPgRowStream::DdbPgRowStream(DdbPgRowStream &&other) noexcept
+    : async(other.async), query(std::move(other.query)), row(std::move(other.row)), error(std::move(other.error))
+{
+    started = other.started;
+    finished = other.finished;
+    failed = other.failed;
+    other.started = false;
+    other.finished = true;
+}
+
+// ==================================================================================================
+DdbPgRowStream::~DdbPgRowStream()
+{
+    if(started && !finished)
+        Abort();
+}
+
+// ==================================================================================================
+void DdbPgRowStream::Abort()
+/*!
+  Cancels the query and discards the rows that have not been read. Blocks until the server
+  has stopped sending.
+*/
+{
+    PGconn *conn = async->db->GetPGConn();
+    row = DdbPgResult();
+    finished = true;
+    if(!conn) {
+        async->Finish();
+        return;
+    }
+    async->db->SendCancel();
+    PQsetnonblocking(conn, 0);
+    PGresult *res;
+    while((res = PQgetResult(conn)) != 0)
+        PQclear(res);
+    async->Finish();
+}
+
+// ==================================================================================================
+DdbTask<bool> DdbPgRowStream::Next()
+/*!
+  Waits for the next row. The first call sends the query.
+  \retval bool True if a row was received. False at the end of the rows or on error
+    (see IsError).
+*/
+{
+    row = DdbPgResult();
+    if(finished)
+        co_return false;
+    if(!started) {
+        started = true;
+        if(!co_await async->Send(query.c_str(), true)) {
+            finished = true;
+            failed = true;
+            error = "Query could not be sent.";
+            co_return false;
+        }
+    }
+    PGresult *res;
+    while((res = co_await async->Receive()) != 0) {
+        ExecStatusType status = PQresultStatus(res);
+        if(status == PGRES_SINGLE_TUPLE) {
+            row = DdbPgResult(res);
+            co_return true;
+        }
+        // The zero row result after the last row. An error ends the rows; the rest is drained.
+        if(status != PGRES_TUPLES_OK && status != PGRES_COMMAND_OK && !failed) {
+            failed = true;
+            error = PQresultErrorMessage(res);
+            CS_VAPRT_ERRO("DdbPgRowStream::Next failed: %s", error.c_str());
+            async->db->SetErrorId(8);
+        }
+        PQclear(res);
+    }
+    finished = true;
+    async->Finish();
+    co_return false;
+}
+
+// ==================================================================================================
+int DdbPgRowStream::Fill(DdbRowSet *rs)
+/*!
+  Moves the current row into the variables bound to the rowset, as GetNext does.
+  \param rs Rowset created by the same DdbPostgre with the variables bound.
+  \retval int Number of non-null values read. Zero if there is no current row.
+*/
+{
+    if(!row.Get())
+        return 0;
+    if(!((DdbPosgtgreRowSet*)rs)->SetResult(row.Release()))
+        return 0;
+    return rs->GetNext();
+}
+
+#endif // DDB_COROUTINES
@@ -0,0 +1,306 @@
+/*! \file ddbcoro.hpp
+ * \brief C++20 coroutine interface for asynchronous PostgreSQL queries. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#ifndef DDB_CORO_H_FILE
+#define DDB_CORO_H_FILE
+
+// The interface requires a compiler with C++20 coroutines (e.g. g++ -std=c++20). Without
+// them the header is empty. The library is built with it when c4s-build is given -coro.
+#if __cplusplus >= 202002L || (defined(_MSVC_LANG) && _MSVC_LANG >= 202002L)
+  #include <version>
+#endif
+
+#if defined(__cpp_impl_coroutine) && defined(__cpp_lib_coroutine)
+#define DDB_COROUTINES
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include "directdatabase.hpp"
+#include "ddbpostgre.hpp"
+
+// ==================================================================================================
+//! Lazily started coroutine that returns a value of type T to the coroutine awaiting it.
+/*! The task starts when it is awaited and the awaiting coroutine resumes when it completes.
+    Top level tasks are started with DdbExecutor::Spawn. Exceptions are not supported; an
+    exception leaving a task terminates the program.
+ */
+template<typename T>
+class DdbTask
+{
+public:
+    struct promise_type;
+    typedef std::coroutine_handle<promise_type> Handle;
+
+    //! Resumes the awaiting coroutine, or destroys a spawned task.
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        std::coroutine_handle<> await_suspend(Handle h) noexcept {
+            std::coroutine_handle<> waiter = h.promise().waiter;
+            if(h.promise().detached)
+                h.destroy();
+            return waiter ? waiter : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+    struct PromiseBase {
+        std::coroutine_handle<> waiter;
+        bool detached = false;
+        std::suspend_always initial_suspend() noexcept { return std::suspend_always(); }
+        FinalAwaiter final_suspend() noexcept { return FinalAwaiter(); }
+        void unhandled_exception() { std::terminate(); }
+    };
+    struct ValuePromise : public PromiseBase {
+        T value = T();
+        void return_value(T val) { value = std::move(val); }
+    };
+    struct promise_type : public ValuePromise {
+        DdbTask get_return_object() { return DdbTask(Handle::from_promise(*this)); }
+    };
+
+    DdbTask(DdbTask &&other) noexcept : handle(other.handle) { other.handle = Handle(); }
+    ~DdbTask() {
+        if(handle)
+            handle.destroy();
+    }
+
+    bool await_ready() { return !handle || handle.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> waiter) {
+        handle.promise().waiter = waiter;
+        return handle;
+    }
+    T await_resume() { return std::move(handle.promise().value); }
+
+    //! Gives up the ownership of the coroutine. It then destroys itself when it completes.
+    Handle Release() {
+        Handle h = handle;
+        handle = Handle();
+        h.promise().detached = true;
+        return h;
+    }
+
+protected:
+    explicit DdbTask(Handle h) : handle(h) {}
+    Handle handle;
+
+private:
+    DdbTask(const DdbTask&);
+    void operator=(const DdbTask&);
+};
+
+//! Void specialization of the promise. See DdbTask.
+template<>
+struct DdbTask<void>::ValuePromise : public DdbTask<void>::PromiseBase {
+    void return_void() {}
+};
+template<>
+inline void DdbTask<void>::await_resume() {}
+
+// ==================================================================================================
+//! Interface between the coroutines and the event loop that resumes them.
+/*! Implement this to run the queries in an application's own event loop. DdbEpollExecutor is
+    a simple built-in implementation for Linux.
+ */
+class DdbExecutor
+{
+public:
+    virtual ~DdbExecutor() {}
+    //! Resumes the coroutine once the socket is readable (or writable if write is true) or it
+    //! has an error. There is at most one waiter for each socket.
+    virtual void WaitSocket(int sock, bool write, std::coroutine_handle<> handle) = 0;
+    //! Resumes the coroutine later from the event loop.
+    virtual void Post(std::coroutine_handle<> handle) = 0;
+
+    //! Starts a task in the event loop. The task is destroyed when it completes.
+    void Spawn(DdbTask<void> &&task) { Post(task.Release()); }
+};
+
+//! Awaitable that suspends the coroutine until a socket is ready.
+struct DdbSocketWait
+{
+    DdbExecutor *executor;
+    int sock;
+    bool write;
+    bool await_ready() { return false; }
+    void await_suspend(std::coroutine_handle<> h) { executor->WaitSocket(sock, write, h); }
+    void await_resume() {}
+};
+
+#ifdef __linux
+// ==================================================================================================
+//! Single threaded event loop on Linux epoll.
+/*! \code
+    DdbEpollExecutor loop;
+    DdbPgAsync async(&pg, &loop);
+    loop.Spawn(Work(async));    // Work is a coroutine returning DdbTask<void>.
+    loop.Run();
+    \endcode
+    Post and Stop may be called from other threads. Everything else, including the coroutines,
+    runs in the thread that calls Run.
+ */
+class DdbEpollExecutor : public DdbExecutor
+{
+public:
+    DdbEpollExecutor();
+    ~DdbEpollExecutor();
+
+    void WaitSocket(int sock, bool write, std::coroutine_handle<> handle);
+    void Post(std::coroutine_handle<> handle);
+    bool Run();
+    void Stop();
+
+protected:
+    void Wake();
+
+    int epollFd;
+    int wakeFd;                     //!< eventfd that interrupts epoll_wait.
+    std::unordered_map<int, std::coroutine_handle<> > waiters;
+    std::mutex mutex;               //!< Guards posted and stopped.
+    std::deque<std::coroutine_handle<> > posted;
+    bool stopped;
+};
+#endif
+
+// ==================================================================================================
+//! Owner of a PGresult. Clears the result when destroyed.
+class DdbPgResult
+{
+public:
+    DdbPgResult(PGresult *res=0) : result(res) {}
+    DdbPgResult(DdbPgResult &&other) noexcept : result(other.result) { other.result = 0; }
+    ~DdbPgResult() { PQclear(result); }
+    DdbPgResult& operator=(DdbPgResult &&other) noexcept {
+        if(this != &other) {
+            PQclear(result);
+            result = other.result;
+            other.result = 0;
+        }
+        return *this;
+    }
+
+    //! Returns true if the result holds rows or the command succeeded.
+    bool IsOk() const {
+        ExecStatusType status = result ? PQresultStatus(result) : PGRES_FATAL_ERROR;
+        return status == PGRES_TUPLES_OK || status == PGRES_COMMAND_OK || status == PGRES_SINGLE_TUPLE;
+    }
+    explicit operator bool() const { return IsOk(); }
+    PGresult* Get() const { return result; }
+    //! Gives up the ownership of the result.
+    PGresult* Release() { PGresult *res = result; result = 0; return res; }
+    int GetRows() const { return result ? PQntuples(result) : 0; }
+    //! Returns the value as text. Null value is an empty string.
+    const char* GetValue(int row, int col) const { return PQgetvalue(result, row, col); }
+    bool IsNull(int row, int col) const { return PQgetisnull(result, row, col) != 0; }
+    const char* GetError() const { return result ? PQresultErrorMessage(result) : ""; }
+
+protected:
+    PGresult *result;
+
+private:
+    DdbPgResult(const DdbPgResult&);
+    void operator=(const DdbPgResult&);
+};
+
+class DdbPgRowStream;
+
+// ==================================================================================================
+//! Asynchronous queries over a DdbPostgre connection.
+/*! Queries are sent with the non-blocking libpq calls and the coroutine is suspended while the
+    socket is not ready, so the executor thread is free for other work. One asynchronous query
+    may be running on a connection at a time; a second one fails with error 28. The connection
+    must not be used synchronously while an asynchronous query is running.
+    \code
+    DdbTask<void> Work(DdbPgAsync &async, DdbRowSet *rs)
+    {
+        DdbPgResult res = co_await async.QueryAsync("SELECT count(*) FROM item");
+        if(res)
+            printf("%s items\n", res.GetValue(0,0));
+        if(co_await async.QueryAsync(rs, "SELECT id, name FROM item")) {
+            while(rs->GetNext())
+                ...                 // Bound variables as with Query.
+        }
+        DdbPgRowStream rows = async.Rows("SELECT id, name FROM big_table");
+        while(co_await rows.Next())
+            ...                     // rows.GetValue(0) or rows.Fill(rs).
+    }
+    \endcode
+    The server side statement timeout applies. The client side deadline of DdbPostgre does not;
+    use DdbPostgre::Cancel to stop a running query. The query counts as running from the send
+    until its last result has been received. Strings passed to the functions must stay
+    valid until the returned task completes.
+ */
+class DdbPgAsync
+{
+    friend class DdbPgRowStream;
+public:
+    DdbPgAsync(DdbPostgre *db, DdbExecutor *executor);
+
+    DdbTask<DdbPgResult> QueryAsync(const char *query);
+    DdbTask<bool> QueryAsync(DdbRowSet *rs, const char *query);
+    DdbTask<int> ExecuteModifyAsync(const char *query);
+    DdbPgRowStream Rows(const char *query);
+
+    //! Returns true while an asynchronous query is running.
+    bool IsBusy() { return busy; }
+    DdbPostgre* GetDatabase() { return db; }
+
+protected:
+    DdbTask<bool> Send(const char *query, bool singleRow);
+    DdbTask<PGresult*> Receive();
+    void Finish();
+
+    DdbPostgre *db;
+    DdbExecutor *executor;
+    bool busy;
+};
+
+// ==================================================================================================
+//! Rows of a query received one at a time in the single row mode.
+/*! Created with DdbPgAsync::Rows. The query is sent by the first Next. The rows are not
+    collected into the memory, so this suits large results. If the stream is destroyed before
+    the last row has been read, the query is canceled and the rest of the rows are discarded
+    with a blocking wait.
+ */
+class DdbPgRowStream
+{
+    friend class DdbPgAsync;
+public:
+    DdbPgRowStream(DdbPgRowStream &&other) noexcept;
+    ~DdbPgRowStream();
+
+    DdbTask<bool> Next();
+    //! Returns the current row as a result with one row.
+    PGresult* GetRow() { return row.Get(); }
+    //! Returns a value of the current row as text.
+    const char* GetValue(int col) { return row.GetValue(0, col); }
+    bool IsNull(int col) { return row.IsNull(0, col); }
+    int Fill(DdbRowSet *rs);
+    //! Returns true if the query failed. The error is in GetError.
+    bool IsError() { return failed; }
+    //! Returns the error message of a failed query.
+    const std::string& GetError() { return error; }
+
+protected:
+    DdbPgRowStream(DdbPgAsync *async, const char *query);
+    void Abort();
+
+    DdbPgAsync *async;
+    std::string query;
+    DdbPgResult row;
+    bool started;
+    bool finished;
+    bool failed;
+    std::string error;
+
+private:
+    DdbPgRowStream(const DdbPgRowStream&);
+    void operator=(const DdbPgRowStream&);
+};
+
+#endif // DDB_COROUTINES
+#endif
@@ -0,0 +1,369 @@
+/*! \file ddbexport.cpp
+ * \brief Streaming export of query results as CSV, TSV or JSON lines. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#include "pch-stop.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#ifdef _WIN32
+  #include <io.h>
+#else
+  #include <sys/uio.h>
+  #include <unistd.h>
+#endif
+#include <cpp4scripts.hpp>
+#include "directdatabase.hpp"
+#include "ddbexport.hpp"
+
+// ==================================================================================================
+DdbExportWriter::DdbExportWriter(int fd_in, int format_in, int options_in, size_t size_in)
+/*!
+  \param fd_in File descriptor to write to. Caller keeps the ownership.
+  \param format_in One of DDB_EXPORT_CSV, DDB_EXPORT_TSV or DDB_EXPORT_JSONL.
+  \param options_in Combination of DDB_EXPORT_HEADER and DDB_EXPORT_NOCOPY.
+  \param size_in Size of the output buffer.
+*/
+{
+    fd = fd_in;
+    format = format_in;
+    options = options_in;
+    size = size_in < 4096 ? 4096 : size_in;
+    buffer = (char*) malloc(size);
+    ptr = buffer;
+    end = buffer ? buffer+size : 0;
+    column = 0;
+    rows = 0;
+    bytes = 0;
+    ok = buffer != 0;
+    if(!buffer)
+        CS_VAPRT_ERRO("DdbExportWriter - Unable to allocate %zu bytes for the buffer.", size);
+}
+
+// ==================================================================================================
+DdbExportWriter::~DdbExportWriter()
+/*!
+  Releases the buffer. Output that has not been flushed is lost: Write is virtual and can not
+  be called from here for a derived writer. DirectDatabase::ExportQuery flushes at the end;
+  writers that are used directly must be flushed by the caller or by the destructor of the
+  derived class.
+*/
+{
+    free(buffer);
+}
+
+// ==================================================================================================
+void DdbExportWriter::SetColumns(const std::vector<std::string> &names)
+/*!
+  Sets the column names. Called by the database before the first row. Writes the header line
+  if DDB_EXPORT_HEADER was given.
+*/
+{
+    keys.clear();
+    if(format == DDB_EXPORT_JSONL) {
+        // Keys are escaped once here and copied as is for each row.
+        for(size_t ndx=0; ndx<names.size(); ndx++) {
+            std::string key("\"");
+            for(const char *name=names[ndx].c_str(); *name; name++) {
+                if(*name == '"' || *name == '\\')
+                    key += '\\';
+                if((unsigned char)*name >= 0x20)
+                    key += *name;
+            }
+            keys.push_back(key + "\":");
+        }
+        return;
+    }
+    if(options & DDB_EXPORT_HEADER) {
+        column = 0;
+        for(size_t ndx=0; ndx<names.size(); ndx++)
+            Field(names[ndx].c_str(), names[ndx].length());
+        PutChar('\n');
+        column = 0;
+    }
+}
+
+// ==================================================================================================
+void DdbExportWriter::BeginRow()
+{
+    column = 0;
+    if(format == DDB_EXPORT_JSONL)
+        PutChar('{');
+}
+
+// ==================================================================================================
+void DdbExportWriter::EndRow()
+{
+    if(format == DDB_EXPORT_JSONL)
+        PutChar('}');
+    PutChar('\n');
+    rows++;
+}
+
+// ==================================================================================================
+void DdbExportWriter::Field(const char *value, size_t len, int kind)
+/*!
+  Writes one field of the current row.
+  \param value Field value. Null pointer for a null value. Need not be null terminated.
+  \param len Length of the value in bytes.
+  \param kind One of DDB_FIELD_... constants. Only affects JSON.
+*/
+{
+    if(format == DDB_EXPORT_TSV) {
+        if(column)
+            PutChar('\t');
+        if(value)
+            PutTsv(value, len);
+        else
+            Put("\\N", 2);
+    }
+    else if(format == DDB_EXPORT_JSONL) {
+        if(column)
+            PutChar(',');
+        if((size_t)column < keys.size())
+            Put(keys[column].c_str(), keys[column].length());
+        else {
+            char key[24];
+            Put(key, sprintf(key, "\"c%d\":", column+1));
+        }
+        if(!value)
+            Put("null", 4);
+        else if(kind == DDB_FIELD_BOOL) {
+            bool set = len && (value[0]=='t' || value[0]=='T' || value[0]=='1' || value[0]=='y' || value[0]=='Y');
+            if(set)
+                Put("true", 4);
+            else
+                Put("false", 5);
+        }
+        else if(kind == DDB_FIELD_JSON && len)
+            PutLarge(value, len);
+        else if(kind == DDB_FIELD_NUMBER && len && (isdigit((unsigned char)value[0])
+                || (value[0]=='-' && len>1 && isdigit((unsigned char)value[1]))))
+            PutLarge(value, len);
+        else
+            PutJson(value, len);
+    }
+    else {
+        if(column)
+            PutChar(',');
+        if(value)
+            PutCsv(value, len);
+    }
+    column++;
+}
+
+// ==================================================================================================
+void DdbExportWriter::Raw(const char *data, size_t len)
+/*!
+  Writes preformatted data, e.g. the output of PostgreSQL COPY.
+*/
+{
+    PutLarge(data, len);
+}
+
+// ==================================================================================================
+void DdbExportWriter::Reserve(size_t len)
+/*!
+  Makes room for len bytes in the buffer by flushing it. Len must not exceed the buffer size.
+*/
+{
+    if((size_t)(end-ptr) < len)
+        Flush();
+}
+
+// ==================================================================================================
+void DdbExportWriter::Put(const char *data, size_t len)
+{
+    if(!buffer)
+        return;     // Allocation failed. Output is discarded.
+    while((size_t)(end-ptr) < len) {
+        size_t part = end-ptr;
+        memcpy(ptr, data, part);
+        ptr += part;
+        data += part;
+        len -= part;
+        Flush();
+    }
+    memcpy(ptr, data, len);
+    ptr += len;
+}
+
+// ==================================================================================================
+void DdbExportWriter::PutLarge(const char *value, size_t len)
+/*!
+  Writes a value that needs no escaping. Large values are written together with the buffer
+  without copying.
+*/
+{
+    if(len < size/4 || !ok) {
+        Put(value, len);
+        return;
+    }
+    ok = Write(buffer, ptr-buffer, value, len);
+    bytes += (ptr-buffer) + len;
+    ptr = buffer;
+}
+
+// ==================================================================================================
+void DdbExportWriter::PutCsv(const char *value, size_t len)
+/*!
+  Quotes the value if it contains a separator, quote or line feed. Empty string is quoted so
+  that it differs from null. Quotes are doubled.
+*/
+{
+    const char *stop = value+len;
+    const char *scan = value;
+    while(scan<stop && *scan!=',' && *scan!='"' && *scan!='\n' && *scan!='\r')
+        scan++;
+    if(scan == stop && len) {
+        PutLarge(value, len);
+        return;
+    }
+    PutChar('"');
+    const char *run = value;
+    for(scan=value; scan<stop; scan++) {
+        if(*scan == '"') {
+            Put(run, scan-run+1);
+            run = scan;
+        }
+    }
+    Put(run, stop-run);
+    PutChar('"');
+}
+
+// ==================================================================================================
+void DdbExportWriter::PutTsv(const char *value, size_t len)
+/*!
+  Escapes backslash, tab, line feed and carriage return with a backslash.
+*/
+{
+    const char *stop = value+len;
+    const char *run = value;
+    for(const char *scan=value; scan<stop; scan++) {
+        char esc;
+        switch(*scan) {
+        case '\\': esc = '\\'; break;
+        case '\t': esc = 't'; break;
+        case '\n': esc = 'n'; break;
+        case '\r': esc = 'r'; break;
+        default: continue;
+        }
+        Put(run, scan-run);
+        PutChar('\\');
+        PutChar(esc);
+        run = scan+1;
+    }
+    if(run == value)
+        PutLarge(value, len);
+    else
+        Put(run, stop-run);
+}
+
+// ==================================================================================================
+void DdbExportWriter::PutJson(const char *value, size_t len)
+/*!
+  Writes the value as JSON string. Quote, backslash and control characters are escaped. Other
+  bytes, including UTF-8 sequences, are copied as is.
+*/
+{
+    const char *stop = value+len;
+    const char *run = value;
+    PutChar('"');
+    for(const char *scan=value; scan<stop; scan++) {
+        unsigned char ch = (unsigned char)*scan;
+        if(ch >= 0x20 && ch != '"' && ch != '\\')
+            continue;
+        Put(run, scan-run);
+        run = scan+1;
+        char esc[8];
+        switch(ch) {
+        case '"':  Put("\\\"", 2); break;
+        case '\\': Put("\\\\", 2); break;
+        case '\n': Put("\\n", 2); break;
+        case '\r': Put("\\r", 2); break;
+        case '\t': Put("\\t", 2); break;
+        default:   Put(esc, sprintf(esc, "\\u%04x", ch)); break;
+        }
+    }
+    if(run == value)
+        PutLarge(value, len);
+    else
+        Put(run, stop-run);
+    PutChar('"');
+}
+
+// ==================================================================================================
+bool DdbExportWriter::Flush()
+/*!
+  Writes the buffered output.
+  \retval bool False if a write has failed.
+*/
+{
+    if(ptr > buffer && ok) {
+        ok = Write(buffer, ptr-buffer, 0, 0);
+        bytes += ptr-buffer;
+    }
+    ptr = buffer;
+    return ok;
+}
+
+// ==================================================================================================
+bool DdbExportWriter::Write(const char *data, size_t len, const char *extra, size_t extraLen)
+/*!
+  Writes the data followed by the extra data into the file descriptor. Partial writes and
+  interrupts are retried.
+  \retval bool False on a write error.
+*/
+{
+#ifdef _WIN32
+    const char *part[2] = { data, extra };
+    size_t partLen[2] = { len, extraLen };
+    for(int ndx=0; ndx<2; ndx++) {
+        while(partLen[ndx]) {
+            int count = _write(fd, part[ndx], partLen[ndx] > 0x40000000 ? 0x40000000 : (unsigned)partLen[ndx]);
+            if(count <= 0) {
+                CS_VAPRT_ERRO("DdbExportWriter::Write - Write failed: %s", strerror(errno));
+                return false;
+            }
+            part[ndx] += count;
+            partLen[ndx] -= count;
+        }
+    }
+    return true;
+#else
+    struct iovec iov[2];
+    iov[0].iov_base = (void*)data;
+    iov[0].iov_len = len;
+    iov[1].iov_base = (void*)extra;
+    iov[1].iov_len = extraLen;
+    struct iovec *vec = iov;
+    int count = 2;
+    while(count) {
+        if(vec->iov_len == 0) {
+            vec++;
+            count--;
+            continue;
+        }
+        ssize_t written = writev(fd, vec, count);
+        if(written < 0) {
+            if(errno == EINTR)
+                continue;
+            CS_VAPRT_ERRO("DdbExportWriter::Write - Write failed: %s", strerror(errno));
+            return false;
+        }
+        while(count && (size_t)written >= vec->iov_len) {
+            written -= vec->iov_len;
+            vec++;
+            count--;
+        }
+        if(count) {
+            vec->iov_base = (char*)vec->iov_base + written;
+            vec->iov_len -= written;
+        }
+    }
+    return true;
+#endif
+}
@@ -0,0 +1,95 @@
+/*! \file ddbexport.hpp
+ * \brief Streaming export of query results as CSV, TSV or JSON lines. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#ifndef DDB_EXPORT_H_FILE
+#define DDB_EXPORT_H_FILE
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Export formats.
+#define DDB_EXPORT_CSV   1      //!< RFC 4180: comma separated, quoted when needed, null is empty.
+#define DDB_EXPORT_TSV   2      //!< PostgreSQL text format: tab separated, backslash escapes, null is \N.
+#define DDB_EXPORT_JSONL 3      //!< One JSON object per line.
+
+// Export options.
+#define DDB_EXPORT_HEADER 0x01  //!< CSV and TSV: write the column names as the first line.
+#define DDB_EXPORT_NOCOPY 0x02  //!< PostgreSQL: do not use COPY.
+
+// Field kinds. They decide how the value is written into JSON.
+#define DDB_FIELD_TEXT   0      //!< Quoted string.
+#define DDB_FIELD_NUMBER 1      //!< Written as is. Non-numeric text (NaN, Infinity) is quoted.
+#define DDB_FIELD_BOOL   2      //!< t/f, 1/0 or true/false written as true or false.
+#define DDB_FIELD_JSON   3      //!< JSON text written as is.
+
+//! Default size of the output buffer.
+#define DDB_EXPORT_BUFFER 262144
+
+// ==================================================================================================
+//! Formats rows into a reusable buffer and writes it to a file descriptor.
+/*! Database implementations pass the field values directly from the result buffers of the
+    driver. Values are escaped straight into the output buffer, so each value is copied once.
+    A value larger than a quarter of the buffer is not copied at all: the buffer and the
+    value are written with a single writev. Derive and override Write to send the data
+    elsewhere than a file descriptor. The destructor does not flush; a derived writer calls
+    Flush in its own destructor if it may be destroyed with buffered output.
+
+    Use DirectDatabase::ExportQuery to run an export.
+ */
+class DdbExportWriter
+{
+public:
+    DdbExportWriter(int fd, int format, int options=0, size_t size=DDB_EXPORT_BUFFER);
+    virtual ~DdbExportWriter();
+
+    void SetColumns(const std::vector<std::string> &names);
+    void BeginRow();
+    void Field(const char *value, size_t len, int kind=DDB_FIELD_TEXT);
+    //! Writes a null field.
+    void Null() { Field(0, 0); }
+    void EndRow();
+    void Raw(const char *data, size_t len);
+    bool Flush();
+
+    //! Returns false once a write has failed. Further output is discarded.
+    bool IsOK() { return ok; }
+    int GetFormat() { return format; }
+    int GetOptions() { return options; }
+    //! Returns the number of rows written.
+    int64_t GetRows() { return rows; }
+    //! Returns the number of bytes written.
+    int64_t GetBytes() { return bytes; }
+
+protected:
+    virtual bool Write(const char *data, size_t len, const char *extra, size_t extraLen);
+    void Reserve(size_t len);
+    void Put(const char *data, size_t len);
+    void PutChar(char ch) { if(ptr == end) Reserve(1); if(ptr != end) *ptr++ = ch; }
+    void PutCsv(const char *value, size_t len);
+    void PutTsv(const char *value, size_t len);
+    void PutJson(const char *value, size_t len);
+    void PutLarge(const char *value, size_t len);
+
+    int fd;
+    int format;
+    int options;
+    char *buffer;
+    char *ptr;                      //!< Next free byte in the buffer.
+    char *end;
+    size_t size;
+    int column;                     //!< Index of the next field in the row.
+    std::vector<std::string> keys;  //!< JSON: escaped "name": prefixes of the fields.
+    int64_t rows;
+    int64_t bytes;
+    bool ok;
+
+private:
+    DdbExportWriter(const DdbExportWriter&);
+    void operator=(const DdbExportWriter&);
+};
+
+#endif
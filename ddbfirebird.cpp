@@ -1,277 +1,716 @@
-/*******************************************************************************
-ddbfirebird.cpp
-Copyright (c) Antti Merenluoto
-*******************************************************************************/
-
-#ifdef WIN32
-    #include <windows.h>
-#endif
-#ifdef __linux
-    #include <string.h>
-#endif
-#include <memory.h>
-#ifdef DDB_USEWX
-  #include <wx/wxprec.h>
-  #ifndef WX_PRECOMP
-    #include <wx/wx.h>
-  #endif
-#endif
-
-#define __DDB_FIREBIRD__
-#include "directdatabase.hpp"
-
-// ==================================================================================================
-DdbFirebird::DdbFirebird()
-/*!
-  Constructs database object for the connection to the Firebird databases.
-*/
-{
-    flags = DDB_FLAG_INITIALIZED;
-    connection = 0;
-    transaction = 0;
-}
-
-// ==================================================================================================
-DdbFirebird::~DdbFirebird()
-/*!
-    Closes up the database connection and on Windows closes socket services.
-*/
-{
-    if( (flags & DDB_FLAG_CONNECTED) > 0)
-        Disconnect();
-}
-
-// ==================================================================================================
-bool DdbFirebird::Connect(int) // Firebird does not use timeouts during connection.
-{
-    char dpbBuffer[500],*pdb;
-    int len;
-    ISC_STATUS_ARRAY statusArray;
-
-#ifdef DDB_USESTL
-    char const *srv  = srvName.length()==0 ? 0 : srvName.data();
-    char const *db   = dbName.length()==0 ? 0 : dbName.data();
-    char const *user = userid.length()==0 ? 0 : userid.data();
-    char const *pass = pwd.length()==0 ? 0 : pwd.data();
-#else
-    char const *srv  = srvName.IsEmpty() ? 0 : srvName.GetData();
-    char const *db   = dbName.IsEmpty() ? 0 : dbName.GetData();
-    char const *user = userid.IsEmpty() ? 0 : userid.GetData();
-    char const *pass = pwd.IsEmpty() ? 0 : pwd.GetData();
-#endif
-    // Check for initialization.
-    if(!(flags&DDB_FLAG_INITIALIZED))
-    {
-        SetErrorId(11);
-        return false;
-    }
-    // Check that we have something to connect to.
-    if(!db)
-    {
-        SetErrorId(3);
-        return false;
-    }
-
-    // Set connection parameters
-    pdb = dpbBuffer;
-    len = 1;
-    *pdb++ = isc_dpb_version1;
-    isc_expand_dpb(&pdb, (short *) &len,
-                   isc_dpb_user_name, user,
-                   isc_dpb_password, pass,  NULL);
-    /*
-    *pdb++ = isc_dpb_user_name;
-    len = strlen(user);
-    memcpy(pdb,user,len);
-    pdb += len;
-    *pdb++ = isc_dpb_password;
-    len = strlen(pass);
-    memcpy(pdb,pass,len);
-    pdb += len;
-    */
-
-    if(isc_attach_database(statusArray,0,db,&connection,(short)len,pdb))
-    {
-        LogError(statusArray);
-        return false;
-    }
-
-    delete pdb;
-    flags |= DDB_FLAG_CONNECTED;
-    return true;
-}
-
-// ==================================================================================================
-bool DdbFirebird::Disconnect()
-{
-    ISC_STATUS_ARRAY statusArray;
-    if(connection)
-    {
-        if(isc_detach_database(statusArray,&connection))
-        {
-            LogError(statusArray);
-            return false;
-        }
-        flags &= ~DDB_FLAG_CONNECTED;
-    }
-    return true;
-}
-
-// ==================================================================================================
-void DdbFirebird::LogError(ISC_STATUS_ARRAY statusArray)
-{
-        char errStr[512];
-        int index;
-        ostringstream ss;
-        if(!statusArray[0])
-            return;
-        ss << "Firebird database error first long = " << statusArray[0] << endl;
-        /*
-        for(index=0; statusArray[index] && index<ISC_STATUS_LENGTH; index++)
-        {
-            isc_sql_code();
-            isc_sql_interprete(statusArray[index],errStr,sizeof(errStr));
-            ss << errStr << endl;
-        }
-        ss << ">>" << endl;
-        */
-        Log(ss);
-}
-
-// ==================================================================================================
-DdbRowSet* DdbFirebird::CreateRowSet()
-{
-    if(!(flags&DDB_FLAG_CONNECTED))
-    {
-        SetErrorId(5);
-        return 0;
-    }
-    return 0; //new DdbPosgtgreRowSet(this);
-}
-
-// ==================================================================================================
-DDBSTR DdbFirebird::GetErrorDescription(DdbRowSet *)
-{
-    DDBSTR errorMsg;
-    errorMsg = GetLastError();
-    return errorMsg;
-}
-
-// ==================================================================================================
-bool DdbFirebird::StartTransaction()
-{
-    if(!(flags&DDB_FLAG_CONNECTED))
-    {
-        SetErrorId(5);
-        return false;
-    }
-    if(flags&DDB_FLAG_TRANSACT_ON)
-    {
-        SetErrorId(6);
-        return false;
-    }
-
-    flags |= DDB_FLAG_TRANSACT_ON;
-    return true;
-}
-
-// ==================================================================================================
-bool DdbFirebird::Commit()
-{
-    if(!(flags&DDB_FLAG_CONNECTED))
-    {
-        SetErrorId(5);
-        return false;
-    }
-    if(!(flags&DDB_FLAG_TRANSACT_ON))
-    {
-        SetErrorId(7);
-        return false;
-    }
-
-    flags &= ~DDB_FLAG_TRANSACT_ON;
-    return true;
-}
-
-// ==================================================================================================
-bool DdbFirebird::RollBack()
-{
-    if(!(flags&DDB_FLAG_CONNECTED))
-    {
-        SetErrorId(5);
-        return false;
-    }
-    if(!(flags&DDB_FLAG_TRANSACT_ON))
-    {
-        SetErrorId(7);
-        return false;
-    }
-
-    flags &= ~DDB_FLAG_TRANSACT_ON;
-    return true;
-}
-
-// ==================================================================================================
-bool DdbFirebird::ExecuteIntFunction(const DDBSTR &query, int &val)
-{
-    if(query.LENGTH()==0)
-        return false;
-    return true;
-}
-
-// ==================================================================================================
-bool DdbFirebird::ExecuteDoubleFunction(const DDBSTR &query, double &val)
-{
-    if(query.LENGTH()==0)
-        return false;
-    return true;
-}
-
-// ==================================================================================================
-bool DdbFirebird::ExecuteBoolFunction(const DDBSTR &query, bool &val)
-{
-    if(query.LENGTH()==0)
-        return false;
-    return false;
-}
-
-// ==================================================================================================
-bool DdbFirebird::ExecuteStrFunction(const DDBSTR &query, DDBSTR &answer)
-{
-    if(query.LENGTH()==0)
-        return false;
-    return true;
-}
-
-// ==================================================================================================
-bool DdbFirebird::ExecuteDateFunction(const DDBSTR &query, DDBTIME &val)
-{
-    tm *tmPtr;
-
-    if(query.LENGTH()==0)
-        return false;
-    if(true)
-    {
-#ifdef DDB_USESTL
-        tmPtr = &val;
-#else
-        tm tmData;
-        tmPtr = &tmData;
-#endif
-#ifdef DDB_USEWX
-        val.Set(tmData);
-#endif
-    }
-    return false;
-}
-
-
-// ==================================================================================================
-int DdbFirebird::ExecuteModify(const DDBSTR &modify)
-{
-    int retval;
-
-    if(modify.LENGTH()==0)
-        return false;
-    return true;
-}
+/*******************************************************************************
+ddbfirebird.cpp
+Copyright (c) Antti Merenluoto
+*******************************************************************************/
+
+#ifdef WIN32
+    #include <windows.h>
+#endif
+#ifdef __linux
+    #include <string.h>
+    #include <stdlib.h>
+#endif
+#include <memory.h>
+#include <string>
+#ifdef DDB_USEWX
+  #include <wx/wxprec.h>
+  #ifndef WX_PRECOMP
+    #include <wx/wx.h>
+  #endif
+#endif
+#include <cpp4scripts.hpp>
+#define __DDB_FIREBIRD__
+#include "directdatabase.hpp"
+
+// Read committed transactions. Read-only ones do not hold back the garbage collection.
+static const char g_tpb_read[]  = { isc_tpb_version3, isc_tpb_read, isc_tpb_read_committed, isc_tpb_rec_version, isc_tpb_nowait };
+static const char g_tpb_write[] = { isc_tpb_version3, isc_tpb_write, isc_tpb_read_committed, isc_tpb_rec_version, isc_tpb_wait };
+
+// ==================================================================================================
+static void AddDpb(std::string &dpb, char tag, const std::string &value)
+{
+    dpb += tag;
+    dpb += (char) value.length();
+    dpb += value;
+}
+
+// ==================================================================================================
+DdbFirebird::DdbFirebird()
+/*!
+  Constructs database object for the connection to the Firebird databases.
+*/
+{
+    flags |= DDB_FLAG_INITIALIZED;
+    feat_support |= DDB_FEATURE_TRANSACTIONS|DDB_FEATURE_AUTOTRIM;
+    connection = 0;
+    transaction = 0;
+#ifdef DDB_FB_BATCH
+    master = fb_get_master_interface();
+    attachment = 0;
+    trInterface = 0;
+#endif
+}
+
+// ==================================================================================================
+DdbFirebird::~DdbFirebird()
+/*!
+    Closes up the database connection.
+*/
+{
+    if( (flags & DDB_FLAG_CONNECTED) > 0)
+        Disconnect();
+}
+
+// ==================================================================================================
+bool DdbFirebird::Connect(const char *constr)
+/*!
+  Attaches to the database.
+  \param constr Database path or key=value pairs, e.g.
+    "database=/tmp/test.fdb user=SYSDBA password=masterkey create=yes"
+*/
+{
+    ISC_STATUS_ARRAY status;
+    std::string database, user, password, charset="UTF8", dpb;
+    bool create = false;
+
+    // Check for initialization.
+    if(!(flags&DDB_FLAG_INITIALIZED))
+    {
+        SetErrorId(11);
+        return false;
+    }
+    if(!constr || !*constr)
+    {
+        SetErrorId(3);
+        return false;
+    }
+    if(flags & DDB_FLAG_CONNECTED)
+        Disconnect();
+
+    // Parse the connection string.
+    if(!strchr(constr,'='))
+        database = constr;
+    else {
+        const char *pos = constr;
+        while(*pos) {
+            while(*pos==' ')
+                pos++;
+            const char *end = strchr(pos,' ');
+            if(!end)
+                end = pos+strlen(pos);
+            std::string item(pos, end-pos);
+            size_t eq = item.find('=');
+            if(eq != std::string::npos) {
+                std::string key = item.substr(0,eq);
+                std::string value = item.substr(eq+1);
+                if(key == "database")      database = value;
+                else if(key == "user")     user = value;
+                else if(key == "password") password = value;
+                else if(key == "charset")  charset = value;
+                else if(key == "create")   create = value[0]=='y' || value[0]=='1';
+                else
+                    CS_VAPRT_WARN("DdbFirebird::Connect - Unknown connection parameter: %s",key.c_str());
+            }
+            pos = end;
+        }
+    }
+    if(database.empty())
+    {
+        SetErrorId(3);
+        return false;
+    }
+
+    // Set connection parameters
+    dpb += (char) isc_dpb_version1;
+    if(!user.empty())
+        AddDpb(dpb, isc_dpb_user_name, user);
+    if(!password.empty())
+        AddDpb(dpb, isc_dpb_password, password);
+    AddDpb(dpb, isc_dpb_lc_ctype, charset);
+
+#ifdef DDB_FB_BATCH
+    Firebird::CheckStatusWrapper st(master->getStatus());
+    Firebird::IProvider *provider = master->getDispatcher();
+    attachment = provider->attachDatabase(&st, database.c_str(), dpb.length(), (const unsigned char*)dpb.data());
+    if(!attachment && create) {
+        st.init();
+        dpb += (char) isc_dpb_set_db_charset;
+        dpb += (char) charset.length();
+        dpb += charset;
+        attachment = provider->createDatabase(&st, database.c_str(), dpb.length(), (const unsigned char*)dpb.data());
+    }
+    provider->release();
+    if(!attachment)
+    {
+        LogError(st.getErrors(), "DdbFirebird::Connect");
+        st.dispose();
+        SetErrorId(4);
+        return false;
+    }
+    st.dispose();
+    // Legacy handle for the isc_dsql calls.
+    if(fb_get_database_handle(status, &connection, attachment))
+    {
+        LogError(status, "DdbFirebird::Connect");
+        attachment->release();
+        attachment = 0;
+        SetErrorId(4);
+        return false;
+    }
+#else
+    if(isc_attach_database(status, 0, database.c_str(), &connection, (short)dpb.length(), dpb.data()))
+    {
+        if(!create)
+        {
+            LogError(status, "DdbFirebird::Connect");
+            SetErrorId(4);
+            return false;
+        }
+        std::string sql = "CREATE DATABASE '" + database + "'";
+        if(!user.empty())
+            sql += " USER '" + user + "'";
+        if(!password.empty())
+            sql += " PASSWORD '" + password + "'";
+        sql += " DEFAULT CHARACTER SET " + charset;
+        isc_tr_handle tr = 0;
+        connection = 0;
+        if(isc_dsql_execute_immediate(status, &connection, &tr, 0, sql.c_str(), DDB_FB_DIALECT, 0))
+        {
+            LogError(status, "DdbFirebird::Connect");
+            SetErrorId(4);
+            return false;
+        }
+    }
+#endif
+    conString = constr;
+    flags |= DDB_FLAG_CONNECTED;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbFirebird::Disconnect()
+{
+    ISC_STATUS_ARRAY status;
+
+    if(flags&DDB_FLAG_TRANSACT_ON)
+        RollBack();
+    if(connection)
+    {
+        if(isc_detach_database(status,&connection))
+            LogError(status, "DdbFirebird::Disconnect");
+        connection = 0;
+    }
+#ifdef DDB_FB_BATCH
+    if(attachment)
+        attachment->release();
+    attachment = 0;
+#endif
+    flags &= ~DDB_FLAG_CONNECTED;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbFirebird::IsConnectOK()
+{
+    ISC_STATUS_ARRAY status;
+    char items[] = { isc_info_ods_version, isc_info_end };
+    char result[32];
+
+    if(!connection)
+        return false;
+    return isc_database_info(status, &connection, sizeof(items), items, sizeof(result), result) == 0;
+}
+
+// ==================================================================================================
+bool DdbFirebird::ResetConnection()
+{
+    DDBSTR constr = conString;
+    Disconnect();
+    return Connect(constr.DATA());
+}
+
+// ==================================================================================================
+void DdbFirebird::LogError(const ISC_STATUS *status, const char *caller)
+/*!
+  Stores the error message from the status vector for GetErrorDescription and logs it.
+*/
+{
+    char msg[512];
+    const ISC_STATUS *pvector = status;
+
+    errorText.clear();
+    while(fb_interpret(msg, sizeof(msg), &pvector))
+    {
+        if(!errorText.empty())
+            errorText += "\n";
+        errorText += msg;
+    }
+    CS_VAPRT_ERRO("%s - %s", caller, errorText.c_str());
+}
+
+// ==================================================================================================
+DdbRowSet* DdbFirebird::CreateRowSet()
+{
+    if(!(flags&DDB_FLAG_CONNECTED))
+    {
+        SetErrorId(5);
+        return 0;
+    }
+    return new DdbFirebirdRowSet(this);
+}
+
+// ==================================================================================================
+DdbFirebirdBatch* DdbFirebird::CreateBatch(const DDBSTR &insert)
+/*!
+  Creates batch for bulk inserts. Caller should delete the batch.
+  \param insert INSERT statement with ? placeholder for each bound field.
+*/
+{
+    if(!(flags&DDB_FLAG_CONNECTED))
+    {
+        SetErrorId(5);
+        return 0;
+    }
+    return new DdbFirebirdBatch(this, insert);
+}
+
+// ==================================================================================================
+DDBSTR DdbFirebird::GetErrorDescription(DdbRowSet *)
+{
+    DDBSTR errorMsg;
+    errorMsg = GetLastError();
+    if(!errorText.empty()) {
+        errorMsg += _T("\n");
+#ifdef DDB_USESTL
+        errorMsg += errorText;
+#else
+        errorMsg += wxString::FromUTF8(errorText.c_str());
+#endif
+    }
+    return errorMsg;
+}
+
+// ==================================================================================================
+bool DdbFirebird::BeginAuto(isc_tr_handle *tr, bool readOnly, bool &autoTr)
+/*!
+  Gives the transaction for a statement. If StartTransaction has been called the statement is run
+  in that transaction. Otherwise a new transaction is started for the statement.
+  \param tr Receives the transaction handle.
+  \param readOnly True to start read only transaction.
+  \param autoTr Set to true if a new transaction was started. It should be ended with EndAuto.
+*/
+{
+    ISC_STATUS_ARRAY status;
+
+    if(flags&DDB_FLAG_TRANSACT_ON)
+    {
+        *tr = transaction;
+        autoTr = false;
+        return true;
+    }
+    *tr = 0;
+    const char *tpb = readOnly ? g_tpb_read : g_tpb_write;
+    unsigned short tpbLen = readOnly ? sizeof(g_tpb_read) : sizeof(g_tpb_write);
+    if(isc_start_transaction(status, tr, 1, &connection, tpbLen, tpb))
+    {
+        LogError(status, "DdbFirebird::BeginAuto");
+        autoTr = false;
+        return false;
+    }
+    autoTr = true;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbFirebird::EndAuto(isc_tr_handle *tr, bool commit)
+{
+    ISC_STATUS_ARRAY status;
+
+    if(!*tr)
+        return true;
+    if(commit ? isc_commit_transaction(status, tr) : isc_rollback_transaction(status, tr))
+    {
+        LogError(status, "DdbFirebird::EndAuto");
+        if(commit)
+            isc_rollback_transaction(status, tr);
+        *tr = 0;
+        return false;
+    }
+    *tr = 0;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbFirebird::StartTransaction()
+{
+    if(!(flags&DDB_FLAG_CONNECTED))
+    {
+        SetErrorId(5);
+        return false;
+    }
+    if(flags&DDB_FLAG_TRANSACT_ON)
+    {
+        SetErrorId(6);
+        return false;
+    }
+#ifdef DDB_FB_BATCH
+    // Started with OO API so that batches can use the same transaction.
+    ISC_STATUS_ARRAY status;
+    Firebird::CheckStatusWrapper st(master->getStatus());
+    trInterface = attachment->startTransaction(&st, sizeof(g_tpb_write), (const unsigned char*)g_tpb_write);
+    if(!trInterface)
+    {
+        LogError(st.getErrors(), "DdbFirebird::StartTransaction");
+        st.dispose();
+        return false;
+    }
+    st.dispose();
+    transaction = 0;
+    if(fb_get_transaction_handle(status, &transaction, trInterface))
+    {
+        LogError(status, "DdbFirebird::StartTransaction");
+        trInterface->release();
+        trInterface = 0;
+        return false;
+    }
+#else
+    bool autoTr;
+    if(!BeginAuto(&transaction, false, autoTr))
+        return false;
+#endif
+    flags |= DDB_FLAG_TRANSACT_ON;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbFirebird::Commit()
+{
+    if(!(flags&DDB_FLAG_CONNECTED))
+    {
+        SetErrorId(5);
+        return false;
+    }
+    if(!(flags&DDB_FLAG_TRANSACT_ON))
+    {
+        SetErrorId(7);
+        return false;
+    }
+    flags &= ~DDB_FLAG_TRANSACT_ON;
+#ifdef DDB_FB_BATCH
+    Firebird::CheckStatusWrapper st(master->getStatus());
+    trInterface->commit(&st);
+    bool ok = !(st.getState() & Firebird::IStatus::STATE_ERRORS);
+    if(!ok) {
+        LogError(st.getErrors(), "DdbFirebird::Commit");
+        st.init();
+        trInterface->rollback(&st);
+        if(st.getState() & Firebird::IStatus::STATE_ERRORS)
+            trInterface->release();
+    }
+    st.dispose();
+    trInterface = 0;
+    transaction = 0;
+    return ok;
+#else
+    return EndAuto(&transaction, true);
+#endif
+}
+
+// ==================================================================================================
+bool DdbFirebird::RollBack()
+{
+    if(!(flags&DDB_FLAG_CONNECTED))
+    {
+        SetErrorId(5);
+        return false;
+    }
+    if(!(flags&DDB_FLAG_TRANSACT_ON))
+    {
+        SetErrorId(7);
+        return false;
+    }
+    flags &= ~DDB_FLAG_TRANSACT_ON;
+#ifdef DDB_FB_BATCH
+    Firebird::CheckStatusWrapper st(master->getStatus());
+    trInterface->rollback(&st);
+    bool ok = !(st.getState() & Firebird::IStatus::STATE_ERRORS);
+    if(!ok) {
+        LogError(st.getErrors(), "DdbFirebird::RollBack");
+        trInterface->release();
+    }
+    st.dispose();
+    trInterface = 0;
+    transaction = 0;
+    return ok;
+#else
+    return EndAuto(&transaction, false);
+#endif
+}
+
+// ==================================================================================================
+void DdbFirebird::CoerceType(short int type, bool input, short &sqltype, short &sqllen, short &sqlscale, short &sqlsubtype)
+/*!
+  Changes the XSQLVAR (or message metadata) type so that the value can be copied directly
+  from/to the bound variable. Firebird converts the value from/to the column type.
+  \param type DDBT_... type of the bound variable.
+  \param input True for parameters, false for query results.
+  \param sqltype Type of the column without the null flag. Replaced with the coerced type.
+*/
+{
+    bool text = sqltype==SQL_TEXT || sqltype==SQL_VARYING;
+    // DDB_TYPE_USED
+    switch(type)
+    {
+    case DDBT_INT:
+        sqltype = SQL_LONG;
+        sqllen = sizeof(ISC_LONG);
+        sqlscale = 0;
+        sqlsubtype = 0;
+        break;
+    case DDBT_NUM:
+        sqltype = SQL_DOUBLE;
+        sqllen = sizeof(double);
+        sqlscale = 0;
+        sqlsubtype = 0;
+        break;
+    case DDBT_LONG:
+        sqltype = SQL_INT64;
+        sqllen = sizeof(ISC_INT64);
+        sqlscale = 0;
+        sqlsubtype = 0;
+        break;
+    case DDBT_DEC:
+        if(!input && (sqltype==SQL_SHORT || sqltype==SQL_LONG || sqltype==SQL_INT64)) {
+            // Exact numeric. The scale is kept so the value is the unscaled integer.
+            sqltype = SQL_INT64;
+            sqllen = sizeof(ISC_INT64);
+            break;
+        }
+        // Others are exchanged as text that Firebird converts.
+        sqltype = SQL_VARYING;
+        sqllen = DDB_DECIMAL_TEXT;
+        sqlscale = 0;
+        sqlsubtype = 0;
+        break;
+    case DDBT_UUID:
+        // CHAR(16) CHARACTER SET OCTETS is passed as the raw bytes, other types as text.
+        if(!text || sqllen != 16 || sqlsubtype != 1) {
+            sqllen = DDB_UUID_TEXT;
+            if(!text)
+                sqlsubtype = 0;
+        }
+        sqltype = SQL_VARYING;
+        sqlscale = 0;
+        break;
+    case DDBT_STR:
+    case DDBT_CHR:
+    case DDBT_BLOB:
+        if(sqltype==SQL_BLOB && !input)
+            break; // Read with ReadBlob.
+        if(!text) {
+            sqllen = type==DDBT_CHR ? 4 : 64;
+            sqlsubtype = 0;
+        }
+        if(sqltype==SQL_BLOB)
+            sqllen = 0x7ff0; // Longest string that can be sent as parameter.
+        sqltype = SQL_VARYING;
+        sqlscale = 0;
+        break;
+    case DDBT_BOOL:
+        if(input) {
+            if(sqltype != SQL_BOOLEAN) {
+                sqltype = SQL_SHORT;
+                sqllen = sizeof(short);
+            }
+        }
+        else {
+            if(!text) {
+                sqllen = 8;
+                sqlsubtype = 0;
+            }
+            sqltype = SQL_VARYING;
+        }
+        sqlscale = 0;
+        break;
+    case DDBT_TIME:
+        sqltype = SQL_TIMESTAMP;
+        sqllen = sizeof(ISC_TIMESTAMP);
+        sqlscale = 0;
+        sqlsubtype = 0;
+        break;
+    case DDBT_DAY:
+        sqltype = SQL_TYPE_DATE;
+        sqllen = sizeof(ISC_DATE);
+        sqlscale = 0;
+        sqlsubtype = 0;
+        break;
+    }
+}
+
+// ==================================================================================================
+bool DdbFirebird::ExecuteFunction(const DDBSTR &query, short int type, void *data)
+/*!
+  Common logic for the Execute..Function family. Reads the first column of the first row.
+*/
+{
+    if(query.LENGTH()==0)
+        return false;
+    if(!(flags&DDB_FLAG_CONNECTED))
+    {
+        SetErrorId(5);
+        return false;
+    }
+    errorId = 0;
+    DdbFirebirdRowSet rs(this);
+    rs.Bind(type, data);
+    if(!rs.Query(query))
+    {
+        errorId = 19;
+        return false;
+    }
+    bool ok = rs.GetNext() > 0;
+    rs.QuitQuery();
+    return ok;
+}
+
+// ==================================================================================================
+bool DdbFirebird::ExecuteIntFunction(const DDBSTR &query, uint32_t &val)
+{
+    int value;
+    if(!ExecuteFunction(query, DDBT_INT, &value))
+        return false;
+    val = (uint32_t) value;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbFirebird::ExecuteLongFunction(const DDBSTR &query, uint64_t &val)
+{
+    DDBSTR value;
+    if(!ExecuteFunction(query, DDBT_STR, &value))
+        return false;
+#ifdef DDB_USESTL
+    val = strtoull(value.c_str(), 0, 10);
+#else
+    unsigned long long ull;
+    value.ToULongLong(&ull);
+    val = ull;
+#endif
+    return true;
+}
+
+// ==================================================================================================
+bool DdbFirebird::ExecuteDoubleFunction(const DDBSTR &query, double &val)
+{
+    return ExecuteFunction(query, DDBT_NUM, &val);
+}
+
+// ==================================================================================================
+bool DdbFirebird::ExecuteBoolFunction(const DDBSTR &query, bool &val)
+{
+    return ExecuteFunction(query, DDBT_BOOL, &val);
+}
+
+// ==================================================================================================
+bool DdbFirebird::ExecuteStrFunction(const DDBSTR &query, DDBSTR &answer)
+{
+    return ExecuteFunction(query, DDBT_STR, &answer);
+}
+
+// ==================================================================================================
+bool DdbFirebird::ExecuteDateFunction(const DDBSTR &query, DDBTIME &val)
+{
+    return ExecuteFunction(query, DDBT_TIME, &val);
+}
+
+// ==================================================================================================
+int DdbFirebird::ExecuteModify(const DDBSTR &modify)
+/*!
+  Executes INSERT, UPDATE or DELETE statement.
+  \retval int Number of affected rows or -1 on error.
+*/
+{
+    ISC_STATUS_ARRAY status;
+    isc_stmt_handle stmt = 0;
+    isc_tr_handle tr;
+    bool autoTr;
+    int count = -1;
+    char items[] = { isc_info_sql_records };
+    char info[64];
+
+    if(modify.LENGTH()==0)
+        return -1;
+    if(!(flags&DDB_FLAG_CONNECTED))
+    {
+        SetErrorId(5);
+        return -1;
+    }
+    if(!BeginAuto(&tr, false, autoTr))
+    {
+        errorId = 18;
+        return -1;
+    }
+    if(isc_dsql_allocate_statement(status, &connection, &stmt)
+       || isc_dsql_prepare(status, &tr, &stmt, 0, (const char*)modify.UTF8(), DDB_FB_DIALECT, 0)
+       || isc_dsql_execute(status, &tr, &stmt, DDB_FB_DIALECT, 0))
+    {
+        LogError(status, "DdbFirebird::ExecuteModify");
+        errorId = 18;
+    }
+    else
+    {
+        // Sum the insert, update and delete counts.
+        count = 0;
+        if(!isc_dsql_sql_info(status, &stmt, sizeof(items), items, sizeof(info), info) && info[0]==isc_info_sql_records)
+        {
+            char *pos = info+3;
+            while(pos < info+sizeof(info) && *pos != isc_info_end)
+            {
+                char item = *pos++;
+                short len = (short) isc_vax_integer(pos, 2);
+                pos += 2;
+                if(item==isc_info_req_insert_count || item==isc_info_req_update_count || item==isc_info_req_delete_count)
+                    count += isc_vax_integer(pos, len);
+                pos += len;
+            }
+        }
+    }
+    if(stmt)
+        isc_dsql_free_statement(status, &stmt, DSQL_drop);
+    if(autoTr)
+        EndAuto(&tr, count>=0);
+    return count;
+}
+
+// ==================================================================================================
+bool DdbFirebird::UpdateStructure(const DDBSTR &command)
+{
+    ISC_STATUS_ARRAY status;
+    isc_tr_handle tr;
+    bool autoTr;
+
+    if(command.LENGTH()==0)
+        return false;
+    if(!(flags&DDB_FLAG_CONNECTED))
+    {
+        SetErrorId(5);
+        return false;
+    }
+    if(!BeginAuto(&tr, false, autoTr))
+    {
+        errorId = 21;
+        return false;
+    }
+    bool ok = isc_dsql_execute_immediate(status, &connection, &tr, 0, (const char*)command.UTF8(), DDB_FB_DIALECT, 0) == 0;
+    if(!ok)
+    {
+        LogError(status, "DdbFirebird::UpdateStructure");
+        errorId = 21;
+    }
+    if(autoTr && !EndAuto(&tr, ok))
+    {
+        errorId = 21;
+        ok = false;
+    }
+    return ok;
+}
@@ -1,71 +1,190 @@
-/*******************************************************************************
-File: ddbfirebird.hpp
-$Revision: $
-
-Copyright (c) Menacon Inc
-*******************************************************************************/
-
-#ifndef DDB_FIREBIRD_H_FILE
-#define DDB_FIREBIRD_H_FILE
-
-#include <ibase.h>
-
-// ==================================================================================================
-//! Class defines PostgreSQL specific implementation to DirectDatabase-interface.
-class DdbFirebird : public DirectDatabase
-{
-public:
-    DdbFirebird();
-    ~DdbFirebird();
-
-    bool Connect(int timeout=0);
-    bool Disconnect();
-
-    DdbRowSet* CreateRowSet();
-    isc_db_handle GetFBConn();
-    DDBSTR GetErrorDescription(DdbRowSet *rs);
-
-    bool StartTransaction();
-    bool Commit();
-    bool RollBack();
-
-    bool ExecuteIntFunction(const DDBSTR &query,int &val);
-    bool ExecuteDoubleFunction(const DDBSTR &query, double &val);
-    bool ExecuteBoolFunction(const DDBSTR &query, bool &val);
-    bool ExecuteStrFunction(const DDBSTR &query, DDBSTR &result);
-    bool ExecuteDateFunction(const DDBSTR &query, DDBTIME &val);
-    int ExecuteModify(const DDBSTR &query);
-
-protected:
-    void LogError(ISC_STATUS_ARRAY);
-
-    isc_db_handle connection;
-    isc_tr_handle transaction;
-};
-
-// ==================================================================================================
-//! Class defines PostgreSQL specific implementation to DdbRowSet-interface.
-class DdbFirebirdRowSet : public DdbRowSet
-{
-    friend class DdbFirebird;
-public:
-    ~DdbFirebirdRowSet();
-
-    bool Query(const DDBSTR &query);
-    int GetNext();
-
-protected:
-    DdbFirebirdRowSet(DirectDatabase*);
-
-    DdbFirebird* db;            //!< Pointer to databse object.
-    int         maxRows;        //!< Total number of records in the current query.
-    int         currentRow;     //!< The number of the current row in the rowset.
-    isc_stmt_handle result;     //!< Query result handle.
-};
-
-inline isc_db_handle DdbFirebird::GetFBConn()
-{
-    return connection;
-}
-
-#endif
+/*******************************************************************************
+File: ddbfirebird.hpp
+$Revision: $
+
+Copyright (c) Menacon Inc
+*******************************************************************************/
+
+#ifndef DDB_FIREBIRD_H_FILE
+#define DDB_FIREBIRD_H_FILE
+
+#include <string>
+#include <ibase.h>
+// Firebird 4 client library has the batch interface for bulk inserts.
+#if defined(FB_API_VER) && FB_API_VER >= 40
+#define DDB_FB_BATCH
+#include <firebird/Interface.h>
+#endif
+#ifndef SQL_BOOLEAN
+#define SQL_BOOLEAN 32764
+#endif
+
+const short DDB_FB_DIALECT  = 3;     //!< SQL dialect used for all statements.
+const int   DDB_FB_BATCHROWS = 1000; //!< Default number of rows sent to the server at a time by DdbFirebirdBatch.
+
+class DdbFirebirdBatch;
+
+// ==================================================================================================
+//! Class defines Firebird specific implementation to DirectDatabase-interface.
+/*! Connection string is either the database path or space separated key=value pairs:
+    database, user, password, charset (default UTF8) and create (yes = create the database if it
+    does not exist). A database path without host name (e.g. "/tmp/test.fdb") is opened with the
+    embedded engine when the client library has been configured with the Engine provider. Use
+    "host:/path" or "inet://host/path" for a server connection.
+
+    Statements outside of StartTransaction - Commit are run in their own short transactions.
+ */
+class DdbFirebird : public DirectDatabase
+{
+    friend class DdbFirebirdRowSet;
+    friend class DdbFirebirdBatch;
+public:
+    DdbFirebird();
+    ~DdbFirebird();
+
+    int GetType() { return DDBTYPE_FIREBIRD; }
+    bool Connect(const char *constr);
+    bool Disconnect();
+    bool IsConnectOK();
+    bool ResetConnection();
+
+    DdbRowSet* CreateRowSet();
+    DdbFirebirdBatch* CreateBatch(const DDBSTR &insert);
+    isc_db_handle GetFBConn();
+    DDBSTR GetErrorDescription(DdbRowSet *rs);
+
+    bool StartTransaction();
+    bool Commit();
+    bool RollBack();
+
+    bool ExecuteIntFunction(const DDBSTR &query,uint32_t &val);
+    bool ExecuteLongFunction(const DDBSTR &query,uint64_t &val);
+    bool ExecuteDoubleFunction(const DDBSTR &query, double &val);
+    bool ExecuteBoolFunction(const DDBSTR &query, bool &val);
+    bool ExecuteStrFunction(const DDBSTR &query, DDBSTR &result);
+    bool ExecuteDateFunction(const DDBSTR &query, DDBTIME &val);
+    int ExecuteModify(const DDBSTR &query);
+    uint64_t GetInsertId() { SetErrorId(22); return 0; } // Use INSERT ... RETURNING
+    bool UpdateStructure(const DDBSTR &command);
+
+    static void CoerceType(short int type, bool input, short &sqltype, short &sqllen, short &sqlscale, short &sqlsubtype);
+
+protected:
+    void LogError(const ISC_STATUS *status, const char *caller);
+    bool ExecuteFunction(const DDBSTR &query, short int type, void *data);
+    bool BeginAuto(isc_tr_handle *tr, bool readOnly, bool &autoTr);
+    bool EndAuto(isc_tr_handle *tr, bool commit);
+
+    isc_db_handle connection;   //!< Database handle.
+    isc_tr_handle transaction;  //!< Transaction started with StartTransaction.
+    DDBSTR conString;           //!< Connection string for the reset.
+    std::string errorText;      //!< Message from the last failed call.
+#ifdef DDB_FB_BATCH
+    Firebird::IMaster *master;          //!< Master interface of the client library.
+    Firebird::IAttachment *attachment;  //!< Connection as OO API interface.
+    Firebird::ITransaction *trInterface;//!< Transaction started with StartTransaction.
+#endif
+};
+
+// ==================================================================================================
+//! Class defines Firebird specific implementation to DdbRowSet-interface.
+/*! The statement is prepared once and reused as long as the same query is repeated. Output
+    XSQLDA is coerced into the types of the bound fields so that the values are copied from the
+    XSQLDA buffers directly. BLOB columns are read as text into string fields.
+ */
+class DdbFirebirdRowSet : public DdbRowSet
+{
+    friend class DdbFirebird;
+public:
+    ~DdbFirebirdRowSet();
+
+    bool Query(const DDBSTR &query);
+    int GetNext();
+    void QuitQuery();
+
+protected:
+    DdbFirebirdRowSet(DirectDatabase*);
+    bool Prepare(const DDBSTR &query);
+    bool SetupOutput();
+    void FreeStatement();
+    bool ReadBlob(XSQLVAR *var, std::string &value);
+
+    DdbFirebird* db;            //!< Pointer to databse object.
+    int         currentRow;     //!< The number of the current row in the rowset.
+    bool        cursorOpen;     //!< True while there are rows to fetch.
+    bool        autoTr;         //!< True if tr was started by this rowset.
+    isc_stmt_handle stmt;       //!< Prepared statement handle.
+    isc_tr_handle tr;           //!< Transaction of the current query.
+    XSQLDA     *sqlda;          //!< Output descriptor.
+    char       *buffer;         //!< Output data buffer.
+    DDBSTR      prepared;       //!< Query the stmt has been prepared for.
+};
+
+// ==================================================================================================
+//! Bulk insert for Firebird.
+/*! Fields are bound like in rowsets. Add copies the current values of the bound variables into
+    the batch. With Firebird 4 client the rows are sent with the IBatch interface, i.e. many rows
+    per round trip. With older clients the prepared statement is executed for each row.
+    Usage:
+    \code
+    DdbFirebirdBatch *batch = db.CreateBatch("INSERT INTO t(id,name) VALUES(?,?)");
+    batch->Bind(DDBT_INT, &id);
+    batch->Bind(DDBT_STR, &name);
+    for(...) { id = ...; name = ...; batch->Add(); }
+    int rows = batch->Execute();
+    delete batch;
+    \endcode
+ */
+class DdbFirebirdBatch
+{
+    friend class DdbFirebird;
+public:
+    ~DdbFirebirdBatch();
+
+    bool Bind(short int type, void *data);
+    bool Add();
+    int Execute();
+    //! Sets the number of rows collected before they are sent to the server.
+    void SetBatchSize(int rows) { batchSize = rows>0 ? rows : 1; }
+    //! Returns number of rows that failed since the batch was created.
+    int GetErrorCount() { return errorCount; }
+
+protected:
+    DdbFirebirdBatch(DdbFirebird *db, const DDBSTR &insert);
+    bool Prepare();
+    bool BeginTr();
+    bool EndTr(bool commit);
+    int Send();
+    void Release();
+
+    DdbFirebird *db;            //!< Pointer to databse object.
+    DDBSTR insert;              //!< Insert statement.
+    DdbBoundField *fieldRoot;   //!< Bound fields.
+    int fieldCount;             //!< Number of bound fields.
+    int batchSize;              //!< Rows per send.
+    int pending;                //!< Rows added but not yet sent.
+    int inserted;               //!< Rows inserted since the last Execute.
+    int errorCount;             //!< Rows that failed.
+    bool prepared;              //!< True once the statement has been prepared.
+    bool autoTr;                //!< True if tr was started by this batch.
+    bool trOpen;                //!< True while the batch has a transaction.
+    isc_tr_handle tr;           //!< Transaction of the current batch.
+#ifdef DDB_FB_BATCH
+    Firebird::IStatement *statement;
+    Firebird::IMessageMetadata *meta;
+    Firebird::IBatch *batch;
+    Firebird::ITransaction *trInterface;
+    unsigned char *message;     //!< One input message.
+#else
+    isc_stmt_handle stmt;       //!< Prepared insert statement.
+    XSQLDA *sqlda;              //!< Input descriptor.
+    char *buffer;               //!< Input data buffer.
+#endif
+};
+
+inline isc_db_handle DdbFirebird::GetFBConn()
+{
+    return connection;
+}
+
+#endif
@@ -0,0 +1,516 @@
+/*******************************************************************************
+ddbfirebirdbatch.cpp
+Copyright (c) Antti Merenluoto
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#ifdef DDB_USEWX
+  #include <wx/wxprec.h>
+  #ifndef WX_PRECOMP
+    #include <wx/wx.h>
+  #endif
+#include "wx/datetime.h"
+#endif
+#include <cpp4scripts.hpp>
+#define __DDB_FIREBIRD__
+#include "directdatabase.hpp"
+
+#ifdef DDB_FB_BATCH
+using namespace Firebird;
+#endif
+
+// ==================================================================================================
+static void EncodeValue(DdbBoundField *field, short sqltype, short sqllen, char *data, short *nullInd)
+/*!
+  Copies the bound variable into the parameter buffer. The parameter has been coerced with
+  DdbFirebird::CoerceType.
+*/
+{
+    tm tmtime;
+
+    *nullInd = 0;
+    // DDB_TYPE_USED
+    switch(field->type)
+    {
+    case DDBT_INT:
+        *(ISC_LONG*)data = *static_cast<int*>(field->data);
+        break;
+    case DDBT_NUM:
+        *(double*)data = *static_cast<double*>(field->data);
+        break;
+    case DDBT_BOOL:
+        if(sqltype == SQL_BOOLEAN)
+            *(unsigned char*)data = *static_cast<bool*>(field->data) ? 1:0;
+        else
+            *(short*)data = *static_cast<bool*>(field->data) ? 1:0;
+        break;
+    case DDBT_STR:
+    case DDBT_CHR:
+    {
+#ifdef DDB_USESTL
+        std::string value;
+        if(field->type == DDBT_STR)
+            value = *static_cast<std::string*>(field->data);
+        else
+            value.assign(1, *static_cast<char*>(field->data));
+#else
+        wxString wxvalue;
+        if(field->type == DDBT_STR)
+            wxvalue = *static_cast<wxString*>(field->data);
+        else
+            wxvalue = wxString(*static_cast<wxUniChar*>(field->data));
+        std::string value(wxvalue.ToUTF8().data());
+#endif
+        unsigned short len = value.length() < (size_t)sqllen ? value.length() : sqllen;
+        *(unsigned short*)data = len;
+        memcpy(data+sizeof(short), value.data(), len);
+        break;
+    }
+    case DDBT_LONG:
+        *(ISC_INT64*)data = *static_cast<int64_t*>(field->data);
+        break;
+    case DDBT_DEC:
+    {
+        int len = static_cast<DdbDecimal*>(field->data)->Format(data+sizeof(short), sqllen);
+        *(unsigned short*)data = len < 0 ? 0 : len;
+        break;
+    }
+    case DDBT_UUID:
+    {
+        const DdbUuid *uuid = static_cast<DdbUuid*>(field->data);
+        if(sqllen == 16) {
+            *(unsigned short*)data = 16;
+            memcpy(data+sizeof(short), uuid->bytes, 16);
+        }
+        else {
+            char text[DDB_UUID_TEXT];
+            uuid->Format(text);
+            *(unsigned short*)data = DDB_UUID_TEXT-1;
+            memcpy(data+sizeof(short), text, DDB_UUID_TEXT-1);
+        }
+        break;
+    }
+    case DDBT_BLOB:
+    {
+        const DdbBlob *blob = static_cast<DdbBlob*>(field->data);
+        unsigned short len = blob->size() < (size_t)sqllen ? blob->size() : sqllen;
+        *(unsigned short*)data = len;
+        if(len)
+            memcpy(data+sizeof(short), blob->data(), len);
+        break;
+    }
+    case DDBT_TIME:
+    case DDBT_DAY:
+#ifdef DDB_USESTL
+        tmtime = *static_cast<tm*>(field->data);
+#else
+        {
+            wxDateTime *dt = static_cast<wxDateTime*>(field->data);
+            if(!dt->IsValid()) {
+                *nullInd = -1;
+                break;
+            }
+            wxDateTime::Tm wtm = dt->GetTm();
+            memset(&tmtime,0,sizeof(tm));
+            tmtime.tm_year = wtm.year-1900;
+            tmtime.tm_mon  = wtm.mon;
+            tmtime.tm_mday = wtm.mday;
+            tmtime.tm_hour = wtm.hour;
+            tmtime.tm_min  = wtm.min;
+            tmtime.tm_sec  = wtm.sec;
+        }
+#endif
+        if(field->type == DDBT_TIME)
+            isc_encode_timestamp(&tmtime, (ISC_TIMESTAMP*)data);
+        else
+            isc_encode_sql_date(&tmtime, (ISC_DATE*)data);
+        break;
+    }
+}
+
+// ==================================================================================================
+DdbFirebirdBatch::DdbFirebirdBatch(DdbFirebird *db_in, const DDBSTR &insert_in)
+/*!
+  \param db_in Database the rows are inserted into.
+  \param insert_in INSERT statement with a ? placeholder for each bound field.
+*/
+{
+    db = db_in;
+    insert = insert_in;
+    fieldRoot = 0;
+    fieldCount = 0;
+    batchSize = DDB_FB_BATCHROWS;
+    pending = 0;
+    inserted = 0;
+    errorCount = 0;
+    prepared = false;
+    autoTr = false;
+    trOpen = false;
+    tr = 0;
+#ifdef DDB_FB_BATCH
+    statement = 0;
+    meta = 0;
+    batch = 0;
+    trInterface = 0;
+    message = 0;
+#else
+    stmt = 0;
+    sqlda = 0;
+    buffer = 0;
+#endif
+}
+
+// ==================================================================================================
+DdbFirebirdBatch::~DdbFirebirdBatch()
+/*!
+  Rows that have been added after the last Execute are rolled back if the batch has its own
+  transaction.
+*/
+{
+    if(trOpen)
+        EndTr(false);
+    Release();
+    DdbBoundField *field = fieldRoot;
+    while(field)
+    {
+        DdbBoundField *next = field->next;
+        delete field;
+        field = next;
+    }
+}
+
+// ==================================================================================================
+bool DdbFirebirdBatch::Bind(short int type, void *data)
+/*!
+  Binds the variable for the next placeholder. Fields should be bound before the first Add.
+*/
+{
+    if(prepared || !data || type < DDBT_MIN || type >= DDBT_INTARR || type == DDBT_BIT)
+        return false;
+    DdbBoundField *newField = new DdbBoundField(type, data);
+    if(!fieldRoot)
+        fieldRoot = newField;
+    else {
+        DdbBoundField *field = fieldRoot;
+        while(field->next)
+            field = field->next;
+        field->next = newField;
+    }
+    fieldCount++;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbFirebirdBatch::BeginTr()
+/*!
+  Uses the transaction started with DdbFirebird::StartTransaction or starts a new one.
+*/
+{
+    if(trOpen)
+        return true;
+#ifdef DDB_FB_BATCH
+    if(db->flags & DDB_FLAG_TRANSACT_ON) {
+        trInterface = db->trInterface;
+        autoTr = false;
+    }
+    else {
+        static const unsigned char tpb[] = { isc_tpb_version3, isc_tpb_write, isc_tpb_read_committed, isc_tpb_rec_version, isc_tpb_wait };
+        CheckStatusWrapper st(db->master->getStatus());
+        trInterface = db->attachment->startTransaction(&st, sizeof(tpb), tpb);
+        if(!trInterface) {
+            db->LogError(st.getErrors(), "DdbFirebirdBatch::BeginTr");
+            st.dispose();
+            return false;
+        }
+        st.dispose();
+        autoTr = true;
+    }
+#else
+    if(!db->BeginAuto(&tr, false, autoTr))
+        return false;
+#endif
+    trOpen = true;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbFirebirdBatch::EndTr(bool commit)
+{
+    bool ok = true;
+    if(!trOpen)
+        return true;
+    trOpen = false;
+    if(!autoTr)
+        return true;
+#ifdef DDB_FB_BATCH
+    CheckStatusWrapper st(db->master->getStatus());
+    if(commit)
+        trInterface->commit(&st);
+    else
+        trInterface->rollback(&st);
+    if(st.getState() & IStatus::STATE_ERRORS) {
+        db->LogError(st.getErrors(), "DdbFirebirdBatch::EndTr");
+        trInterface->release();
+        ok = false;
+    }
+    st.dispose();
+    trInterface = 0;
+#else
+    ok = db->EndAuto(&tr, commit);
+#endif
+    autoTr = false;
+    return ok;
+}
+
+// ==================================================================================================
+bool DdbFirebirdBatch::Prepare()
+/*!
+  Prepares the insert and coerces the parameters into the bound types.
+*/
+{
+    DdbBoundField *field;
+    int ndx;
+
+    if(prepared)
+        return true;
+    if(!fieldRoot) {
+        db->SetErrorId(9);
+        return false;
+    }
+#ifdef DDB_FB_BATCH
+    CheckStatusWrapper st(db->master->getStatus());
+    IMessageMetadata *in = 0;
+    IMetadataBuilder *builder = 0;
+    IXpbBuilder *pb = 0;
+
+    statement = db->attachment->prepare(&st, trInterface, 0, (const char*)insert.UTF8(), DDB_FB_DIALECT, IStatement::PREPARE_PREFETCH_METADATA);
+    if(statement)
+        in = statement->getInputMetadata(&st);
+    if(in && (int)in->getCount(&st) != fieldCount) {
+        CS_VAPRT_ERRO("DdbFirebirdBatch::Prepare - Statement has %d parameters, %d fields bound.", in->getCount(&st), fieldCount);
+        in->release();
+        st.dispose();
+        Release();
+        return false;
+    }
+    if(in)
+        builder = in->getBuilder(&st);
+    for(ndx=0, field=fieldRoot; builder && field; ndx++, field=field->next) {
+        short sqltype = in->getType(&st, ndx) & ~1;
+        short sqllen = in->getLength(&st, ndx);
+        short sqlscale = in->getScale(&st, ndx);
+        short sqlsubtype = in->getSubType(&st, ndx);
+        DdbFirebird::CoerceType(field->type, true, sqltype, sqllen, sqlscale, sqlsubtype);
+        builder->setType(&st, ndx, sqltype | 1);
+        builder->setLength(&st, ndx, sqllen);
+        builder->setScale(&st, ndx, sqlscale);
+        builder->setSubType(&st, ndx, sqltype==SQL_VARYING ? 0 : sqlsubtype);
+    }
+    if(builder)
+        meta = builder->getMetadata(&st);
+    if(meta) {
+        // Per row results so that one failed row does not stop the rest.
+        pb = db->master->getUtilInterface()->getXpbBuilder(&st, IXpbBuilder::BATCH, 0, 0);
+        pb->insertInt(&st, IBatch::TAG_MULTIERROR, 1);
+        pb->insertInt(&st, IBatch::TAG_RECORD_COUNTS, 1);
+        batch = statement->createBatch(&st, meta, pb->getBufferLength(&st), pb->getBuffer(&st));
+        pb->dispose();
+    }
+    if(builder)
+        builder->release();
+    if(in)
+        in->release();
+    if(!batch) {
+        db->LogError(st.getErrors(), "DdbFirebirdBatch::Prepare");
+        st.dispose();
+        Release();
+        return false;
+    }
+    message = new unsigned char[meta->getMessageLength(&st)];
+    st.dispose();
+#else
+    ISC_STATUS_ARRAY status;
+    XSQLVAR *var;
+    size_t size, offset;
+
+    sqlda = (XSQLDA*) malloc(XSQLDA_LENGTH(fieldCount));
+    sqlda->version = SQLDA_VERSION1;
+    sqlda->sqln = fieldCount;
+    isc_db_handle con = db->GetFBConn();
+    if(isc_dsql_allocate_statement(status, &con, &stmt)
+       || isc_dsql_prepare(status, &tr, &stmt, 0, (const char*)insert.UTF8(), DDB_FB_DIALECT, 0)
+       || isc_dsql_describe_bind(status, &stmt, DDB_FB_DIALECT, sqlda))
+    {
+        db->LogError(status, "DdbFirebirdBatch::Prepare");
+        Release();
+        return false;
+    }
+    if(sqlda->sqld != fieldCount) {
+        CS_VAPRT_ERRO("DdbFirebirdBatch::Prepare - Statement has %d parameters, %d fields bound.", sqlda->sqld, fieldCount);
+        Release();
+        return false;
+    }
+    size = fieldCount*sizeof(short);
+    for(ndx=0, field=fieldRoot, var=sqlda->sqlvar; field; ndx++, field=field->next, var++) {
+        short sqltype = var->sqltype & ~1;
+        DdbFirebird::CoerceType(field->type, true, sqltype, var->sqllen, var->sqlscale, var->sqlsubtype);
+        if(sqltype == SQL_VARYING)
+            var->sqlsubtype = 0;
+        var->sqltype = sqltype | 1;
+        size += (sqltype==SQL_VARYING ? var->sqllen+2 : var->sqllen) + 8;
+    }
+    buffer = (char*) malloc(size);
+    offset = fieldCount*sizeof(short);
+    for(ndx=0, var=sqlda->sqlvar; ndx<fieldCount; ndx++, var++) {
+        offset = (offset+7) & ~((size_t)7);
+        var->sqlind = (short*)buffer + ndx;
+        var->sqldata = buffer + offset;
+        offset += (var->sqltype & ~1)==SQL_VARYING ? var->sqllen+2 : var->sqllen;
+    }
+#endif
+    prepared = true;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbFirebirdBatch::Add()
+/*!
+  Copies the current values of the bound variables into the batch. Rows are sent to the server
+  when the batch size is reached or Execute is called.
+  \retval bool True on success. With older clients the row is inserted immediately and false
+    means that the insert failed.
+*/
+{
+    DdbBoundField *field;
+    int ndx;
+
+    if(!BeginTr())
+        return false;
+    if(!Prepare())
+        return false;
+#ifdef DDB_FB_BATCH
+    CheckStatusWrapper st(db->master->getStatus());
+    for(ndx=0, field=fieldRoot; field; ndx++, field=field->next) {
+        EncodeValue(field, meta->getType(&st, ndx) & ~1, meta->getLength(&st, ndx),
+                    (char*)message + meta->getOffset(&st, ndx),
+                    (short*)(message + meta->getNullOffset(&st, ndx)));
+    }
+    batch->add(&st, 1, message);
+    if(st.getState() & IStatus::STATE_ERRORS) {
+        db->LogError(st.getErrors(), "DdbFirebirdBatch::Add");
+        st.dispose();
+        return false;
+    }
+    st.dispose();
+    if(++pending >= batchSize)
+        return Send() >= 0;
+    return true;
+#else
+    ISC_STATUS_ARRAY status;
+    XSQLVAR *var;
+    for(ndx=0, field=fieldRoot, var=sqlda->sqlvar; field; ndx++, field=field->next, var++)
+        EncodeValue(field, var->sqltype & ~1, var->sqllen, var->sqldata, var->sqlind);
+    if(isc_dsql_execute(status, &tr, &stmt, DDB_FB_DIALECT, sqlda)) {
+        db->LogError(status, "DdbFirebirdBatch::Add");
+        errorCount++;
+        return false;
+    }
+    inserted++;
+    return true;
+#endif
+}
+
+// ==================================================================================================
+int DdbFirebirdBatch::Send()
+/*!
+  Sends the pending rows to the server.
+  \retval int Number of rows inserted or -1 if the batch could not be executed.
+*/
+{
+#ifdef DDB_FB_BATCH
+    if(!pending)
+        return 0;
+    CheckStatusWrapper st(db->master->getStatus());
+    IBatchCompletionState *cs = batch->execute(&st, trInterface);
+    if(!cs) {
+        db->LogError(st.getErrors(), "DdbFirebirdBatch::Send");
+        st.dispose();
+        errorCount += pending;
+        pending = 0;
+        return -1;
+    }
+    int count = 0;
+    unsigned size = cs->getSize(&st);
+    for(unsigned row=0; row<size; row++) {
+        if(cs->getState(&st, row) == IBatchCompletionState::EXECUTE_FAILED)
+            errorCount++;
+        else
+            count++;
+    }
+    if(count < (int)size)
+        CS_VAPRT_ERRO("DdbFirebirdBatch::Send - %d of %u rows failed.", size-count, size);
+    cs->dispose();
+    st.dispose();
+    pending = 0;
+    inserted += count;
+    return count;
+#else
+    return 0;
+#endif
+}
+
+// ==================================================================================================
+int DdbFirebirdBatch::Execute()
+/*!
+  Sends the remaining rows and commits the transaction if the batch started one. If the
+  DdbFirebird::StartTransaction has been called the rows are committed with the database.
+  \retval int Number of rows inserted since the previous Execute or -1 on failure.
+*/
+{
+    if(!trOpen)
+        return 0;
+    if(Send() < 0) {
+        EndTr(false);
+        inserted = 0;
+        return -1;
+    }
+    int count = inserted;
+    inserted = 0;
+    if(!EndTr(true))
+        return -1;
+    return count;
+}
+
+// ==================================================================================================
+void DdbFirebirdBatch::Release()
+/*!
+  Frees the prepared statement and the buffers.
+*/
+{
+#ifdef DDB_FB_BATCH
+    if(batch)
+        batch->release();
+    if(meta)
+        meta->release();
+    if(statement)
+        statement->release();
+    delete[] message;
+    batch = 0;
+    meta = 0;
+    statement = 0;
+    message = 0;
+#else
+    ISC_STATUS_ARRAY status;
+    if(stmt && db->GetFBConn())
+        isc_dsql_free_statement(status, &stmt, DSQL_drop);
+    stmt = 0;
+    free(sqlda);
+    free(buffer);
+    sqlda = 0;
+    buffer = 0;
+#endif
+    prepared = false;
+    pending = 0;
+}
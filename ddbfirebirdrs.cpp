@@ -0,0 +1,403 @@
+/*******************************************************************************
+ddbfirebirdrs.cpp
+Copyright (c) Antti Merenluoto
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#ifdef DDB_USEWX
+  #include <wx/wxprec.h>
+  #ifndef WX_PRECOMP
+    #include <wx/wx.h>
+  #endif
+#include "wx/datetime.h"
+#endif
+#include <cpp4scripts.hpp>
+#define __DDB_FIREBIRD__
+#include "directdatabase.hpp"
+
+// ==================================================================================================
+static void SetString(void *data, const char *str, size_t len, bool trim)
+{
+#ifdef DDB_USESTL
+    static_cast<std::string*>(data)->assign(str,len);
+    if(trim)
+        DirectDatabase::TrimTail(static_cast<std::string*>(data));
+#else
+    *(static_cast<wxString*>(data)) = wxString::FromUTF8(str,len);
+    if(trim)
+        static_cast<wxString*>(data)->Trim();
+#endif
+}
+
+// ==================================================================================================
+DdbFirebirdRowSet::DdbFirebirdRowSet(DirectDatabase *db_in)
+    :DdbRowSet()
+/*!
+    Initializes member variables to default values.
+    \param db_in Pointer to database object.
+*/
+{
+    db = static_cast<DdbFirebird*>(db_in);
+    currentRow = 0;
+    cursorOpen = false;
+    autoTr = false;
+    stmt = 0;
+    tr = 0;
+    sqlda = 0;
+    buffer = 0;
+}
+
+// ==================================================================================================
+DdbFirebirdRowSet::~DdbFirebirdRowSet()
+/*!
+    Closes the query and drops the prepared statement.
+*/
+{
+    QuitQuery();
+    FreeStatement();
+}
+
+// ==================================================================================================
+void DdbFirebirdRowSet::FreeStatement()
+/*!
+  Drops the prepared statement. Cursor should have been closed.
+*/
+{
+    ISC_STATUS_ARRAY status;
+
+    if(stmt && db->GetFBConn())
+        isc_dsql_free_statement(status, &stmt, DSQL_drop);
+    stmt = 0;
+    free(sqlda);
+    free(buffer);
+    sqlda = 0;
+    buffer = 0;
+    prepared.CLEAR();
+}
+
+// ==================================================================================================
+bool DdbFirebirdRowSet::Prepare(const DDBSTR &query)
+/*!
+  Prepares the query unless it is the same query that was prepared previously.
+*/
+{
+    ISC_STATUS_ARRAY status;
+    int count = 0;
+
+    if(stmt && prepared == query)
+        return true;
+    FreeStatement();
+
+    for(DdbBoundField *field=fieldRoot; field; field=field->next)
+        count++;
+    sqlda = (XSQLDA*) malloc(XSQLDA_LENGTH(count));
+    sqlda->version = SQLDA_VERSION1;
+    sqlda->sqln = count;
+
+    isc_db_handle con = db->GetFBConn();
+    if(isc_dsql_allocate_statement(status, &con, &stmt)
+       || isc_dsql_prepare(status, &tr, &stmt, 0, (const char*)query.UTF8(), DDB_FB_DIALECT, sqlda))
+    {
+        db->LogError(status, "DdbFirebirdRowSet::Prepare");
+        FreeStatement();
+        return false;
+    }
+    // Query has more columns than bound fields.
+    if(sqlda->sqld > sqlda->sqln)
+    {
+        count = sqlda->sqld;
+        free(sqlda);
+        sqlda = (XSQLDA*) malloc(XSQLDA_LENGTH(count));
+        sqlda->version = SQLDA_VERSION1;
+        sqlda->sqln = count;
+        if(isc_dsql_describe(status, &stmt, DDB_FB_DIALECT, sqlda))
+        {
+            db->LogError(status, "DdbFirebirdRowSet::Prepare");
+            FreeStatement();
+            return false;
+        }
+    }
+    if(!SetupOutput())
+    {
+        FreeStatement();
+        return false;
+    }
+    prepared = query;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbFirebirdRowSet::SetupOutput()
+/*!
+  Coerces the output columns into the bound types and allocates one buffer for all values
+  and null indicators.
+*/
+{
+    DdbBoundField *field;
+    XSQLVAR *var;
+    size_t size, offset;
+    int ndx;
+
+    // Compute the buffer size.
+    size = 0;
+    field = fieldRoot;
+    for(ndx=0, var=sqlda->sqlvar; ndx<sqlda->sqld; ndx++, var++)
+    {
+        short nullable = var->sqltype & 1;
+        short sqltype = var->sqltype & ~1;
+        if(field) {
+            DdbFirebird::CoerceType(field->type, false, sqltype, var->sqllen, var->sqlscale, var->sqlsubtype);
+            field = field->next;
+        }
+        var->sqltype = sqltype | nullable;
+        size += (sqltype==SQL_VARYING ? var->sqllen+2 : var->sqllen) + 8;
+    }
+    size += sqlda->sqld*sizeof(short);
+    buffer = (char*) malloc(size);
+    if(!buffer)
+    {
+        CS_PRINT_ERRO("DdbFirebirdRowSet::SetupOutput - Out of memory.");
+        return false;
+    }
+
+    // Null indicators first, then the values aligned to 8 bytes.
+    offset = sqlda->sqld*sizeof(short);
+    for(ndx=0, var=sqlda->sqlvar; ndx<sqlda->sqld; ndx++, var++)
+    {
+        offset = (offset+7) & ~((size_t)7);
+        var->sqlind = (short*)buffer + ndx;
+        var->sqldata = buffer + offset;
+        offset += (var->sqltype & ~1)==SQL_VARYING ? var->sqllen+2 : var->sqllen;
+    }
+    return true;
+}
+
+// ==================================================================================================
+bool DdbFirebirdRowSet::Query(const DDBSTR &query)
+{
+    ISC_STATUS_ARRAY status;
+
+    if(!fieldRoot)
+    {
+        db->SetErrorId(9);
+        return  false;
+    }
+    queryStmt = query;
+    if(queryStmt.LENGTH()==0)
+        return false;
+    QuitQuery();
+
+    if(!db->BeginAuto(&tr, true, autoTr))
+    {
+        db->SetErrorId(8);
+        return false;
+    }
+    if(!Prepare(query))
+    {
+        db->SetErrorId(8);
+        QuitQuery();
+        return false;
+    }
+    if(!sqlda->sqld)
+    {
+        CS_PRINT_NOTE("DdbFirebirdRowSet::Query - Statement does not return rows.");
+        QuitQuery();
+        return false;
+    }
+    if(isc_dsql_execute(status, &tr, &stmt, DDB_FB_DIALECT, 0))
+    {
+        db->LogError(status, "DdbFirebirdRowSet::Query");
+        db->SetErrorId(8);
+        QuitQuery();
+        return false;
+    }
+    cursorOpen = true;
+    currentRow = 0;
+    return true;
+}
+
+// ==================================================================================================
+int DdbFirebirdRowSet::GetNext()
+/*!
+  Fetches the next row and copies the values from the XSQLDA buffers into the bound variables.
+  Firebird client library prefetches the rows from the server in network sized batches.
+  \retval int Number of the row read. Zero at the end of the result or on error.
+*/
+{
+    ISC_STATUS_ARRAY status;
+    DdbBoundField *field;
+    XSQLVAR *var;
+    const char *str;
+    tm tmtime;
+    int ndx;
+
+    if(!cursorOpen)
+        return 0;
+
+    ISC_STATUS rc = isc_dsql_fetch(status, &stmt, DDB_FB_DIALECT, sqlda);
+    if(rc == 100)
+    {
+        QuitQuery();
+        return 0;
+    }
+    if(rc)
+    {
+        db->LogError(status, "DdbFirebirdRowSet::GetNext");
+        db->SetErrorId(20);
+        QuitQuery();
+        return 0;
+    }
+
+    bool trim = db->IsFeatureOn(DDB_FEATURE_AUTOTRIM);
+    for(field=fieldRoot, ndx=0, var=sqlda->sqlvar; field && ndx<sqlda->sqld; field=field->next, ndx++, var++)
+    {
+        bool isNull = (var->sqltype & 1) && *var->sqlind < 0;
+        short sqltype = var->sqltype & ~1;
+        field->null = isNull;
+        // Strings are SQL_VARYING after coercion: length followed by the data.
+        str = var->sqldata + sizeof(short);
+        // DDB_TYPE_USED
+        switch(field->type)
+        {
+        case DDBT_INT:
+            *(static_cast<int*>(field->data)) = isNull ? 0 : *(ISC_LONG*)var->sqldata;
+            break;
+        case DDBT_NUM:
+            *(static_cast<double*>(field->data)) = isNull ? 0 : *(double*)var->sqldata;
+            break;
+        case DDBT_STR:
+            if(isNull)
+                static_cast<DDBSTR*>(field->data)->CLEAR();
+            else if(sqltype == SQL_BLOB) {
+                std::string value;
+                if(ReadBlob(var, value))
+                    SetString(field->data, value.c_str(), value.length(), trim);
+                else
+                    static_cast<DDBSTR*>(field->data)->CLEAR();
+            }
+            else
+                SetString(field->data, str, *(unsigned short*)var->sqldata, trim);
+            break;
+        case DDBT_BOOL:
+            *(static_cast<bool*>(field->data)) = !isNull && *(unsigned short*)var->sqldata>0 && strchr("tTyY1",str[0]) ? true:false;
+            break;
+        case DDBT_CHR:
+#ifdef DDB_USESTL
+            *(static_cast<char*>(field->data)) = isNull || *(unsigned short*)var->sqldata==0 ? 0 : str[0];
+#else
+            *(static_cast<wxUniChar*>(field->data)) = isNull || *(unsigned short*)var->sqldata==0 ? 0 : str[0];
+#endif
+            break;
+        case DDBT_TIME:
+        case DDBT_DAY:
+            memset(&tmtime,0,sizeof(tm));
+            if(!isNull) {
+                if(field->type == DDBT_TIME)
+                    isc_decode_timestamp((ISC_TIMESTAMP*)var->sqldata, &tmtime);
+                else
+                    isc_decode_sql_date((ISC_DATE*)var->sqldata, &tmtime);
+                tmtime.tm_isdst = -1;
+            }
+#ifdef DDB_USESTL
+            memcpy(field->data,&tmtime,sizeof(tm));
+#else
+            if(isNull)
+                *(static_cast<wxDateTime*>(field->data)) = wxInvalidDateTime;
+            else
+                static_cast<wxDateTime*>(field->data)->Set(tmtime);
+#endif
+            break;
+        case DDBT_LONG:
+            *(static_cast<int64_t*>(field->data)) = isNull ? 0 : *(ISC_INT64*)var->sqldata;
+            break;
+        case DDBT_DEC:
+        {
+            DdbDecimal *dec = static_cast<DdbDecimal*>(field->data);
+            if(isNull)
+                dec->Clear();
+            else if(sqltype == SQL_INT64) {
+                dec->value = *(ISC_INT64*)var->sqldata;
+                dec->scale = -var->sqlscale;
+            }
+            else if(!dec->Parse(str, *(unsigned short*)var->sqldata))
+                CS_PRINT_WARN("DdbFirebirdRowSet::GetNext - Decimal parse failed.");
+            break;
+        }
+        case DDBT_UUID:
+        {
+            DdbUuid *uuid = static_cast<DdbUuid*>(field->data);
+            unsigned short len = *(unsigned short*)var->sqldata;
+            if(isNull)
+                uuid->Clear();
+            else if(len == 16)
+                memcpy(uuid->bytes, str, 16);
+            else
+                uuid->Parse(str, len);
+            break;
+        }
+        case DDBT_BLOB:
+        {
+            DdbBlob *blob = static_cast<DdbBlob*>(field->data);
+            if(isNull)
+                blob->clear();
+            else if(sqltype == SQL_BLOB) {
+                std::string value;
+                ReadBlob(var, value);
+                blob->assign(value.begin(), value.end());
+            }
+            else
+                blob->assign((const uint8_t*)str, (const uint8_t*)str + *(unsigned short*)var->sqldata);
+            break;
+        }
+        }
+    }
+    return ++currentRow;
+}
+
+// ==================================================================================================
+bool DdbFirebirdRowSet::ReadBlob(XSQLVAR *var, std::string &value)
+/*!
+  Reads the BLOB of the column.
+  \param value Receives the content. Text blobs are not converted.
+  \retval bool False if the blob could not be opened.
+*/
+{
+    ISC_STATUS_ARRAY status;
+    isc_blob_handle blob = 0;
+    unsigned short actual;
+    char segment[4096];
+
+    isc_db_handle con = db->GetFBConn();
+    if(isc_open_blob2(status, &con, &tr, &blob, (ISC_QUAD*)var->sqldata, 0, 0))
+    {
+        db->LogError(status, "DdbFirebirdRowSet::ReadBlob");
+        return false;
+    }
+    value.clear();
+    while(isc_get_segment(status, &blob, &actual, sizeof(segment), segment) == 0 || status[1] == isc_segment)
+        value.append(segment, actual);
+    isc_close_blob(status, &blob);
+    return true;
+}
+
+// ==================================================================================================
+void DdbFirebirdRowSet::QuitQuery()
+/*!
+  Closes the cursor. The prepared statement is kept for the next query.
+*/
+{
+    ISC_STATUS_ARRAY status;
+
+    if(cursorOpen)
+    {
+        if(isc_dsql_free_statement(status, &stmt, DSQL_close))
+            db->LogError(status, "DdbFirebirdRowSet::QuitQuery");
+        cursorOpen = false;
+    }
+    if(autoTr)
+        db->EndAuto(&tr, true);
+    autoTr = false;
+    tr = 0;
+}
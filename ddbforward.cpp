@@ -0,0 +1,139 @@
+/*! \file ddbforward.cpp
+ * \brief Rowset that forwards the query to a database selected per query. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#include "pch-stop.h"
+#include <cpp4scripts.hpp>
+#include "ddbforward.hpp"
+
+// ==================================================================================================
+DdbForwardRowSet::DdbForwardRowSet(DdbQueryRoute *route_in)
+    :DdbRowSet()
+/*!
+    \param route_in Object that selects the database for each query.
+*/
+{
+    route = route_in;
+    active = 0;
+    target = 0;
+}
+
+// ==================================================================================================
+DdbForwardRowSet::~DdbForwardRowSet()
+/*!
+    Deletes the rowsets created into the target databases.
+*/
+{
+    QuitQuery();
+    for(std::vector<Target>::iterator it=targets.begin(); it!=targets.end(); it++)
+        delete it->rs;
+}
+
+// ==================================================================================================
+DdbRowSet* DdbForwardRowSet::GetRowSet(DirectDatabase *db)
+/*!
+  Returns rowset for the given database. Rowset is created at first use. Fields bound after the
+  previous use are bound into the rowset before it is returned. In the auto-describe mode the
+  rowset describes its own columns instead.
+*/
+{
+    Target *tg = 0;
+    for(std::vector<Target>::iterator it=targets.begin(); it!=targets.end(); it++) {
+        if(it->db == db) {
+            tg = &(*it);
+            break;
+        }
+    }
+    if(!tg) {
+        Target nt;
+        nt.db = db;
+        nt.rs = db->CreateRowSet();
+        nt.bound = 0;
+        if(!nt.rs)
+            return 0;
+        targets.push_back(nt);
+        tg = &targets.back();
+    }
+    if(tg->rs->IsAutoDescribe() != autoDescribe) {
+        if(!tg->rs->SetAutoDescribe(autoDescribe))
+            return 0;
+        tg->bound = 0;
+    }
+    if(autoDescribe)
+        return tg->rs;
+    int ndx = 0;
+    for(DdbBoundField *field=fieldRoot; field; field=field->next, ndx++) {
+        if(ndx < tg->bound)
+            continue;
+        tg->rs->Bind(field->type, field->data);
+        tg->bound++;
+    }
+    return tg->rs;
+}
+
+// ==================================================================================================
+bool DdbForwardRowSet::Query(const DDBSTR &query)
+/*!
+  Runs the query on the routed database. In the auto-describe mode the columns described by the
+  target are copied and bound into this rowset.
+*/
+{
+    if(!fieldRoot && !autoDescribe) {
+        CS_PRINT_NOTE("DdbForwardRowSet::Query - Query called without binding variables.");
+        return  false;
+    }
+    QuitQuery();
+    queryStmt = query;
+    DirectDatabase *db = route->RouteQuery(query);
+    while(db) {
+        DdbRowSet *rs = GetRowSet(db);
+        if(rs && rs->Query(query)) {
+            active = rs;
+            target = db;
+            if(autoDescribe) {
+                columns.clear();
+                for(int col=0; col<rs->GetColumnCount(); col++)
+                    columns.push_back(rs->GetColumn(col));
+                BindColumns();
+            }
+            return true;
+        }
+        route->RouteDone(db);
+        db = route->RouteFailed(query, db);
+    }
+    return false;
+}
+
+// ==================================================================================================
+int DdbForwardRowSet::GetNext()
+/*!
+  Reads the next row of the target. The target reads into the same variables, or in the
+  auto-describe mode into its own columns whose values are copied into this rowset.
+  \retval int Number of non-null values. Zero at the end of the result, which also ends the
+  routing, and for a row of NULL values.
+*/
+{
+    if(!active)
+        return 0;
+    if(!active->GetNextRow()) {
+        QuitQuery();
+        return 0;
+    }
+    if(autoDescribe) {
+        for(size_t col=0; col<columns.size(); col++)
+            columns[col] = active->GetColumn((int)col);
+    }
+    return CopyNulls(active);
+}
+
+// ==================================================================================================
+void DdbForwardRowSet::QuitQuery()
+{
+    if(!active)
+        return;
+    active->QuitQuery();
+    route->RouteDone(target);
+    active = 0;
+    target = 0;
+}
@@ -0,0 +1,67 @@
+/*! \file ddbforward.hpp
+ * \brief Rowset that forwards the query to a database selected per query. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#ifndef DDB_FORWARD_H_FILE
+#define DDB_FORWARD_H_FILE
+
+#include <vector>
+#include "directdatabase.hpp"
+
+// ==================================================================================================
+//! Interface for the database wrappers that select the executing connection per query.
+class DdbQueryRoute
+{
+public:
+    virtual ~DdbQueryRoute() {}
+
+    /*! Returns the database that should execute the given read query.
+        \retval DirectDatabase* Target database. Null aborts the query.     */
+    virtual DirectDatabase* RouteQuery(const DDBSTR &query)=0;
+
+    /*! Called when the query failed on the routed database.
+        \param query The failed query.
+        \param failed Database where the query failed.
+        \retval DirectDatabase* Database where the query should be retried. Null if none.  */
+    virtual DirectDatabase* RouteFailed(const DDBSTR &, DirectDatabase *) { return 0; }
+
+    /*! Called when the rowset has finished with the database returned by RouteQuery.  */
+    virtual void RouteDone(DirectDatabase *) {}
+};
+
+// ==================================================================================================
+//! Rowset that executes each query on a database selected by DdbQueryRoute.
+/*! The rowset creates one rowset for each target database it has used and binds the
+    caller's variables into it. Bind, Query and GetNext work as with any other rowset, as does
+    the auto-describe mode.
+ */
+class DdbForwardRowSet : public DdbRowSet
+{
+public:
+    DdbForwardRowSet(DdbQueryRoute *route);
+    ~DdbForwardRowSet();
+
+    bool Query(const DDBSTR &query);
+    int GetNext();
+    void QuitQuery();
+
+    //! Returns the database that executes the current query. Null if there is no query.
+    DirectDatabase* GetTarget() { return target; }
+
+protected:
+    //! Rowset created into one target database.
+    struct Target {
+        DirectDatabase *db;     //!< Target database.
+        DdbRowSet *rs;          //!< Rowset created by the target.
+        int bound;              //!< Number of fields bound into rs so far.
+    };
+    DdbRowSet* GetRowSet(DirectDatabase *db);
+
+    DdbQueryRoute *route;
+    std::vector<Target> targets;
+    DdbRowSet *active;          //!< Rowset of the current query.
+    DirectDatabase *target;     //!< Database of the current query.
+};
+
+#endif
@@ -0,0 +1,415 @@
+/*! \file ddbhedge.cpp
+ * \brief Hedged reads over equivalent PostgreSQL connections. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#include "pch-stop.h"
+#include <string.h>
+#include <algorithm>
+#ifdef _WIN32
+  #include <winsock2.h>
+#else
+  #include <poll.h>
+#endif
+#include <cpp4scripts.hpp>
+#define __DDB_POSTGRE__
+#include "ddbhedge.hpp"
+#include "ddbrouter.hpp"
+
+using namespace std::chrono;
+
+// ==================================================================================================
+static void WaitSockets(const int *socks, int count, int ms)
+/*!
+  Waits until one of the sockets is readable or the time has passed.
+  \param ms Time to wait in milliseconds. Negative waits without a limit.
+*/
+{
+#ifdef _WIN32
+    WSAPOLLFD pfd[2];
+    for(int ndx=0; ndx<count; ndx++) {
+        pfd[ndx].fd = (SOCKET)socks[ndx];
+        pfd[ndx].events = POLLRDNORM;
+        pfd[ndx].revents = 0;
+    }
+    WSAPoll(pfd, count, ms);
+#else
+    struct pollfd pfd[2];
+    for(int ndx=0; ndx<count; ndx++) {
+        pfd[ndx].fd = socks[ndx];
+        pfd[ndx].events = POLLIN;
+        pfd[ndx].revents = 0;
+    }
+    poll(pfd, count, ms);
+#endif
+}
+
+// ==================================================================================================
+static bool IsErrorResult(PGresult *result)
+{
+    if(!result)
+        return true;
+    ExecStatusType status = PQresultStatus(result);
+    return status == PGRES_FATAL_ERROR || status == PGRES_BAD_RESPONSE;
+}
+
+// ==================================================================================================
+DdbHedgedPostgre::DdbHedgedPostgre()
+/*!
+  Constructs an unconnected object without peers. Connect it as any DdbPostgre.
+*/
+{
+    Member self = { this, false };
+    members.push_back(self);
+    next = 0;
+    samples.reserve(DDB_HEDGE_SAMPLES);
+    sampleCount = 0;
+    hedgeDelay = 0;
+    percentile = 95;
+    minDelay = 2;
+    initialDelay = 50;
+    maxRate = 10;
+    hedging = true;
+    ResetStats();
+}
+
+// ==================================================================================================
+DdbHedgedPostgre::~DdbHedgedPostgre()
+/*!
+  Waits for the canceled queries of the peers so that they are left usable.
+*/
+{
+    for(size_t ndx=1; ndx<members.size(); ndx++) {
+        if(members[ndx].draining)
+            Drain(ndx, true);
+    }
+}
+
+// ==================================================================================================
+void DdbHedgedPostgre::AddPeer(DdbPostgre *peer)
+/*!
+  Adds a connection the reads may be sent to. The peer should be connected to a database
+  holding the same data, e.g. to a replica or with a different connection to the same server.
+  \param peer Connection to add. Caller keeps the ownership and must keep it alive while this
+    object is in use.
+*/
+{
+    if(!peer || peer == this)
+        return;
+    Member member = { peer, false };
+    members.push_back(member);
+}
+
+// ==================================================================================================
+bool DdbHedgedPostgre::Drain(size_t ndx, bool wait)
+/*!
+  Reads away the results of the canceled query of a member. If the query does not finish within
+  DDB_PG_CANCEL_WAIT ms the connection is reset.
+  \param ndx Member index.
+  \param wait If false only the input already received is processed.
+  \retval bool True if the member is ready for a new query.
+*/
+{
+    PGconn *conn = Conn(ndx);
+    if(!conn)
+        return false;
+    steady_clock::time_point limit = steady_clock::now() + milliseconds(DDB_PG_CANCEL_WAIT);
+    for(;;) {
+        if(!PQconsumeInput(conn))
+            break;
+        while(!PQisBusy(conn)) {
+            PGresult *result = PQgetResult(conn);
+            if(!result) {
+                members[ndx].draining = false;
+                return true;
+            }
+            PQclear(result);
+        }
+        if(!wait)
+            return false;
+        int ms = (int)duration_cast<milliseconds>(limit - steady_clock::now()).count();
+        if(ms <= 0)
+            break;
+        int sock = PQsocket(conn);
+        WaitSockets(&sock, 1, ms);
+    }
+    CS_VAPRT_WARN("DdbHedgedPostgre::Drain - Canceled query did not finish. Resetting connection %d.", (int)ndx);
+    members[ndx].draining = false;
+    return members[ndx].db->ResetConnection();
+}
+
+// ==================================================================================================
+void DdbHedgedPostgre::Abandon(size_t ndx)
+/*!
+  Cancels the query that is running on a member and leaves the member draining.
+*/
+{
+    // Unlike Cancel this does not mark the caller's query canceled.
+    if(ndx == 0)
+        SendCancel();
+    else {
+        members[ndx].db->SendCancel();
+        members[ndx].db->SetRunning(false);
+    }
+    members[ndx].draining = true;
+    Drain(ndx, false);
+}
+
+// ==================================================================================================
+int DdbHedgedPostgre::Pick(int skip)
+/*!
+  Selects the next idle member in turn.
+  \param skip Member that is not to be selected. Negative if the first query of a read is
+    selected; the turn then advances.
+  \retval int Member index or -1 if none is available.
+*/
+{
+    size_t count = members.size();
+    for(size_t offset=0; offset<count; offset++) {
+        size_t ndx = (next + offset) % count;
+        PGconn *conn = Conn(ndx);
+        if((int)ndx == skip || !conn || PQstatus(conn) != CONNECTION_OK)
+            continue;
+        if(members[ndx].draining && !Drain(ndx, false))
+            continue;
+        if(skip < 0)
+            next = (ndx + 1) % count;
+        return (int)ndx;
+    }
+    return -1;
+}
+
+// ==================================================================================================
+void DdbHedgedPostgre::Record(double ms)
+/*!
+  Adds a read latency into the samples and updates the hedge delay.
+*/
+{
+    if(samples.size() < DDB_HEDGE_SAMPLES)
+        samples.push_back(ms);
+    else
+        samples[sampleCount % DDB_HEDGE_SAMPLES] = ms;
+    sampleCount++;
+    // The percentile changes slowly once the window is full; no need to sort on every read.
+    if(sampleCount < DDB_HEDGE_MIN_SAMPLES || (sampleCount > DDB_HEDGE_SAMPLES && sampleCount%16))
+        return;
+    std::vector<double> sorted(samples);
+    size_t pos = sorted.size() * percentile / 100;
+    std::nth_element(sorted.begin(), sorted.begin()+pos, sorted.end());
+    hedgeDelay = sorted[pos];
+}
+
+// ==================================================================================================
+double DdbHedgedPostgre::EstimateSaved(double ms)
+/*!
+  Estimates how much longer a read that has taken the given time would still have taken, i.e.
+  the mean of the recorded latencies longer than it minus the time.
+  \retval double Estimate in milliseconds. Zero if no longer latency has been recorded.
+*/
+{
+    double sum = 0;
+    int count = 0;
+    for(size_t ndx=0; ndx<samples.size(); ndx++) {
+        if(samples[ndx] > ms) {
+            sum += samples[ndx];
+            count++;
+        }
+    }
+    return count ? sum/count - ms : 0;
+}
+
+// ==================================================================================================
+double DdbHedgedPostgre::GetHedgeDelay()
+/*!
+  \retval double Time in milliseconds after which a read is sent to a second connection.
+*/
+{
+    double delay = sampleCount < DDB_HEDGE_MIN_SAMPLES ? initialDelay : hedgeDelay;
+    return delay < minDelay ? minDelay : delay;
+}
+
+// ==================================================================================================
+void DdbHedgedPostgre::ResetStats()
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+// ==================================================================================================
+bool DdbHedgedPostgre::Cancel()
+/*!
+  Cancels the query running on this connection and on the peers. The peers are marked running
+  while a hedged read is in flight on them, so a read waiting for a peer is interrupted too.
+  Thread safe as DdbPostgre::Cancel.
+  \retval bool True if a cancel request was delivered.
+*/
+{
+    bool sent = DdbPostgre::Cancel();
+    for(size_t ndx=1; ndx<members.size(); ndx++) {
+        if(members[ndx].db->DdbPostgre::Cancel())
+            sent = true;
+    }
+    return sent;
+}
+
+// ==================================================================================================
+uint64_t DdbHedgedPostgre::GetInsertId()
+/*!
+  Reads lastval from this object's own connection. The value belongs to the session, so it is
+  never read from a peer.
+*/
+{
+    if(members[0].draining)
+        Drain(0, true);
+    return ReadInsertId(DdbPostgre::Exec("SELECT lastval()"));
+}
+
+// ==================================================================================================
+PGresult* DdbHedgedPostgre::Exec(const char *query)
+/*!
+  Executes a read as a hedged query. Writes, queries inside a transaction and all queries when
+  there are no peers or hedging is off are passed to DdbPostgre::Exec. The statement timeout
+  and the deadline of this object limit the whole read.
+  \retval PGresult* Result of the query. Caller must clear it. Null if no connection was
+    available, the query was canceled or the deadline had passed.
+*/
+{
+    //! Query sent to one member.
+    struct Flight {
+        int ndx;
+        PGresult *last;
+        bool done;
+    };
+
+    if(!hedging || members.size() < 2 || IsTransaction() || !DdbRouter::IsReadQuery(query)) {
+        if(members[0].draining)
+            Drain(0, true);
+        return DdbPostgre::Exec(query);
+    }
+    timedOut = false;
+    steady_clock::time_point limit;
+    bool limited = GetLimit(limit);
+    steady_clock::time_point start = steady_clock::now();
+    if(limited && start >= limit) {
+        CS_PRINT_WARN("DdbHedgedPostgre::Exec - Deadline has passed. Query was not sent.");
+        timedOut = true;
+        SetErrorId(27);
+        return 0;
+    }
+    int first = Pick(-1);
+    if(first < 0 || !PQsendQuery(Conn(first), query)) {
+        if(first >= 0)
+            CS_VAPRT_WARN("DdbHedgedPostgre::Exec - Send failed: %s", PQerrorMessage(Conn(first)));
+        if(members[0].draining)
+            Drain(0, true);
+        return DdbPostgre::Exec(query);
+    }
+    SetRunning(true);
+    if(first)
+        members[first].db->SetRunning(true);
+    stats.queries++;
+    bool mayHedge = stats.hedged*100 < stats.queries*maxRate;
+    steady_clock::time_point hedgeAt = start + microseconds((int64_t)(GetHedgeDelay()*1000));
+    Flight flight[2] = { { first, 0, false }, { -1, 0, true } };
+    int count = 1;
+    int winner = -1;
+
+    while(winner < 0) {
+        steady_clock::time_point now = steady_clock::now();
+        if(mayHedge && now >= hedgeAt) {
+            mayHedge = false;
+            int second = Pick(first);
+            if(second >= 0 && PQsendQuery(Conn(second), query)) {
+                if(second)
+                    members[second].db->SetRunning(true);
+                flight[1].ndx = second;
+                flight[1].done = false;
+                count = 2;
+                stats.hedged++;
+            }
+        }
+        // Wait for the answers, the hedge time or the limit.
+        int ms = -1;
+        if(mayHedge)
+            ms = (int)duration_cast<milliseconds>(hedgeAt - now).count() + 1;
+        if(limited) {
+            int left = (int)duration_cast<milliseconds>(limit - now).count() + 1;
+            if(ms < 0 || left < ms)
+                ms = left;
+        }
+        int socks[2], active=0;
+        for(int fl=0; fl<count; fl++) {
+            if(!flight[fl].done)
+                socks[active++] = PQsocket(Conn(flight[fl].ndx));
+        }
+        WaitSockets(socks, active, ms);
+
+        for(int fl=0; fl<count; fl++) {
+            Flight &f = flight[fl];
+            PGconn *conn = Conn(f.ndx);
+            if(f.done)
+                continue;
+            if(!PQconsumeInput(conn))
+                f.done = true;
+            while(!f.done && !PQisBusy(conn)) {
+                PGresult *result = PQgetResult(conn);
+                if(!result) {
+                    f.done = true;
+                    break;
+                }
+                // As with PQexec an error result is kept over the results that follow it.
+                if(f.last && IsErrorResult(f.last))
+                    PQclear(result);
+                else {
+                    PQclear(f.last);
+                    f.last = result;
+                }
+            }
+            if(f.done && f.ndx)
+                members[f.ndx].db->SetRunning(false);
+        }
+        if(canceled || (limited && steady_clock::now() >= limit)) {
+            for(int fl=0; fl<count; fl++) {
+                if(!flight[fl].done)
+                    Abandon(flight[fl].ndx);
+                PQclear(flight[fl].last);
+            }
+            SetRunning(false);
+            CS_VAPRT_WARN("DdbHedgedPostgre::Exec - Query was canceled: %.200s", query);
+            timedOut = true;
+            SetErrorId(27);
+            return 0;
+        }
+        // The first successful answer wins. An error is used only if no other query is running.
+        for(int fl=0; fl<count && winner<0; fl++) {
+            if(flight[fl].done && !IsErrorResult(flight[fl].last))
+                winner = fl;
+        }
+        if(winner < 0) {
+            bool pending = false;
+            for(int fl=0; fl<count; fl++) {
+                if(!flight[fl].done)
+                    pending = true;
+            }
+            if(!pending)
+                winner = 0;
+        }
+    }
+
+    SetRunning(false);
+    double elapsed = duration_cast<microseconds>(steady_clock::now() - start).count() / 1000.0;
+    if(!IsErrorResult(flight[winner].last)) {
+        if(winner == 1) {
+            stats.hedgeWins++;
+            stats.savedMs += EstimateSaved(elapsed);
+        }
+        stats.latencyMs += elapsed;
+        Record(elapsed);
+    }
+    if(count == 2) {
+        Flight &loser = flight[1-winner];
+        if(!loser.done)
+            Abandon(loser.ndx);
+        PQclear(loser.last);
+    }
+    return flight[winner].last;
+}
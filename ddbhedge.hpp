@@ -0,0 +1,110 @@
+/*! \file ddbhedge.hpp
+ * \brief Hedged reads over equivalent PostgreSQL connections. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#ifndef DDB_HEDGE_H_FILE
+#define DDB_HEDGE_H_FILE
+
+#include <vector>
+#include <chrono>
+#include "directdatabase.hpp"
+#include "ddbpostgre.hpp"
+
+//! Number of recent query latencies kept for the hedge delay.
+#define DDB_HEDGE_SAMPLES 1024
+//! Number of latencies needed before the percentile is used as the hedge delay.
+#define DDB_HEDGE_MIN_SAMPLES 32
+
+//! Statistics of DdbHedgedPostgre.
+struct DdbHedgeStats
+{
+    int64_t queries;        //!< Reads executed with hedging enabled.
+    int64_t hedged;         //!< Reads that were sent to a second connection.
+    int64_t hedgeWins;      //!< Hedged reads answered first by the second connection.
+    double latencyMs;       //!< Sum of the read latencies.
+    double savedMs;         //!< Estimated latency saved by the hedge wins.
+};
+
+// ==================================================================================================
+//! PostgreSQL connection that hedges reads over a set of equivalent connections.
+/*! The object is a connected DdbPostgre of its own and the peers given with AddPeer are
+    equivalent connections, e.g. to replicas of the same data. Reads (see DdbRouter::IsReadQuery)
+    outside transactions are sent to the connections in turn. If the answer has not arrived
+    within the hedge delay, the same query is sent to another idle connection. The first
+    successful answer is used and the other query is canceled. Writes and transactions use
+    only this object's own connection.
+
+    The hedge delay is the given percentile (default 95) of the recent read latencies, but at
+    least the minimum delay. Until enough latencies have been seen the initial delay is used.
+    Hedges are limited to the given share of the reads (default 10 %) so that a general
+    slowdown does not double the load.
+
+    Rowsets created from this object and the Execute...Function calls hedge automatically.
+    The saved latency of a hedge win is estimated as the mean of the recorded latencies longer
+    than the observed one, minus the observed one. The estimate is conservative since the
+    slowest reads are canceled before they finish.
+    \code
+    DdbHedgedPostgre pg;
+    pg.Connect("host=replica1 dbname=app");
+    DdbPostgre peer;
+    peer.Connect("host=replica2 dbname=app");
+    pg.AddPeer(&peer);
+    pg.ExecuteIntFunction("SELECT count(*) FROM item", count);
+    \endcode
+    Peers must not be used for anything else while they are attached.
+ */
+class DdbHedgedPostgre : public DdbPostgre
+{
+public:
+    DdbHedgedPostgre();
+    ~DdbHedgedPostgre();
+
+    void AddPeer(DdbPostgre *peer);
+    PGresult* Exec(const char *query);
+    uint64_t GetInsertId();
+    bool Cancel();
+
+    //! Sets the percentile of the latencies used as the hedge delay. Default is 95.
+    void SetHedgePercentile(int pct) { percentile = pct<1 ? 1 : (pct>99 ? 99 : pct); }
+    //! Sets the minimum hedge delay in milliseconds. Default is 2.
+    void SetMinDelay(int ms) { minDelay = ms>0 ? ms : 0; }
+    //! Sets the hedge delay used until enough latencies have been recorded. Default is 50 ms.
+    void SetInitialDelay(int ms) { initialDelay = ms>0 ? ms : 0; }
+    //! Sets the maximum share of the reads that may be hedged, in percent. Default is 10.
+    void SetMaxHedgeRate(int pct) { maxRate = pct<0 ? 0 : (pct>100 ? 100 : pct); }
+    //! Turns hedging off and on. Default is on.
+    void SetHedging(bool on) { hedging = on; }
+
+    double GetHedgeDelay();
+    //! Returns the statistics since the creation or ResetStats.
+    const DdbHedgeStats& GetStats() { return stats; }
+    void ResetStats();
+
+protected:
+    //! Connection taking part in the hedging.
+    struct Member {
+        DdbPostgre *db;
+        bool draining;          //!< True while a canceled query is still finishing.
+    };
+    PGconn* Conn(size_t ndx) { return ndx ? members[ndx].db->GetPGConn() : connection; }
+    bool Drain(size_t ndx, bool wait);
+    void Abandon(size_t ndx);
+    int Pick(int skip);
+    void Record(double ms);
+    double EstimateSaved(double ms);
+
+    std::vector<Member> members;    //!< This object first, then the peers.
+    size_t next;                    //!< Member to send the next read to.
+    std::vector<double> samples;    //!< Recent latencies in ms, a ring buffer.
+    size_t sampleCount;             //!< Latencies recorded in total.
+    double hedgeDelay;              //!< Current hedge delay in ms.
+    int percentile;
+    int minDelay;
+    int initialDelay;
+    int maxRate;
+    bool hedging;
+    DdbHedgeStats stats;
+};
+
+#endif
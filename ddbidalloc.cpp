@@ -0,0 +1,210 @@
+/*! \file ddbidalloc.cpp
+ * \brief Client side allocation of keys in blocks (hi/lo). */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#include "pch-stop.h"
+#include <stdio.h>
+#include <ctype.h>
+#include <cpp4scripts.hpp>
+#include "ddbidalloc.hpp"
+
+// ==================================================================================================
+DdbIdAllocator::DdbIdAllocator(DirectDatabase *db_in)
+    : db(db_in), blockSize(0), next(0), end(0)
+/*!
+  \param db_in Connection the blocks are reserved with. Not owned by the allocator.
+*/
+{
+}
+
+// ==================================================================================================
+bool DdbIdAllocator::IsName(const char *name)
+/*!
+  Accepts plain and schema qualified names. The names are placed into the SQL as such.
+*/
+{
+    if(!name || !*name)
+        return false;
+    for(; *name; name++) {
+        if(!isalnum((unsigned char)*name) && *name!='_' && *name!='.')
+            return false;
+    }
+    return true;
+}
+
+// ==================================================================================================
+bool DdbIdAllocator::SetSequence(const char *sequence_in)
+/*!
+  Reserves the blocks from a PostgreSQL sequence. The block size is the increment of the
+  sequence, which is read here.
+  \param sequence_in Name of the sequence.
+  \retval bool False if the sequence is not found or the database is not PostgreSQL.
+*/
+{
+    uint64_t increment = 0;
+    if(!db || db->GetType() != DDBTYPE_POSTGRES || !IsName(sequence_in)) {
+        CS_PRINT_ERRO("DdbIdAllocator::SetSequence - PostgreSQL sequence name required.");
+        return false;
+    }
+    std::string sql = "SELECT seqincrement FROM pg_sequence WHERE seqrelid = '";
+    sql += sequence_in;
+    sql += "'::regclass";
+    std::lock_guard<std::mutex> lock(mutex);
+    if(!db->ExecuteLongFunction(DDBSTR(sql.c_str()), increment) || (int64_t)increment < 1) {
+        CS_VAPRT_ERRO("DdbIdAllocator::SetSequence - Unable to read the increment of %s.", sequence_in);
+        return false;
+    }
+    if(increment == 1)
+        CS_VAPRT_WARN("DdbIdAllocator::SetSequence - Sequence %s reserves one key at a time.", sequence_in);
+    sequence = sequence_in;
+    table.clear();
+    blockSize = (int64_t)increment;
+    next = end = 0;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbIdAllocator::SetRangeTable(const char *table_in, const char *name_in, int blockSize_in)
+/*!
+  Reserves the blocks from a range table.
+  \param table_in Name of the table. See the class description for the columns.
+  \param name_in Name of the range, e.g. the name of the table the keys are for.
+  \param blockSize_in Number of keys reserved at a time.
+*/
+{
+    if(!db || !IsName(table_in) || !IsName(name_in) || blockSize_in < 1) {
+        CS_PRINT_ERRO("DdbIdAllocator::SetRangeTable - Invalid parameters.");
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    sequence.clear();
+    table = table_in;
+    name = name_in;
+    blockSize = blockSize_in;
+    next = end = 0;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbIdAllocator::FetchBlock()
+/*!
+  Reserves a new block. Caller holds the lock.
+*/
+{
+    if(!sequence.empty())
+        return FetchSequence();
+    if(!table.empty())
+        return FetchRange();
+    CS_PRINT_ERRO("DdbIdAllocator - Source of the keys has not been set.");
+    return false;
+}
+
+// ==================================================================================================
+bool DdbIdAllocator::FetchSequence()
+{
+    uint64_t value;
+    std::string sql = "SELECT nextval('" + sequence + "')";
+    if(!db->ExecuteLongFunction(DDBSTR(sql.c_str()), value)) {
+        CS_VAPRT_ERRO("DdbIdAllocator - nextval failed for %s.", sequence.c_str());
+        return false;
+    }
+    next = (int64_t)value;
+    end = next + blockSize;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbIdAllocator::FetchRange()
+/*!
+  Moves the range forward by a block. The row of the range is created if the update does not
+  find it. A concurrent client may create it first; the update is tried again then anyway.
+*/
+{
+    char number[24];
+    int64_t value;
+    snprintf(number, sizeof(number), "%lld", (long long)blockSize);
+    std::string update = "UPDATE " + table + " SET next_id = next_id + " + number
+        + " WHERE name = '" + name + "' RETURNING next_id";
+    std::string insert = "INSERT INTO " + table + "(name, next_id) VALUES('" + name + "', 1)";
+
+    DdbRowSet *rs = db->CreateRowSet();
+    if(!rs)
+        return false;
+    bool ok = false;
+    rs->Bind(DDBT_LONG, &value);
+    for(int attempt=0; attempt<2 && !ok; attempt++) {
+        if(!rs->QueryReturning(DDBSTR(update.c_str()), 0))
+            break;
+        if(rs->GetNext()) {
+            rs->QuitQuery();
+            next = value - blockSize;
+            end = value;
+            ok = true;
+        }
+        else if(attempt == 0)
+            db->ExecuteModify(DDBSTR(insert.c_str()));
+    }
+    delete rs;
+    if(!ok)
+        CS_VAPRT_ERRO("DdbIdAllocator - Unable to reserve keys from %s for %s.", table.c_str(), name.c_str());
+    return ok;
+}
+
+// ==================================================================================================
+bool DdbIdAllocator::Next(int64_t &id)
+/*!
+  Returns the next key. The database is accessed only when the block runs out.
+  \param id Receives the key.
+  \retval bool False if a new block could not be reserved.
+*/
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if(next == end && !FetchBlock())
+        return false;
+    id = next++;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbIdAllocator::Reserve(size_t count, std::vector<int64_t> &ids)
+/*!
+  Takes a number of keys at once, e.g. for a batch or a COPY. The keys are ascending but they
+  are not contiguous over the block boundaries.
+  \param count Number of keys.
+  \param ids Receives the keys. Cleared first.
+  \retval bool False if a block could not be reserved. The keys taken so far are lost then.
+*/
+{
+    ids.clear();
+    ids.reserve(count);
+    std::lock_guard<std::mutex> lock(mutex);
+    while(ids.size() < count) {
+        if(next == end && !FetchBlock())
+            return false;
+        while(next < end && ids.size() < count)
+            ids.push_back(next++);
+    }
+    return true;
+}
+
+// ==================================================================================================
+int64_t DdbIdAllocator::GetAvailable()
+/*!
+  Returns the number of keys left in the current block.
+*/
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return end - next;
+}
+
+// ==================================================================================================
+void DdbIdAllocator::Discard()
+/*!
+  Drops the rest of the current block, e.g. after the keys have been reset in the database.
+  The next key comes from a new block.
+*/
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    next = end = 0;
+}
@@ -0,0 +1,79 @@
+/*! \file ddbidalloc.hpp
+ * \brief Client side allocation of keys in blocks (hi/lo). */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#ifndef DDB_IDALLOC_H_FILE
+#define DDB_IDALLOC_H_FILE
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include "directdatabase.hpp"
+
+//! Default number of keys reserved at a time from a range table.
+#define DDB_ID_BLOCK 1000
+
+// ==================================================================================================
+//! Hands out keys from memory and reserves them from the database a block at a time.
+/*! The keys can be set into the rows before the insert, so the inserts need neither
+    GetInsertId nor RETURNING and a batch or a COPY can carry its keys. One round trip reserves
+    a whole block. The blocks come from one of two sources:
+
+    - A PostgreSQL sequence whose increment is the block size. Each nextval reserves the keys
+      from the returned value up to the next block. Plain nextval callers, e.g. a column
+      default, stay safe: each of them uses the first key of a block of its own.
+      \code
+      CREATE SEQUENCE item_id_seq INCREMENT BY 1000;
+      \endcode
+    - A range table, for the databases that return the rows of UPDATE .. RETURNING as a
+      result (PostgreSQL, SQLite 3.35 or later). The row of the name is created on the first
+      use.
+      \code
+      CREATE TABLE ddb_id_range(name VARCHAR(64) PRIMARY KEY, next_id BIGINT NOT NULL);
+      \endcode
+
+    The allocator is thread safe. It uses the connection only while it holds its lock; give it
+    a connection of its own if other threads use the same connection. The connection should not
+    be in a transaction: a rolled back block is reserved again, and an open transaction holds
+    the range row locked until it ends. The unused keys of the block are lost when the
+    allocator is deleted, so the keys have gaps.
+    \code
+    DdbIdAllocator ids(db);
+    ids.SetSequence("item_id_seq");
+    int64_t id;
+    if(ids.Next(id))
+        ...
+    std::vector<int64_t> keys;
+    ids.Reserve(rows.size(), keys);    // Keys for a COPY.
+    \endcode
+ */
+class DdbIdAllocator
+{
+public:
+    DdbIdAllocator(DirectDatabase *db);
+
+    bool SetSequence(const char *sequence);
+    bool SetRangeTable(const char *table, const char *name, int blockSize=DDB_ID_BLOCK);
+    bool Next(int64_t &id);
+    bool Reserve(size_t count, std::vector<int64_t> &ids);
+    int64_t GetAvailable();
+    void Discard();
+
+protected:
+    bool FetchBlock();
+    bool FetchSequence();
+    bool FetchRange();
+    static bool IsName(const char *name);
+
+    DirectDatabase *db;
+    std::mutex  mutex;          //!< Guards the block and the connection.
+    std::string sequence;       //!< Sequence name. Empty for the range table.
+    std::string table;          //!< Range table.
+    std::string name;           //!< Name of the row in the range table.
+    int64_t     blockSize;      //!< Keys per block.
+    int64_t     next;           //!< Next free key of the block.
+    int64_t     end;            //!< End of the block (exclusive).
+};
+
+#endif
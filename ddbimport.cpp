@@ -0,0 +1,585 @@
+/*! \file ddbimport.cpp
+ * \brief Parallel import of CSV files into PostgreSQL with COPY. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#include "pch-stop.h"
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#ifndef _WIN32
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+#include <cpp4scripts.hpp>
+#define __DDB_POSTGRE__
+#include "ddbimport.hpp"
+
+// ==================================================================================================
+static int64_t CountLines(const char *ptr, const char *end)
+{
+    int64_t count = 0;
+    while(ptr < end && (ptr = (const char*)memchr(ptr, '\n', end-ptr)) != 0) {
+        count++;
+        ptr++;
+    }
+    return count;
+}
+
+// ==================================================================================================
+static void Escape(const char *ptr, const char *end, std::string *out)
+/*!
+  Appends the value in the COPY text format: backslash, tab, line feed and carriage return are
+  escaped with a backslash.
+*/
+{
+    if(!out)
+        return;
+    const char *run = ptr;
+    for(; ptr<end; ptr++) {
+        char esc;
+        switch(*ptr) {
+        case '\\': esc = '\\'; break;
+        case '\t': esc = 't'; break;
+        case '\n': esc = 'n'; break;
+        case '\r': esc = 'r'; break;
+        default: continue;
+        }
+        out->append(run, ptr-run);
+        out->push_back('\\');
+        out->push_back(esc);
+        run = ptr+1;
+    }
+    out->append(run, end-run);
+}
+
+// ==================================================================================================
+DdbCsvImport::DdbCsvImport(const std::vector<DdbPostgre*> &sessions_in, const char *table_in, const char *columns_in)
+/*!
+  \param sessions_in Connected databases, one per parallel COPY session. Caller keeps the ownership.
+  \param table_in Target table. Used in the COPY command as is.
+  \param columns_in Comma separated target columns in the order of the fields. If null, the
+    header line or the table order is used.
+*/
+{
+    sessions = sessions_in;
+    table = table_in;
+    if(columns_in)
+        columns = columns_in;
+    delimiter = ',';
+    header = false;
+    single = false;
+    chunkSize = DDB_IMPORT_CHUNK;
+    maxErrors = 0;
+    errorFile = 0;
+    progress = 0;
+    progressContext = 0;
+    fieldCount = 0;
+    total = 0;
+    nextChunk = 0;
+    stop = false;
+    sent = 0;
+    window = 0;
+    done = 0;
+    rows = 0;
+    errorCount = 0;
+}
+
+// ==================================================================================================
+DdbCsvImport::~DdbCsvImport()
+{
+    if(errorFile)
+        fclose(errorFile);
+}
+
+// ==================================================================================================
+bool DdbCsvImport::SetErrorFile(const char *path)
+/*!
+  Sets the file that receives the rejected rows as they were in the input.
+  \retval bool False if the file cannot be created.
+*/
+{
+    if(errorFile)
+        fclose(errorFile);
+    errorFile = fopen(path, "wb");
+    if(!errorFile) {
+        CS_VAPRT_ERRO("DdbCsvImport::SetErrorFile - Unable to create %s", path);
+        return false;
+    }
+    return true;
+}
+
+// ==================================================================================================
+int64_t DdbCsvImport::Run(const char *path)
+/*!
+  Imports the file.
+  \param path CSV file to import.
+  \retval int64_t Number of rows imported or -1 if the import failed or was stopped because of
+    too many errors. In the parallel mode the chunks imported before the stop remain in the
+    table; GetRows tells how many rows they had.
+*/
+{
+    rows = 0;
+    done = 0;
+    errorCount = 0;
+    errors.clear();
+    chunks.clear();
+    stop = false;
+    nextChunk = 0;
+    sent = 0;
+    if(sessions.empty())
+        return -1;
+
+    // Map the input.
+    char *data = 0;
+    size_t size = 0;
+#ifdef _WIN32
+    FILE *fp = fopen(path, "rb");
+    if(fp) {
+        fseek(fp, 0, SEEK_END);
+        size = (size_t)ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        data = (char*) malloc(size ? size : 1);
+        if(data && fread(data, 1, size, fp) != size) {
+            free(data);
+            data = 0;
+        }
+        fclose(fp);
+    }
+#else
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if(fd >= 0 && fstat(fd, &st) == 0) {
+        size = (size_t)st.st_size;
+        if(size == 0)
+            data = (char*)"";
+        else {
+            void *map = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            data = map == MAP_FAILED ? 0 : (char*)map;
+        }
+    }
+    if(fd >= 0)
+        close(fd);
+#endif
+    if(!data) {
+        CS_VAPRT_ERRO("DdbCsvImport::Run - Unable to read %s", path);
+        return -1;
+    }
+    total = size;
+
+    const char *ptr = data;
+    const char *end = data + size;
+    if(size >= 3 && !memcmp(ptr, "\xEF\xBB\xBF", 3))
+        ptr += 3;
+    std::string reason;
+    std::string first;
+    const char *start = ptr;
+    if(header) {
+        fieldCount = ParseRow(ptr, end, &first, reason);
+        if(fieldCount > 0 && columns.empty()) {
+            // Names come in the COPY format: split at the tabs and undo the escapes.
+            std::string name;
+            for(size_t ndx=0; ndx<=first.length(); ndx++) {
+                if(ndx == first.length() || first[ndx] == '\t') {
+                    std::string quoted("\"");
+                    for(size_t pos=0; pos<name.length(); pos++) {
+                        if(name[pos] == '"')
+                            quoted += '"';
+                        quoted += name[pos];
+                    }
+                    columns += (columns.empty() ? "" : ", ") + quoted + "\"";
+                    name.clear();
+                }
+                else if(first[ndx] == '\\' && ndx+1 < first.length()) {
+                    ndx++;
+                    char ch = first[ndx];
+                    name += ch=='t' ? '\t' : ch=='n' ? '\n' : ch=='r' ? '\r' : ch;
+                }
+                else
+                    name += first[ndx];
+            }
+        }
+    }
+    else {
+        // The first row tells the number of fields. It is left to be imported.
+        const char *scan = ptr;
+        do {
+            fieldCount = ParseRow(scan, end, 0, reason);
+        } while(fieldCount == 0 && scan < end);
+    }
+    if(fieldCount <= 0) {
+        if(fieldCount < 0)
+            CS_VAPRT_ERRO("DdbCsvImport::Run - Unable to read the first line of %s: %s", path, reason.c_str());
+#ifdef _WIN32
+        free(data);
+#else
+        if(size)
+            munmap(data, size);
+#endif
+        return fieldCount < 0 ? -1 : 0;
+    }
+    command = "COPY " + table;
+    if(!columns.empty())
+        command += " (" + columns + ")";
+    command += " FROM STDIN";
+
+    Split(ptr, end-ptr, 1 + CountLines(start, ptr));
+    done = ptr - data;
+
+    std::vector<std::thread> threads;
+    if(single) {
+        DdbPostgre *db = sessions[0];
+        if(!db->StartTransaction())
+            stop = true;
+        unsigned converters = std::thread::hardware_concurrency();
+        if(converters < 2)
+            converters = 2;
+        window = 2*converters;
+        ready.assign(chunks.size(), 0);
+        for(unsigned ndx=0; ndx<converters && !stop; ndx++)
+            threads.push_back(std::thread(&DdbCsvImport::Converter, this));
+        // Send the chunks in order as the converters finish them.
+        for(size_t ndx=0; ndx<chunks.size() && !stop; ndx++) {
+            Converted *conv;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [&]{ return ready[ndx] != 0 || stop; });
+                if(stop)
+                    break;
+                conv = ready[ndx];
+                ready[ndx] = 0;
+            }
+            int stored = Send(0, *conv, 0, conv->source.size());
+            delete conv;
+            Done(chunks[ndx], stored);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                sent++;
+            }
+            cond.notify_all();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(stop)
+                cond.notify_all();
+        }
+        for(size_t ndx=0; ndx<threads.size(); ndx++)
+            threads[ndx].join();
+        for(size_t ndx=0; ndx<ready.size(); ndx++)
+            delete ready[ndx];
+        ready.clear();
+        if(db->IsTransaction()) {
+            if(stop)
+                db->RollBack();
+            else if(!db->Commit())
+                stop = true;
+        }
+        if(stop)
+            rows = 0;
+    }
+    else {
+        for(size_t ndx=0; ndx<sessions.size(); ndx++)
+            threads.push_back(std::thread(&DdbCsvImport::Worker, this, (int)ndx));
+        for(size_t ndx=0; ndx<threads.size(); ndx++)
+            threads[ndx].join();
+    }
+
+#ifdef _WIN32
+    free(data);
+#else
+    if(size)
+        munmap(data, size);
+#endif
+    if(errorFile)
+        fflush(errorFile);
+    return stop ? -1 : rows;
+}
+
+// ==================================================================================================
+void DdbCsvImport::Split(const char *data, size_t size, int64_t line)
+/*!
+  Splits the input into chunks of about chunkSize bytes. A chunk ends after a line feed that
+  is not inside a quoted value. Quotes are counted from the start, which is the only sequential
+  pass over the input.
+*/
+{
+    const char *ptr = data;
+    const char *end = data + size;
+    while(ptr < end) {
+        Chunk chunk;
+        chunk.begin = ptr;
+        chunk.line = line;
+        const char *cut = (size_t)(end-ptr) > chunkSize ? ptr+chunkSize : end;
+        bool quoted = false;
+        for(const char *scan=ptr; scan<cut && (scan = (const char*)memchr(scan, '"', cut-scan)) != 0; scan++)
+            quoted = !quoted;
+        while(cut < end) {
+            char ch = *cut++;
+            if(ch == '"')
+                quoted = !quoted;
+            else if(ch == '\n' && !quoted)
+                break;
+        }
+        chunk.end = cut;
+        line += CountLines(ptr, cut);
+        chunks.push_back(chunk);
+        ptr = cut;
+    }
+}
+
+// ==================================================================================================
+int DdbCsvImport::ParseRow(const char *&ptr, const char *end, std::string *out, std::string &reason)
+/*!
+  Parses one row and appends it in the COPY text format without the line feed.
+  \param ptr Start of the row. Moved to the start of the next row, also on error.
+  \param end End of the input.
+  \param out Receives the converted row. May be null to count the fields only.
+  \param reason Receives the reason on error.
+  \retval int Number of fields, zero for an empty line or -1 on error.
+*/
+{
+    const char *p = ptr;
+    if(p < end && (*p == '\n' || (*p == '\r' && p+1 < end && p[1] == '\n'))) {
+        ptr = p + (*p == '\r' ? 2 : 1);
+        return 0;
+    }
+    int fields = 0;
+    for(;;) {
+        if(fields && out)
+            out->push_back('\t');
+        fields++;
+        if(p < end && *p == '"') {
+            p++;
+            for(;;) {
+                const char *quote = (const char*)memchr(p, '"', end-p);
+                if(!quote) {
+                    reason = "Unterminated quoted value";
+                    ptr = end;
+                    return -1;
+                }
+                Escape(p, quote, out);
+                p = quote+1;
+                if(p < end && *p == '"') {
+                    if(out)
+                        out->push_back('"');
+                    p++;
+                    continue;
+                }
+                break;
+            }
+            if(p < end && *p == '\r' && p+1 < end && p[1] == '\n')
+                p++;
+            if(p < end && *p != delimiter && *p != '\n') {
+                reason = "Unexpected character after a quoted value";
+                const char *lf = (const char*)memchr(p, '\n', end-p);
+                ptr = lf ? lf+1 : end;
+                return -1;
+            }
+        }
+        else {
+            const char *start = p;
+            while(p < end && *p != delimiter && *p != '\n')
+                p++;
+            const char *stop = p;
+            if(stop > start && stop[-1] == '\r' && (p == end || *p == '\n'))
+                stop--;
+            if(stop == start) {
+                if(out)
+                    out->append("\\N");
+            }
+            else
+                Escape(start, stop, out);
+        }
+        if(p == end) {
+            ptr = end;
+            return fields;
+        }
+        if(*p++ == '\n') {
+            ptr = p;
+            return fields;
+        }
+    }
+}
+
+// ==================================================================================================
+void DdbCsvImport::Convert(const Chunk &chunk, Converted &conv)
+/*!
+  Converts the chunk into the COPY text format. Rows that cannot be parsed or have a wrong
+  number of fields are rejected.
+*/
+{
+    std::string reason;
+    conv.chunk = &chunk;
+    conv.data.clear();
+    conv.rows.clear();
+    conv.source.clear();
+    conv.data.reserve((chunk.end-chunk.begin) + (chunk.end-chunk.begin)/8);
+    const char *ptr = chunk.begin;
+    while(ptr < chunk.end && !stop) {
+        const char *row = ptr;
+        size_t mark = conv.data.size();
+        int count = ParseRow(ptr, chunk.end, &conv.data, reason);
+        if(count == 0)
+            continue;
+        if(count > 0 && count != fieldCount) {
+            char msg[80];
+            sprintf(msg, "Expected %d fields, found %d", fieldCount, count);
+            reason = msg;
+            count = -1;
+        }
+        if(count < 0) {
+            conv.data.resize(mark);
+            Reject(chunk, row, ptr, reason);
+            continue;
+        }
+        conv.data.push_back('\n');
+        conv.rows.push_back(mark);
+        conv.source.push_back(std::make_pair(row, ptr));
+    }
+    conv.rows.push_back(conv.data.size());
+}
+
+// ==================================================================================================
+int DdbCsvImport::Send(int session, Converted &conv, size_t first, size_t last)
+/*!
+  Copies rows first..last-1 of the converted chunk. If the server rejects them the range is
+  split in halves and both are sent again, until the rejected rows have been isolated.
+  \retval int Number of rows stored.
+*/
+{
+    if(first >= last || stop)
+        return 0;
+    std::string message;
+    int count = Copy(session, conv.data.data() + conv.rows[first], conv.rows[last] - conv.rows[first], message);
+    if(count >= 0)
+        return count;
+    if(count == -2) {
+        // The session is unusable. Retrying would only reject every row.
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+        cond.notify_all();
+        return 0;
+    }
+    if(last - first == 1) {
+        size_t lf = message.find('\n');
+        Reject(*conv.chunk, conv.source[first].first, conv.source[first].second, message.substr(0, lf));
+        return 0;
+    }
+    size_t middle = (first + last) / 2;
+    int stored = Send(session, conv, first, middle);
+    return stored + Send(session, conv, middle, last);
+}
+
+// ==================================================================================================
+int DdbCsvImport::Copy(int session, const char *data, size_t len, std::string &message)
+/*!
+  Sends the rows with one COPY. Inside a transaction the COPY is run under a savepoint so that
+  a rejected COPY does not abort the transaction.
+  \retval int Number of rows copied, -1 if the server rejected the data or -2 if the session
+    cannot be used.
+*/
+{
+    DdbPostgre *db = sessions[session];
+    bool nested = db->IsTransaction();
+    if(nested && !db->BeginNested())
+        return -2;
+    int count = -2;
+    if(db->CopyBegin(command)) {
+        if(db->CopyPut(data, len))
+            count = db->CopyEnd(&message);
+        else
+            db->CopyEnd();
+    }
+    if(nested) {
+        if(count >= 0)
+            db->CommitNested();
+        else
+            db->RollBackNested();
+    }
+    if(count == -2 || (count < 0 && !db->IsConnectOK())) {
+        CS_VAPRT_ERRO("DdbCsvImport::Copy - Session %d failed. Import is stopped.", session);
+        return -2;
+    }
+    return count;
+}
+
+// ==================================================================================================
+void DdbCsvImport::Reject(const Chunk &chunk, const char *begin, const char *end, const std::string &reason)
+/*!
+  Records a rejected row and stops the import when there are too many of them.
+*/
+{
+    DdbImportError error;
+    error.line = chunk.line + CountLines(chunk.begin, begin);
+    error.reason = reason;
+    std::lock_guard<std::mutex> lock(mutex);
+    errorCount++;
+    if((int)errors.size() <= maxErrors)
+        errors.push_back(error);
+    if(errorFile) {
+        fwrite(begin, 1, end-begin, errorFile);
+        if(end == begin || end[-1] != '\n')
+            fputc('\n', errorFile);
+    }
+    if(errorCount > maxErrors) {
+        if(!stop)
+            CS_VAPRT_WARN("DdbCsvImport - Too many rejected rows. Last at line %ld: %s", (long)error.line, reason.c_str());
+        stop = true;
+        cond.notify_all();
+    }
+}
+
+// ==================================================================================================
+void DdbCsvImport::Worker(int session)
+/*!
+  Parallel mode: converts and sends chunks until all have been taken.
+*/
+{
+    Converted conv;
+    for(;;) {
+        size_t ndx = nextChunk++;
+        if(ndx >= chunks.size() || stop)
+            break;
+        Convert(chunks[ndx], conv);
+        int count = Send(session, conv, 0, conv.source.size());
+        Done(chunks[ndx], count);
+    }
+}
+
+// ==================================================================================================
+void DdbCsvImport::Converter()
+/*!
+  Single transaction mode: converts chunks ahead of the sender, at most window chunks.
+*/
+{
+    for(;;) {
+        size_t ndx = nextChunk++;
+        if(ndx >= chunks.size())
+            break;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [&]{ return ndx < sent + window || stop; });
+            if(stop)
+                break;
+        }
+        Converted *conv = new Converted;
+        Convert(chunks[ndx], *conv);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready[ndx] = conv;
+        }
+        cond.notify_all();
+    }
+}
+
+// ==================================================================================================
+void DdbCsvImport::Done(const Chunk &chunk, int count)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    rows += count;
+    done += chunk.end - chunk.begin;
+    if(progress)
+        progress(progressContext, done, total, rows);
+}
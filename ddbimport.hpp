@@ -0,0 +1,147 @@
+/*! \file ddbimport.hpp
+ * \brief Parallel import of CSV files into PostgreSQL with COPY. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#ifndef DDB_IMPORT_H_FILE
+#define DDB_IMPORT_H_FILE
+
+#include <stdio.h>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "directdatabase.hpp"
+#include "ddbpostgre.hpp"
+
+//! Default size of the chunks the input is split into.
+#define DDB_IMPORT_CHUNK (8*1024*1024)
+
+//! Called after each imported chunk with the bytes processed, the input size and the rows imported.
+typedef void (*DdbImportProgress)(void *context, uint64_t done, uint64_t total, int64_t rows);
+
+//! Rejected input row.
+struct DdbImportError
+{
+    int64_t line;           //!< Line number of the row in the input file. First line is 1.
+    std::string reason;
+};
+
+// ==================================================================================================
+//! Imports a CSV file into a table using several PostgreSQL COPY sessions in parallel.
+/*! The input file is mapped into the memory and split into chunks at the line boundaries that
+    are not inside quoted values. Each session has a worker thread that takes the next chunk,
+    parses it, checks the field count and converts the rows into the COPY text format. The
+    chunk is then sent with one COPY, which commits it.
+
+    The input follows RFC 4180: fields are separated by the delimiter and may be quoted with
+    double quotes; a quote inside a quoted field is doubled. Empty unquoted field is null.
+    Lines may end with LF or CR LF. Empty lines are skipped.
+
+    A row that does not parse or has a wrong number of fields is rejected. If the server
+    rejects a COPY, the chunk is split in halves and resent until the failing rows have been
+    found. Rejected rows are written as is into the error file (SetErrorFile) and listed in
+    GetErrors. The import stops when more than SetMaxErrors rows have been rejected.
+
+    In the single transaction mode the chunks are still converted in parallel but they are sent
+    through the first session inside one transaction, each chunk under a savepoint. Nothing is
+    stored unless the whole import succeeds. PostgreSQL transactions cannot span connections,
+    so only one COPY session is used in this mode.
+    \code
+    std::vector<DdbPostgre*> sessions;   // e.g. 4 connected DdbPostgre objects.
+    DdbCsvImport import(sessions, "item");
+    import.SetHeader(true);
+    import.SetErrorFile("item.rejected.csv");
+    int64_t rows = import.Run("item.csv");
+    \endcode
+    Sessions must not be used by other threads during Run.
+ */
+class DdbCsvImport
+{
+public:
+    DdbCsvImport(const std::vector<DdbPostgre*> &sessions, const char *table, const char *columns=0);
+    virtual ~DdbCsvImport();
+
+    int64_t Run(const char *path);
+
+    //! Sets the field delimiter. Default is comma.
+    void SetDelimiter(char delim) { delimiter = delim; }
+    //! If true the first line holds the column names. They are used unless columns were given.
+    void SetHeader(bool header_in) { header = header_in; }
+    //! Sets the size of the chunks. Default is DDB_IMPORT_CHUNK.
+    void SetChunkSize(size_t size) { chunkSize = size < 4096 ? 4096 : size; }
+    //! Sets the single transaction mode. Default is off.
+    void SetSingleTransaction(bool single_in) { single = single_in; }
+    //! Sets the number of rejected rows that is tolerated. Default is zero.
+    void SetMaxErrors(int count) { maxErrors = count; }
+    bool SetErrorFile(const char *path);
+    //! Sets the progress callback. It is called from the worker threads, one call at a time.
+    void SetProgressCallback(DdbImportProgress cb, void *context) { progress = cb; progressContext = context; }
+
+    //! Returns the number of rows imported by the last run.
+    int64_t GetRows() { return rows; }
+    //! Returns the number of rejected rows.
+    int GetErrorCount() { return errorCount; }
+    //! Returns the rejected rows. At most SetMaxErrors+1 are listed.
+    const std::vector<DdbImportError>& GetErrors() { return errors; }
+
+protected:
+    //! Part of the input.
+    struct Chunk {
+        const char *begin;
+        const char *end;
+        int64_t line;                   //!< Line number of the first line.
+    };
+    //! Chunk converted into the COPY format.
+    struct Converted {
+        std::string data;
+        std::vector<size_t> rows;       //!< Offset of each row in data, followed by the data size.
+        std::vector<std::pair<const char*,const char*> > source; //!< Each row in the input.
+        const Chunk *chunk;
+    };
+
+    void Split(const char *data, size_t size, int64_t line);
+    int ParseRow(const char *&ptr, const char *end, std::string *out, std::string &reason);
+    void Convert(const Chunk &chunk, Converted &conv);
+    int Send(int session, Converted &conv, size_t first, size_t last);
+    virtual int Copy(int session, const char *data, size_t len, std::string &message);
+    void Reject(const Chunk &chunk, const char *begin, const char *end, const std::string &reason);
+    void Worker(int session);
+    void Converter();
+    void Done(const Chunk &chunk, int count);
+
+    std::vector<DdbPostgre*> sessions;
+    std::string table;
+    std::string columns;
+    std::string command;                //!< COPY command.
+    char delimiter;
+    bool header;
+    bool single;
+    size_t chunkSize;
+    int maxErrors;
+    FILE *errorFile;
+    DdbImportProgress progress;
+    void *progressContext;
+
+    int fieldCount;                     //!< Expected number of fields.
+    std::vector<Chunk> chunks;
+    uint64_t total;
+    std::atomic<size_t> nextChunk;
+    std::atomic<bool> stop;
+    std::mutex mutex;                   //!< Guards the members below.
+    std::condition_variable cond;       //!< Single transaction mode: signals ready and sent.
+    std::vector<Converted*> ready;      //!< Single transaction mode: converted chunks by index.
+    size_t sent;                        //!< Single transaction mode: chunks sent so far.
+    size_t window;                      //!< Single transaction mode: max. chunks converted ahead.
+    uint64_t done;
+    int64_t rows;
+    int errorCount;
+    std::vector<DdbImportError> errors;
+
+private:
+    DdbCsvImport(const DdbCsvImport&);
+    void operator=(const DdbCsvImport&);
+};
+
+#endif
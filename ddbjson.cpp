@@ -0,0 +1,516 @@
+/*! \file ddbjson.cpp
+ * \brief Streaming reader for the JSON columns bound with DDBT_JSON. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#include "pch-stop.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+#include <cpp4scripts.hpp>
+#include "directdatabase.hpp"
+
+//! Value of a hex digit or -1.
+static inline int HexNibble(char ch)
+{
+    if(ch >= '0' && ch <= '9')
+        return ch - '0';
+    ch |= 0x20;
+    if(ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    return -1;
+}
+
+static inline const char* SkipSpace(const char *ptr, const char *end)
+{
+    while(ptr < end && (*ptr == ' ' || *ptr == '\n' || *ptr == '\r' || *ptr == '\t'))
+        ptr++;
+    return ptr;
+}
+
+// ==================================================================================================
+bool DdbJsonReader::Parse(const char *text, size_t len, DdbJsonHandler &handler)
+/*!
+  Parses a JSON document and calls the handler for each part of it.
+  \param text Document. Need not be null terminated.
+  \param len Length of the document.
+  \param handler Handler for the parts.
+  \retval bool True if the document was valid or the handler stopped the parsing. False on a
+    syntax error; see GetErrorOffset.
+*/
+{
+    enum { VALUE, AFTER_VALUE, KEY } state = VALUE;
+    const char *ptr = text, *end = text + len;
+    const char *str;
+    size_t slen;
+
+    stack.clear();
+    errorOffset = 0;
+    for(;;) {
+        ptr = SkipSpace(ptr, end);
+        if(state == AFTER_VALUE) {
+            if(stack.empty()) {
+                if(ptr == end)
+                    return true;
+                break;
+            }
+            if(ptr == end)
+                break;
+            char ch = *ptr++;
+            if(ch == ',')
+                state = stack.back() == '{' ? KEY : VALUE;
+            else if(ch == '}' && stack.back() == '{') {
+                stack.pop_back();
+                if(!handler.EndObject())
+                    return true;
+            }
+            else if(ch == ']' && stack.back() == '[') {
+                stack.pop_back();
+                if(!handler.EndArray())
+                    return true;
+            }
+            else {
+                ptr--;
+                break;
+            }
+            continue;
+        }
+        if(ptr == end)
+            break;
+        if(state == KEY) {
+            if(*ptr != '"' || !(ptr = ParseString(ptr, end, str, slen)))
+                break;
+            ptr = SkipSpace(ptr, end);
+            if(ptr == end || *ptr != ':')
+                break;
+            ptr++;
+            if(!handler.Key(str, slen))
+                return true;
+            state = VALUE;
+            continue;
+        }
+        // A value.
+        bool more = true;
+        const char *start = ptr;
+        state = AFTER_VALUE;
+        switch(*ptr) {
+        case '{':
+            more = handler.StartObject();
+            ptr = SkipSpace(ptr+1, end);
+            if(ptr < end && *ptr == '}') {
+                ptr++;
+                more = more && handler.EndObject();
+            }
+            else {
+                stack.push_back('{');
+                state = KEY;
+            }
+            break;
+        case '[':
+            more = handler.StartArray();
+            ptr = SkipSpace(ptr+1, end);
+            if(ptr < end && *ptr == ']') {
+                ptr++;
+                more = more && handler.EndArray();
+            }
+            else {
+                stack.push_back('[');
+                state = VALUE;
+            }
+            break;
+        case '"':
+            ptr = ParseString(ptr, end, str, slen);
+            if(ptr)
+                more = handler.String(str, slen);
+            break;
+        case 't':
+            ptr = end - ptr >= 4 && memcmp(ptr, "true", 4) == 0 ? ptr+4 : 0;
+            if(ptr)
+                more = handler.Bool(true);
+            break;
+        case 'f':
+            ptr = end - ptr >= 5 && memcmp(ptr, "false", 5) == 0 ? ptr+5 : 0;
+            if(ptr)
+                more = handler.Bool(false);
+            break;
+        case 'n':
+            ptr = end - ptr >= 4 && memcmp(ptr, "null", 4) == 0 ? ptr+4 : 0;
+            if(ptr)
+                more = handler.Null();
+            break;
+        default:
+            ptr = ParseNumber(ptr, end);
+            if(ptr)
+                more = handler.Number(start, ptr - start);
+            break;
+        }
+        if(!ptr) {
+            ptr = start;
+            break;
+        }
+        if(!more)
+            return true;
+    }
+    errorOffset = ptr - text;
+    return false;
+}
+
+// ==================================================================================================
+const char* DdbJsonReader::ParseString(const char *ptr, const char *end, const char *&str, size_t &len)
+/*!
+  Parses a string that starts at the quote. A string without escapes is returned from the input,
+  other strings are unescaped into the scratch buffer.
+  \retval char* Position after the closing quote or null on error.
+*/
+{
+    const char *start = ++ptr;
+    while(ptr < end && *ptr != '"' && *ptr != '\\') {
+        if((unsigned char)*ptr < 0x20)
+            return 0;
+        ptr++;
+    }
+    if(ptr == end)
+        return 0;
+    if(*ptr == '"') {
+        str = start;
+        len = ptr - start;
+        return ptr+1;
+    }
+    scratch.assign(start, ptr - start);
+    while(ptr < end && *ptr != '"') {
+        if((unsigned char)*ptr < 0x20)
+            return 0;
+        if(*ptr != '\\') {
+            scratch += *ptr++;
+            continue;
+        }
+        if(++ptr == end)
+            return 0;
+        switch(*ptr++) {
+        case '"':  scratch += '"'; break;
+        case '\\': scratch += '\\'; break;
+        case '/':  scratch += '/'; break;
+        case 'b':  scratch += '\b'; break;
+        case 'f':  scratch += '\f'; break;
+        case 'n':  scratch += '\n'; break;
+        case 'r':  scratch += '\r'; break;
+        case 't':  scratch += '\t'; break;
+        case 'u': {
+            unsigned long code = 0;
+            for(int pass=0; pass<2; pass++) {
+                unsigned long unit = 0;
+                if(end - ptr < 4)
+                    return 0;
+                for(int ndx=0; ndx<4; ndx++) {
+                    int nibble = HexNibble(*ptr++);
+                    if(nibble < 0)
+                        return 0;
+                    unit = unit<<4 | nibble;
+                }
+                if(pass == 0) {
+                    code = unit;
+                    // A high surrogate must be followed by the low one. A low one alone is invalid.
+                    if(code >= 0xDC00 && code <= 0xDFFF)
+                        return 0;
+                    if(code < 0xD800 || code > 0xDBFF)
+                        break;
+                    if(end - ptr < 2 || ptr[0] != '\\' || ptr[1] != 'u')
+                        return 0;
+                    ptr += 2;
+                }
+                else {
+                    if(unit < 0xDC00 || unit > 0xDFFF)
+                        return 0;
+                    code = 0x10000 + ((code - 0xD800)<<10) + (unit - 0xDC00);
+                }
+            }
+            if(code < 0x80)
+                scratch += (char)code;
+            else if(code < 0x800) {
+                scratch += (char)(0xC0 | code>>6);
+                scratch += (char)(0x80 | (code & 0x3F));
+            }
+            else if(code < 0x10000) {
+                scratch += (char)(0xE0 | code>>12);
+                scratch += (char)(0x80 | (code>>6 & 0x3F));
+                scratch += (char)(0x80 | (code & 0x3F));
+            }
+            else {
+                scratch += (char)(0xF0 | code>>18);
+                scratch += (char)(0x80 | (code>>12 & 0x3F));
+                scratch += (char)(0x80 | (code>>6 & 0x3F));
+                scratch += (char)(0x80 | (code & 0x3F));
+            }
+            break;
+        }
+        default:
+            return 0;
+        }
+    }
+    if(ptr == end)
+        return 0;
+    str = scratch.data();
+    len = scratch.length();
+    return ptr+1;
+}
+
+// ==================================================================================================
+const char* DdbJsonReader::ParseNumber(const char *ptr, const char *end)
+/*!
+  Checks the syntax of a number: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+  \retval char* Position after the number or null on error.
+*/
+{
+    if(ptr < end && *ptr == '-')
+        ptr++;
+    if(ptr == end || *ptr < '0' || *ptr > '9')
+        return 0;
+    if(*ptr++ != '0') {
+        while(ptr < end && *ptr >= '0' && *ptr <= '9')
+            ptr++;
+    }
+    if(ptr < end && *ptr == '.') {
+        if(++ptr == end || *ptr < '0' || *ptr > '9')
+            return 0;
+        while(ptr < end && *ptr >= '0' && *ptr <= '9')
+            ptr++;
+    }
+    if(ptr < end && (*ptr == 'e' || *ptr == 'E')) {
+        if(++ptr < end && (*ptr == '+' || *ptr == '-'))
+            ptr++;
+        if(ptr == end || *ptr < '0' || *ptr > '9')
+            return 0;
+        while(ptr < end && *ptr >= '0' && *ptr <= '9')
+            ptr++;
+    }
+    return ptr;
+}
+
+// ==================================================================================================
+bool DdbJsonPaths::Bind(const char *path_in, short int type, void *data)
+/*!
+  Binds a variable to a path.
+  \param path_in Path, e.g. "items[0].price". A leading "$." is accepted.
+  \param type DDBT_INT, DDBT_LONG, DDBT_NUM, DDBT_DEC, DDBT_BOOL or DDBT_STR.
+  \param data Pointer to the variable.
+  \retval bool False if the type is not supported or the path is empty.
+*/
+{
+    if(!path_in || !data)
+        return false;
+    if(type != DDBT_INT && type != DDBT_LONG && type != DDBT_NUM && type != DDBT_DEC
+       && type != DDBT_BOOL && type != DDBT_STR)
+        return false;
+    if(path_in[0] == '$')
+        path_in++;
+    if(!*path_in)
+        return false;
+    Target target;
+    // Normalize into the form used for the current path: each key starts with a dot.
+    if(*path_in != '.' && *path_in != '[')
+        target.path = ".";
+    target.path += path_in;
+    target.type = type;
+    target.data = data;
+    target.found = false;
+    targets.push_back(target);
+    return true;
+}
+
+// ==================================================================================================
+void DdbJsonPaths::StartDocument()
+/*!
+  Clears the bound variables.
+*/
+{
+    levels.clear();
+    path.clear();
+    found = 0;
+    for(size_t ndx=0; ndx<targets.size(); ndx++)
+        Clear(&targets[ndx]);
+}
+
+// ==================================================================================================
+void DdbJsonPaths::EnterValue()
+/*!
+  Appends the index into the path for a value in an array.
+*/
+{
+    if(levels.empty() || levels.back().index < 0)
+        return;
+    char buffer[16];
+    path.resize(levels.back().base);
+    path.append(buffer, snprintf(buffer, sizeof(buffer), "[%d]", levels.back().index++));
+}
+
+// ==================================================================================================
+bool DdbJsonPaths::StartObject()
+{
+    EnterValue();
+    Level level = { path.length(), -1 };
+    levels.push_back(level);
+    return true;
+}
+
+// ==================================================================================================
+bool DdbJsonPaths::EndObject()
+{
+    path.resize(levels.back().base);
+    levels.pop_back();
+    return true;
+}
+
+// ==================================================================================================
+bool DdbJsonPaths::StartArray()
+{
+    EnterValue();
+    Level level = { path.length(), 0 };
+    levels.push_back(level);
+    return true;
+}
+
+// ==================================================================================================
+bool DdbJsonPaths::EndArray()
+{
+    path.resize(levels.back().base);
+    levels.pop_back();
+    return true;
+}
+
+// ==================================================================================================
+bool DdbJsonPaths::Key(const char *str, size_t len)
+{
+    path.resize(levels.back().base);
+    path += '.';
+    path.append(str, len);
+    return true;
+}
+
+// ==================================================================================================
+DdbJsonPaths::Target* DdbJsonPaths::FindTarget()
+{
+    for(size_t ndx=0; ndx<targets.size(); ndx++) {
+        if(targets[ndx].path == path)
+            return &targets[ndx];
+    }
+    return 0;
+}
+
+// ==================================================================================================
+bool DdbJsonPaths::String(const char *str, size_t len)
+{
+    EnterValue();
+    Target *target = FindTarget();
+    if(target)
+        Store(target, str, len, true);
+    // Stop reading when all the paths have been found.
+    return found < (int)targets.size();
+}
+
+// ==================================================================================================
+bool DdbJsonPaths::Number(const char *str, size_t len)
+{
+    EnterValue();
+    Target *target = FindTarget();
+    if(target)
+        Store(target, str, len, false);
+    return found < (int)targets.size();
+}
+
+// ==================================================================================================
+bool DdbJsonPaths::Bool(bool value)
+{
+    EnterValue();
+    Target *target = FindTarget();
+    if(target)
+        Store(target, value ? "true" : "false", value ? 4 : 5, true);
+    return found < (int)targets.size();
+}
+
+// ==================================================================================================
+bool DdbJsonPaths::Null()
+{
+    EnterValue();
+    return true;
+}
+
+// ==================================================================================================
+void DdbJsonPaths::Store(Target *target, const char *str, size_t len, bool isString)
+/*!
+  Converts the text of a string or a number into the bound variable.
+*/
+{
+    if(target->type == DDBT_STR) {
+#ifdef DDB_USESTL
+        static_cast<std::string*>(target->data)->assign(str, len);
+#else
+        *(static_cast<wxString*>(target->data)) = wxString::FromUTF8(str, len);
+#endif
+    }
+    else if(target->type == DDBT_DEC)
+        static_cast<DdbDecimal*>(target->data)->Parse(str, len);
+    else
+        StoreNumber(target, str, len, isString);
+    if(!target->found) {
+        target->found = true;
+        found++;
+    }
+}
+
+// ==================================================================================================
+void DdbJsonPaths::StoreNumber(Target *target, const char *str, size_t len, bool isString)
+/*!
+  Converts the text into an int, long, double or bool variable. Short texts are converted from
+  a stack buffer, longer ones, e.g. numbers with many decimals, from a temporary string.
+*/
+{
+    char buffer[64];
+    std::string text;
+    char *number = buffer;
+    if(len < sizeof(buffer)) {
+        memcpy(buffer, str, len);
+        buffer[len] = 0;
+    }
+    else {
+        text.assign(str, len);
+        number = &text[0];
+    }
+    switch(target->type) {
+    case DDBT_INT:
+        *(static_cast<int*>(target->data)) = (int)strtol(number,0,10);
+        break;
+    case DDBT_LONG:
+        *(static_cast<int64_t*>(target->data)) = strtoll(number,0,10);
+        break;
+    case DDBT_NUM: {
+        char *stop;
+        double value = strtod(number,&stop);
+        // JSON has always a decimal point. Parse again if the locale uses a comma.
+        if(*stop == '.') {
+            *stop = *localeconv()->decimal_point;
+            value = strtod(number,0);
+        }
+        *(static_cast<double*>(target->data)) = value;
+        break;
+    }
+    case DDBT_BOOL:
+        *(static_cast<bool*>(target->data)) = isString ? (number[0]=='t' || number[0]=='1') : strtod(number,0) != 0;
+        break;
+    }
+}
+
+// ==================================================================================================
+void DdbJsonPaths::Clear(Target *target)
+{
+    target->found = false;
+    // DDB_TYPE_USED
+    switch(target->type) {
+    case DDBT_INT:  *(static_cast<int*>(target->data)) = 0; break;
+    case DDBT_LONG: *(static_cast<int64_t*>(target->data)) = 0; break;
+    case DDBT_NUM:  *(static_cast<double*>(target->data)) = 0; break;
+    case DDBT_DEC:  static_cast<DdbDecimal*>(target->data)->Clear(); break;
+    case DDBT_BOOL: *(static_cast<bool*>(target->data)) = false; break;
+    case DDBT_STR:  static_cast<DDBSTR*>(target->data)->CLEAR(); break;
+    }
+}
@@ -0,0 +1,131 @@
+/*! \file ddbjson.hpp
+ * \brief Streaming reader for the JSON columns bound with DDBT_JSON. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#ifndef DDB_JSON_H_FILE
+#define DDB_JSON_H_FILE
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// ==================================================================================================
+//! Receives the parts of a JSON document in the document order (SAX style).
+/*! A handler is bound to a json / jsonb column with DDBT_JSON and it is called from GetNext with
+    the bytes of the cell, so the document is neither copied into a string nor built into a tree.
+    The strings and numbers point into the cell or into a scratch buffer and they are valid during
+    the call only. The strings are unescaped UTF-8 and not null terminated. Numbers are passed as
+    their text, as they appear in the document.
+
+    A callback returns false to stop reading the rest of the document. Bind the handler through
+    a DdbJsonHandler pointer:
+    \code
+    MyHandler handler;
+    rs->Bind(DDBT_INT, &id);
+    rs->Bind(DDBT_JSON, static_cast<DdbJsonHandler*>(&handler));
+    \endcode
+ */
+class DdbJsonHandler
+{
+public:
+    virtual ~DdbJsonHandler() {}
+
+    //! Called for each row before the document, also when the column is NULL.
+    virtual void StartDocument() {}
+    virtual bool StartObject() { return true; }
+    virtual bool EndObject() { return true; }
+    virtual bool StartArray() { return true; }
+    virtual bool EndArray() { return true; }
+    virtual bool Key(const char *, size_t) { return true; }
+    virtual bool String(const char *, size_t) { return true; }
+    virtual bool Number(const char *, size_t) { return true; }
+    virtual bool Bool(bool) { return true; }
+    virtual bool Null() { return true; }
+};
+
+// ==================================================================================================
+//! Parses JSON text and calls a handler for its parts.
+/*! The parser does not recurse, so the depth of the document is not limited by the stack. Strings
+    without escapes are passed to the handler directly from the input. The buffers are kept
+    between the documents; the rowsets keep one reader for all the rows.
+ */
+class DdbJsonReader
+{
+public:
+    DdbJsonReader() : errorOffset(0) {}
+
+    bool Parse(const char *text, size_t len, DdbJsonHandler &handler);
+    //! Returns the offset of the syntax error found by the last Parse.
+    size_t GetErrorOffset() { return errorOffset; }
+
+protected:
+    const char* ParseString(const char *ptr, const char *end, const char *&str, size_t &len);
+    const char* ParseNumber(const char *ptr, const char *end);
+
+    std::string scratch;        //!< Unescaped string.
+    std::vector<char> stack;    //!< Open containers, '{' or '['.
+    size_t errorOffset;
+};
+
+// ==================================================================================================
+//! Handler that extracts values from a set of paths into bound variables in a single pass.
+/*! A path has the keys separated by dots and the array indexes in brackets, e.g.
+    "customer.name" or "items[0].price". The variables are bound as in DdbRowSet::Bind with
+    DDBT_INT, DDBT_LONG, DDBT_NUM, DDBT_DEC, DDBT_BOOL or DDBT_STR. The values are converted from
+    the strings and numbers as needed; a missing or null value clears the variable.
+    \code
+    DdbJsonPaths paths;
+    paths.Bind("customer.name", DDBT_STR, &name);
+    paths.Bind("total", DDBT_DEC, &total);
+    rs->Bind(DDBT_JSON, static_cast<DdbJsonHandler*>(&paths));
+    while(rs->GetNext())
+        ...
+    \endcode
+    The object and the array values are not extracted. Keys with dots or brackets can not be
+    addressed.
+ */
+class DdbJsonPaths : public DdbJsonHandler
+{
+public:
+    DdbJsonPaths() : found(0) {}
+
+    bool Bind(const char *path, short int type, void *data);
+    //! Returns the number of bound paths found in the last document.
+    int GetFoundCount() { return found; }
+
+    void StartDocument();
+    bool StartObject();
+    bool EndObject();
+    bool StartArray();
+    bool EndArray();
+    bool Key(const char *str, size_t len);
+    bool String(const char *str, size_t len);
+    bool Number(const char *str, size_t len);
+    bool Bool(bool value);
+    bool Null();
+
+protected:
+    struct Target {
+        std::string path;   //!< Path in the form .key[0].key
+        short int type;
+        void *data;
+        bool found;         //!< True if the value was found in the current document.
+    };
+    struct Level {
+        size_t base;        //!< Length of the path of the container.
+        int index;          //!< Index of the next array element. -1 for an object.
+    };
+    void EnterValue();
+    Target* FindTarget();
+    void Store(Target *target, const char *str, size_t len, bool isString);
+    void StoreNumber(Target *target, const char *str, size_t len, bool isString);
+    void Clear(Target *target);
+
+    std::vector<Target> targets;
+    std::vector<Level> levels;
+    std::string path;       //!< Path of the current value.
+    int found;
+};
+
+#endif
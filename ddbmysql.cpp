@@ -346,9 +346,9 @@ bool DdbMySql::UpdateStructure(const DDBSTR &command)
 }
 
 // ==================================================================================================
-unsigned long DdbMySql::GetInsertId()
+uint64_t DdbMySql::GetInsertId()
 {
     if( (flags & DDB_FLAG_CONNECTED) > 0)
-        return (unsigned long) mysql_insert_id(&connection);
+        return (uint64_t) mysql_insert_id(&connection);
     return 0;
 }
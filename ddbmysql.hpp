@@ -36,7 +36,7 @@ public:
     bool ExecuteStrFunction(const DDBSTR &query, DDBSTR &result);
     bool ExecuteDateFunction(const DDBSTR &query, DDBTIME &val);
     int ExecuteModify(const DDBSTR &query);
-    unsigned long GetInsertId();
+    uint64_t GetInsertId();
     bool UpdateStructure(const DDBSTR &command);
 
 protected:
@@ -53,6 +53,7 @@ class DdbMySqlRowSet : public DdbRowSet
 public:
     ~DdbMySqlRowSet();
 
+    bool Bind(short int type, void *data);
     bool Query(const DDBSTR &query);
     int GetNext();
     void QuitQuery();
@@ -66,6 +67,7 @@ protected:
     int         currentRow;     //!< The number of the current row in the rowset.
     MYSQL_RES  *result;         //!< Pointer to the result structure.
     bool        resultCleared;  //!< True if the result has been cleared.
+    DdbJsonReader jsonReader;   //!< Reader for the DDBT_JSON fields.
 };
 
 
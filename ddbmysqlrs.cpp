@@ -18,6 +18,7 @@ Copyright (c) Antti Merenluoto
 #else
 #include <fstream>
 #endif
+#include <cpp4scripts.hpp>
 #define __DDB_MYSQL__
 #include "directdatabase.hpp"
 
@@ -48,6 +49,18 @@ DdbMySqlRowSet::~DdbMySqlRowSet()
         mysql_free_result(result);
 }
 
+// ==================================================================================================
+bool DdbMySqlRowSet::Bind(short int type, void *data)
+/*!
+  Binds a variable as DdbRowSet::Bind. In addition a JSON column can be bound with DDBT_JSON to
+  a DdbJsonHandler pointer.
+*/
+{
+    if(type == DDBT_JSON)
+        return data && InsertField(new DdbBoundField(type,data));
+    return DdbRowSet::Bind(type, data);
+}
+
 // ==================================================================================================
 bool DdbMySqlRowSet::Query(const DDBSTR &query)
 {
@@ -104,11 +117,13 @@ int DdbMySqlRowSet::GetNext()
         maxFields = 0;
         return 0;
     }
+    unsigned long *lengths = mysql_fetch_lengths(result);
     field = fieldRoot;
     nField = 0;
     count=0;
     while(field && nField < maxFields)
     {
+        field->null = !row[nField];
         // Use type to convert the data. DDB_TYPE_USED
         switch(field->type)
         {
@@ -230,6 +245,57 @@ int DdbMySqlRowSet::GetNext()
             *(static_cast<char*>(field->data)) = row[nField][0];
             count++;
             break;
+        case DDBT_LONG:
+            if(!row[nField])
+                *(static_cast<int64_t*>(field->data)) = 0;
+            else
+            {
+                *(static_cast<int64_t*>(field->data)) = strtoll(row[nField],0,10);
+                count++;
+            }
+            break;
+        case DDBT_DEC:
+            if(!row[nField])
+                static_cast<DdbDecimal*>(field->data)->Clear();
+            else
+            {
+                static_cast<DdbDecimal*>(field->data)->Parse(row[nField], lengths[nField]);
+                count++;
+            }
+            break;
+        case DDBT_UUID:
+            if(!row[nField])
+                static_cast<DdbUuid*>(field->data)->Clear();
+            else
+            {
+                // BINARY(16) or the text from UUID().
+                if(lengths[nField] == 16)
+                    memcpy(static_cast<DdbUuid*>(field->data)->bytes, row[nField], 16);
+                else
+                    static_cast<DdbUuid*>(field->data)->Parse(row[nField], lengths[nField]);
+                count++;
+            }
+            break;
+        case DDBT_BLOB:
+            if(!row[nField])
+                static_cast<DdbBlob*>(field->data)->clear();
+            else
+            {
+                static_cast<DdbBlob*>(field->data)->assign((uint8_t*)row[nField], (uint8_t*)row[nField] + lengths[nField]);
+                count++;
+            }
+            break;
+        case DDBT_JSON: {
+            DdbJsonHandler *handler = static_cast<DdbJsonHandler*>(field->data);
+            handler->StartDocument();
+            if(row[nField])
+            {
+                if(!jsonReader.Parse(row[nField], lengths[nField], *handler))
+                    CS_VAPRT_WARN("DdbMySqlRowSet::GetNext - Invalid JSON at offset %zu.",jsonReader.GetErrorOffset());
+                count++;
+            }
+            break;
+        }
         }
 
         field = field->next;
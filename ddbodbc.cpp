@@ -1,532 +1,869 @@
-/*******************************************************************************
-ddbodbc.cpp
-Copyright (c) Antti Merenluoto
-*******************************************************************************/
-
-#ifdef __linux__
-    #error Not supported currently.
-#endif
-
-#include "pch-stop.h"
-#ifdef DDB_USEWX
-#include <wx/wxprec.h>
-  #ifndef WX_PRECOMP
-    #include <wx/wx.h>
-  #endif
-#endif
-#define __DDB_ODBCWIN__
-#include "directdatabase.hpp"
-
-// ==================================================================================================
-DdbOdbc::DdbOdbc()
-/*!
-  Constructs database object for the connection to the ODBC databases.
-  Please note that 3.x specification is followed.
-*/
-{
-    hConnection = SQL_NULL_HANDLE;
-    execStmt = SQL_NULL_HANDLE;
-    flags = 0;
-    feature = 0;
-
-    SQLAllocHandle(SQL_HANDLE_ENV,SQL_NULL_HANDLE,&hEnvironment);
-    SQLSetEnvAttr(hEnvironment,SQL_ATTR_ODBC_VERSION,(SQLPOINTER)SQL_OV_ODBC3,0);
-}
-
-// ==================================================================================================
-DdbOdbc::~DdbOdbc()
-/*!
-    Closes up the database connection and on Windows closes socket services.
-*/
-{
-    if(flags & DDB_FLAG_CONNECTED)
-        Disconnect();
-    SQLFreeHandle(SQL_HANDLE_ENV,hEnvironment);
-}
-
-// ==================================================================================================
-bool DdbOdbc::Connect(int timeout)
-{
-    char connectStr[1024],connectOut[1024];
-    SQLCHAR *sqlUser,*sqlPwd;
-    SQLSMALLINT sqlUserLen, sqlPwdLen,conOutLen;
-    SQLRETURN retval;
-    ostringstream ss;
-
-    // Safety checks
-    if(!(flags&DDB_FLAG_INITIALIZED))
-    {
-        SetErrorId(11);
-        return false;
-    }
-    if(srvName.LENGTH()==0 || dbName.LENGTH()==0)
-    {
-        SetErrorId(3);
-        return false;
-    }
-
-    if(flags & DDB_FLAG_CONNECTED)
-        Disconnect();
-
-    // Allocate connection hanle
-    retval = SQLAllocHandle(SQL_HANDLE_DBC,hEnvironment,&hConnection);
-    if(!SQLSUCCESS(retval))
-    {
-        ss << "wxDdbOdbc::Connect - SQLAllocHandle failure " <<retval;
-        Log(ss);
-        return false;
-    }
-    // Set the timeout if user so desired.
-    if(timeout)
-    {
-        SQLUINTEGER sqlTO=timeout;
-        retval = SQLSetConnectAttr(hConnection,SQL_ATTR_CONNECTION_TIMEOUT,&sqlTO,0);
-        if(!SQLSUCCESS(retval))
-            ss << "DdbOdbc::Connect - Set connection timeout failure " << retval;
-        retval = SQLSetConnectAttr(hConnection,SQL_ATTR_LOGIN_TIMEOUT,&sqlTO,0);
-        if(!SQLSUCCESS(retval))
-            ss << "DdbOdbc::Connect - Set connection login failure " << retval;
-        Log(ss);
-        return false;
-    }
-
-    bool dsnUsed = srvName == "DSN" ? true:false;
-    if(dsnUsed)
-        strcpy(connectStr,dbName.DATA());
-    else
-        sprintf(connectStr,"DRIVER={%s};DBQ=%s;",srvName.DATA(),dbName.DATA());
-
-    // Get user id and the password
-    if(userid.LENGTH()==0)
-    {
-        sqlUser = 0;
-        sqlUserLen = 0;
-    }
-    else
-    {
-        sqlUser = (SQLCHAR*) userid.DATA();
-        sqlUserLen = (SQLSMALLINT) userid.LENGTH();
-        if(!dsnUsed)
-        {
-            strcat(connectStr,"UID=");
-            strcat(connectStr,(char*)sqlUser);
-            strcat(connectStr,";");
-        }
-    }
-    if(pwd.LENGTH()==0)
-    {
-        sqlPwd = 0;
-        sqlPwdLen = 0;
-    }
-    else
-    {
-        sqlPwd = (SQLCHAR*)pwd.DATA();
-        sqlPwdLen = (SQLSMALLINT) pwd.LENGTH();
-        if(!dsnUsed)
-        {
-            strcat(connectStr,"PWD=");
-            strcat(connectStr,(char*)sqlPwd);
-            strcat(connectStr,";");
-        }
-    }
-
-    // Finally, the connection
-    if(dsnUsed)
-        retval = SQLConnect(hConnection,(SQLCHAR*)connectStr,strlen(connectStr),sqlUser,sqlUserLen,sqlPwd,sqlPwdLen);
-    else
-        retval = SQLDriverConnect(hConnection,0,(SQLCHAR*)connectStr,strlen(connectStr),
-                                  (SQLCHAR*)connectOut,sizeof(connectOut),&conOutLen,SQL_DRIVER_NOPROMPT);
-
-    if(!SQLSUCCESS(retval))
-    {
-        SetErrorId(4);
-        ostringstream errorStr;
-        errorStr << GetErrorDescription(0).DATA();
-        Log(errorStr);
-        SQLFreeHandle(SQL_HANDLE_DBC,hConnection);
-        return false;
-    }
-    // Allocate statement handle for Exec-functions
-    SQLAllocHandle(SQL_HANDLE_STMT,hConnection,&execStmt);
-
-    flags |= DDB_FLAG_CONNECTED;
-    return true;
-}
-
-// ==================================================================================================
-bool DdbOdbc::Disconnect()
-{
-    if(execStmt != SQL_NULL_HANDLE)
-        SQLFreeHandle(SQL_HANDLE_STMT,execStmt);
-
-    SQLRETURN retval = SQLDisconnect(hConnection);
-    if(!SQLSUCCESS(retval))
-    {
-        ostringstream ss;
-        ss << "DdbOdbc::Disconnect - SQLDisconnect failure " << retval;
-        Log(ss);
-        return false;
-    }
-
-    if(hConnection != SQL_NULL_HANDLE)
-        SQLFreeHandle(SQL_HANDLE_DBC,hConnection);
-
-    flags &= ~DDB_FLAG_CONNECTED;
-    return true;
-}
-
-// ==================================================================================================
-DdbRowSet* DdbOdbc::CreateRowSet()
-{
-    if(!(flags&DDB_FLAG_CONNECTED))
-    {
-        SetErrorId(5);
-        return 0;
-    }
-    return new DdbOdbcRowSet(this);
-}
-
-// ==================================================================================================
-DDBSTR DdbOdbc::GetErrorDescription(DdbRowSet *rs)
-{
-    SQLCHAR SqlState[6], msg[SQL_MAX_MESSAGE_LENGTH];
-    SQLINTEGER NativeError;
-    SQLSMALLINT i, MsgLen,handleType;
-    SQLRETURN rc;
-    DDBSTR errorMsg;
-    SQLHANDLE handle;
-
-    errorMsg = GetLastError();
-    if(hConnection != SQL_NULL_HANDLE)
-    {
-        errorMsg += "\n";
-        if(rs)
-        {
-            handleType = SQL_HANDLE_STMT;
-            handle     = static_cast<DdbOdbcRowSet*>(rs)->hStmt;
-        }
-        else if(execStmt == SQL_NULL_HANDLE)
-        {
-            handleType = SQL_HANDLE_DBC;
-            handle     = hConnection;
-        }
-        else
-        {
-            handleType = SQL_HANDLE_STMT;
-            handle     = execStmt;
-        }
-        i = 1;
-        while ((rc = SQLGetDiagRec(handleType, handle, i, SqlState, &NativeError,
-                                    msg, sizeof(msg), &MsgLen)) != SQL_NO_DATA)
-        {
-            errorMsg += (char*)msg;
-            errorMsg += "\n";
-            i++;
-        }
-    }
-    return errorMsg;
-}
-
-// ==================================================================================================
-bool DdbOdbc::StartTransaction()
-{
-    if(!(flags&DDB_FLAG_CONNECTED))
-    {
-        SetErrorId(5);
-        return false;
-    }
-    if(flags&DDB_FLAG_TRANSACT_ON)
-    {
-        SetErrorId(6);
-        return false;
-    }
-
-    return false;
-}
-
-// ==================================================================================================
-bool DdbOdbc::Commit()
-{
-    if(!(flags&DDB_FLAG_CONNECTED))
-    {
-        SetErrorId(5);
-        return false;
-    }
-    if(!(flags&DDB_FLAG_TRANSACT_ON))
-    {
-        SetErrorId(7);
-        return false;
-    }
-
-    return false;
-}
-
-// ==================================================================================================
-bool DdbOdbc::RollBack()
-{
-    if(!(flags&DDB_FLAG_CONNECTED))
-    {
-        SetErrorId(5);
-        return false;
-    }
-    if(!(flags&DDB_FLAG_TRANSACT_ON))
-    {
-        SetErrorId(7);
-        return false;
-    }
-
-    return false;
-}
-
-// ==================================================================================================
-bool DdbOdbc::ExecuteIntFunction(const DDBSTR &query, int &val)
-{
-    ostringstream ss;
-    int retval;
-    SQLRETURN sqlrv;
-    SQLINTEGER cbint=0;
-
-    if(query.LENGTH()==0 || execStmt == SQL_NULL_HANDLE)
-        return false;
-
-    sqlrv = SQLBindCol(execStmt,1,SQL_C_SLONG,&retval,0,&cbint);
-    if(!SQLSUCCESS(sqlrv))
-    {
-        ss << "DdbOdbc::ExecuteIntFunction - SQLBindCol failure " << sqlrv;
-        ss << endl << GetErrorDescription(0);
-        Log(ss);
-        errorId = 19;
-        return false;
-    }
-    sqlrv = SQLExecDirect(execStmt,(SQLCHAR*)query.DATA(),SQL_NTS);
-    if(!SQLSUCCESS(sqlrv))
-    {
-        ss << "DdbOdbc::ExecuteIntFunction - SQLExecDirect failure " << sqlrv << endl << query.DATA();
-        Log(ss);
-        goto ODBC_EXE_INT_ERROR;
-    }
-    sqlrv = SQLFetch(execStmt);
-    if(sqlrv != SQL_NO_DATA && !SQLSUCCESS(sqlrv))
-    {
-        ss << "DdbOdbc::ExecuteIntFunction - SQLFetch failure " << sqlrv;
-        Log(ss);
-        goto ODBC_EXE_INT_ERROR;
-    }
-    FreeExecStmt();
-    if(sqlrv == SQL_NO_DATA)
-        return false;
-    val = retval;
-    return true;
-
- ODBC_EXE_INT_ERROR:
-    ostringstream errorStr;
-    errorId = 19;
-    errorStr << GetErrorDescription(0).DATA();
-    Log(errorStr);
-    FreeExecStmt();
-    return false;
-}
-
-// ==================================================================================================
-bool DdbOdbc::ExecuteDoubleFunction(const DDBSTR &query, double &val)
-{
-    ostringstream ss;
-    double retval;
-    SQLRETURN sqlrv;
-    SQLINTEGER cb=0;
-
-    if(query.LENGTH()==0 || execStmt == SQL_NULL_HANDLE)
-        return false;
-
-    sqlrv = SQLBindCol(execStmt,1,SQL_C_DOUBLE,&retval,0,&cb);
-    if(!SQLSUCCESS(sqlrv))
-    {
-        ss << "DdbOdbc::ExecuteDoubleFunction - SQLBindCol failure " << sqlrv;
-        ss << endl << GetErrorDescription(0).DATA();
-        Log(ss);
-        errorId = 19;
-        return false;
-    }
-    sqlrv = SQLExecDirect(execStmt,(SQLCHAR*)query.DATA(),SQL_NTS);
-    if(!SQLSUCCESS(sqlrv))
-    {
-        ss << "DdbOdbc::ExecuteDoubleFunction - SQLExecDirect failure " << sqlrv << endl << query.DATA();
-        Log(ss);
-        goto ODBC_EXE_DBL_ERROR;
-    }
-    sqlrv = SQLFetch(execStmt);
-    if(sqlrv != SQL_NO_DATA && !SQLSUCCESS(sqlrv))
-    {
-        ss << "DdbOdbc::ExecuteDoubleFunction - SQLFetch failure " << sqlrv;
-        Log(ss);
-        goto ODBC_EXE_DBL_ERROR;
-    }
-    FreeExecStmt();
-    if(sqlrv == SQL_NO_DATA)
-        return false;
-    val = retval;
-    return true;
-
- ODBC_EXE_DBL_ERROR:
-    ostringstream errorStr;
-    errorId = 19;
-    errorStr << GetErrorDescription(0).DATA();
-    Log(errorStr);
-    FreeExecStmt();
-    return false;
-}
-
-// ==================================================================================================
-bool DdbOdbc::ExecuteStrFunction(const DDBSTR &query, DDBSTR &answer)
-{
-    SQLRETURN sqlrv;
-    SQLINTEGER resLen=0, cb=0;
-    char *str=0, buffer[1024];
-    ostringstream ss;
-
-    if(!query.LENGTH())
-        return false;
-
-    if(query.LENGTH()==0 || execStmt == SQL_NULL_HANDLE)
-        return false;
-
-    sqlrv = SQLExecDirect(execStmt,(SQLCHAR*)query.DATA(),SQL_NTS);
-    if(!SQLSUCCESS(sqlrv))
-    {
-        ss << "DdbOdbc::ExecuteStrFunction - SQLExecDirect failure " << sqlrv << endl << query.DATA();
-        Log(ss);
-        goto ODBC_EXE_STR_ERROR;
-    }
-
-    SQLColAttribute (execStmt,1,SQL_DESC_DISPLAY_SIZE,0,0,0,&resLen);
-    if(resLen >= 1024)
-        str = new char[resLen+1];
-    else
-        str = buffer;
-    sqlrv = SQLBindCol(execStmt,1,SQL_C_CHAR,str,resLen,&cb);
-    if(!SQLSUCCESS(sqlrv))
-    {
-        ss << "DdbOdbc::ExecuteStrFunction - SQLBindCol failure " << sqlrv;
-        Log(ss);
-        goto ODBC_EXE_STR_ERROR;
-    }
-    sqlrv = SQLFetch(execStmt);
-    answer = str;
-
-    if(resLen >= 1024 && str)
-        delete[] str;
-    FreeExecStmt();
-
-    if(sqlrv == SQL_NO_DATA)
-        return false;
-    if(!SQLSUCCESS(sqlrv))
-    {
-        ss << "DdbOdbc::ExecuteStrFunction - SQLFetch failure " << sqlrv;
-        Log(ss);
-        return false;
-    }
-    return true;
-
-ODBC_EXE_STR_ERROR:
-    ostringstream  errorStr;
-    errorId = 19;
-    errorStr << GetErrorDescription(0).DATA();
-    Log(errorStr);
-    if(resLen >= 1024 && str)
-        delete[] str;
-    return false;
-}
-
-// ==================================================================================================
-bool DdbOdbc::ExecuteDateFunction(const DDBSTR &, DDBTIME &)
-{
-    ostringstream ss;
-    ss << "DdbOdbc::ExecuteDateFunction - NOT implemented";
-    Log(ss);
-    return false;
-}
-
-// ==================================================================================================
-bool DdbOdbc::ExecuteBoolFunction(const DDBSTR &, bool &)
-{
-    ostringstream ss;
-    ss << "DdbOdbc::ExecuteDateFunction - NOT implemented";
-    Log(ss);
-    return false;
-}
-
-// ==================================================================================================
-int DdbOdbc::ExecuteModify(const DDBSTR &modify)
-{
-    SQLINTEGER rowCount;
-    SQLRETURN sqlrv;
-    ostringstream ss;
-
-    if(modify.LENGTH()==0)
-        return 0;
-
-    sqlrv = SQLExecDirect(execStmt,(SQLCHAR*)modify.DATA(),SQL_NTS);
-    if(sqlrv == SQL_NO_DATA)
-        return 0;
-    if(!SQLSUCCESS(sqlrv))
-    {
-        ss << "DdbOdbc::ExecuteModify - SQLExecDirect failure"<<endl<<modify.DATA();
-        ss << endl << GetErrorDescription(0).DATA();
-        Log(ss);
-        errorId = 18;
-        return -1;
-    }
-    sqlrv = SQLRowCount(execStmt,&rowCount);
-    if(!SQLSUCCESS(sqlrv))
-    {
-        ss << "DdbOdbc::ExecuteModify - SQLRowCount failure";
-        Log(ss);
-        rowCount = -1;
-    }
-
-    return rowCount;
-}
-
-// ==================================================================================================
-bool DdbOdbc::UpdateStructure(const DDBSTR &command)
-{
-    SQLRETURN sqlrv;
-    ostringstream ss;
-
-    if(command.LENGTH()==0)
-        return false;
-
-    sqlrv = SQLExecDirect(execStmt,(SQLCHAR*)command.DATA(),SQL_NTS);
-    if(sqlrv == SQL_NO_DATA)
-        return false;
-    if(!SQLSUCCESS(sqlrv))
-    {
-        ss << "DdbOdbc::UpdateStructure - SQLExecDirect failure"<<endl<<command.DATA();
-        ss << endl << GetErrorDescription(0).DATA();
-        Log(ss);
-        errorId = 21;
-        return false;
-    }
-    return true;
-}
-
-// ==================================================================================================
-void DdbOdbc::FreeExecStmt()
-/*!
-  Closes the cursor and unbinds exeStmt.
-*/
-{
-    ostringstream ss;
-    SQLRETURN sqlrv = SQLCloseCursor(execStmt);
-    if(!SQLSUCCESS(sqlrv))
-    {
-        ss << "DdbOdbc::FreeExecStmt - SQLCloseCursor failure " << sqlrv;
-        Log(ss);
-    }
-    sqlrv = SQLFreeStmt(execStmt,SQL_UNBIND);
-    if(!SQLSUCCESS(sqlrv))
-    {
-        ss << "DdbOdbc::FreeExecStmt - SQLFreeStmt failure " << sqlrv;
-        Log(ss);
-    }
-}
+/*******************************************************************************
+ddbodbc.cpp
+Copyright (c) Antti Merenluoto
+*******************************************************************************/
+
+#include "pch-stop.h"
+#ifdef DDB_USEWX
+#include <wx/wxprec.h>
+  #ifndef WX_PRECOMP
+    #include <wx/wx.h>
+  #endif
+#endif
+#include <string.h>
+#include <stdlib.h>
+#include <string>
+#include <cpp4scripts.hpp>
+#define __DDB_ODBC__
+#include "directdatabase.hpp"
+
+// ==================================================================================================
+DdbOdbc::DdbOdbc()
+/*!
+  Constructs database object for the connection to the ODBC databases.
+  Please note that 3.x specification is followed.
+*/
+{
+    hConnection = SQL_NULL_HANDLE;
+    execStmt = SQL_NULL_HANDLE;
+    rowArraySize = DDB_ODBC_ROWARRAY;
+
+    SQLRETURN retval = SQLAllocHandle(SQL_HANDLE_ENV,SQL_NULL_HANDLE,&hEnvironment);
+    if(SQLSUCCESS(retval)) {
+        SQLSetEnvAttr(hEnvironment,SQL_ATTR_ODBC_VERSION,(SQLPOINTER)SQL_OV_ODBC3,0);
+        flags |= DDB_FLAG_INITIALIZED;
+    }
+    else {
+        CS_PRINT_CRIT("DdbOdbc::DdbOdbc - Unable to allocate ODBC environment.");
+        hEnvironment = SQL_NULL_HANDLE;
+    }
+    feat_support |= DDB_FEATURE_TRANSACTIONS|DDB_FEATURE_AUTOTRIM;
+}
+
+// ==================================================================================================
+DdbOdbc::~DdbOdbc()
+/*!
+    Closes up the database connection and frees the environment.
+*/
+{
+    if(flags & DDB_FLAG_CONNECTED)
+        Disconnect();
+    if(hEnvironment != SQL_NULL_HANDLE)
+        SQLFreeHandle(SQL_HANDLE_ENV,hEnvironment);
+}
+
+// ==================================================================================================
+bool DdbOdbc::Connect(const char *constr)
+/*!
+  Connects to the database with SQLDriverConnect.
+  \param constr ODBC connection string, e.g. "DSN=test" or "DRIVER=SQLite3;Database=/tmp/test.db"
+*/
+{
+    SQLCHAR connectOut[1024];
+    SQLSMALLINT conOutLen;
+    SQLRETURN retval;
+
+    // Safety checks
+    if(!(flags&DDB_FLAG_INITIALIZED))
+    {
+        SetErrorId(11);
+        return false;
+    }
+    if(!constr || !*constr)
+    {
+        SetErrorId(3);
+        return false;
+    }
+
+    if(flags & DDB_FLAG_CONNECTED)
+        Disconnect();
+
+    // Allocate connection hanle
+    retval = SQLAllocHandle(SQL_HANDLE_DBC,hEnvironment,&hConnection);
+    if(!SQLSUCCESS(retval))
+    {
+        CS_VAPRT_ERRO("DdbOdbc::Connect - SQLAllocHandle failure %d",retval);
+        hConnection = SQL_NULL_HANDLE;
+        SetErrorId(4);
+        return false;
+    }
+
+    retval = SQLDriverConnect(hConnection,0,(SQLCHAR*)constr,SQL_NTS,
+                              connectOut,sizeof(connectOut),&conOutLen,SQL_DRIVER_NOPROMPT);
+    if(!SQLSUCCESS(retval))
+    {
+        SetErrorId(4);
+        CS_PRINT_ERRO(GetErrorDescription(0).DATA());
+        SQLFreeHandle(SQL_HANDLE_DBC,hConnection);
+        hConnection = SQL_NULL_HANDLE;
+        return false;
+    }
+    // Allocate statement handle for Exec-functions
+    SQLAllocHandle(SQL_HANDLE_STMT,hConnection,&execStmt);
+
+    conString = constr;
+    flags |= DDB_FLAG_CONNECTED;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbOdbc::Disconnect()
+{
+    if(execStmt != SQL_NULL_HANDLE)
+        SQLFreeHandle(SQL_HANDLE_STMT,execStmt);
+    execStmt = SQL_NULL_HANDLE;
+    if(hConnection == SQL_NULL_HANDLE)
+        return true;
+
+    if(flags&DDB_FLAG_TRANSACT_ON)
+        RollBack();
+    SQLRETURN retval = SQLDisconnect(hConnection);
+    if(!SQLSUCCESS(retval))
+        CS_VAPRT_ERRO("DdbOdbc::Disconnect - SQLDisconnect failure %d",retval);
+
+    SQLFreeHandle(SQL_HANDLE_DBC,hConnection);
+    hConnection = SQL_NULL_HANDLE;
+    flags &= ~DDB_FLAG_CONNECTED;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbOdbc::IsConnectOK()
+{
+    SQLUINTEGER dead = SQL_CD_TRUE;
+    if(hConnection == SQL_NULL_HANDLE)
+        return false;
+    SQLRETURN retval = SQLGetConnectAttr(hConnection,SQL_ATTR_CONNECTION_DEAD,&dead,0,0);
+    if(!SQLSUCCESS(retval))
+        return (flags&DDB_FLAG_CONNECTED) ? true:false; // Attribute not supported by the driver.
+    return dead == SQL_CD_FALSE;
+}
+
+// ==================================================================================================
+bool DdbOdbc::ResetConnection()
+{
+    DDBSTR constr = conString;
+    Disconnect();
+    return Connect(constr.DATA());
+}
+
+// ==================================================================================================
+DdbRowSet* DdbOdbc::CreateRowSet()
+{
+    if(!(flags&DDB_FLAG_CONNECTED))
+    {
+        SetErrorId(5);
+        return 0;
+    }
+    return new DdbOdbcRowSet(this);
+}
+
+// ==================================================================================================
+DDBSTR DdbOdbc::GetErrorDescription(DdbRowSet *rs)
+{
+    SQLCHAR SqlState[6], msg[SQL_MAX_MESSAGE_LENGTH];
+    SQLINTEGER NativeError;
+    SQLSMALLINT i, MsgLen,handleType;
+    DDBSTR errorMsg;
+    SQLHANDLE handle;
+
+    errorMsg = GetLastError();
+    if(hConnection != SQL_NULL_HANDLE)
+    {
+        errorMsg += "\n";
+        if(rs)
+        {
+            handleType = SQL_HANDLE_STMT;
+            handle     = static_cast<DdbOdbcRowSet*>(rs)->hStmt;
+        }
+        else if(execStmt == SQL_NULL_HANDLE)
+        {
+            handleType = SQL_HANDLE_DBC;
+            handle     = hConnection;
+        }
+        else
+        {
+            handleType = SQL_HANDLE_STMT;
+            handle     = execStmt;
+        }
+        i = 1;
+        while (SQLGetDiagRec(handleType, handle, i, SqlState, &NativeError,
+                             msg, sizeof(msg), &MsgLen) != SQL_NO_DATA)
+        {
+            errorMsg += (char*)msg;
+            errorMsg += "\n";
+            i++;
+            if(i>10)
+                break;
+        }
+    }
+    return errorMsg;
+}
+
+// ==================================================================================================
+bool DdbOdbc::StartTransaction()
+/*!
+  ODBC connections are in auto commit mode by default. Transaction is started by turning the
+  auto commit off. It is turned back on by Commit or RollBack.
+*/
+{
+    if(!(flags&DDB_FLAG_CONNECTED))
+    {
+        SetErrorId(5);
+        return false;
+    }
+    if(flags&DDB_FLAG_TRANSACT_ON)
+    {
+        SetErrorId(6);
+        return false;
+    }
+    SQLRETURN retval = SQLSetConnectAttr(hConnection,SQL_ATTR_AUTOCOMMIT,(SQLPOINTER)SQL_AUTOCOMMIT_OFF,SQL_IS_UINTEGER);
+    if(!SQLSUCCESS(retval))
+    {
+        CS_PRINT_ERRO("DdbOdbc::StartTransaction - unable to turn auto commit off.");
+        return false;
+    }
+    flags |= DDB_FLAG_TRANSACT_ON;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbOdbc::EndTransaction(SQLSMALLINT completion)
+{
+    if(!(flags&DDB_FLAG_CONNECTED))
+    {
+        SetErrorId(5);
+        return false;
+    }
+    if(!(flags&DDB_FLAG_TRANSACT_ON))
+    {
+        SetErrorId(7);
+        return false;
+    }
+    SQLRETURN retval = SQLEndTran(SQL_HANDLE_DBC,hConnection,completion);
+    if(!SQLSUCCESS(retval))
+    {
+        CS_VAPRT_ERRO("DdbOdbc::EndTransaction - SQLEndTran failure %d",retval);
+        CS_PRINT_ERRO(GetErrorDescription(0).DATA());
+        if(completion==SQL_COMMIT)
+            return false;
+    }
+    SQLSetConnectAttr(hConnection,SQL_ATTR_AUTOCOMMIT,(SQLPOINTER)SQL_AUTOCOMMIT_ON,SQL_IS_UINTEGER);
+    flags &= ~DDB_FLAG_TRANSACT_ON;
+    return SQLSUCCESS(retval);
+}
+
+// ==================================================================================================
+bool DdbOdbc::Commit()
+{
+    return EndTransaction(SQL_COMMIT);
+}
+
+// ==================================================================================================
+bool DdbOdbc::RollBack()
+{
+    return EndTransaction(SQL_ROLLBACK);
+}
+
+// ==================================================================================================
+bool DdbOdbc::ExecuteFunction(const DDBSTR &query, const char *caller)
+/*!
+  Common query logic for the Execute..Function family. Executes the query with the exec
+  statement and fetches the first row. Caller reads the first column with SQLGetData and
+  calls FreeExecStmt.
+  \retval bool True if there is a row to read. On false the statement has been freed.
+*/
+{
+    if(query.LENGTH()==0 || execStmt == SQL_NULL_HANDLE)
+        return false;
+
+    SQLRETURN sqlrv = SQLExecDirect(execStmt,(SQLCHAR*)query.DATA(),SQL_NTS);
+    if(!SQLSUCCESS(sqlrv))
+    {
+        errorId = 19;
+        CS_VAPRT_ERRO("%s - SQLExecDirect failure %d: %s",caller,sqlrv,query.DATA());
+        CS_PRINT_ERRO(GetErrorDescription(0).DATA());
+        FreeExecStmt();
+        return false;
+    }
+    sqlrv = SQLFetch(execStmt);
+    if(sqlrv == SQL_NO_DATA)
+    {
+        FreeExecStmt();
+        return false;
+    }
+    if(!SQLSUCCESS(sqlrv))
+    {
+        errorId = 19;
+        CS_VAPRT_ERRO("%s - SQLFetch failure %d",caller,sqlrv);
+        CS_PRINT_ERRO(GetErrorDescription(0).DATA());
+        FreeExecStmt();
+        return false;
+    }
+    return true;
+}
+
+// ==================================================================================================
+bool DdbOdbc::ExecuteIntFunction(const DDBSTR &query, uint32_t &val)
+{
+    SQLINTEGER retval;
+    SQLLEN cb=0;
+
+    if(!ExecuteFunction(query,"DdbOdbc::ExecuteIntFunction"))
+        return false;
+    SQLRETURN sqlrv = SQLGetData(execStmt,1,SQL_C_SLONG,&retval,0,&cb);
+    FreeExecStmt();
+    if(!SQLSUCCESS(sqlrv) || cb == SQL_NULL_DATA)
+        return false;
+    val = (uint32_t) retval;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbOdbc::ExecuteLongFunction(const DDBSTR &query, uint64_t &val)
+{
+    SQLBIGINT retval;
+    SQLLEN cb=0;
+
+    if(!ExecuteFunction(query,"DdbOdbc::ExecuteLongFunction"))
+        return false;
+    SQLRETURN sqlrv = SQLGetData(execStmt,1,SQL_C_SBIGINT,&retval,0,&cb);
+    FreeExecStmt();
+    if(!SQLSUCCESS(sqlrv) || cb == SQL_NULL_DATA)
+        return false;
+    val = (uint64_t) retval;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbOdbc::ExecuteDoubleFunction(const DDBSTR &query, double &val)
+{
+    SQLDOUBLE retval;
+    SQLLEN cb=0;
+
+    if(!ExecuteFunction(query,"DdbOdbc::ExecuteDoubleFunction"))
+        return false;
+    SQLRETURN sqlrv = SQLGetData(execStmt,1,SQL_C_DOUBLE,&retval,0,&cb);
+    FreeExecStmt();
+    if(!SQLSUCCESS(sqlrv) || cb == SQL_NULL_DATA)
+        return false;
+    val = retval;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbOdbc::ExecuteBoolFunction(const DDBSTR &query, bool &val)
+{
+    char retval[8];
+    SQLLEN cb=0;
+
+    if(!ExecuteFunction(query,"DdbOdbc::ExecuteBoolFunction"))
+        return false;
+    SQLRETURN sqlrv = SQLGetData(execStmt,1,SQL_C_CHAR,retval,sizeof(retval),&cb);
+    FreeExecStmt();
+    if(!SQLSUCCESS(sqlrv) || cb == SQL_NULL_DATA)
+        return false;
+    val = retval[0] && strchr("tTyY1",retval[0]) ? true:false;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbOdbc::ExecuteStrFunction(const DDBSTR &query, DDBSTR &answer)
+/*!
+  Reads the string in pieces so that there is no limit for the string length.
+*/
+{
+    char buffer[1024];
+    SQLLEN cb=0;
+    SQLRETURN sqlrv;
+    std::string value;
+
+    if(!ExecuteFunction(query,"DdbOdbc::ExecuteStrFunction"))
+        return false;
+    while( (sqlrv = SQLGetData(execStmt,1,SQL_C_CHAR,buffer,sizeof(buffer),&cb)) != SQL_NO_DATA )
+    {
+        if(!SQLSUCCESS(sqlrv) || cb == SQL_NULL_DATA)
+            break;
+        if(cb == SQL_NO_TOTAL || cb >= (SQLLEN)sizeof(buffer))
+            value.append(buffer, sizeof(buffer)-1);
+        else
+            value.append(buffer, cb);
+        if(sqlrv == SQL_SUCCESS)
+            break;
+    }
+    FreeExecStmt();
+    if(!SQLSUCCESS(sqlrv) && sqlrv != SQL_NO_DATA)
+    {
+        errorId = 19;
+        return false;
+    }
+    if(cb == SQL_NULL_DATA)
+    {
+        answer.CLEAR();
+        return false;
+    }
+#ifdef DDB_USESTL
+    answer = value;
+    if( (feat_on&DDB_FEATURE_AUTOTRIM)>0 )
+        DirectDatabase::TrimTail(&answer);
+#else
+    answer = wxString::FromUTF8(value.c_str());
+    if( (feat_on&DDB_FEATURE_AUTOTRIM)>0 )
+        answer.Trim();
+#endif
+    return true;
+}
+
+// ==================================================================================================
+bool DdbOdbc::ExecuteDateFunction(const DDBSTR &query, DDBTIME &val)
+{
+    TIMESTAMP_STRUCT timestamp;
+    SQLLEN cb=0;
+    tm tmtime;
+
+    if(!ExecuteFunction(query,"DdbOdbc::ExecuteDateFunction"))
+        return false;
+    SQLRETURN sqlrv = SQLGetData(execStmt,1,SQL_C_TYPE_TIMESTAMP,&timestamp,sizeof(timestamp),&cb);
+    FreeExecStmt();
+    if(!SQLSUCCESS(sqlrv) || cb == SQL_NULL_DATA)
+        return false;
+    memset(&tmtime,0,sizeof(tm));
+    tmtime.tm_year = timestamp.year-1900;
+    tmtime.tm_mon  = timestamp.month-1;
+    tmtime.tm_mday = timestamp.day;
+    tmtime.tm_hour = timestamp.hour;
+    tmtime.tm_min  = timestamp.minute;
+    tmtime.tm_sec  = timestamp.second;
+    tmtime.tm_isdst = -1;
+#ifdef DDB_USESTL
+    val = tmtime;
+#else
+    val.Set(tmtime);
+#endif
+    return true;
+}
+
+// ==================================================================================================
+int DdbOdbc::ExecuteModify(const DDBSTR &modify)
+{
+    SQLLEN rowCount;
+    SQLRETURN sqlrv;
+
+    if(modify.LENGTH()==0 || execStmt == SQL_NULL_HANDLE)
+        return -1;
+
+    sqlrv = SQLExecDirect(execStmt,(SQLCHAR*)modify.DATA(),SQL_NTS);
+    if(sqlrv == SQL_NO_DATA)
+    {
+        SQLFreeStmt(execStmt,SQL_CLOSE);
+        return 0;
+    }
+    if(!SQLSUCCESS(sqlrv))
+    {
+        errorId = 18;
+        CS_VAPRT_ERRO("DdbOdbc::ExecuteModify - SQLExecDirect failure: %s",modify.DATA());
+        CS_PRINT_ERRO(GetErrorDescription(0).DATA());
+        return -1;
+    }
+    sqlrv = SQLRowCount(execStmt,&rowCount);
+    if(!SQLSUCCESS(sqlrv))
+    {
+        CS_PRINT_ERRO("DdbOdbc::ExecuteModify - SQLRowCount failure");
+        rowCount = -1;
+    }
+    SQLFreeStmt(execStmt,SQL_CLOSE);
+    return (int) rowCount;
+}
+
+// ==================================================================================================
+int DdbOdbc::ExecuteArray(const DDBSTR &query, DdbOdbcParamArray &params)
+/*!
+  Executes the query once for each row of the parameter arrays. All rows are sent to the
+  driver with one SQLExecute. Status of each row is stored into params.
+  \param query Statement with one ? placeholder for each bound parameter array.
+  \param params Bound parameter arrays.
+  \retval int Number of rows executed successfully, -1 if the statement could not be executed.
+*/
+{
+    SQLRETURN sqlrv;
+    int row, count, err = 0;
+
+    if(!(flags&DDB_FLAG_CONNECTED))
+    {
+        SetErrorId(5);
+        return -1;
+    }
+    if(query.LENGTH()==0 || params.params.empty() || execStmt == SQL_NULL_HANDLE)
+        return -1;
+
+    sqlrv = SQLPrepare(execStmt,(SQLCHAR*)query.DATA(),SQL_NTS);
+    if(!SQLSUCCESS(sqlrv))
+    {
+        errorId = 18;
+        CS_VAPRT_ERRO("DdbOdbc::ExecuteArray - SQLPrepare failure %d: %s",sqlrv,query.DATA());
+        CS_PRINT_ERRO(GetErrorDescription(0).DATA());
+        return -1;
+    }
+    for(row=0; row<params.rows; row++)
+        params.status[row] = SQL_PARAM_UNUSED;
+    params.processed = 0;
+    SQLSetStmtAttr(execStmt,SQL_ATTR_PARAM_BIND_TYPE,(SQLPOINTER)SQL_PARAM_BIND_BY_COLUMN,0);
+    SQLSetStmtAttr(execStmt,SQL_ATTR_PARAM_STATUS_PTR,&params.status[0],0);
+    SQLSetStmtAttr(execStmt,SQL_ATTR_PARAMS_PROCESSED_PTR,&params.processed,0);
+    sqlrv = SQLSetStmtAttr(execStmt,SQL_ATTR_PARAMSET_SIZE,(SQLPOINTER)(SQLULEN)params.rows,0);
+    if(!SQLSUCCESS(sqlrv) || (err = params.BindParameters(execStmt)) != 0)
+    {
+        errorId = err ? err : 18;
+        CS_PRINT_ERRO("DdbOdbc::ExecuteArray - Unable to bind the parameter arrays.");
+        CS_PRINT_ERRO(GetErrorDescription(0).DATA());
+        count = -1;
+        goto RESET;
+    }
+
+    sqlrv = SQLExecute(execStmt);
+    if(sqlrv == SQL_SUCCESS)
+    {
+        // All rows succeeded. Some drivers leave the status array untouched in this case.
+        for(row=0; row<params.rows; row++)
+            params.status[row] = SQL_PARAM_SUCCESS;
+        count = params.rows;
+    }
+    else if(SQLSUCCESS(sqlrv) || sqlrv == SQL_ERROR || sqlrv == SQL_NO_DATA)
+    {
+        // With warnings the driver may leave the status of the processed rows unset.
+        if(sqlrv == SQL_SUCCESS_WITH_INFO) {
+            SQLULEN done = params.processed ? params.processed : params.rows;
+            for(row=0; row<params.rows && (SQLULEN)row<done; row++) {
+                if(params.status[row] == SQL_PARAM_UNUSED)
+                    params.status[row] = SQL_PARAM_SUCCESS_WITH_INFO;
+            }
+        }
+        count = 0;
+        for(row=0; row<params.rows; row++) {
+            if(params.IsRowOK(row))
+                count++;
+        }
+        if(sqlrv == SQL_ERROR)
+        {
+            errorId = 18;
+            CS_VAPRT_ERRO("DdbOdbc::ExecuteArray - SQLExecute failure. %d of %d rows succeeded.",count,params.rows);
+            CS_PRINT_ERRO(GetErrorDescription(0).DATA());
+            if(params.processed == 0)
+                count = -1;
+        }
+    }
+    else
+    {
+        errorId = 18;
+        CS_VAPRT_ERRO("DdbOdbc::ExecuteArray - SQLExecute failure %d",sqlrv);
+        count = -1;
+    }
+
+RESET:
+    // Return the exec statement into single parameter set mode.
+    SQLFreeStmt(execStmt,SQL_CLOSE);
+    SQLFreeStmt(execStmt,SQL_RESET_PARAMS);
+    SQLSetStmtAttr(execStmt,SQL_ATTR_PARAMSET_SIZE,(SQLPOINTER)1,0);
+    SQLSetStmtAttr(execStmt,SQL_ATTR_PARAM_STATUS_PTR,0,0);
+    SQLSetStmtAttr(execStmt,SQL_ATTR_PARAMS_PROCESSED_PTR,0,0);
+    return count;
+}
+
+// ==================================================================================================
+bool DdbOdbc::UpdateStructure(const DDBSTR &command)
+{
+    SQLRETURN sqlrv;
+
+    if(command.LENGTH()==0 || execStmt == SQL_NULL_HANDLE)
+        return false;
+
+    sqlrv = SQLExecDirect(execStmt,(SQLCHAR*)command.DATA(),SQL_NTS);
+    if(sqlrv == SQL_NO_DATA)
+        return true;
+    if(!SQLSUCCESS(sqlrv))
+    {
+        errorId = 21;
+        CS_VAPRT_ERRO("DdbOdbc::UpdateStructure - SQLExecDirect failure: %s",command.DATA());
+        CS_PRINT_ERRO(GetErrorDescription(0).DATA());
+        return false;
+    }
+    SQLFreeStmt(execStmt,SQL_CLOSE);
+    return true;
+}
+
+// ==================================================================================================
+void DdbOdbc::FreeExecStmt()
+/*!
+  Closes the cursor and unbinds exeStmt.
+*/
+{
+    SQLRETURN sqlrv = SQLFreeStmt(execStmt,SQL_CLOSE);
+    if(!SQLSUCCESS(sqlrv))
+        CS_VAPRT_ERRO("DdbOdbc::FreeExecStmt - SQLFreeStmt(close) failure %d",sqlrv);
+    sqlrv = SQLFreeStmt(execStmt,SQL_UNBIND);
+    if(!SQLSUCCESS(sqlrv))
+        CS_VAPRT_ERRO("DdbOdbc::FreeExecStmt - SQLFreeStmt(unbind) failure %d",sqlrv);
+}
+
+// ==================================================================================================
+DdbOdbcParamArray::DdbOdbcParamArray(int rows_in)
+/*!
+  \param rows_in Number of rows in each bound array.
+*/
+{
+    capacity = rows_in>0 ? rows_in : 1;
+    rows = capacity;
+    processed = 0;
+    status.resize(capacity, SQL_PARAM_UNUSED);
+}
+
+// ==================================================================================================
+DdbOdbcParamArray::~DdbOdbcParamArray()
+{
+    for(std::vector<Param>::iterator it=params.begin(); it!=params.end(); it++) {
+        free(it->buffer);
+        delete[] it->ind;
+        delete[] it->nulls;
+    }
+}
+
+// ==================================================================================================
+bool DdbOdbcParamArray::Bind(short int type, void *data, int maxLength)
+/*!
+  Binds the next parameter array. Parameters are bound in the order of the placeholders.
+  Arrays must have a value for each row. Values are read when the statement is executed.
+  \param type DDBT_... type of the array elements: int, DDBSTR, bool, DDBTIME, double or char.
+  \param data Pointer to the first element of the array.
+  \param maxLength For DDBT_STR the longest string in bytes. If zero the strings are measured
+    at each execution. A longer string fails the execution with error 17.
+*/
+{
+    // DDB_TYPE_USED
+    if(!data || type < DDBT_MIN || type > DDBT_CHR || type == DDBT_BIT)
+        return false;
+    Param p;
+    p.type = type;
+    p.data = data;
+    p.maxLength = maxLength;
+    p.buffer = 0;
+    p.width = 0;
+    p.ind = new SQLLEN[capacity];
+    p.nulls = new bool[capacity];
+    memset(p.nulls, 0, capacity*sizeof(bool));
+    params.push_back(p);
+    return true;
+}
+
+// ==================================================================================================
+void DdbOdbcParamArray::SetNull(int param, int row, bool isNull)
+/*!
+  Marks the value as NULL. The mark stays until it is cleared.
+  \param param Zero based index of the parameter in the bind order.
+  \param row Zero based row index.
+*/
+{
+    if(param<0 || param>=(int)params.size() || row<0 || row>=capacity)
+        return;
+    params[param].nulls[row] = isNull;
+}
+
+// ==================================================================================================
+void DdbOdbcParamArray::ClearNulls()
+{
+    for(std::vector<Param>::iterator it=params.begin(); it!=params.end(); it++)
+        memset(it->nulls, 0, capacity*sizeof(bool));
+}
+
+// ==================================================================================================
+int DdbOdbcParamArray::BindParameters(SQLHANDLE stmt)
+/*!
+  Converts the client values into driver format where needed and binds the arrays.
+  \retval int Zero on success, otherwise the error id: 17 if a string is longer than the
+    maxLength it was bound with.
+*/
+{
+    SQLSMALLINT ctype, sqltype, digits;
+    SQLULEN colSize;
+    SQLPOINTER value;
+    SQLLEN width;
+    SQLRETURN sqlrv;
+    int row, ndx=0;
+    tm tmtime;
+
+    for(std::vector<Param>::iterator p=params.begin(); p!=params.end(); p++, ndx++)
+    {
+        digits = 0;
+        switch(p->type)
+        {
+        case DDBT_INT:
+            ctype = SQL_C_SLONG;
+            sqltype = SQL_INTEGER;
+            colSize = 10;
+            width = sizeof(int);
+            value = p->data;
+            for(row=0; row<rows; row++)
+                p->ind[row] = p->nulls[row] ? SQL_NULL_DATA : 0;
+            break;
+        case DDBT_NUM:
+            ctype = SQL_C_DOUBLE;
+            sqltype = SQL_DOUBLE;
+            colSize = 15;
+            width = sizeof(double);
+            value = p->data;
+            for(row=0; row<rows; row++)
+                p->ind[row] = p->nulls[row] ? SQL_NULL_DATA : 0;
+            break;
+        case DDBT_STR:
+        {
+            DDBSTR *strs = static_cast<DDBSTR*>(p->data);
+#ifndef DDB_USESTL
+            std::vector<std::string> utf(rows);
+            for(row=0; row<rows; row++)
+                utf[row] = strs[row].ToUTF8().data();
+#endif
+            SQLLEN len = p->maxLength;
+            if(len <= 0) {
+                for(row=0; row<rows; row++) {
+#ifdef DDB_USESTL
+                    if(!p->nulls[row] && (SQLLEN)strs[row].length() > len)
+                        len = strs[row].length();
+#else
+                    if(!p->nulls[row] && (SQLLEN)utf[row].length() > len)
+                        len = utf[row].length();
+#endif
+                }
+            }
+            if(len < 1)
+                len = 1;
+            ctype = SQL_C_CHAR;
+            sqltype = SQL_VARCHAR;
+            colSize = len;
+            width = len+1;
+            if(width > p->width) {
+                free(p->buffer);
+                p->buffer = (char*) malloc(width*capacity);
+                if(!p->buffer) {
+                    p->width = 0;
+                    return 18;
+                }
+                p->width = width;
+            }
+            width = p->width;
+            for(row=0; row<rows; row++) {
+                char *cell = p->buffer + row*width;
+                if(p->nulls[row]) {
+                    p->ind[row] = SQL_NULL_DATA;
+                    continue;
+                }
+#ifdef DDB_USESTL
+                const std::string &str = strs[row];
+#else
+                const std::string &str = utf[row];
+#endif
+                SQLLEN sl = (SQLLEN)str.length();
+                if(sl > len) {
+                    CS_VAPRT_ERRO("DdbOdbcParamArray::BindParameters - String of row %d of parameter %d is longer than %d bytes.",
+                                  row, ndx+1, p->maxLength);
+                    return 17;
+                }
+                memcpy(cell, str.data(), sl);
+                cell[sl] = 0;
+                p->ind[row] = sl;
+            }
+            value = p->buffer;
+            break;
+        }
+        default:
+            // Types that are converted into a fixed size buffer.
+            switch(p->type) {
+            case DDBT_BOOL:
+                ctype = SQL_C_BIT;
+                sqltype = SQL_BIT;
+                colSize = 1;
+                width = 1;
+                break;
+            case DDBT_CHR:
+                ctype = SQL_C_CHAR;
+                sqltype = SQL_CHAR;
+                colSize = 1;
+                width = 2;
+                break;
+            case DDBT_TIME:
+                ctype = SQL_C_TYPE_TIMESTAMP;
+                sqltype = SQL_TYPE_TIMESTAMP;
+                colSize = 19;
+                width = sizeof(TIMESTAMP_STRUCT);
+                break;
+            default: // DDBT_DAY
+                ctype = SQL_C_TYPE_DATE;
+                sqltype = SQL_TYPE_DATE;
+                colSize = 10;
+                width = sizeof(DATE_STRUCT);
+                break;
+            }
+            if(!p->buffer) {
+                p->buffer = (char*) malloc(width*capacity);
+                if(!p->buffer)
+                    return 18;
+                p->width = width;
+            }
+            for(row=0; row<rows; row++) {
+                char *cell = p->buffer + row*width;
+                if(p->nulls[row]) {
+                    p->ind[row] = SQL_NULL_DATA;
+                    continue;
+                }
+                p->ind[row] = p->type==DDBT_CHR ? 1 : 0;
+                if(p->type == DDBT_BOOL) {
+                    *(unsigned char*)cell = static_cast<bool*>(p->data)[row] ? 1:0;
+                    continue;
+                }
+                if(p->type == DDBT_CHR) {
+#ifdef DDB_USESTL
+                    cell[0] = static_cast<char*>(p->data)[row];
+#else
+                    cell[0] = (char)static_cast<wxUniChar*>(p->data)[row];
+#endif
+                    cell[1] = 0;
+                    continue;
+                }
+#ifdef DDB_USESTL
+                tmtime = static_cast<tm*>(p->data)[row];
+#else
+                wxDateTime::Tm wtm = static_cast<wxDateTime*>(p->data)[row].GetTm();
+                memset(&tmtime,0,sizeof(tm));
+                tmtime.tm_year = wtm.year-1900;
+                tmtime.tm_mon  = wtm.mon;
+                tmtime.tm_mday = wtm.mday;
+                tmtime.tm_hour = wtm.hour;
+                tmtime.tm_min  = wtm.min;
+                tmtime.tm_sec  = wtm.sec;
+#endif
+                if(p->type == DDBT_TIME) {
+                    TIMESTAMP_STRUCT *ts = (TIMESTAMP_STRUCT*)cell;
+                    ts->year   = tmtime.tm_year+1900;
+                    ts->month  = tmtime.tm_mon+1;
+                    ts->day    = tmtime.tm_mday;
+                    ts->hour   = tmtime.tm_hour;
+                    ts->minute = tmtime.tm_min;
+                    ts->second = tmtime.tm_sec;
+                    ts->fraction = 0;
+                }
+                else {
+                    DATE_STRUCT *ds = (DATE_STRUCT*)cell;
+                    ds->year  = tmtime.tm_year+1900;
+                    ds->month = tmtime.tm_mon+1;
+                    ds->day   = tmtime.tm_mday;
+                }
+            }
+            value = p->buffer;
+            break;
+        }
+        sqlrv = SQLBindParameter(stmt,ndx+1,SQL_PARAM_INPUT,ctype,sqltype,colSize,digits,value,width,p->ind);
+        if(!SQLSUCCESS(sqlrv)) {
+            CS_VAPRT_ERRO("DdbOdbcParamArray::BindParameters - SQLBindParameter failure %d for parameter %d",sqlrv,ndx+1);
+            return 18;
+        }
+    }
+    return 0;
+}
@@ -1,78 +1,179 @@
-/*******************************************************************************
-File: ddbodbc.hpp
-$Revision: 1.2 $
-Copyright (c) Menacon Inc
-*******************************************************************************/
-
-#ifndef DDB_ODBC_H_FILE
-#define DDB_ODBC_H_FILE
-
-#include <windows.h>
-#include <sql.h>
-#include <sqlext.h>
-
-#define SQLSUCCESS(rc) ((rc==SQL_SUCCESS)||(rc==SQL_SUCCESS_WITH_INFO))
-
-// ==================================================================================================
-//! Class defines ODBC specific implementation to DirectDatabase-interface.
-/*! This class ignores the database name. Set the DSN to server name.
- */
-class DdbOdbc : public DirectDatabase
-{
-public:
-    DdbOdbc();
-    ~DdbOdbc();
-
-    int GetType() { return DDBTYPE_ODBC; }
-    bool Connect(int timeout=0);
-    bool Disconnect();
-
-    DdbRowSet* CreateRowSet();
-    DDBSTR GetErrorDescription(DdbRowSet *rs);
-
-    bool StartTransaction();
-    bool Commit();
-    bool RollBack();
-
-    bool ExecuteIntFunction(const DDBSTR &query,int &val);
-    bool ExecuteDoubleFunction(const DDBSTR &query, double &val);
-    bool ExecuteBoolFunction(const DDBSTR &query, bool &val);
-    bool ExecuteStrFunction(const DDBSTR &query, DDBSTR &result);
-    bool ExecuteDateFunction(const DDBSTR &query, DDBTIME &val);
-    int ExecuteModify(const DDBSTR &query);
-    unsigned long GetInsertId() { return 0; } // NOT SUPPORTED
-    bool UpdateStructure(const DDBSTR &command);
-
-    SQLHANDLE GetEnv() { return hEnvironment; }
-    SQLHANDLE GetCon() { return hConnection; }
-
-protected:
-    void FreeExecStmt();
-
-    SQLHANDLE hEnvironment;  //!< Environment handle.
-    SQLHANDLE hConnection;   //!< Connection handle.
-    SQLHANDLE execStmt;      //!< Statement handle that is used for Exec-functions.
-};
-
-// ==================================================================================================
-//! Class defines PostgreSQL specific implementation to DdbRowSet-interface.
-class DdbOdbcRowSet : public DdbRowSet
-{
-    friend class DdbOdbc;
-public:
-    ~DdbOdbcRowSet();
-
-    bool Query(const DDBSTR &query);
-    int GetNext();
-
-protected:
-    DdbOdbcRowSet(DirectDatabase*);
-
-    DdbOdbc*   db;              //!< Pointer to databse object.
-    int        currentRow;      //!< The number of the current row in the
-    bool       resultCleared;   //!< True if the result has been cleared.
-    int        bindIndex;       //!< Index nubmer of the current bind. Starts from 1.
-    SQLHANDLE  hStmt;           //!< Statement handle for this row set.
-};
-
-#endif
+/*******************************************************************************
+File: ddbodbc.hpp
+$Revision: 1.3 $
+Copyright (c) Menacon Inc
+*******************************************************************************/
+
+#ifndef DDB_ODBC_H_FILE
+#define DDB_ODBC_H_FILE
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <sql.h>
+#include <sqlext.h>
+#include <vector>
+
+#define SQLSUCCESS(rc) ((rc==SQL_SUCCESS)||(rc==SQL_SUCCESS_WITH_INFO))
+
+const int DDB_ODBC_ROWARRAY    = 256;         //!< Default number of rows fetched with one SQLFetch.
+const SQLULEN DDB_ODBC_MAXSTR  = 4096;        //!< Longest string column (in characters) fetched with block cursor.
+const SQLULEN DDB_ODBC_MAXBLOCK = 0x100000;   //!< Maximum size of the block cursor buffers per rowset.
+
+// ==================================================================================================
+//! Column-wise parameter arrays for DdbOdbc::ExecuteArray.
+/*! Each bound parameter is a client side array with one value per row. The values are bound
+    with SQLBindParameter and all rows are sent to the driver with one SQLExecute. After the
+    execution the status of each row can be checked with GetStatus or IsRowOK.
+    Usage:
+    \code
+    int ids[1000];
+    std::string names[1000];
+    DdbOdbcParamArray params(1000);
+    params.Bind(DDBT_INT, ids);
+    params.Bind(DDBT_STR, names);
+    int ok = db.ExecuteArray("INSERT INTO t(id,name) VALUES(?,?)", params);
+    \endcode
+ */
+class DdbOdbcParamArray
+{
+    friend class DdbOdbc;
+public:
+    DdbOdbcParamArray(int rows);
+    ~DdbOdbcParamArray();
+
+    bool Bind(short int type, void *data, int maxLength=0);
+    void SetNull(int param, int row, bool isNull=true);
+    void ClearNulls();
+    //! Sets the number of rows used by the next execution. Can not exceed the row count given to the constructor.
+    void SetRows(int count) { rows = count>0 && count<=capacity ? count : capacity; }
+    int GetRows() { return rows; }
+    int GetParamCount() { return (int)params.size(); }
+    //! Returns the SQL_PARAM_... status of the row after the execution.
+    SQLUSMALLINT GetStatus(int row) { return status[row]; }
+    bool IsRowOK(int row) { return status[row]==SQL_PARAM_SUCCESS || status[row]==SQL_PARAM_SUCCESS_WITH_INFO; }
+    //! Returns the number of rows the driver processed in the last execution.
+    SQLULEN GetProcessed() { return processed; }
+
+protected:
+    int BindParameters(SQLHANDLE stmt);
+
+    //! Bound parameter array.
+    struct Param {
+        short int   type;       //!< DDBT_... type of the client data.
+        void       *data;       //!< Client array.
+        int         maxLength;  //!< Longest string in characters. Zero = measured at execution.
+        char       *buffer;     //!< Converted values when the client type can not be bound directly.
+        SQLLEN      width;      //!< Bytes per row in buffer.
+        SQLLEN     *ind;        //!< Length / indicator per row.
+        bool       *nulls;      //!< Rows that are sent as NULL.
+    };
+
+    std::vector<Param> params;
+    std::vector<SQLUSMALLINT> status;
+    SQLULEN processed;
+    int capacity;
+    int rows;
+};
+
+// ==================================================================================================
+//! Class defines ODBC specific implementation to DirectDatabase-interface.
+/*! Connection string is passed to SQLDriverConnect as it is, e.g.
+    "DSN=mydsn;UID=user;PWD=secret" or "DRIVER=SQLite3;Database=/tmp/test.db". Works with
+    unixODBC on Linux and with the Windows driver manager.
+ */
+class DdbOdbc : public DirectDatabase
+{
+public:
+    DdbOdbc();
+    ~DdbOdbc();
+
+    int GetType() { return DDBTYPE_ODBC; }
+    bool Connect(const char *constr);
+    bool Disconnect();
+    bool IsConnectOK();
+    bool ResetConnection();
+
+    DdbRowSet* CreateRowSet();
+    DDBSTR GetErrorDescription(DdbRowSet *rs);
+
+    bool StartTransaction();
+    bool Commit();
+    bool RollBack();
+
+    bool ExecuteIntFunction(const DDBSTR &query,uint32_t &val);
+    bool ExecuteLongFunction(const DDBSTR &query,uint64_t &val);
+    bool ExecuteDoubleFunction(const DDBSTR &query, double &val);
+    bool ExecuteBoolFunction(const DDBSTR &query, bool &val);
+    bool ExecuteStrFunction(const DDBSTR &query, DDBSTR &result);
+    bool ExecuteDateFunction(const DDBSTR &query, DDBTIME &val);
+    int ExecuteModify(const DDBSTR &query);
+    int ExecuteArray(const DDBSTR &query, DdbOdbcParamArray &params);
+    uint64_t GetInsertId() { return 0; } // NOT SUPPORTED
+    bool UpdateStructure(const DDBSTR &command);
+
+    SQLHANDLE GetEnv() { return hEnvironment; }
+    SQLHANDLE GetCon() { return hConnection; }
+    //! Sets the number of rows fetched by the rowsets with one driver call. One turns the block cursor off.
+    void SetRowArraySize(int rows) { rowArraySize = rows>0 ? rows : 1; }
+    int GetRowArraySize() { return rowArraySize; }
+
+protected:
+    bool ExecuteFunction(const DDBSTR &query, const char *caller);
+    bool EndTransaction(SQLSMALLINT completion);
+    void FreeExecStmt();
+
+    SQLHANDLE hEnvironment;  //!< Environment handle.
+    SQLHANDLE hConnection;   //!< Connection handle.
+    SQLHANDLE execStmt;      //!< Statement handle that is used for Exec-functions.
+    DDBSTR    conString;     //!< Connection string for the reset.
+    int       rowArraySize;  //!< Rows per fetch for block cursors.
+};
+
+// ==================================================================================================
+//! Class defines ODBC specific implementation to DdbRowSet-interface.
+/*! Rows are fetched with a block cursor: the bound fields are bound as column arrays and one
+    SQLFetch call retrieves up to DdbOdbc::GetRowArraySize rows. GetNext then converts the rows
+    from the arrays without driver calls. If the result contains string columns that are longer
+    than DDB_ODBC_MAXSTR (or of unknown length) the rowset falls back to SQLGetData per row.
+ */
+class DdbOdbcRowSet : public DdbRowSet
+{
+    friend class DdbOdbc;
+public:
+    ~DdbOdbcRowSet();
+
+    bool Query(const DDBSTR &query);
+    int GetNext();
+    void QuitQuery();
+
+protected:
+    DdbOdbcRowSet(DirectDatabase*);
+    void Describe(SQLSMALLINT maxFields);
+    bool BindArrays(SQLSMALLINT maxFields);
+    void FreeArrays();
+    int ConvertBlockRow(SQLULEN row);
+    int ConvertRow();
+
+    //! Column array of the block cursor.
+    struct ColumnArray {
+        SQLSMALLINT ctype;      //!< C data type the column is bound with.
+        SQLLEN      width;      //!< Bytes reserved for one row.
+        char       *data;       //!< Column values, width bytes per row.
+        SQLLEN     *ind;        //!< Length / indicator of each row.
+    };
+
+    DdbOdbc*   db;              //!< Pointer to databse object.
+    int        currentRow;      //!< The number of the current row in the
+    bool       resultCleared;   //!< True if the result has been cleared.
+    bool       blockMode;       //!< True if the current result is read with the block cursor.
+    SQLHANDLE  hStmt;           //!< Statement handle for this row set.
+    ColumnArray *arrays;        //!< Bound column arrays. One per bound field.
+    int        arrayCount;      //!< Number of entries in arrays.
+    SQLULEN    arraySize;       //!< Rows per fetch for the current result.
+    SQLULEN    rowsFetched;     //!< Rows in the current block. Set by the driver.
+    SQLULEN    blockRow;        //!< Next row in the current block.
+    SQLUSMALLINT *rowStatus;    //!< Row status array of the current block.
+};
+
+#endif
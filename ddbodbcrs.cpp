@@ -1,205 +1,645 @@
-/*******************************************************************************
-ddbodbcrs.cpp
-Copyright (c) Antti Merenluoto
-*******************************************************************************/
-
-#ifdef __linux__
-    #error Not supported currently.
-#endif
-#include <stdlib.h>
-#ifdef DDB_USEWX
-  #include <wx/wxprec.h>
-  #ifndef WX_PRECOMP
-    #include <wx/wx.h>
-  #endif
-#include "wx/datetime.h"
-#endif
-#define __DDB_ODBCWIN__
-#include "directdatabase.hpp"
-
-// ==================================================================================================
-DdbOdbcRowSet::DdbOdbcRowSet(DirectDatabase *db_in)
-    :DdbRowSet()
-/*!
-    Initializes member variables to default values.
-    \param db_in Pointer to database object.
-*/
-{
-    currentRow = 0;
-    bindIndex = 1;
-    resultCleared = true;
-
-    db = static_cast<DdbOdbc*>(db_in);
-    SQLAllocHandle(SQL_HANDLE_STMT,db->GetCon(),&hStmt);
-}
-
-// ==================================================================================================
-DdbOdbcRowSet::~DdbOdbcRowSet()
-/*!
-    Relases the statement handle
-*/
-{
-    if(!resultCleared)
-        SQLCloseCursor(hStmt);
-    if(hStmt != SQL_NULL_HANDLE)
-        SQLFreeHandle(SQL_HANDLE_STMT,hStmt);
-}
-
-// ==================================================================================================
-bool DdbOdbcRowSet::Query(const DDBSTR &query)
-{
-    SQLSMALLINT maxFields;
-
-    if(!fieldRoot)
-    {
-        db->SetErrorId(9);
-        return  false;
-    }
-    queryStmt = query;
-    if(queryStmt.LENGTH()==0)
-        return false;
-    if(!resultCleared)
-        SQLCloseCursor(hStmt);
-
-    SQLRETURN sqlrv = SQLExecDirect(hStmt,(SQLCHAR*)query.DATA(),query.LENGTH());
-    if(!SQLSUCCESS(sqlrv))
-    {
-        ostringstream ss;
-        db->SetErrorId(8);
-        ss << "DdbOdbc::Query - SQLExecDirect failure " << sqlrv << endl << db->GetErrorDescription(this).DATA();
-        db->Log(ss);
-        resultCleared = true;
-        return false;
-    }
-
-    // If result is empty:
-    sqlrv = SQLNumResultCols(hStmt,&maxFields);
-    if(!SQLSUCCESS(sqlrv) || !maxFields)
-    {
-        // Close the cursor
-        SQLCloseCursor(hStmt);
-        resultCleared = true;
-        return false;
-    }
-
-    resultCleared = false;
-    currentRow = 0;
-    return true;
-}
-
-// ==================================================================================================
-int DdbOdbcRowSet::GetNext()
-{
-    DdbBoundField *field;
-    int fieldIndex;
-    char *str,boolChar;
-    SQLINTEGER cb;
-    SQLRETURN sqlrv;
-    TIMESTAMP_STRUCT timestamp;
-    DATE_STRUCT date;
-    tm tmtime;
-
-    if(resultCleared)
-        return 0;
-
-    sqlrv = SQLFetch(hStmt);
-    if(sqlrv == SQL_NO_DATA)
-    {
-        SQLCloseCursor(hStmt);
-        resultCleared = true;
-        return 0;
-    }
-    if(!SQLSUCCESS(sqlrv))
-    {
-        SQLCloseCursor(hStmt);
-        resultCleared = true;
-        db->SetErrorId(20);
-        return 0;
-    }
-
-    field = fieldRoot;
-    fieldIndex = 1;
-    while(field)
-    {
-        // Use type to convert the data. DDB_TYPE_USED
-        switch(field->type)
-        {
-        case DDBT_INT:
-            SQLGetData(hStmt,fieldIndex,SQL_C_SLONG,field->data,0,&cb);
-            break;
-        case DDBT_STR:
-            sqlrv = SQLGetData(hStmt,fieldIndex,SQL_C_CHAR,&boolChar,0,&cb);
-            if(!SQLSUCCESS(sqlrv))
-            {
-                ostringstream error;
-                error << db->GetErrorDescription(this).DATA();
-                db->Log(error);
-            }
-            else if(cb != SQL_NULL_DATA && cb != SQL_NO_TOTAL)
-            {
-#ifdef DDB_USESTL
-                str = new char(cb+1);
-                SQLGetData(hStmt,fieldIndex,SQL_C_CHAR,str,cb+1,&cb);
-                static_cast<DDBSTR*>(field->data)->assign(str);
-                delete[] str;
-#else
-                str = static_cast<DDBSTR*>(field->data)->GetWriteBuf(cb+1);
-                SQLGetData(hStmt,fieldIndex,SQL_C_CHAR,str,cb+1,&cb);
-                static_cast<DDBSTR*>(field->data)->UngetWriteBuf();
-                static_cast<DDBSTR*>(field->data)->Trim();
-#endif
-            }
-            else
-#ifdef DDB_USESTL
-                static_cast<DDBSTR*>(field->data)->erase();
-#else
-                static_cast<DDBSTR*>(field->data)->Empty();
-#endif
-            break;
-        case DDBT_BOOL:
-            SQLGetData(hStmt,fieldIndex,SQL_C_CHAR,&boolChar,1,&cb);
-            *(static_cast<bool*>(field->data)) = boolChar == 't'? true : false;
-            break;
-        case DDBT_TIME:
-            memset(&tmtime,0,sizeof(tm));
-            SQLGetData(hStmt,fieldIndex,SQL_C_TYPE_TIMESTAMP,&timestamp,sizeof(TIMESTAMP_STRUCT),&cb);
-            tmtime.tm_year = timestamp.year-1900;
-            tmtime.tm_mon  = timestamp.month-1;
-            tmtime.tm_mday = timestamp.day;
-            tmtime.tm_hour = timestamp.hour;
-            tmtime.tm_min  = timestamp.minute;
-            tmtime.tm_sec  = timestamp.second;
-            tmtime.tm_isdst = -1;
-#ifdef DDB_USESTL
-            memcpy(field->data,&tmtime,sizeof(tmtime));
-#else
-            static_cast<DDBTIME*>(field->data)->Set(tmtime);
-#endif
-            break;
-        case DDBT_DAY:
-            memset(&tmtime,0,sizeof(tm));
-            SQLGetData(hStmt,fieldIndex,SQL_C_TYPE_DATE,&date,sizeof(DATE_STRUCT),&cb);
-            tmtime.tm_year = date.year-1900;
-            tmtime.tm_mon  = date.month-1;
-            tmtime.tm_mday = date.day;
-            tmtime.tm_isdst = -1;
-#ifdef DDB_USESTL
-            memcpy(field->data,&tmtime,sizeof(tmtime));
-#else
-            static_cast<DDBTIME*>(field->data)->Set(tmtime);
-#endif
-            break;
-        case DDBT_NUM:
-            SQLGetData(hStmt,fieldIndex,SQL_C_DOUBLE,field->data,0,&cb);
-            break;
-        case DDBT_CHR:
-            SQLGetData(hStmt,fieldIndex,SQL_C_STINYINT,field->data,1,&cb);
-            break;
-        }
-
-        field = field->next;
-        fieldIndex++;
-    }
-
-    return ++currentRow;
-}
+/*******************************************************************************
+ddbodbcrs.cpp
+Copyright (c) Antti Merenluoto
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#ifdef DDB_USEWX
+  #include <wx/wxprec.h>
+  #ifndef WX_PRECOMP
+    #include <wx/wx.h>
+  #endif
+#include "wx/datetime.h"
+#endif
+#include <cpp4scripts.hpp>
+#define __DDB_ODBC__
+#include "directdatabase.hpp"
+
+// ==================================================================================================
+static void TimestampToTm(const TIMESTAMP_STRUCT *ts, tm *tmtime)
+{
+    memset(tmtime,0,sizeof(tm));
+    tmtime->tm_year = ts->year-1900;
+    tmtime->tm_mon  = ts->month-1;
+    tmtime->tm_mday = ts->day;
+    tmtime->tm_hour = ts->hour;
+    tmtime->tm_min  = ts->minute;
+    tmtime->tm_sec  = ts->second;
+    tmtime->tm_isdst = -1;
+}
+
+// ==================================================================================================
+static void DateToTm(const DATE_STRUCT *date, tm *tmtime)
+{
+    memset(tmtime,0,sizeof(tm));
+    tmtime->tm_year = date->year-1900;
+    tmtime->tm_mon  = date->month-1;
+    tmtime->tm_mday = date->day;
+    tmtime->tm_isdst = -1;
+}
+
+// ==================================================================================================
+static void SetTime(void *data, const tm *tmtime)
+{
+#ifdef DDB_USESTL
+    memcpy(data,tmtime,sizeof(tm));
+#else
+    static_cast<DDBTIME*>(data)->Set(*tmtime);
+#endif
+}
+
+// ==================================================================================================
+static void SetString(void *data, const char *str, size_t len, bool trim)
+{
+#ifdef DDB_USESTL
+    static_cast<std::string*>(data)->assign(str,len);
+    if(trim)
+        DirectDatabase::TrimTail(static_cast<std::string*>(data));
+#else
+    *(static_cast<wxString*>(data)) = wxString::FromUTF8(str,len);
+    if(trim)
+        static_cast<wxString*>(data)->Trim();
+#endif
+}
+
+// ==================================================================================================
+DdbOdbcRowSet::DdbOdbcRowSet(DirectDatabase *db_in)
+    :DdbRowSet()
+/*!
+    Initializes member variables to default values.
+    \param db_in Pointer to database object.
+*/
+{
+    currentRow = 0;
+    resultCleared = true;
+    blockMode = false;
+    arrays = 0;
+    arrayCount = 0;
+    arraySize = 1;
+    rowsFetched = 0;
+    blockRow = 0;
+    rowStatus = 0;
+
+    db = static_cast<DdbOdbc*>(db_in);
+    if(!SQLSUCCESS(SQLAllocHandle(SQL_HANDLE_STMT,db->GetCon(),&hStmt))) {
+        CS_PRINT_ERRO("DdbOdbcRowSet::DdbOdbcRowSet - Unable to allocate statement handle.");
+        hStmt = SQL_NULL_HANDLE;
+    }
+}
+
+// ==================================================================================================
+DdbOdbcRowSet::~DdbOdbcRowSet()
+/*!
+    Relases the statement handle
+*/
+{
+    QuitQuery();
+    if(hStmt != SQL_NULL_HANDLE)
+        SQLFreeHandle(SQL_HANDLE_STMT,hStmt);
+}
+
+// ==================================================================================================
+bool DdbOdbcRowSet::Query(const DDBSTR &query)
+{
+    SQLSMALLINT maxFields;
+
+    if(!fieldRoot && !autoDescribe)
+    {
+        db->SetErrorId(9);
+        return  false;
+    }
+    queryStmt = query;
+    if(queryStmt.LENGTH()==0 || hStmt == SQL_NULL_HANDLE)
+        return false;
+    QuitQuery();
+
+    SQLRETURN sqlrv = SQLExecDirect(hStmt,(SQLCHAR*)query.DATA(),SQL_NTS);
+    if(!SQLSUCCESS(sqlrv))
+    {
+        db->SetErrorId(8);
+        CS_VAPRT_ERRO("DdbOdbcRowSet::Query - SQLExecDirect failure %d: %s",sqlrv,query.DATA());
+        CS_PRINT_ERRO(db->GetErrorDescription(this).DATA());
+        return false;
+    }
+
+    // If result is empty:
+    sqlrv = SQLNumResultCols(hStmt,&maxFields);
+    if(!SQLSUCCESS(sqlrv) || !maxFields)
+    {
+        SQLCloseCursor(hStmt);
+        return false;
+    }
+    resultCleared = false;
+    currentRow = 0;
+    if(autoDescribe)
+        Describe(maxFields);
+    blockMode = db->GetRowArraySize()>1 && BindArrays(maxFields);
+    return true;
+}
+
+// ==================================================================================================
+void DdbOdbcRowSet::Describe(SQLSMALLINT maxFields)
+/*!
+  Describes the columns of the result from SQLDescribeCol and binds them.
+*/
+{
+    SQLCHAR name[256];
+    SQLSMALLINT nameLen, sqltype;
+
+    columns.resize(maxFields);
+    for(SQLSMALLINT col=0; col<maxFields; col++) {
+        DdbColumn &column = columns[col];
+        sqltype = SQL_UNKNOWN_TYPE;
+        if(!SQLSUCCESS(SQLDescribeCol(hStmt,col+1,name,sizeof(name),&nameLen,&sqltype,0,0,0)))
+            name[0] = 0;
+        column.name = (const char*)name;
+        column.dbType = (unsigned int)sqltype;
+        // DDB_TYPE_USED
+        switch(sqltype) {
+        case SQL_TINYINT:
+        case SQL_SMALLINT:
+        case SQL_INTEGER:
+            column.type = DDBT_INT;
+            break;
+        case SQL_BIGINT:
+            column.type = DDBT_LONG;
+            break;
+        case SQL_DECIMAL:
+        case SQL_NUMERIC:
+            column.type = DDBT_DEC;
+            break;
+        case SQL_REAL:
+        case SQL_FLOAT:
+        case SQL_DOUBLE:
+            column.type = DDBT_NUM;
+            break;
+        case SQL_BIT:
+            column.type = DDBT_BOOL;
+            break;
+        case SQL_TYPE_DATE:
+            column.type = DDBT_DAY;
+            break;
+        case SQL_TYPE_TIMESTAMP:
+            column.type = DDBT_TIME;
+            break;
+        case SQL_GUID:
+            column.type = DDBT_UUID;
+            break;
+        case SQL_BINARY:
+        case SQL_VARBINARY:
+        case SQL_LONGVARBINARY:
+            column.type = DDBT_BLOB;
+            break;
+        default:
+            column.type = DDBT_STR;
+            break;
+        }
+    }
+    BindColumns();
+}
+
+// ==================================================================================================
+bool DdbOdbcRowSet::BindArrays(SQLSMALLINT maxFields)
+/*!
+  Binds the fields as column arrays for the block cursor. Array size is reduced so that the
+  buffers stay within DDB_ODBC_MAXBLOCK.
+  \retval bool False if the result can not be read with the block cursor. Rows are then read
+    with SQLGetData.
+*/
+{
+    SQLULEN colSize, rowWidth, rows;
+    SQLSMALLINT ndx, count;
+    DdbBoundField *field;
+    SQLRETURN sqlrv;
+
+    count = 0;
+    for(field=fieldRoot; field && count<maxFields; field=field->next)
+        count++;
+    arrays = new ColumnArray[count];
+    arrayCount = count;
+
+    rowWidth = 0;
+    ndx = 0;
+    for(field=fieldRoot; ndx<count; field=field->next, ndx++)
+    {
+        ColumnArray &col = arrays[ndx];
+        col.data = 0;
+        col.ind = 0;
+        switch(field->type)
+        {
+        case DDBT_INT:
+            col.ctype = SQL_C_SLONG;
+            col.width = sizeof(SQLINTEGER);
+            break;
+        case DDBT_STR:
+            colSize = 0;
+            sqlrv = SQLDescribeCol(hStmt,ndx+1,0,0,0,0,&colSize,0,0);
+            if(!SQLSUCCESS(sqlrv) || colSize==0 || colSize>DDB_ODBC_MAXSTR) {
+                FreeArrays();
+                return false;
+            }
+            col.ctype = SQL_C_CHAR;
+            col.width = colSize*4+1; // Room for UTF-8 and terminating zero.
+            break;
+        case DDBT_BOOL:
+        case DDBT_CHR:
+            col.ctype = SQL_C_CHAR;
+            col.width = 8;
+            break;
+        case DDBT_TIME:
+            col.ctype = SQL_C_TYPE_TIMESTAMP;
+            col.width = sizeof(TIMESTAMP_STRUCT);
+            break;
+        case DDBT_DAY:
+            col.ctype = SQL_C_TYPE_DATE;
+            col.width = sizeof(DATE_STRUCT);
+            break;
+        case DDBT_NUM:
+            col.ctype = SQL_C_DOUBLE;
+            col.width = sizeof(SQLDOUBLE);
+            break;
+        case DDBT_LONG:
+            col.ctype = SQL_C_SBIGINT;
+            col.width = sizeof(SQLBIGINT);
+            break;
+        case DDBT_DEC:
+        case DDBT_UUID:
+            // Read as text. Drivers convert the GUID and numeric columns.
+            col.ctype = SQL_C_CHAR;
+            col.width = DDB_DECIMAL_TEXT;
+            break;
+        default:
+            FreeArrays();
+            return false;
+        }
+        // Keep the row alignment for numeric and struct types.
+        col.width = (col.width+sizeof(SQLLEN)-1) & ~(sizeof(SQLLEN)-1);
+        rowWidth += col.width + sizeof(SQLLEN);
+    }
+
+    rows = DDB_ODBC_MAXBLOCK/rowWidth;
+    if(rows > (SQLULEN)db->GetRowArraySize())
+        rows = db->GetRowArraySize();
+    if(rows < 1)
+        rows = 1;
+
+    sqlrv = SQLSetStmtAttr(hStmt,SQL_ATTR_ROW_BIND_TYPE,(SQLPOINTER)SQL_BIND_BY_COLUMN,0);
+    if(SQLSUCCESS(sqlrv))
+        sqlrv = SQLSetStmtAttr(hStmt,SQL_ATTR_ROW_ARRAY_SIZE,(SQLPOINTER)rows,0);
+    if(!SQLSUCCESS(sqlrv)) {
+        FreeArrays();
+        return false;
+    }
+    // Driver may have changed the value (01S02).
+    arraySize = rows;
+    SQLGetStmtAttr(hStmt,SQL_ATTR_ROW_ARRAY_SIZE,&arraySize,0,0);
+    if(arraySize < 1 || arraySize > rows) {
+        FreeArrays();
+        return false;
+    }
+    rowStatus = new SQLUSMALLINT[arraySize];
+    SQLSetStmtAttr(hStmt,SQL_ATTR_ROW_STATUS_PTR,rowStatus,0);
+    SQLSetStmtAttr(hStmt,SQL_ATTR_ROWS_FETCHED_PTR,&rowsFetched,0);
+
+    for(ndx=0; ndx<count; ndx++)
+    {
+        ColumnArray &col = arrays[ndx];
+        col.data = (char*) malloc(col.width*arraySize);
+        col.ind  = (SQLLEN*) malloc(sizeof(SQLLEN)*arraySize);
+        if(!col.data || !col.ind) {
+            CS_PRINT_ERRO("DdbOdbcRowSet::BindArrays - Out of memory.");
+            FreeArrays();
+            return false;
+        }
+        sqlrv = SQLBindCol(hStmt,ndx+1,col.ctype,col.data,col.width,col.ind);
+        if(!SQLSUCCESS(sqlrv)) {
+            CS_VAPRT_ERRO("DdbOdbcRowSet::BindArrays - SQLBindCol failure %d for column %d",sqlrv,ndx+1);
+            FreeArrays();
+            return false;
+        }
+    }
+    rowsFetched = 0;
+    blockRow = 0;
+    return true;
+}
+
+// ==================================================================================================
+void DdbOdbcRowSet::FreeArrays()
+/*!
+  Unbinds the column arrays and resets the statement to single row fetch.
+*/
+{
+    if(hStmt != SQL_NULL_HANDLE && (arrays || rowStatus)) {
+        SQLFreeStmt(hStmt,SQL_UNBIND);
+        SQLSetStmtAttr(hStmt,SQL_ATTR_ROW_ARRAY_SIZE,(SQLPOINTER)1,0);
+        SQLSetStmtAttr(hStmt,SQL_ATTR_ROW_STATUS_PTR,0,0);
+        SQLSetStmtAttr(hStmt,SQL_ATTR_ROWS_FETCHED_PTR,0,0);
+    }
+    for(int ndx=0; ndx<arrayCount; ndx++) {
+        free(arrays[ndx].data);
+        free(arrays[ndx].ind);
+    }
+    delete[] arrays;
+    delete[] rowStatus;
+    arrays = 0;
+    arrayCount = 0;
+    rowStatus = 0;
+    arraySize = 1;
+    rowsFetched = 0;
+    blockRow = 0;
+}
+
+// ==================================================================================================
+int DdbOdbcRowSet::GetNext()
+/*!
+  Copies the next row into the bound variables. In block mode a new block is fetched from the
+  driver only when the rows of the previous block have been used.
+  \retval int Number of the row read. Zero at the end of the result or on error.
+*/
+{
+    SQLRETURN sqlrv;
+
+    if(resultCleared)
+        return 0;
+
+    if(blockMode)
+    {
+        // Skip the rows the driver could not fetch.
+        while(blockRow < rowsFetched &&
+              (rowStatus[blockRow]==SQL_ROW_ERROR || rowStatus[blockRow]==SQL_ROW_NOROW))
+            blockRow++;
+        while(blockRow >= rowsFetched)
+        {
+            rowsFetched = 0;
+            blockRow = 0;
+            sqlrv = SQLFetch(hStmt);
+            if(sqlrv == SQL_NO_DATA)
+            {
+                QuitQuery();
+                return 0;
+            }
+            if(!SQLSUCCESS(sqlrv))
+            {
+                db->SetErrorId(20);
+                CS_VAPRT_ERRO("DdbOdbcRowSet::GetNext - SQLFetch failure %d",sqlrv);
+                CS_PRINT_ERRO(db->GetErrorDescription(this).DATA());
+                QuitQuery();
+                return 0;
+            }
+            while(blockRow < rowsFetched &&
+                  (rowStatus[blockRow]==SQL_ROW_ERROR || rowStatus[blockRow]==SQL_ROW_NOROW))
+                blockRow++;
+        }
+        ConvertBlockRow(blockRow++);
+        return ++currentRow;
+    }
+
+    sqlrv = SQLFetch(hStmt);
+    if(sqlrv == SQL_NO_DATA)
+    {
+        QuitQuery();
+        return 0;
+    }
+    if(!SQLSUCCESS(sqlrv))
+    {
+        db->SetErrorId(20);
+        CS_VAPRT_ERRO("DdbOdbcRowSet::GetNext - SQLFetch failure %d",sqlrv);
+        CS_PRINT_ERRO(db->GetErrorDescription(this).DATA());
+        QuitQuery();
+        return 0;
+    }
+    ConvertRow();
+    return ++currentRow;
+}
+
+// ==================================================================================================
+int DdbOdbcRowSet::ConvertBlockRow(SQLULEN row)
+/*!
+  Copies values of the given block row from the column arrays into the bound variables.
+  \retval int Number of non-null values.
+*/
+{
+    DdbBoundField *field;
+    SQLLEN ind;
+    char *value;
+    tm tmtime;
+    int ndx, count=0;
+
+    bool trim = db->IsFeatureOn(DDB_FEATURE_AUTOTRIM);
+    for(field=fieldRoot, ndx=0; field && ndx<arrayCount; field=field->next, ndx++)
+    {
+        ColumnArray &col = arrays[ndx];
+        ind = col.ind[row];
+        value = col.data + row*col.width;
+        field->null = ind == SQL_NULL_DATA;
+        if(ind != SQL_NULL_DATA)
+            count++;
+        switch(field->type)
+        {
+        case DDBT_INT:
+            *(static_cast<int*>(field->data)) = ind==SQL_NULL_DATA ? 0 : *(SQLINTEGER*)value;
+            break;
+        case DDBT_STR:
+            if(ind == SQL_NULL_DATA)
+                static_cast<DDBSTR*>(field->data)->CLEAR();
+            else
+                SetString(field->data, value, ind==SQL_NO_TOTAL || ind>=col.width ? strlen(value) : ind, trim);
+            break;
+        case DDBT_BOOL:
+            *(static_cast<bool*>(field->data)) = ind!=SQL_NULL_DATA && value[0] && strchr("tTyY1",value[0]) ? true:false;
+            break;
+        case DDBT_CHR:
+#ifdef DDB_USESTL
+            *(static_cast<char*>(field->data)) = ind==SQL_NULL_DATA ? 0 : value[0];
+#else
+            *(static_cast<wxUniChar*>(field->data)) = ind==SQL_NULL_DATA ? 0 : value[0];
+#endif
+            break;
+        case DDBT_TIME:
+            if(ind == SQL_NULL_DATA)
+                memset(&tmtime,0,sizeof(tm));
+            else
+                TimestampToTm((TIMESTAMP_STRUCT*)value,&tmtime);
+            SetTime(field->data,&tmtime);
+            break;
+        case DDBT_DAY:
+            if(ind == SQL_NULL_DATA)
+                memset(&tmtime,0,sizeof(tm));
+            else
+                DateToTm((DATE_STRUCT*)value,&tmtime);
+            SetTime(field->data,&tmtime);
+            break;
+        case DDBT_NUM:
+            *(static_cast<double*>(field->data)) = ind==SQL_NULL_DATA ? 0 : *(SQLDOUBLE*)value;
+            break;
+        case DDBT_LONG:
+            *(static_cast<int64_t*>(field->data)) = ind==SQL_NULL_DATA ? 0 : *(SQLBIGINT*)value;
+            break;
+        case DDBT_DEC:
+            if(ind == SQL_NULL_DATA)
+                static_cast<DdbDecimal*>(field->data)->Clear();
+            else if(!static_cast<DdbDecimal*>(field->data)->Parse(value, strlen(value)))
+                CS_VAPRT_WARN("DdbOdbcRowSet::GetNext - Decimal parse failed for %s",value);
+            break;
+        case DDBT_UUID:
+            if(ind == SQL_NULL_DATA)
+                static_cast<DdbUuid*>(field->data)->Clear();
+            else
+                static_cast<DdbUuid*>(field->data)->Parse(value, strlen(value));
+            break;
+        }
+    }
+    return count;
+}
+
+// ==================================================================================================
+int DdbOdbcRowSet::ConvertRow()
+/*!
+  Reads the current row with SQLGetData. Used when the result can not be bound into arrays.
+  \retval int Number of non-null values.
+*/
+{
+    DdbBoundField *field;
+    SQLUSMALLINT fieldIndex;
+    SQLSMALLINT maxFields;
+    SQLLEN cb;
+    SQLRETURN sqlrv;
+    TIMESTAMP_STRUCT timestamp;
+    DATE_STRUCT date;
+    SQLINTEGER ival;
+    SQLBIGINT lval;
+    SQLDOUBLE dval;
+    char buffer[1024];
+    tm tmtime;
+    int count=0;
+
+    if(!SQLSUCCESS(SQLNumResultCols(hStmt,&maxFields)))
+        maxFields = 0;
+    bool trim = db->IsFeatureOn(DDB_FEATURE_AUTOTRIM);
+    for(field=fieldRoot, fieldIndex=1; field && fieldIndex<=maxFields; field=field->next, fieldIndex++)
+    {
+        cb = SQL_NULL_DATA;
+        switch(field->type)
+        {
+        case DDBT_INT:
+            sqlrv = SQLGetData(hStmt,fieldIndex,SQL_C_SLONG,&ival,0,&cb);
+            *(static_cast<int*>(field->data)) = SQLSUCCESS(sqlrv) && cb!=SQL_NULL_DATA ? ival : 0;
+            break;
+        case DDBT_STR:
+        {
+            // Read in pieces since the length may be unknown.
+            std::string value;
+            while( (sqlrv = SQLGetData(hStmt,fieldIndex,SQL_C_CHAR,buffer,sizeof(buffer),&cb)) != SQL_NO_DATA )
+            {
+                if(!SQLSUCCESS(sqlrv))
+                {
+                    CS_PRINT_ERRO(db->GetErrorDescription(this).DATA());
+                    break;
+                }
+                if(cb == SQL_NULL_DATA)
+                    break;
+                if(cb == SQL_NO_TOTAL || cb >= (SQLLEN)sizeof(buffer))
+                    value.append(buffer,sizeof(buffer)-1);
+                else
+                    value.append(buffer,cb);
+                if(sqlrv == SQL_SUCCESS)
+                    break;
+            }
+            if(cb == SQL_NULL_DATA)
+                static_cast<DDBSTR*>(field->data)->CLEAR();
+            else
+                SetString(field->data,value.c_str(),value.length(),trim);
+            break;
+        }
+        case DDBT_BOOL:
+            sqlrv = SQLGetData(hStmt,fieldIndex,SQL_C_CHAR,buffer,8,&cb);
+            *(static_cast<bool*>(field->data)) = SQLSUCCESS(sqlrv) && cb!=SQL_NULL_DATA && buffer[0] && strchr("tTyY1",buffer[0]) ? true:false;
+            break;
+        case DDBT_CHR:
+            sqlrv = SQLGetData(hStmt,fieldIndex,SQL_C_CHAR,buffer,8,&cb);
+            if(!SQLSUCCESS(sqlrv) || cb==SQL_NULL_DATA)
+                buffer[0] = 0;
+#ifdef DDB_USESTL
+            *(static_cast<char*>(field->data)) = buffer[0];
+#else
+            *(static_cast<wxUniChar*>(field->data)) = buffer[0];
+#endif
+            break;
+        case DDBT_TIME:
+            sqlrv = SQLGetData(hStmt,fieldIndex,SQL_C_TYPE_TIMESTAMP,&timestamp,sizeof(TIMESTAMP_STRUCT),&cb);
+            if(SQLSUCCESS(sqlrv) && cb!=SQL_NULL_DATA)
+                TimestampToTm(&timestamp,&tmtime);
+            else
+                memset(&tmtime,0,sizeof(tm));
+            SetTime(field->data,&tmtime);
+            break;
+        case DDBT_DAY:
+            sqlrv = SQLGetData(hStmt,fieldIndex,SQL_C_TYPE_DATE,&date,sizeof(DATE_STRUCT),&cb);
+            if(SQLSUCCESS(sqlrv) && cb!=SQL_NULL_DATA)
+                DateToTm(&date,&tmtime);
+            else
+                memset(&tmtime,0,sizeof(tm));
+            SetTime(field->data,&tmtime);
+            break;
+        case DDBT_NUM:
+            sqlrv = SQLGetData(hStmt,fieldIndex,SQL_C_DOUBLE,&dval,0,&cb);
+            *(static_cast<double*>(field->data)) = SQLSUCCESS(sqlrv) && cb!=SQL_NULL_DATA ? dval : 0;
+            break;
+        case DDBT_LONG:
+            sqlrv = SQLGetData(hStmt,fieldIndex,SQL_C_SBIGINT,&lval,0,&cb);
+            *(static_cast<int64_t*>(field->data)) = SQLSUCCESS(sqlrv) && cb!=SQL_NULL_DATA ? lval : 0;
+            break;
+        case DDBT_DEC:
+            sqlrv = SQLGetData(hStmt,fieldIndex,SQL_C_CHAR,buffer,DDB_DECIMAL_TEXT,&cb);
+            if(!SQLSUCCESS(sqlrv) || cb==SQL_NULL_DATA)
+                static_cast<DdbDecimal*>(field->data)->Clear();
+            else if(!static_cast<DdbDecimal*>(field->data)->Parse(buffer, strlen(buffer)))
+                CS_VAPRT_WARN("DdbOdbcRowSet::GetNext - Decimal parse failed for %s",buffer);
+            break;
+        case DDBT_UUID:
+            sqlrv = SQLGetData(hStmt,fieldIndex,SQL_C_CHAR,buffer,DDB_UUID_TEXT+2,&cb);
+            if(!SQLSUCCESS(sqlrv) || cb==SQL_NULL_DATA)
+                static_cast<DdbUuid*>(field->data)->Clear();
+            else
+                static_cast<DdbUuid*>(field->data)->Parse(buffer, strlen(buffer));
+            break;
+        case DDBT_BLOB:
+        {
+            DdbBlob *blob = static_cast<DdbBlob*>(field->data);
+            blob->clear();
+            // Read in pieces. Binary data has no terminating zero.
+            while( (sqlrv = SQLGetData(hStmt,fieldIndex,SQL_C_BINARY,buffer,sizeof(buffer),&cb)) != SQL_NO_DATA )
+            {
+                if(!SQLSUCCESS(sqlrv))
+                {
+                    CS_PRINT_ERRO(db->GetErrorDescription(this).DATA());
+                    break;
+                }
+                if(cb == SQL_NULL_DATA)
+                    break;
+                size_t len = cb == SQL_NO_TOTAL || cb > (SQLLEN)sizeof(buffer) ? sizeof(buffer) : cb;
+                blob->insert(blob->end(), (uint8_t*)buffer, (uint8_t*)buffer+len);
+                if(sqlrv == SQL_SUCCESS)
+                    break;
+            }
+            break;
+        }
+        }
+        field->null = cb == SQL_NULL_DATA;
+        if(cb != SQL_NULL_DATA)
+            count++;
+    }
+    return count;
+}
+
+// ==================================================================================================
+void DdbOdbcRowSet::QuitQuery()
+{
+    if(!resultCleared && hStmt != SQL_NULL_HANDLE)
+        SQLCloseCursor(hStmt);
+    FreeArrays();
+    resultCleared = true;
+    blockMode = false;
+}
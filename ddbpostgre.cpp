@@ -18,9 +18,16 @@ Copyright (c) Antti Merenluoto
   #include <stdlib.h>
   #include <errno.h>
 #endif
+#include <ctype.h>
+#ifdef _WIN32
+  #include <winsock2.h>
+#else
+  #include <poll.h>
+#endif
 #include <cpp4scripts.hpp>
 #define __DDB_POSTGRE__
 #include "directdatabase.hpp"
+#include "ddbexport.hpp"
 
 void DdbPQNoticeProcessor(void *, const char *message)
 {
@@ -59,6 +66,12 @@ WSADATA wsaData;
 #endif
     feat_support |= DDB_FEATURE_AUTOTRIM;
     connection = 0;
+    cancelHandle = 0;
+    canceled = false;
+    running = false;
+    statementTimeout = 0;
+    hasDeadline = false;
+    timedOut = false;
 }
 
 // ==================================================================================================
@@ -99,14 +112,24 @@ bool DdbPostgre::Connect(const char *constr)
     flags |= DDB_FLAG_CONNECTED;
     CS_VAPRT_INFO("Postgre client encoding id=%d",PQclientEncoding(connection));
     PQsetNoticeProcessor(connection, &DdbPQNoticeProcessor, 0);
+    UpdateCancel();
+    if(statementTimeout)
+        SetStatementTimeout(statementTimeout);
     return true;
 }
 
 // ==================================================================================================
 bool DdbPostgre::Disconnect()
 {
+    {
+        std::lock_guard<std::mutex> lock(cancelMutex);
+        if(cancelHandle)
+            PQfreeCancel(cancelHandle);
+        cancelHandle = 0;
+    }
     if(connection)
         PQfinish(connection);
+    connection = 0;
     flags &= ~DDB_FLAG_CONNECTED;
     return true;
 }
@@ -121,8 +144,311 @@ bool DdbPostgre::IsConnectOK()
 bool DdbPostgre::ResetConnection()
 {
     PQreset(connection);
+    flags &= ~DDB_FLAG_TRANSACT_ON;
+    UpdateCancel();
+    if(statementTimeout && IsConnectOK())
+        SetStatementTimeout(statementTimeout);
     return IsConnectOK();
 }
+
+// ==================================================================================================
+void DdbPostgre::UpdateCancel()
+/*!
+  Creates the cancel handle for the current backend. Called after (re)connect.
+*/
+{
+    std::lock_guard<std::mutex> lock(cancelMutex);
+    if(cancelHandle)
+        PQfreeCancel(cancelHandle);
+    cancelHandle = connection ? PQgetCancel(connection) : 0;
+}
+
+// ==================================================================================================
+bool DdbPostgre::Cancel()
+/*!
+  Asks the server to cancel the query that is running on this connection. Thread safe: intended
+  to be called from another thread than the one waiting for the query. The waiting call fails
+  and IsCanceled returns true. Does nothing if no query of Exec, ExecParams or Export is in
+  flight, so a late call does not mark the next query canceled.
+  \retval bool True if the cancel request was delivered to the server.
+*/
+{
+    std::lock_guard<std::mutex> lock(cancelMutex);
+    if(!cancelHandle || !running)
+        return false;
+    canceled = true;
+    char msg[256];
+    if(!PQcancel(cancelHandle, msg, sizeof(msg))) {
+        CS_VAPRT_WARN("DdbPostgre::Cancel failed: %s", msg);
+        return false;
+    }
+    return true;
+}
+
+// ==================================================================================================
+bool DdbPostgre::SendCancel()
+/*!
+  Sends a cancel request for whatever runs on the connection without marking a query canceled,
+  e.g. for a query that was sent with the libpq functions directly. Thread safe.
+  \retval bool True if the cancel request was delivered to the server.
+*/
+{
+    std::lock_guard<std::mutex> lock(cancelMutex);
+    char msg[256];
+    if(!cancelHandle)
+        return false;
+    if(!PQcancel(cancelHandle, msg, sizeof(msg))) {
+        CS_VAPRT_WARN("DdbPostgre::Cancel failed: %s", msg);
+        return false;
+    }
+    return true;
+}
+
+// ==================================================================================================
+void DdbPostgre::SetRunning(bool on)
+/*!
+  Marks a query in flight for Cancel. Starting a query clears the canceled flag. Code that sends
+  queries with the libpq functions directly sets this around the query so that Cancel reaches it.
+*/
+{
+    std::lock_guard<std::mutex> lock(cancelMutex);
+    running = on;
+    if(on)
+        canceled = false;
+}
+
+// ==================================================================================================
+bool DdbPostgre::SetStatementTimeout(int ms)
+/*!
+  Sets the statement timeout of the connection on the server and on the client. The setting
+  is restored when the connection is reset.
+  \param ms Timeout in milliseconds. Zero removes the timeout.
+  \retval bool False if the server did not accept the setting.
+*/
+{
+    statementTimeout = ms>0 ? ms : 0;
+    if(!connection)
+        return true;
+    char sql[64];
+    sprintf(sql, "SET statement_timeout = %d", statementTimeout);
+    PGresult *result = PQexec(connection, sql);
+    bool ok = PQresultStatus(result) == PGRES_COMMAND_OK;
+    if(!ok)
+        CS_VAPRT_WARN("DdbPostgre::SetStatementTimeout failed: %s", PQresultErrorMessage(result));
+    PQclear(result);
+    return ok;
+}
+
+// ==================================================================================================
+void DdbPostgre::SetDeadline(int ms)
+/*!
+  Sets the point in time by which the following queries must complete. Queries still running
+  then are canceled. Transaction control (commit and rollback) is not limited.
+  \param ms Deadline in milliseconds from now.
+*/
+{
+    deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+    hasDeadline = true;
+}
+
+// ==================================================================================================
+bool DdbPostgre::GetLimit(std::chrono::steady_clock::time_point &limit)
+/*!
+  Computes the time by which the next query must complete: the deadline or the statement
+  timeout from now, whichever is nearer.
+  \retval bool False if neither is set.
+*/
+{
+    using namespace std::chrono;
+    bool limited = hasDeadline;
+    limit = deadline;
+    if(statementTimeout) {
+        steady_clock::time_point stmt = steady_clock::now() + milliseconds(statementTimeout + DDB_PG_TIMEOUT_GRACE);
+        if(!limited || stmt < limit)
+            limit = stmt;
+        limited = true;
+    }
+    return limited;
+}
+
+// ==================================================================================================
+static bool WaitSocket(int sock, int ms)
+/*!
+  Waits until the socket is readable or the time has passed.
+  \param ms Time to wait in milliseconds. Negative waits without a limit.
+  \retval bool False on timeout.
+*/
+{
+#ifdef _WIN32
+    fd_set set;
+    FD_ZERO(&set);
+    FD_SET((SOCKET)sock, &set);
+    struct timeval tv;
+    tv.tv_sec = ms/1000;
+    tv.tv_usec = (ms%1000)*1000;
+    return select(sock+1, &set, 0, 0, ms<0 ? 0 : &tv) != 0;
+#else
+    struct pollfd pfd;
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, ms) != 0;
+#endif
+}
+
+// ==================================================================================================
+PGresult* DdbPostgre::Exec(const char *query)
+/*!
+  Executes the query like PQexec but honors the statement timeout and the deadline. Without
+  them the query is passed to PQexec. Otherwise the query is sent asynchronously and the
+  client waits for the socket until the limit, cancels the query and waits for it to finish
+  at most DDB_PG_CANCEL_WAIT ms. If that is exceeded too the connection is reset.
+  \retval PGresult* Result of the query, last one if there were several statements. Caller
+    must clear it. Null if the connection failed or the deadline had passed already.
+*/
+{
+    return Run(query, 0);
+}
+
+// ==================================================================================================
+PGresult* DdbPostgre::ExecParams(const char *query, const DdbPgParams &params)
+/*!
+  Executes a single statement with parameters like PQexecParams. Timeouts apply as with Exec.
+  \retval PGresult* Result of the query. Caller must clear it.
+*/
+{
+    return Run(query, &params);
+}
+
+// ==================================================================================================
+PGresult* DdbPostgre::Run(const char *query, const DdbPgParams *params)
+/*!
+  Implements Exec and ExecParams.
+  \param params Parameters or null for a plain query.
+*/
+{
+    using namespace std::chrono;
+    timedOut = false;
+    if(!connection)
+        return 0;
+    steady_clock::time_point limit;
+    if(!GetLimit(limit)) {
+        SetRunning(true);
+        PGresult *result = params
+            ? PQexecParams(connection, query, params->GetCount(), params->GetTypes(), params->GetValues(),
+                           params->GetLengths(), params->GetFormats(), 0)
+            : PQexec(connection, query);
+        SetRunning(false);
+        if(canceled) {
+            timedOut = true;
+            SetErrorId(27);
+        }
+        return result;
+    }
+    if(steady_clock::now() >= limit) {
+        CS_PRINT_WARN("DdbPostgre::Exec - Deadline has passed. Query was not sent.");
+        timedOut = true;
+        SetErrorId(27);
+        return 0;
+    }
+    SetRunning(true);
+    int sent = params
+        ? PQsendQueryParams(connection, query, params->GetCount(), params->GetTypes(), params->GetValues(),
+                            params->GetLengths(), params->GetFormats(), 0)
+        : PQsendQuery(connection, query);
+    if(!sent) {
+        SetRunning(false);
+        CS_VAPRT_ERRO("DdbPostgre::Exec - Send failed: %s", PQerrorMessage(connection));
+        return 0;
+    }
+    bool cancelSent = false;
+    PGresult *last = 0;
+    for(;;) {
+        PGresult *result = WaitResult(true, limit, cancelSent);
+        if(!result) {
+            if(timedOut) {
+                SetRunning(false);
+                PQclear(last);
+                return 0;
+            }
+            break;
+        }
+        ExecStatusType status = PQresultStatus(result);
+        if(status == PGRES_COPY_IN || status == PGRES_COPY_OUT || status == PGRES_COPY_BOTH) {
+            SetRunning(false);
+            PQclear(last);
+            return result;
+        }
+        // As with PQexec an error result is kept over the results that follow it.
+        if(last && (PQresultStatus(last) == PGRES_FATAL_ERROR || PQresultStatus(last) == PGRES_BAD_RESPONSE))
+            PQclear(result);
+        else {
+            PQclear(last);
+            last = result;
+        }
+    }
+    SetRunning(false);
+    if(canceled) {
+        CS_VAPRT_WARN("DdbPostgre::Exec - Query was canceled: %.200s", query);
+        timedOut = true;
+        SetErrorId(27);
+    }
+    return last;
+}
+
+// ==================================================================================================
+bool DdbPostgre::WaitInput(bool limited, std::chrono::steady_clock::time_point &limit, bool &cancelSent)
+/*!
+  Waits for more input of the query that was sent, at most until the limit. The query is
+  canceled at the limit and the limit is moved DDB_PG_CANCEL_WAIT ms ahead. If the query has not
+  finished by then either, the connection is reset.
+  \param limited False to wait without a limit.
+  \param limit Time limit of the query. Updated when the cancel is sent.
+  \param cancelSent Set when the cancel has been sent. False for the first call of a query.
+  \retval bool False if the input could not be read or the connection was reset, in which case
+    timedOut is set.
+*/
+{
+    using namespace std::chrono;
+    int wait = -1;
+    if(limited) {
+        wait = (int)duration_cast<milliseconds>(limit - steady_clock::now()).count();
+        if(wait <= 0) {
+            if(cancelSent) {
+                CS_PRINT_ERRO("DdbPostgre::Exec - Canceled query did not finish. Resetting the connection.");
+                ResetConnection();
+                timedOut = true;
+                SetErrorId(27);
+                return false;
+            }
+            DdbPostgre::Cancel();
+            cancelSent = true;
+            limit = steady_clock::now() + milliseconds(DDB_PG_CANCEL_WAIT);
+            return true;
+        }
+    }
+    WaitSocket(PQsocket(connection), wait);
+    return PQconsumeInput(connection) != 0;
+}
+
+// ==================================================================================================
+PGresult* DdbPostgre::WaitResult(bool limited, std::chrono::steady_clock::time_point &limit, bool &cancelSent)
+/*!
+  Waits for the next result of the query that was sent. See WaitInput for the limit.
+  \retval PGresult* Next result. Null at the end of the results, or if the connection was reset,
+    in which case timedOut is set.
+*/
+{
+    while(PQisBusy(connection)) {
+        if(!WaitInput(limited, limit, cancelSent)) {
+            if(timedOut)
+                return 0;
+            break;
+        }
+    }
+    return PQgetResult(connection);
+}
+
 // ==================================================================================================
 DdbRowSet* DdbPostgre::CreateRowSet()
 {
@@ -163,6 +489,13 @@ bool DdbPostgre::StartTransaction()
     }
 
     PGresult *result = PQexec(connection, "BEGIN");
+    if(PQresultStatus(result) != PGRES_COMMAND_OK)
+    {
+        CS_VAPRT_ERRO("DdbPostgre::StartTransaction - BEGIN failed: %s", PQerrorMessage(connection));
+        PQclear(result);
+        SetErrorId(29);
+        return false;
+    }
     PQclear(result);
 
     flags |= DDB_FLAG_TRANSACT_ON;
@@ -171,6 +504,12 @@ bool DdbPostgre::StartTransaction()
 
 // ==================================================================================================
 bool DdbPostgre::Commit()
+/*!
+  Commits the transaction. A statement that failed within the transaction aborts it and the
+  server answers the COMMIT with ROLLBACK; that is reported as a failure.
+  \retval bool False if the transaction was not committed. If the transaction is still open,
+  e.g. the COMMIT could not be sent, it is left for RollBack.
+*/
 {
     if(!(flags&DDB_FLAG_CONNECTED))
     {
@@ -184,10 +523,20 @@ bool DdbPostgre::Commit()
     }
 
     PGresult *result = PQexec(connection, "COMMIT");
+    bool committed = PQresultStatus(result) == PGRES_COMMAND_OK && !strcmp(PQcmdStatus(result), "COMMIT");
+    if(!committed)
+    {
+        if(PQresultStatus(result) == PGRES_COMMAND_OK)
+            CS_PRINT_ERRO("DdbPostgre::Commit - Transaction was aborted and rolled back.");
+        else
+            CS_VAPRT_ERRO("DdbPostgre::Commit - COMMIT failed: %s", PQerrorMessage(connection));
+        SetErrorId(29);
+    }
     PQclear(result);
 
-    flags &= ~DDB_FLAG_TRANSACT_ON;
-    return true;
+    if(committed || PQtransactionStatus(connection) == PQTRANS_IDLE)
+        flags &= ~DDB_FLAG_TRANSACT_ON;
+    return committed;
 }
 
 // ==================================================================================================
@@ -216,7 +565,7 @@ bool DdbPostgre::ExecuteIntFunction(const DDBSTR &query, uint32_t &val)
 {
     if(query.LENGTH()==0)
         return false;
-    PGresult *result = PQexec(connection, query.UTF8());
+    PGresult *result = Exec(query.UTF8());
 
     if (!result || PQresultStatus(result) != PGRES_TUPLES_OK)
     {
@@ -244,7 +593,7 @@ bool DdbPostgre::ExecuteLongFunction(const DDBSTR &query, uint64_t &val)
 {
     if(query.LENGTH()==0)
         return false;
-    PGresult *result = PQexec(connection, query.UTF8());
+    PGresult *result = Exec(query.UTF8());
 
     if (!result || PQresultStatus(result) != PGRES_TUPLES_OK)
     {
@@ -262,7 +611,7 @@ bool DdbPostgre::ExecuteLongFunction(const DDBSTR &query, uint64_t &val)
         PQclear(result);
         return false;
     }
-    val = (uint64_t) strtol(PQgetvalue(result, 0, 0),0,0);
+    val = (uint64_t) strtoll(PQgetvalue(result, 0, 0),0,10);
     PQclear(result);
     return true;
 }
@@ -272,7 +621,7 @@ bool DdbPostgre::ExecuteDoubleFunction(const DDBSTR &query, double &val)
 {
     if(query.LENGTH()==0)
         return false;
-    PGresult *result = PQexec(connection, query.UTF8());
+    PGresult *result = Exec(query.UTF8());
 
     if (!result || PQresultStatus(result) != PGRES_TUPLES_OK)
     {
@@ -306,7 +655,7 @@ bool DdbPostgre::ExecuteBoolFunction(const DDBSTR &query, bool &val)
 {
     if(query.LENGTH()==0)
         return false;
-    PGresult *result = PQexec(connection, query.UTF8());
+    PGresult *result = Exec(query.UTF8());
 
     if (!result || PQresultStatus(result) != PGRES_TUPLES_OK)
     {
@@ -340,7 +689,7 @@ bool DdbPostgre::ExecuteStrFunction(const DDBSTR &query, DDBSTR &answer)
 {
     if(query.LENGTH()==0)
         return false;
-    PGresult *result = PQexec(connection, query.UTF8());
+    PGresult *result = Exec(query.UTF8());
     if (!result || PQresultStatus(result) != PGRES_TUPLES_OK) {
         CS_PRINT_ERRO("DdbPostgre::ExecuteStrFunction failed.");
         errorId = 19;
@@ -383,7 +732,7 @@ bool DdbPostgre::ExecuteDateFunction(const DDBSTR &query, DDBTIME &val)
     tm *tmPtr;
     if(query.LENGTH()==0)
         return false;
-    PGresult *result = PQexec(connection, query.UTF8());
+    PGresult *result = Exec(query.UTF8());
 
     if (!result || PQresultStatus(result) != PGRES_TUPLES_OK)
     {
@@ -443,13 +792,45 @@ bool DdbPostgre::ExtractTimestamp(const char *result, struct tm *tmPtr)
     return false;
 }
 
+// ==================================================================================================
+size_t DdbPostgre::DecodeBytea(const char *value, size_t len, uint8_t *out)
+/*!
+  Decodes a bytea value from the text result. The hex format ("\\x0a1b..", the default since
+  PostgreSQL 9.0) is decoded with DdbHexDecode. The older escape format is decoded byte by byte.
+  \param value Value as returned by PQgetvalue.
+  \param len Length of the value from PQgetlength.
+  \param out Output buffer. len bytes is always enough.
+  \retval size_t Number of bytes or DDB_DECODE_ERROR if the value is not valid bytea.
+*/
+{
+    if(len >= 2 && value[0] == '\\' && value[1] == 'x')
+        return DdbHexDecode(value+2, len-2, out);
+    size_t count = 0;
+    for(size_t ndx=0; ndx<len; ndx++) {
+        if(value[ndx] != '\\')
+            out[count++] = (uint8_t)value[ndx];
+        else if(ndx+1 < len && value[ndx+1] == '\\') {
+            out[count++] = '\\';
+            ndx++;
+        }
+        else if(ndx+3 < len && value[ndx+1] >= '0' && value[ndx+1] <= '3'
+                && value[ndx+2] >= '0' && value[ndx+2] <= '7' && value[ndx+3] >= '0' && value[ndx+3] <= '7') {
+            out[count++] = (uint8_t)((value[ndx+1]-'0')<<6 | (value[ndx+2]-'0')<<3 | (value[ndx+3]-'0'));
+            ndx += 3;
+        }
+        else
+            return DDB_DECODE_ERROR;
+    }
+    return count;
+}
+
 
 // ==================================================================================================
 int DdbPostgre::ExecuteModify(const DDBSTR &modify)
 {
     if(modify.LENGTH()==0)
         return -1;
-    PGresult *result = PQexec(connection, modify.UTF8());
+    PGresult *result = Exec(modify.UTF8());
     if (!result || PQresultStatus(result) != PGRES_COMMAND_OK)
     {
         CS_VAPRT_ERRO("DdbPostgre::ExecuteModify - Failed. PQStatus=%d",PQresultStatus(result));
@@ -472,7 +853,7 @@ bool DdbPostgre::UpdateStructure(const DDBSTR &command)
 {
     if(command.LENGTH()==0)
         return false;
-    PGresult *result = PQexec(connection, command.UTF8());
+    PGresult *result = Exec(command.UTF8());
 
     if (!result || PQresultStatus(result) != PGRES_COMMAND_OK)
     {
@@ -488,9 +869,22 @@ bool DdbPostgre::UpdateStructure(const DDBSTR &command)
 }
 
 // ==================================================================================================
-unsigned long DdbPostgre::GetInsertId()
+uint64_t DdbPostgre::GetInsertId()
+/*!
+  Returns the value that nextval returned last in this session. Costs a round trip; the
+  inserts that need the key should use DdbRowSet::ExecuteInsertReturning.
+*/
+{
+    return ReadInsertId(Exec("SELECT lastval()"));
+}
+
+// ==================================================================================================
+uint64_t DdbPostgre::ReadInsertId(PGresult *result)
+/*!
+  Reads the value from the result of SELECT lastval() and clears the result.
+  \retval uint64_t Value or zero on error.
+*/
 {
-    PGresult *result = PQexec(connection,"SELECT lastval()");
     if (!result) {
         CS_PRINT_WARN("DdbPostgre::GetInsertId - unable to get result.");
         return 0;
@@ -499,17 +893,299 @@ unsigned long DdbPostgre::GetInsertId()
     {
         CS_VAPRT_ERRO("DdbPostgre::GetInsertId failure:%s",PQresultErrorMessage(result));
         PQclear(result);
+        SetErrorId(22);
         return 0;
     }
-    char *endptr;
-    char* resultStr = PQgetvalue(result, 0, 0);
     errno = 0;
-    unsigned long rv = strtoul(resultStr,&endptr,10);
+    uint64_t rv = strtoull(PQgetvalue(result, 0, 0),0,10);
+    PQclear(result);
     if(errno)
         return 0;
     return rv;
 }
 
+// ==================================================================================================
+static bool IsCopyQuery(const std::string &query)
+/*!
+  Returns true if the query can be placed inside COPY ( ... ) TO STDOUT.
+*/
+{
+    const char *ptr = query.c_str();
+    while(isspace((unsigned char)*ptr) || *ptr=='(')
+        ptr++;
+    std::string tok;
+    while(isalpha((unsigned char)*ptr))
+        tok += (char)tolower(*ptr++);
+    return tok == "select" || tok == "with" || tok == "values" || tok == "table";
+}
+
+// ==================================================================================================
+int DdbPostgre::Export(const DDBSTR &query, DdbExportWriter &out)
+/*!
+  Streams the query result into the writer. CSV and TSV are produced by the server with COPY
+  when the query is a plain select. Otherwise the rows are received one at a time in the single
+  row mode, so the whole result is never held in the memory. The statement timeout and the
+  deadline apply and Cancel cancels the export.
+  \retval int Number of rows exported or -1 on error.
+*/
+{
+    if(!connection) {
+        SetErrorId(5);
+        return -1;
+    }
+    std::string sql(query.UTF8());
+    size_t last = sql.find_last_not_of(" \t\r\n;");
+    sql.erase(last == std::string::npos ? 0 : last+1);
+    if(sql.empty()) {
+        SetErrorId(19);
+        return -1;
+    }
+    errorId = 0;
+    timedOut = false;
+    std::chrono::steady_clock::time_point limit;
+    bool limited = GetLimit(limit);
+    if(limited && std::chrono::steady_clock::now() >= limit) {
+        CS_PRINT_WARN("DdbPostgre::Export - Deadline has passed. Query was not sent.");
+        timedOut = true;
+        SetErrorId(27);
+        return -1;
+    }
+    // TSV header with COPY requires PostgreSQL 15.
+    bool header = (out.GetOptions() & DDB_EXPORT_HEADER) != 0;
+    if(out.GetFormat() != DDB_EXPORT_JSONL && !(out.GetOptions() & DDB_EXPORT_NOCOPY)
+       && !(header && out.GetFormat() == DDB_EXPORT_TSV) && IsCopyQuery(sql))
+        return ExportCopy(sql, out, limited, limit);
+
+    SetRunning(true);
+    if(!PQsendQuery(connection, sql.c_str())) {
+        SetRunning(false);
+        CS_VAPRT_ERRO("DdbPostgre::Export failed: %s", PQerrorMessage(connection));
+        SetErrorId(19);
+        return -1;
+    }
+    PQsetSingleRowMode(connection);
+    int rows = 0;
+    bool ok = true;
+    bool cancelSent = false;
+    std::vector<int> kinds;
+    PGresult *result;
+    // Results are read until the end even after an error to leave the connection usable. A
+    // failed writer cancels the rest of the query.
+    while((result = WaitResult(limited, limit, cancelSent)) != 0) {
+        ExecStatusType status = PQresultStatus(result);
+        if(status != PGRES_SINGLE_TUPLE && status != PGRES_TUPLES_OK) {
+            if(ok)
+                CS_VAPRT_ERRO("DdbPostgre::Export failed: %s", PQresultErrorMessage(result));
+            ok = false;
+        }
+        else if(ok) {
+            int fields = PQnfields(result);
+            if(kinds.empty() && fields) {
+                std::vector<std::string> names;
+                for(int col=0; col<fields; col++) {
+                    names.push_back(PQfname(result, col));
+                    Oid type = PQftype(result, col);
+                    if(type == DDB_PGOID_INT2 || type == DDB_PGOID_INT4 || type == DDB_PGOID_INT8 || type == DDB_PGOID_OID
+                       || type == DDB_PGOID_FLOAT4 || type == DDB_PGOID_FLOAT8 || type == DDB_PGOID_NUMERIC)
+                        kinds.push_back(DDB_FIELD_NUMBER);
+                    else if(type == DDB_PGOID_BOOL)
+                        kinds.push_back(DDB_FIELD_BOOL);
+                    else if(type == DDB_PGOID_JSON || type == DDB_PGOID_JSONB)
+                        kinds.push_back(DDB_FIELD_JSON);
+                    else
+                        kinds.push_back(DDB_FIELD_TEXT);
+                }
+                out.SetColumns(names);
+            }
+            for(int row=0; row<PQntuples(result); row++) {
+                out.BeginRow();
+                for(int col=0; col<fields; col++) {
+                    if(PQgetisnull(result, row, col))
+                        out.Null();
+                    else
+                        out.Field(PQgetvalue(result, row, col), PQgetlength(result, row, col), kinds[col]);
+                }
+                out.EndRow();
+                rows++;
+            }
+            if(!out.IsOK()) {
+                ok = false;
+                SendCancel();
+            }
+        }
+        PQclear(result);
+    }
+    SetRunning(false);
+    if(timedOut)
+        return -1;
+    if(canceled) {
+        CS_VAPRT_WARN("DdbPostgre::Export - Query was canceled: %.200s", sql.c_str());
+        timedOut = true;
+        SetErrorId(27);
+        return -1;
+    }
+    if(!ok) {
+        if(!errorId)
+            SetErrorId(19);
+        return -1;
+    }
+    return rows;
+}
+
+// ==================================================================================================
+int DdbPostgre::ExportCopy(const std::string &query, DdbExportWriter &out, bool limited,
+                           std::chrono::steady_clock::time_point &limit)
+/*!
+  Exports with COPY ( query ) TO STDOUT. The server formats the rows and they are passed to the
+  writer as they arrive. The data is read without blocking so that the limit and Cancel stop
+  the export. A failed writer cancels the rest of the COPY.
+  \param limited False if there is no time limit.
+  \param limit Time limit of the export.
+*/
+{
+    std::string copy = "COPY (" + query + ") TO STDOUT WITH (FORMAT ";
+    copy += out.GetFormat() == DDB_EXPORT_CSV ? "csv" : "text";
+    if(out.GetOptions() & DDB_EXPORT_HEADER)
+        copy += ", HEADER true";
+    copy += ")";
+
+    SetRunning(true);
+    if(!PQsendQuery(connection, copy.c_str())) {
+        SetRunning(false);
+        CS_VAPRT_ERRO("DdbPostgre::ExportCopy failed: %s", PQerrorMessage(connection));
+        SetErrorId(19);
+        return -1;
+    }
+    bool cancelSent = false;
+    bool ok = true;
+    int rows = -1;
+    PGresult *result = WaitResult(limited, limit, cancelSent);
+    if(PQresultStatus(result) == PGRES_COPY_OUT) {
+        PQclear(result);
+        char *data;
+        int len;
+        for(;;) {
+            len = PQgetCopyData(connection, &data, 1);
+            if(len > 0) {
+                if(ok) {
+                    out.Raw(data, len);
+                    if(!out.IsOK()) {
+                        ok = false;
+                        SendCancel();
+                    }
+                }
+                PQfreemem(data);
+            }
+            else if(len < 0 || !WaitInput(limited, limit, cancelSent))
+                break;
+        }
+        if(len == -2) {
+            CS_VAPRT_ERRO("DdbPostgre::ExportCopy failed: %s", PQerrorMessage(connection));
+            ok = false;
+        }
+        result = timedOut ? 0 : WaitResult(limited, limit, cancelSent);
+    }
+    // Results are read until the end to leave the connection usable.
+    for(; result; result = WaitResult(limited, limit, cancelSent)) {
+        if(PQresultStatus(result) == PGRES_COMMAND_OK)
+            rows = atoi(PQcmdTuples(result));
+        else {
+            if(ok && !canceled)
+                CS_VAPRT_ERRO("DdbPostgre::ExportCopy failed: %s", PQresultErrorMessage(result));
+            ok = false;
+        }
+        PQclear(result);
+    }
+    SetRunning(false);
+    if(timedOut)
+        return -1;
+    if(canceled) {
+        CS_VAPRT_WARN("DdbPostgre::ExportCopy - Query was canceled: %.200s", query.c_str());
+        timedOut = true;
+        SetErrorId(27);
+        return -1;
+    }
+    if(!ok || rows < 0) {
+        if(!errorId)
+            SetErrorId(19);
+        return -1;
+    }
+    return rows;
+}
+
+// ==================================================================================================
+bool DdbPostgre::CopyBegin(const DDBSTR &command)
+/*!
+  Starts COPY ... FROM STDIN. Send the data with CopyPut and finish with CopyEnd. The connection
+  cannot be used for anything else in between.
+  \param command COPY command, e.g. "COPY item (id, name) FROM STDIN".
+  \retval bool True if the server is ready to receive the data.
+*/
+{
+    if(!connection) {
+        SetErrorId(5);
+        return false;
+    }
+    PGresult *result = Exec(command.UTF8());
+    if(PQresultStatus(result) != PGRES_COPY_IN) {
+        CS_VAPRT_ERRO("DdbPostgre::CopyBegin failed: %s", PQresultErrorMessage(result));
+        PQclear(result);
+        SetErrorId(18);
+        return false;
+    }
+    PQclear(result);
+    return true;
+}
+
+// ==================================================================================================
+bool DdbPostgre::CopyPut(const char *data, size_t len)
+/*!
+  Sends data in the format given to CopyBegin. Rows may be split between the calls.
+  \retval bool False if the connection has failed.
+*/
+{
+    while(len) {
+        int part = len > 0x40000000 ? 0x40000000 : (int)len;
+        if(PQputCopyData(connection, data, part) != 1) {
+            CS_VAPRT_ERRO("DdbPostgre::CopyPut failed: %s", PQerrorMessage(connection));
+            return false;
+        }
+        data += part;
+        len -= part;
+    }
+    return true;
+}
+
+// ==================================================================================================
+int DdbPostgre::CopyEnd(std::string *message)
+/*!
+  Ends the COPY and waits for the server to store the rows. The COPY is all or nothing: if any
+  row is rejected no rows are stored.
+  \param message If given, receives the server error message on failure.
+  \retval int Number of rows copied or -1 on error.
+*/
+{
+    if(PQputCopyEnd(connection, 0) != 1) {
+        CS_VAPRT_ERRO("DdbPostgre::CopyEnd failed: %s", PQerrorMessage(connection));
+        if(message)
+            *message = PQerrorMessage(connection);
+        SetErrorId(18);
+        return -1;
+    }
+    int rows = -1;
+    PGresult *result;
+    while((result = PQgetResult(connection)) != 0) {
+        if(PQresultStatus(result) == PGRES_COMMAND_OK)
+            rows = atoi(PQcmdTuples(result));
+        else if(message)
+            *message = PQresultErrorMessage(result);
+        PQclear(result);
+    }
+    if(rows < 0)
+        SetErrorId(18);
+    return rows;
+}
+
 // ==========================================================================================
 // $$$$ ADMIN COMMANDS $$$
 // ------------------------------------------------------------------------------------------
@@ -566,3 +1242,190 @@ bool DdbPostgre::CreateTable(const DDBSTR &name, const DDBSTR &sql)
     }
     return true;
 }
+
+// ==================================================================================================
+void DdbPgParams::Clear()
+{
+    values.clear();
+    nulls.clear();
+    types.clear();
+    lengths.clear();
+    formats.clear();
+}
+
+// ==================================================================================================
+void DdbPgParams::AddText(const char *text, size_t len)
+{
+    values.push_back(std::string(text, len));
+    nulls.push_back(false);
+    types.push_back(0);
+    lengths.push_back((int)len);
+    formats.push_back(0);
+}
+
+// ==================================================================================================
+void DdbPgParams::Add(int value)
+{
+    char buffer[16];
+    AddText(buffer, snprintf(buffer, sizeof(buffer), "%d", value));
+}
+
+// ==================================================================================================
+void DdbPgParams::Add(int64_t value)
+{
+    char buffer[24];
+    AddText(buffer, snprintf(buffer, sizeof(buffer), "%lld", (long long)value));
+}
+
+// ==================================================================================================
+void DdbPgParams::Add(double value)
+{
+    char buffer[32];
+    int len = snprintf(buffer, sizeof(buffer), "%.17g", value);
+    // Server expects a decimal point regardless of the client locale.
+    char *comma = strchr(buffer, ',');
+    if(comma)
+        *comma = '.';
+    AddText(buffer, len);
+}
+
+// ==================================================================================================
+void DdbPgParams::Add(const char *value)
+/*!
+  \param value Text value. Null pointer adds a NULL.
+*/
+{
+    if(!value)
+        AddNull();
+    else
+        AddText(value, strlen(value));
+}
+
+// ==================================================================================================
+void DdbPgParams::Add(const std::string &value)
+{
+    AddText(value.data(), value.length());
+}
+
+// ==================================================================================================
+void DdbPgParams::AddNull()
+{
+    values.push_back(std::string());
+    nulls.push_back(true);
+    types.push_back(0);
+    lengths.push_back(0);
+    formats.push_back(0);
+}
+
+// ==================================================================================================
+void DdbPgParams::PutInt32(std::string &out, uint32_t value)
+/*!
+  Appends the value in the network byte order.
+*/
+{
+    char bytes[4] = { (char)(value>>24), (char)(value>>16), (char)(value>>8), (char)value };
+    out.append(bytes, 4);
+}
+
+// ==================================================================================================
+void DdbPgParams::BeginArray(Oid arrayType, Oid elemType, size_t count)
+/*!
+  Adds a binary array parameter and writes the array header. The elements are appended to
+  the value by the caller.
+*/
+{
+    values.push_back(std::string());
+    nulls.push_back(false);
+    types.push_back(arrayType);
+    lengths.push_back(0);
+    formats.push_back(1);
+    std::string &out = values.back();
+    // Dimensions, null flag and element type. An empty array has no dimensions.
+    PutInt32(out, count ? 1 : 0);
+    PutInt32(out, 0);
+    PutInt32(out, elemType);
+    if(count) {
+        PutInt32(out, (uint32_t)count);
+        PutInt32(out, 1);       // Lower bound.
+    }
+}
+
+// ==================================================================================================
+void DdbPgParams::Add(const std::vector<int> &values_in)
+/*!
+  Adds an int4[] parameter.
+*/
+{
+    BeginArray(DDB_PGOID_INT4ARRAY, DDB_PGOID_INT4, values_in.size());
+    std::string &out = values.back();
+    out.reserve(out.size() + values_in.size()*8);
+    for(size_t ndx=0; ndx<values_in.size(); ndx++) {
+        PutInt32(out, 4);
+        PutInt32(out, (uint32_t)values_in[ndx]);
+    }
+    lengths.back() = (int)out.size();
+}
+
+// ==================================================================================================
+void DdbPgParams::Add(const std::vector<int64_t> &values_in)
+/*!
+  Adds an int8[] parameter.
+*/
+{
+    BeginArray(DDB_PGOID_INT8ARRAY, DDB_PGOID_INT8, values_in.size());
+    std::string &out = values.back();
+    out.reserve(out.size() + values_in.size()*12);
+    for(size_t ndx=0; ndx<values_in.size(); ndx++) {
+        uint64_t value = (uint64_t)values_in[ndx];
+        PutInt32(out, 8);
+        PutInt32(out, (uint32_t)(value>>32));
+        PutInt32(out, (uint32_t)value);
+    }
+    lengths.back() = (int)out.size();
+}
+
+// ==================================================================================================
+void DdbPgParams::Add(const std::vector<double> &values_in)
+/*!
+  Adds a float8[] parameter.
+*/
+{
+    BeginArray(DDB_PGOID_FLOAT8ARRAY, DDB_PGOID_FLOAT8, values_in.size());
+    std::string &out = values.back();
+    out.reserve(out.size() + values_in.size()*12);
+    for(size_t ndx=0; ndx<values_in.size(); ndx++) {
+        uint64_t value;
+        memcpy(&value, &values_in[ndx], sizeof(value));
+        PutInt32(out, 8);
+        PutInt32(out, (uint32_t)(value>>32));
+        PutInt32(out, (uint32_t)value);
+    }
+    lengths.back() = (int)out.size();
+}
+
+// ==================================================================================================
+void DdbPgParams::Add(const std::vector<std::string> &values_in)
+/*!
+  Adds a text[] parameter. The strings must be UTF-8.
+*/
+{
+    BeginArray(DDB_PGOID_TEXTARRAY, DDB_PGOID_TEXT, values_in.size());
+    std::string &out = values.back();
+    for(size_t ndx=0; ndx<values_in.size(); ndx++) {
+        PutInt32(out, (uint32_t)values_in[ndx].length());
+        out.append(values_in[ndx]);
+    }
+    lengths.back() = (int)out.size();
+}
+
+// ==================================================================================================
+const char* const* DdbPgParams::GetValues() const
+/*!
+  Returns the values for PQexecParams. Null parameters have a null pointer.
+*/
+{
+    pointers.resize(values.size());
+    for(size_t ndx=0; ndx<values.size(); ndx++)
+        pointers[ndx] = nulls[ndx] ? 0 : values[ndx].data();
+    return pointers.data();
+}
@@ -7,9 +7,114 @@
 #define DDB_POSTGRE_H_FILE
 
 #include <libpq-fe.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+// PostgreSQL type OIDs (see pg_type.h) for inspecting the result metadata with PQftype.
+const Oid DDB_PGOID_BOOL    = 16;
+const Oid DDB_PGOID_BYTEA   = 17;
+const Oid DDB_PGOID_CHAR    = 18;
+const Oid DDB_PGOID_INT8    = 20;
+const Oid DDB_PGOID_INT2    = 21;
+const Oid DDB_PGOID_INT4    = 23;
+const Oid DDB_PGOID_TEXT    = 25;
+const Oid DDB_PGOID_OID     = 26;
+const Oid DDB_PGOID_JSON    = 114;
+const Oid DDB_PGOID_FLOAT4  = 700;
+const Oid DDB_PGOID_FLOAT8  = 701;
+const Oid DDB_PGOID_BPCHAR  = 1042;
+const Oid DDB_PGOID_VARCHAR = 1043;
+const Oid DDB_PGOID_DATE    = 1082;
+const Oid DDB_PGOID_TIMESTAMP   = 1114;
+const Oid DDB_PGOID_TIMESTAMPTZ = 1184;
+const Oid DDB_PGOID_NUMERIC = 1700;
+const Oid DDB_PGOID_UUID    = 2950;
+const Oid DDB_PGOID_INT2ARRAY   = 1005;
+const Oid DDB_PGOID_INT4ARRAY   = 1007;
+const Oid DDB_PGOID_TEXTARRAY   = 1009;
+const Oid DDB_PGOID_VARCHARARRAY = 1015;
+const Oid DDB_PGOID_INT8ARRAY   = 1016;
+const Oid DDB_PGOID_FLOAT4ARRAY = 1021;
+const Oid DDB_PGOID_FLOAT8ARRAY = 1022;
+const Oid DDB_PGOID_JSONB   = 3802;
+
+//! Time in milliseconds the client waits beyond the statement timeout before it cancels the query.
+#define DDB_PG_TIMEOUT_GRACE 250
+//! Time in milliseconds a canceled query may take to finish before the connection is reset.
+#define DDB_PG_CANCEL_WAIT 5000
+
+// ==================================================================================================
+//! Parameters of a query with $1, $2, .. placeholders.
+/*! Scalars are sent as text and their type is resolved by the server from the query. Vectors
+    are sent as one-dimensional arrays in the binary array format, which suits the lookups with
+    ANY:
+    \code
+    std::vector<int> ids;   // Filled by the caller.
+    DdbPgParams params;
+    params.Add(ids);
+    params.Add("open");
+    rs->Query("SELECT id, name FROM item WHERE id = ANY($1) AND state=$2", params);
+    \endcode
+    The values are copied; the object may be reused after Clear.
+ */
+class DdbPgParams
+{
+public:
+    DdbPgParams() {}
+
+    void Add(int value);
+    void Add(int64_t value);
+    void Add(double value);
+    void Add(const char *value);
+    void Add(const std::string &value);
+    void Add(const std::vector<int> &values);
+    void Add(const std::vector<int64_t> &values);
+    void Add(const std::vector<double> &values);
+    void Add(const std::vector<std::string> &values);
+    void AddNull();
+    void Clear();
+    //! Returns the number of parameters.
+    int GetCount() const { return (int)values.size(); }
+    //! Returns the type OID of the parameter. Zero lets the server infer the type.
+    const Oid* GetTypes() const { return types.data(); }
+    const char* const* GetValues() const;
+    const int* GetLengths() const { return lengths.data(); }
+    const int* GetFormats() const { return formats.data(); }
+
+protected:
+    void AddText(const char *text, size_t len);
+    void BeginArray(Oid arrayType, Oid elemType, size_t count);
+    void PutInt32(std::string &out, uint32_t value);
+
+    std::vector<std::string> values;    //!< Text or binary value of each parameter.
+    std::vector<bool> nulls;
+    std::vector<Oid> types;
+    std::vector<int> lengths;
+    std::vector<int> formats;           //!< 0 for text, 1 for binary.
+    mutable std::vector<const char*> pointers;
+};
 
 // ==================================================================================================
 //! Class defines PostgreSQL specific implementation to DirectDatabase-interface.
+/*! Queries can be bounded in time in two ways. SetStatementTimeout sets the PostgreSQL
+    statement_timeout of the connection and the same limit (plus DDB_PG_TIMEOUT_GRACE) on the
+    client side, so a query is stopped even if the server does not answer. SetDeadline sets an
+    absolute point in time, e.g. the deadline of the request being served, that all following
+    calls must meet until ClearDeadline. The nearer of the two applies. A query that runs past
+    it is canceled, the call fails and IsCanceled returns true.
+
+    Cancel may be called from any thread to cancel the query that is running on the connection.
+    \code
+    pg.SetStatementTimeout(30000);
+    pg.SetDeadline(200);            // This request must be served in 200 ms.
+    if(!pg.ExecuteIntFunction(query, count) && pg.IsCanceled())
+        ...                         // Too slow.
+    pg.ClearDeadline();
+    \endcode
+ */
 class DdbPostgre : public DirectDatabase
 {
 public:
@@ -38,8 +143,27 @@ public:
     bool ExecuteStrFunction(const DDBSTR &query, DDBSTR &result);
     bool ExecuteDateFunction(const DDBSTR &query, DDBTIME &val);
     int ExecuteModify(const DDBSTR &query);
-    unsigned long GetInsertId();
+    uint64_t GetInsertId();
     bool UpdateStructure(const DDBSTR &command);
+    int Export(const DDBSTR &query, DdbExportWriter &out);
+
+    bool CopyBegin(const DDBSTR &command);
+    bool CopyPut(const char *data, size_t len);
+    int CopyEnd(std::string *message=0);
+
+    virtual PGresult* Exec(const char *query);
+    PGresult* ExecParams(const char *query, const DdbPgParams &params);
+    bool Cancel();
+    bool SendCancel();
+    void SetRunning(bool on);
+    bool SetStatementTimeout(int ms);
+    //! Returns the statement timeout in milliseconds. Zero if not set.
+    int GetStatementTimeout() { return statementTimeout; }
+    void SetDeadline(int ms);
+    //! Removes the deadline set by SetDeadline.
+    void ClearDeadline() { hasDeadline = false; }
+    //! Returns true if the last query was canceled by Cancel or because of a timeout.
+    bool IsCanceled() { return timedOut; }
 
     // Admin commands
     bool CreateUser(const DDBSTR &uid, const DDBSTR &pwd);
@@ -52,8 +176,26 @@ public:
         return pg;
     }
     static bool ExtractTimestamp(const char *result, struct tm *);
+    static size_t DecodeBytea(const char *value, size_t len, uint8_t *out);
 protected:
+    int ExportCopy(const std::string &query, DdbExportWriter &out, bool limited,
+                   std::chrono::steady_clock::time_point &limit);
+    PGresult* Run(const char *query, const DdbPgParams *params);
+    uint64_t ReadInsertId(PGresult *result);
+    void UpdateCancel();
+    bool GetLimit(std::chrono::steady_clock::time_point &limit);
+    bool WaitInput(bool limited, std::chrono::steady_clock::time_point &limit, bool &cancelSent);
+    PGresult* WaitResult(bool limited, std::chrono::steady_clock::time_point &limit, bool &cancelSent);
+
     PGconn     *connection;
+    PGcancel   *cancelHandle;   //!< Handle for Cancel. Guarded by cancelMutex.
+    std::mutex  cancelMutex;
+    std::atomic<bool> canceled; //!< Set by Cancel.
+    bool        running;        //!< True while a query is in flight. Guarded by cancelMutex.
+    int         statementTimeout;
+    std::chrono::steady_clock::time_point deadline;
+    bool        hasDeadline;
+    bool        timedOut;       //!< True if the last query was canceled.
 
 };
 
@@ -65,12 +207,20 @@ class DdbPosgtgreRowSet : public DdbRowSet
 public:
     ~DdbPosgtgreRowSet();
 
+    bool Bind(short int type, void *data);
     bool Query(const DDBSTR &query);
+    bool Query(const DDBSTR &query, const DdbPgParams &params);
     int GetNext();
     void QuitQuery();
+    int Materialize(const DDBSTR &query, DdbResultRows &rows);
+    bool SetResult(PGresult *res);
 
 protected:
     DdbPosgtgreRowSet(DirectDatabase*);
+    void Describe();
+    bool DecodeArray(DdbBoundField *field, int col);
+
+    DdbJsonReader jsonReader;   //!< Reader for the DDBT_JSON fields.
 
     DdbPostgre* db;             //!< Pointer to databse object.
     int         maxRows;        //!< Total number of records in the current query.
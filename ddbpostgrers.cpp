@@ -25,9 +25,11 @@
 #include <libpq-fe.h>
 #include <stdlib.h>
 #include <cstdarg>
+#include <new>
 #include <cpp4scripts.hpp>
 #define __DDB_POSTGRE__
 #include "directdatabase.hpp"
+#include "ddbarena.hpp"
 
 // ==================================================================================================
 DdbPosgtgreRowSet::DdbPosgtgreRowSet(DirectDatabase *db_in)
@@ -58,7 +60,7 @@ DdbPosgtgreRowSet::~DdbPosgtgreRowSet()
 // ==================================================================================================
 bool DdbPosgtgreRowSet::Query(const DDBSTR &query)
 {
-    if(!fieldRoot) {
+    if(!fieldRoot && !autoDescribe) {
         CS_PRINT_NOTE("DdbPosgtgreRowSet::Query - Query called without binding variables.");
         db->SetErrorId(9);
         return  false;
@@ -68,11 +70,63 @@ bool DdbPosgtgreRowSet::Query(const DDBSTR &query)
         return false;
     }
     queryStmt = query;
+    return SetResult(db->Exec(queryStmt.UTF8()));
+}
+
+// ==================================================================================================
+bool DdbPosgtgreRowSet::Query(const DDBSTR &query, const DdbPgParams &params)
+/*!
+  Runs a query with $1, $2, .. placeholders.
+  \param query Query text.
+  \param params Values of the placeholders.
+*/
+{
+    if(!fieldRoot && !autoDescribe) {
+        CS_PRINT_NOTE("DdbPosgtgreRowSet::Query - Query called without binding variables.");
+        db->SetErrorId(9);
+        return  false;
+    }
+    if(query.LENGTH()==0) {
+        CS_PRINT_WARN("DdbPosgtgreRowSet::Query - Empty query string. Aborted.");
+        return false;
+    }
+    queryStmt = query;
+    return SetResult(db->ExecParams(queryStmt.UTF8(), params));
+}
+
+// ==================================================================================================
+bool DdbPosgtgreRowSet::Bind(short int type, void *data)
+/*!
+  Binds a variable as DdbRowSet::Bind. In addition the array columns can be bound into vectors
+  with DDBT_INTARR (std::vector<int>), DDBT_LONGARR (std::vector<int64_t>), DDBT_NUMARR
+  (std::vector<double>) and DDBT_STRARR (std::vector<std::string>). Multidimensional arrays are
+  flattened. NULL elements are returned as zeros and empty strings.
+
+  A json or jsonb column can be bound with DDBT_JSON to a DdbJsonHandler pointer. The handler is
+  called with the parts of the document directly from the result.
+*/
+{
+    if(type >= DDBT_INTARR && type <= DDBT_JSON)
+        return data && InsertField(new DdbBoundField(type,data));
+    return DdbRowSet::Bind(type, data);
+}
+
+// ==================================================================================================
+bool DdbPosgtgreRowSet::SetResult(PGresult *res)
+/*!
+  Takes the result of a query for GetNext. Used by Query and for the results received
+  asynchronously (see DdbPgAsync). Previous result is released.
+  \param res Result with the rows, or a single row in the single row mode. Rowset takes the
+    ownership of it, also when it is an error.
+  \retval bool False if the result is null or it is not a row result.
+*/
+{
     if(resultCleared == false)
         PQclear(result);
 
-    result = PQexec(db->GetPGConn(), queryStmt.UTF8());
-    if (!result || PQresultStatus(result) != PGRES_TUPLES_OK)
+    result = res;
+    ExecStatusType status = result ? PQresultStatus(result) : PGRES_FATAL_ERROR;
+    if (status != PGRES_TUPLES_OK && status != PGRES_SINGLE_TUPLE)
     {
         CS_VAPRT_ERRO("DdbPosgtgreRowSet::Query failed: %s", PQresultErrorMessage(result));
         db->SetErrorId(8);
@@ -84,9 +138,76 @@ bool DdbPosgtgreRowSet::Query(const DDBSTR &query)
     resultCleared = false;
     maxRows = PQntuples(result);
     currentRow = 0;
+    // In the single row mode the columns are described by the first row only.
+    if(autoDescribe) {
+        if(status == PGRES_TUPLES_OK || (int)columns.size() != PQnfields(result))
+            Describe();
+    }
+    else if(status == PGRES_TUPLES_OK && CountFields() != PQnfields(result))
+        CS_VAPRT_WARN("DdbPosgtgreRowSet::Query - %d variables bound for %d columns: %.200s",
+                      CountFields(), PQnfields(result), queryStmt.UTF8());
     return true;
 }
 
+// ==================================================================================================
+void DdbPosgtgreRowSet::Describe()
+/*!
+  Describes the columns of the result from PQfname and PQftype and binds them.
+*/
+{
+    int count = PQnfields(result);
+    columns.resize(count);
+    for(int col=0; col<count; col++) {
+        DdbColumn &column = columns[col];
+        column.name = PQfname(result, col);
+        column.dbType = PQftype(result, col);
+        // DDB_TYPE_USED
+        switch(column.dbType) {
+        case DDB_PGOID_INT2:
+        case DDB_PGOID_INT4:
+        case DDB_PGOID_OID:
+            column.type = DDBT_INT;
+            break;
+        case DDB_PGOID_INT8:
+            column.type = DDBT_LONG;
+            break;
+        case DDB_PGOID_NUMERIC: {
+            // Type modifier is ((precision << 16) | scale) + 4, or -1 without a precision.
+            int mod = PQfmod(result, col);
+            column.type = mod >= 4 && ((mod-4)>>16) <= DDB_DECIMAL_DIGITS ? DDBT_DEC : DDBT_NUM;
+            break;
+        }
+        case DDB_PGOID_FLOAT4:
+        case DDB_PGOID_FLOAT8:
+            column.type = DDBT_NUM;
+            break;
+        case DDB_PGOID_UUID:
+            column.type = DDBT_UUID;
+            break;
+        case DDB_PGOID_BYTEA:
+            column.type = DDBT_BLOB;
+            break;
+        case DDB_PGOID_BOOL:
+            column.type = DDBT_BOOL;
+            break;
+        case DDB_PGOID_DATE:
+            column.type = DDBT_DAY;
+            break;
+        case DDB_PGOID_TIMESTAMP:
+        case DDB_PGOID_TIMESTAMPTZ:
+            column.type = DDBT_TIME;
+            break;
+        case DDB_PGOID_CHAR:
+            column.type = DDBT_CHR;
+            break;
+        default:
+            column.type = DDBT_STR;
+            break;
+        }
+    }
+    BindColumns();
+}
+
 // ==================================================================================================
 int DdbPosgtgreRowSet::GetNext()
 {
@@ -113,6 +234,7 @@ int DdbPosgtgreRowSet::GetNext()
     while(field)
     {
         resultStr = PQgetvalue(result, currentRow, nField);
+        field->null = PQgetisnull(result, currentRow, nField) != 0;
         if(resultStr)
         {
             // Use type to convert the data. DDB_TYPE_USED
@@ -203,6 +325,72 @@ int DdbPosgtgreRowSet::GetNext()
 #endif
                 count++;
                 break;
+            case DDBT_LONG:
+                if(resultStr[0]=='\0')
+                    *(static_cast<int64_t*>(field->data)) = 0;
+                else
+                {
+                    *(static_cast<int64_t*>(field->data)) = strtoll(resultStr,0,10);
+                    count++;
+                }
+                break;
+            case DDBT_DEC:
+                if(resultStr[0]=='\0')
+                    static_cast<DdbDecimal*>(field->data)->Clear();
+                else
+                {
+                    if(!static_cast<DdbDecimal*>(field->data)->Parse(resultStr, PQgetlength(result, currentRow, nField)))
+                        CS_VAPRT_WARN("DdbPosgtgreRowSet::GetNext - Decimal parse failed for %.60s",resultStr);
+                    count++;
+                }
+                break;
+            case DDBT_UUID:
+                if(resultStr[0]=='\0')
+                    static_cast<DdbUuid*>(field->data)->Clear();
+                else
+                {
+                    if(!static_cast<DdbUuid*>(field->data)->Parse(resultStr, PQgetlength(result, currentRow, nField)))
+                        CS_VAPRT_WARN("DdbPosgtgreRowSet::GetNext - UUID parse failed for %.60s",resultStr);
+                    count++;
+                }
+                break;
+            case DDBT_BLOB: {
+                DdbBlob *blob = static_cast<DdbBlob*>(field->data);
+                size_t len = PQgetlength(result, currentRow, nField);
+                if(PQgetisnull(result, currentRow, nField))
+                    blob->clear();
+                else
+                {
+                    blob->resize(len);
+                    len = DdbPostgre::DecodeBytea(resultStr, len, blob->data());
+                    if(len == DDB_DECODE_ERROR)
+                    {
+                        CS_PRINT_WARN("DdbPosgtgreRowSet::GetNext - Invalid bytea value.");
+                        len = 0;
+                    }
+                    blob->resize(len);
+                    count++;
+                }
+                break;
+            }
+            case DDBT_INTARR:
+            case DDBT_LONGARR:
+            case DDBT_NUMARR:
+            case DDBT_STRARR:
+                if(DecodeArray(field, nField))
+                    count++;
+                break;
+            case DDBT_JSON: {
+                DdbJsonHandler *handler = static_cast<DdbJsonHandler*>(field->data);
+                handler->StartDocument();
+                if(!PQgetisnull(result, currentRow, nField))
+                {
+                    if(!jsonReader.Parse(resultStr, PQgetlength(result, currentRow, nField), *handler))
+                        CS_VAPRT_WARN("DdbPosgtgreRowSet::GetNext - Invalid JSON at offset %zu.",jsonReader.GetErrorOffset());
+                    count++;
+                }
+                break;
+            }
             }
         }
 
@@ -220,6 +408,115 @@ int DdbPosgtgreRowSet::GetNext()
     return count;
 }
 
+// ==================================================================================================
+static void ClearArray(DdbBoundField *field)
+{
+    switch(field->type) {
+    case DDBT_INTARR:  static_cast<std::vector<int>*>(field->data)->clear(); break;
+    case DDBT_LONGARR: static_cast<std::vector<int64_t>*>(field->data)->clear(); break;
+    case DDBT_NUMARR:  static_cast<std::vector<double>*>(field->data)->clear(); break;
+    case DDBT_STRARR:  static_cast<std::vector<std::string>*>(field->data)->clear(); break;
+    }
+}
+
+// ==================================================================================================
+static void PutTextElement(DdbBoundField *field, size_t ndx, const char *text, size_t len, bool comma)
+/*!
+  Stores an element of a text array. A null text is a NULL element. The string vectors reuse
+  the existing strings so that their buffers are kept from row to row.
+*/
+{
+    if(field->type == DDBT_STRARR) {
+        std::vector<std::string> *vec = static_cast<std::vector<std::string>*>(field->data);
+        if(ndx < vec->size())
+            (*vec)[ndx].assign(text ? text : "", text ? len : 0);
+        else
+            vec->push_back(std::string(text ? text : "", text ? len : 0));
+        return;
+    }
+    char number[64];
+    if(!text || len >= sizeof(number))
+        len = 0;
+    else
+        memcpy(number, text, len);
+    number[len] = 0;
+    switch(field->type) {
+    case DDBT_INTARR:
+        static_cast<std::vector<int>*>(field->data)->push_back((int)strtol(number,0,10));
+        break;
+    case DDBT_LONGARR:
+        static_cast<std::vector<int64_t>*>(field->data)->push_back(strtoll(number,0,10));
+        break;
+    case DDBT_NUMARR:
+        if(comma) {
+            char *commaPoint = strchr(number,'.');
+            if(commaPoint)
+                *commaPoint = ',';
+        }
+        static_cast<std::vector<double>*>(field->data)->push_back(strtod(number,0));
+        break;
+    }
+}
+
+// ==================================================================================================
+bool DdbPosgtgreRowSet::DecodeArray(DdbBoundField *field, int col)
+/*!
+  Decodes an array value of the current row into the bound vector in a single pass. The text
+  form is e.g. {1,2,3}, {{1,2},{3,4}}, [0:1]={1,2} or {"a b","c\"d",NULL}.
+  \retval bool False if the value is NULL or invalid. Vector is empty then.
+*/
+{
+    const char *ptr = PQgetvalue(result, currentRow, col);
+    int len = PQgetlength(result, currentRow, col);
+    if(PQgetisnull(result, currentRow, col)) {
+        ClearArray(field);
+        return false;
+    }
+
+    const char *end = ptr + len;
+    if(ptr < end && *ptr == '[') {
+        // Skip the dimensions that are printed when the lower bound is not 1.
+        ptr = static_cast<const char*>(memchr(ptr, '=', len));
+        if(!ptr) {
+            CS_PRINT_WARN("DdbPosgtgreRowSet::DecodeArray - Invalid array value.");
+            ClearArray(field);
+            return false;
+        }
+        ptr++;
+    }
+    if(field->type != DDBT_STRARR)
+        ClearArray(field);
+    bool comma = db->IsCommaDecimal();
+    std::string quoted;
+    size_t count = 0;
+    while(ptr < end) {
+        if(*ptr == '{' || *ptr == '}' || *ptr == ',' || *ptr == ' ') {
+            ptr++;
+            continue;
+        }
+        if(*ptr == '"') {
+            quoted.clear();
+            for(ptr++; ptr < end && *ptr != '"'; ptr++) {
+                if(*ptr == '\\' && ptr+1 < end)
+                    ptr++;
+                quoted += *ptr;
+            }
+            ptr++;
+            PutTextElement(field, count++, quoted.data(), quoted.length(), comma);
+            continue;
+        }
+        const char *start = ptr;
+        while(ptr < end && *ptr != ',' && *ptr != '}')
+            ptr++;
+        size_t elen = ptr - start;
+        bool null = elen == 4 && memcmp(start, "NULL", 4) == 0;
+        PutTextElement(field, count++, null ? 0 : start, elen, comma);
+    }
+    if(field->type == DDBT_STRARR)
+        static_cast<std::vector<std::string>*>(field->data)->resize(count);
+    return true;
+}
+
 // ==================================================================================================
 void DdbPosgtgreRowSet::QuitQuery()
 {
@@ -230,3 +527,129 @@ void DdbPosgtgreRowSet::QuitQuery()
     maxRows = 0;
     currentRow = 0;
 }
+
+// ==================================================================================================
+int DdbPosgtgreRowSet::Materialize(const DDBSTR &query, DdbResultRows &rows)
+/*!
+  Executes the query and copies the values from the PostgreSQL result directly into the arena
+  without going through the bound variables. Null values are flagged. In the auto-describe mode
+  the columns are described by the query before the layout is set up.
+  \retval int Number of rows read or -1 on error.
+*/
+{
+    if(!Query(query))
+        return -1;
+    if(!SetupRows(rows)) {
+        QuitQuery();
+        db->SetErrorId(9);
+        return -1;
+    }
+    bool trim = db->IsFeatureOn(DDB_FEATURE_AUTOTRIM);
+    bool comma = db->IsCommaDecimal();
+    int cols = rows.GetColumnCount();
+    if(cols > PQnfields(result))
+        cols = PQnfields(result);
+    DdbArena *arena = rows.GetArena();
+    if(!rows.Reserve(maxRows))
+    {
+        QuitQuery();
+        return -1;
+    }
+    for(int rowNdx=0; rowNdx<maxRows; rowNdx++)
+    {
+        char *row = rows.AddRow();
+        if(!row)
+        {
+            QuitQuery();
+            return -1;
+        }
+        for(int col=0; col<cols; col++)
+        {
+            if(PQgetisnull(result, rowNdx, col))
+            {
+                *rows.NullFlag(row,col) = 1;
+#ifndef DDB_USESTL
+                if(rows.GetType(col) == DDBT_TIME || rows.GetType(col) == DDBT_DAY)
+                    new(rows.Slot(row,col)) wxDateTime(wxInvalidDateTime);
+#endif
+                continue;
+            }
+            char *value = PQgetvalue(result, rowNdx, col);
+            char *slot = rows.Slot(row,col);
+            // DDB_TYPE_USED
+            switch(rows.GetType(col))
+            {
+            case DDBT_INT:
+                *(int*)slot = strtol(value,0,10);
+                break;
+            case DDBT_STR: {
+                size_t len = PQgetlength(result, rowNdx, col);
+                while(trim && len>0 && value[len-1]==' ')
+                    len--;
+                ((DdbStrRef*)slot)->ptr = arena->Copy(value, len);
+                ((DdbStrRef*)slot)->len = len;
+                break;
+            }
+            case DDBT_BOOL:
+                *(bool*)slot = value[0] == 't';
+                break;
+            case DDBT_TIME:
+            case DDBT_DAY:
+#ifdef DDB_USESTL
+                DdbPostgre::ExtractTimestamp(value,(tm*)slot);
+#else
+                {
+                    wxString::const_iterator end;
+                    wxDateTime stamp;
+                    stamp.ParseFormat(value, rows.GetType(col)==DDBT_DAY ? "%Y-%m-%d" : "%Y-%m-%d %H:%M:%S", &end);
+                    new(slot) wxDateTime(stamp);
+                }
+#endif
+                break;
+            case DDBT_NUM:
+                if(comma)
+                {
+                    char *commaPoint=strchr(value,'.');
+                    if(commaPoint)
+                        *commaPoint=',';
+                }
+                *(double*)slot = strtod(value,0);
+                break;
+            case DDBT_CHR:
+#ifdef DDB_USESTL
+                *(char*)slot = value[0];
+#else
+                *(wxUniChar*)slot = value[0];
+#endif
+                break;
+            case DDBT_LONG:
+                *(int64_t*)slot = strtoll(value,0,10);
+                break;
+            case DDBT_DEC:
+                if(!((DdbDecimal*)slot)->Parse(value, PQgetlength(result, rowNdx, col)))
+                    CS_VAPRT_WARN("DdbPosgtgreRowSet::Materialize - Decimal parse failed for %.60s",value);
+                break;
+            case DDBT_UUID:
+                ((DdbUuid*)slot)->Parse(value, PQgetlength(result, rowNdx, col));
+                break;
+            case DDBT_BLOB: {
+                size_t len = PQgetlength(result, rowNdx, col);
+                uint8_t *bytes = (uint8_t*) arena->Alloc(len+1, 1);
+                if(!bytes)
+                {
+                    QuitQuery();
+                    return -1;
+                }
+                len = DdbPostgre::DecodeBytea(value, len, bytes);
+                if(len == DDB_DECODE_ERROR)
+                    len = 0;
+                ((DdbStrRef*)slot)->ptr = (const char*)bytes;
+                ((DdbStrRef*)slot)->len = len;
+                break;
+            }
+            }
+        }
+    }
+    QuitQuery();
+    return rows.GetRowCount();
+}
@@ -0,0 +1,391 @@
+/*! \file ddbqueryexec.cpp
+ * \brief Thread pool that runs queries concurrently over a pool of connections. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#include "pch-stop.h"
+#include <cpp4scripts.hpp>
+#include "ddbqueryexec.hpp"
+
+//! Executor and worker index of the current thread. Set in the worker threads only.
+static thread_local DdbQueryExecutor *currentExecutor = 0;
+static thread_local size_t currentWorker = 0;
+
+// ==================================================================================================
+DdbQueryExecutor::DdbQueryExecutor()
+    : nextQueue(0), pending(0), running(false)
+{
+}
+
+// ==================================================================================================
+DdbQueryExecutor::~DdbQueryExecutor()
+/*!
+  Stops the workers and deletes the connections.
+*/
+{
+    Stop();
+    for(size_t ndx=0; ndx<connections.size(); ndx++)
+        delete connections[ndx];
+}
+
+// ==================================================================================================
+void DdbQueryExecutor::AddConnection(DirectDatabase *db)
+/*!
+  Adds a connection to the pool. Add the connections before Start.
+  \param db Connected database. The executor takes the ownership and deletes it.
+*/
+{
+    if(!db)
+        return;
+    std::lock_guard<std::mutex> lock(poolMutex);
+    connections.push_back(db);
+    idle.push_back(db);
+}
+
+// ==================================================================================================
+bool DdbQueryExecutor::Start(int threads)
+/*!
+  Starts the worker threads.
+  \param threads Number of workers. Zero uses one worker per connection. More workers than
+    connections only wait for the connections.
+  \retval bool False if there are no connections or the executor is running already.
+*/
+{
+    if(running)
+        return false;
+    if(connections.empty()) {
+        CS_PRINT_ERRO("DdbQueryExecutor::Start - No connections.");
+        return false;
+    }
+    if(threads <= 0)
+        threads = (int)connections.size();
+    running = true;
+    for(int ndx=0; ndx<threads; ndx++)
+        workers.push_back(new Worker());
+    for(size_t ndx=0; ndx<workers.size(); ndx++)
+        workers[ndx]->thread = std::thread(&DdbQueryExecutor::Run, this, ndx);
+    return true;
+}
+
+// ==================================================================================================
+void DdbQueryExecutor::Stop()
+/*!
+  Runs the queued jobs to the end and stops the workers. Jobs submitted after this from outside
+  the executor are not run, nor are the jobs still waiting for a connection held by an open
+  session: their futures throw std::runtime_error. Must not be called from a job.
+*/
+{
+    if(workers.empty())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        running = false;
+        sleepCond.notify_all();
+    }
+    // The workers may still steal from each other's queues until all of them have finished.
+    for(size_t ndx=0; ndx<workers.size(); ndx++)
+        workers[ndx]->thread.join();
+    for(size_t ndx=0; ndx<workers.size(); ndx++)
+        delete workers[ndx];
+    workers.clear();
+
+    std::deque<Parked> dropped;
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        dropped.swap(parked);
+    }
+    if(!dropped.empty())
+        CS_VAPRT_WARN("DdbQueryExecutor::Stop - %d jobs waiting for a connection failed.",(int)dropped.size());
+    for(size_t ndx=0; ndx<dropped.size(); ndx++)
+        dropped[ndx].job(0);
+}
+
+// ==================================================================================================
+bool DdbQueryExecutor::Post(Job job)
+/*!
+  Queues a job. From a worker the job goes to the worker's own queue, otherwise to the next
+  queue in turn.
+  \retval bool False if the executor is not running. The job is dropped.
+*/
+{
+    size_t ndx;
+    if(currentExecutor == this)
+        ndx = currentWorker;
+    else {
+        if(!running || workers.empty())
+            return false;
+        ndx = nextQueue++ % workers.size();
+    }
+    {
+        std::lock_guard<std::mutex> lock(workers[ndx]->mutex);
+        workers[ndx]->jobs.push_back(std::move(job));
+    }
+    pending++;
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    sleepCond.notify_one();
+    return true;
+}
+
+// ==================================================================================================
+bool DdbQueryExecutor::Pop(size_t ndx, Job &job)
+/*!
+  Takes the newest job from the worker's own queue.
+*/
+{
+    Worker *worker = workers[ndx];
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    if(worker->jobs.empty())
+        return false;
+    job = std::move(worker->jobs.back());
+    worker->jobs.pop_back();
+    return true;
+}
+
+// ==================================================================================================
+bool DdbQueryExecutor::Steal(size_t ndx, Job &job)
+/*!
+  Takes the oldest job from the queue of another worker.
+*/
+{
+    for(size_t offset=1; offset<workers.size(); offset++) {
+        Worker *victim = workers[(ndx + offset) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim->mutex);
+        if(!victim->jobs.empty()) {
+            job = std::move(victim->jobs.front());
+            victim->jobs.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+// ==================================================================================================
+void DdbQueryExecutor::Run(size_t ndx)
+/*!
+  Worker thread. Runs jobs until the executor is stopped and the queues are empty.
+*/
+{
+    currentExecutor = this;
+    currentWorker = ndx;
+    Job job;
+    for(;;) {
+        if(Pop(ndx, job) || Steal(ndx, job)) {
+            pending--;
+            job();
+            job = Job();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepCond.wait(lock, [this]() { return pending > 0 || !running; });
+        if(!running && pending == 0)
+            break;
+    }
+    currentExecutor = 0;
+}
+
+// ==================================================================================================
+void DdbQueryExecutor::Dispatch(DbJob job, bool release)
+/*!
+  Runs the job on an idle connection. If all the connections are in use the job is parked
+  and the worker is freed; Release hands the next free connection to it. A worker must not
+  wait for a connection: the jobs that would release one might be queued behind it.
+  \param job Job to run.
+  \param release True to return the connection into the pool after the job. False if the job
+    keeps it and calls Release later.
+*/
+{
+    Parked entry = { std::move(job), release };
+    std::unique_lock<std::mutex> lock(poolMutex);
+    if(idle.empty()) {
+        parked.push_back(std::move(entry));
+        return;
+    }
+    DirectDatabase *db = idle.back();
+    idle.pop_back();
+    lock.unlock();
+    RunParked(db, entry);
+}
+
+// ==================================================================================================
+void DdbQueryExecutor::RunParked(DirectDatabase *db, const Parked &entry)
+/*!
+  Runs a job on the given connection. A lost connection is reset first.
+*/
+{
+    if(!db->IsConnectOK()) {
+        CS_PRINT_WARN("DdbQueryExecutor - Connection lost. Resetting.");
+        db->ResetConnection();
+    }
+    entry.job(db);
+    if(entry.release)
+        Release(db);
+}
+
+// ==================================================================================================
+void DdbQueryExecutor::Release(DirectDatabase *db)
+/*!
+  Returns a connection. It is passed on to the oldest parked job, if any, otherwise it goes
+  into the pool.
+*/
+{
+    if(db->IsTransaction()) {
+        CS_PRINT_WARN("DdbQueryExecutor - Job left a transaction open. Rolling back.");
+        db->RollBack();
+    }
+    std::unique_lock<std::mutex> lock(poolMutex);
+    if(!parked.empty()) {
+        std::shared_ptr<Parked> entry(new Parked(std::move(parked.front())));
+        parked.pop_front();
+        lock.unlock();
+        if(Post([this, db, entry]() { RunParked(db, *entry); }))
+            return;
+        CS_PRINT_WARN("DdbQueryExecutor - Executor stopped. Parked job failed.");
+        entry->job(0);
+        lock.lock();
+    }
+    idle.push_back(db);
+}
+
+// ==================================================================================================
+std::future<int> DdbQueryExecutor::ExecuteModify(const DDBSTR &query)
+/*!
+  Runs DirectDatabase::ExecuteModify on an idle connection.
+  \retval future Number of rows affected or -1 on error.
+*/
+{
+    return Submit([query](DirectDatabase *db) { return db->ExecuteModify(query); });
+}
+
+// ==================================================================================================
+std::future<bool> DdbQueryExecutor::UpdateStructure(const DDBSTR &command)
+/*!
+  Runs DirectDatabase::UpdateStructure on an idle connection.
+*/
+{
+    return Submit([command](DirectDatabase *db) { return db->UpdateStructure(command); });
+}
+
+// ==================================================================================================
+DdbQuerySession::DdbQuerySession(DdbQueryExecutor &exec)
+    : state(new State())
+{
+    state->exec = &exec;
+    state->db = 0;
+    state->scheduled = false;
+    state->closed = false;
+}
+
+// ==================================================================================================
+DdbQuerySession::~DdbQuerySession()
+{
+    Close();
+}
+
+// ==================================================================================================
+void DdbQuerySession::Add(Job job)
+/*!
+  Queues a job and schedules the queue unless a worker already runs it.
+*/
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if(state->closed) {
+        CS_PRINT_WARN("DdbQuerySession - Job submitted to a closed session. Ignored.");
+        return;
+    }
+    state->jobs.push_back(std::move(job));
+    if(state->scheduled)
+        return;
+    std::shared_ptr<State> shared = state;
+    state->scheduled = state->exec->Post([shared]() { RunQueue(shared); });
+    if(!state->scheduled) {
+        for(size_t ndx=0; ndx<state->jobs.size(); ndx++)
+            state->jobs[ndx](0);
+        state->jobs.clear();
+    }
+}
+
+// ==================================================================================================
+void DdbQuerySession::RunQueue(std::shared_ptr<State> state)
+/*!
+  Runs the queued jobs of the session in order on the session's connection.
+*/
+{
+    std::unique_lock<std::mutex> lock(state->mutex);
+    if(!state->db) {
+        // The session keeps the connection; Detach returns it.
+        lock.unlock();
+        state->exec->Dispatch([state](DirectDatabase *db) {
+            if(!db) {
+                Fail(*state);
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> guard(state->mutex);
+                state->db = db;
+            }
+            RunQueue(state);
+        }, false);
+        return;
+    }
+    while(!state->jobs.empty()) {
+        Job job = std::move(state->jobs.front());
+        state->jobs.pop_front();
+        lock.unlock();
+        job(state->db);
+        lock.lock();
+    }
+    state->scheduled = false;
+    if(state->closed)
+        Detach(*state);
+}
+
+// ==================================================================================================
+void DdbQuerySession::Fail(State &state)
+/*!
+  Fails the queued jobs when the executor stopped before the session got a connection.
+*/
+{
+    std::deque<Job> jobs;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        jobs.swap(state.jobs);
+        state.scheduled = false;
+    }
+    for(size_t ndx=0; ndx<jobs.size(); ndx++)
+        jobs[ndx](0);
+}
+
+// ==================================================================================================
+void DdbQuerySession::Detach(State &state)
+/*!
+  Returns the connection into the pool. Caller holds the state mutex.
+*/
+{
+    if(!state.db)
+        return;
+    state.exec->Release(state.db);
+    state.db = 0;
+}
+
+// ==================================================================================================
+std::future<int> DdbQuerySession::ExecuteModify(const DDBSTR &query)
+/*!
+  Runs DirectDatabase::ExecuteModify on the session's connection.
+  \retval future Number of rows affected or -1 on error.
+*/
+{
+    return Submit([query](DirectDatabase *db) { return db->ExecuteModify(query); });
+}
+
+// ==================================================================================================
+void DdbQuerySession::Close()
+/*!
+  Ends the session. The connection is returned into the pool after the queued jobs have run.
+  Does not wait for them.
+*/
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->closed = true;
+    if(!state->scheduled)
+        Detach(*state);
+}
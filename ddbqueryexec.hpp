@@ -0,0 +1,218 @@
+/*! \file ddbqueryexec.hpp
+ * \brief Thread pool that runs queries concurrently over a pool of connections. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#ifndef DDB_QUERYEXEC_H_FILE
+#define DDB_QUERYEXEC_H_FILE
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <future>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <stdexcept>
+#include "directdatabase.hpp"
+
+class DdbQuerySession;
+
+// ==================================================================================================
+//! Runs queries and closures concurrently on a pool of connections.
+/*! The executor owns the connections given with AddConnection and a pool of worker threads.
+    Each worker has a queue of its own. Work submitted from outside is spread over the queues in
+    turn and work submitted by a running job goes to the worker's own queue. A worker takes the
+    newest job from its own queue and, when that is empty, steals the oldest job from the other
+    queues. Each job borrows an idle connection for its duration.
+
+    Submit accepts a closure taking the DirectDatabase to use and returns a std::future of its
+    result. ExecuteModify and UpdateStructure are shortcuts for plain SQL. WhenAll collects the
+    results of a batch.
+    \code
+    DdbQueryExecutor exec;
+    for(int ndx=0; ndx<4; ndx++) {
+        DdbPostgre *pg = new DdbPostgre();
+        pg->Connect("host=localhost dbname=app");
+        exec.AddConnection(pg);
+    }
+    exec.Start();
+    std::future<uint32_t> count = exec.Submit([](DirectDatabase *db) {
+        uint32_t val = 0;
+        db->ExecuteIntFunction("SELECT count(*) FROM item", val);
+        return val;
+    });
+    std::vector<std::future<int> > batch;
+    for(size_t ndx=0; ndx<updates.size(); ndx++)
+        batch.push_back(exec.ExecuteModify(updates[ndx]));
+    std::vector<int> rows = DdbQueryExecutor::WhenAll(batch);
+    \endcode
+    A job that finds no idle connection is parked without holding its worker and it is given
+    the next connection that is released. So the sessions may hold all the connections.
+    A job must not leave a transaction open; it is rolled back when the connection is returned.
+    Use DdbQuerySession for a sequence of jobs that must run on the same connection. Jobs should
+    not wait for the futures of other jobs: the waiting job keeps its worker and connection.
+    A job that can not be run because the executor is not running, or was stopped while the job
+    waited for a connection, is not called; its future throws std::runtime_error.
+ */
+class DdbQueryExecutor
+{
+    friend class DdbQuerySession;
+public:
+    DdbQueryExecutor();
+    ~DdbQueryExecutor();
+
+    void AddConnection(DirectDatabase *db);
+    bool Start(int threads=0);
+    void Stop();
+    //! Returns true between Start and Stop.
+    bool IsRunning() { return running; }
+    //! Returns the number of connections.
+    int GetConnectionCount() { return (int)connections.size(); }
+
+    //! Runs fn(DirectDatabase*) on a worker with an idle connection.
+    /*! \retval future Result of fn. If the job can not be run, the future throws
+          std::runtime_error.
+     */
+    template<typename F>
+    auto Submit(F fn) -> std::future<decltype(fn((DirectDatabase*)0))>
+    {
+        typedef decltype(fn((DirectDatabase*)0)) R;
+        std::shared_ptr<std::packaged_task<R(DirectDatabase*)> > task(new std::packaged_task<R(DirectDatabase*)>(Guard<R>(fn)));
+        std::future<R> result = task->get_future();
+        if(!Post([this, task]() { Dispatch([task](DirectDatabase *db) { (*task)(db); }, true); }))
+            (*task)(0);
+        return result;
+    }
+
+    std::future<int> ExecuteModify(const DDBSTR &query);
+    std::future<bool> UpdateStructure(const DDBSTR &command);
+
+    //! Waits for all futures and returns their results in the same order.
+    template<typename R>
+    static std::vector<R> WhenAll(std::vector<std::future<R> > &futures)
+    {
+        std::vector<R> results;
+        results.reserve(futures.size());
+        for(size_t ndx=0; ndx<futures.size(); ndx++)
+            results.push_back(futures[ndx].get());
+        return results;
+    }
+
+protected:
+    typedef std::function<void()> Job;
+    typedef std::function<void(DirectDatabase*)> DbJob;
+    //! Job waiting for a connection. Called with a null connection if the executor stops.
+    struct Parked {
+        DbJob job;
+        bool release;               //!< Return the connection into the pool after the job.
+    };
+    //! Worker thread and its job queue.
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+        std::thread thread;
+    };
+
+    //! Wraps fn so that the job fails with std::runtime_error when it is given no connection.
+    template<typename R, typename F>
+    static std::function<R(DirectDatabase*)> Guard(F fn)
+    {
+        return [fn](DirectDatabase *db) -> R {
+            if(!db)
+                throw std::runtime_error("DdbQueryExecutor is not running.");
+            return fn(db);
+        };
+    }
+
+    bool Post(Job job);
+    bool Pop(size_t ndx, Job &job);
+    bool Steal(size_t ndx, Job &job);
+    void Run(size_t ndx);
+    void Dispatch(DbJob job, bool release);
+    void RunParked(DirectDatabase *db, const Parked &parked);
+    void Release(DirectDatabase *db);
+
+    std::vector<DirectDatabase*> connections;   //!< All connections. Owned.
+    std::vector<DirectDatabase*> idle;          //!< Connections not in use.
+    std::deque<Parked> parked;                  //!< Jobs waiting for a connection.
+    std::mutex poolMutex;
+
+    std::vector<Worker*> workers;
+    std::atomic<size_t> nextQueue;              //!< Queue for the next job from outside.
+    std::atomic<int> pending;                   //!< Jobs in the queues.
+    std::mutex sleepMutex;                      //!< Guards running for the sleeping workers.
+    std::condition_variable sleepCond;
+    std::atomic<bool> running;
+
+private:
+    DdbQueryExecutor(const DdbQueryExecutor&);
+    void operator=(const DdbQueryExecutor&);
+};
+
+// ==================================================================================================
+//! Sequence of jobs that run in order on the same connection of a DdbQueryExecutor.
+/*! The session takes a connection when its first job runs and keeps it until Close, so a
+    transaction may span several jobs. Jobs of a session never run concurrently. Other sessions
+    and jobs continue on the other connections meanwhile.
+    \code
+    DdbQuerySession session(exec);
+    session.Submit([](DirectDatabase *db) { return db->StartTransaction(); });
+    std::future<int> moved = session.ExecuteModify("UPDATE account SET balance=balance-10 WHERE id=1");
+    session.ExecuteModify("UPDATE account SET balance=balance+10 WHERE id=2");
+    session.Submit([](DirectDatabase *db) { return db->Commit(); });
+    session.Close();
+    \endcode
+    A transaction still open at Close is rolled back. An open session keeps its connection from
+    the other jobs, so keep the sessions short. The executor must outlive the session's jobs.
+    If the executor stops before the session gets a connection, the futures of the queued jobs
+    throw std::runtime_error.
+ */
+class DdbQuerySession
+{
+public:
+    DdbQuerySession(DdbQueryExecutor &exec);
+    ~DdbQuerySession();
+
+    //! Runs fn(DirectDatabase*) after the previously submitted jobs of this session.
+    template<typename F>
+    auto Submit(F fn) -> std::future<decltype(fn((DirectDatabase*)0))>
+    {
+        typedef decltype(fn((DirectDatabase*)0)) R;
+        std::shared_ptr<std::packaged_task<R(DirectDatabase*)> > task(
+            new std::packaged_task<R(DirectDatabase*)>(DdbQueryExecutor::Guard<R>(fn)));
+        std::future<R> result = task->get_future();
+        Add([task](DirectDatabase *db) { (*task)(db); });
+        return result;
+    }
+
+    std::future<int> ExecuteModify(const DDBSTR &query);
+    void Close();
+
+protected:
+    typedef std::function<void(DirectDatabase*)> Job;
+    //! Session data shared with the job that runs the queue.
+    struct State {
+        DdbQueryExecutor *exec;
+        std::mutex mutex;
+        std::deque<Job> jobs;
+        DirectDatabase *db;         //!< Connection held by the session. Null before the first job.
+        bool scheduled;             //!< True while a worker runs or is about to run the queue.
+        bool closed;
+    };
+
+    void Add(Job job);
+    static void RunQueue(std::shared_ptr<State> state);
+    static void Fail(State &state);
+    static void Detach(State &state);
+
+    std::shared_ptr<State> state;
+
+private:
+    DdbQuerySession(const DdbQuerySession&);
+    void operator=(const DdbQuerySession&);
+};
+
+#endif
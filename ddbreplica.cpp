@@ -0,0 +1,586 @@
+/*! \file ddbreplica.cpp
+ * \brief Local SQLite replica of PostgreSQL reference tables. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#include "pch-stop.h"
+#include <string.h>
+#include <ctype.h>
+#include <cpp4scripts.hpp>
+#include "ddbreplica.hpp"
+
+// ==================================================================================================
+DdbPgReplica::DdbPgReplica(DdbPostgre *source_in)
+/*!
+  \param source_in Connected PostgreSQL database. Caller keeps the ownership.
+*/
+{
+    source = source_in;
+    refreshInterval = 0;
+    fetchSize = 5000;
+    lastRefresh = 0;
+    flags |= DDB_FLAG_INITIALIZED;
+    feat_support = DDB_FEATURE_TRANSACTIONS;
+}
+
+// ==================================================================================================
+DdbPgReplica::~DdbPgReplica()
+{
+    Disconnect();
+}
+
+// ==================================================================================================
+bool DdbPgReplica::Connect(const char *constr)
+/*!
+  Opens the local SQLite database that holds the replicated tables.
+  \param constr SQLite file name. Null or empty string uses an in-memory database.
+*/
+{
+    if(!constr || !*constr)
+        constr = ":memory:";
+    if(!local.Connect(constr)) {
+        SetErrorId(4);
+        return false;
+    }
+    flags |= DDB_FLAG_CONNECTED;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbPgReplica::Disconnect()
+{
+    local.Disconnect();
+    flags &= ~DDB_FLAG_CONNECTED;
+    for(std::vector<Table>::iterator it=tables.begin(); it!=tables.end(); it++) {
+        it->created = false;
+        it->mark.clear();
+    }
+    return true;
+}
+
+// ==================================================================================================
+bool DdbPgReplica::IsConnectOK()
+{
+    return source->IsConnectOK() && local.IsConnectOK();
+}
+
+// ==================================================================================================
+bool DdbPgReplica::ResetConnection()
+{
+    return source->ResetConnection();
+}
+
+// ==================================================================================================
+DdbRowSet* DdbPgReplica::CreateRowSet()
+{
+    if(!source->IsConnected())
+    {
+        SetErrorId(5);
+        return 0;
+    }
+    return new DdbForwardRowSet(this);
+}
+
+// ==================================================================================================
+DDBSTR DdbPgReplica::GetErrorDescription(DdbRowSet *rs)
+{
+    return source->GetErrorDescription(rs);
+}
+
+// ==================================================================================================
+bool DdbPgReplica::AddTable(const char *table, const char *key, const char *watermark)
+/*!
+  Adds table into the replica. Table is copied at the next refresh.
+  \param table Name of the table in the source database. Schema prefix is not allowed.
+  \param key Primary key column. Required for incremental refresh.
+  \param watermark Column that is updated on each modification, e.g. an updated_at timestamp.
+         Null or empty if the table should be reloaded completely at each refresh. Rows deleted
+         from the source are not removed by the incremental refresh.
+*/
+{
+    if(!table || !*table || strchr(table,'.'))
+        return false;
+    Table tb;
+    tb.name = table;
+    for(std::string::iterator it=tb.name.begin(); it!=tb.name.end(); it++)
+        *it = tolower(*it);
+    if(FindTable(tb.name))
+        return true;
+    if(key)
+        tb.key = key;
+    if(watermark && tb.key.length())
+        tb.watermark = watermark;
+    tb.created = false;
+    tb.dirty = true;
+    tables.push_back(tb);
+    return true;
+}
+
+// ==================================================================================================
+DdbPgReplica::Table* DdbPgReplica::FindTable(const std::string &name)
+{
+    for(std::vector<Table>::iterator it=tables.begin(); it!=tables.end(); it++) {
+        if(it->name == name)
+            return &(*it);
+    }
+    return 0;
+}
+
+// ==================================================================================================
+bool DdbPgReplica::Refresh()
+/*!
+  Refreshes all replicated tables.
+  \retval bool True if all tables were refreshed successfully.
+*/
+{
+    bool rv = true;
+    lastRefresh = time(0);
+    for(std::vector<Table>::iterator it=tables.begin(); it!=tables.end(); it++) {
+        if(!RefreshTable(*it))
+            rv = false;
+    }
+    return rv;
+}
+
+// ==================================================================================================
+bool DdbPgReplica::RefreshTable(const char *table)
+{
+    std::string name(table ? table : "");
+    for(std::string::iterator it=name.begin(); it!=name.end(); it++)
+        *it = tolower(*it);
+    Table *tb = FindTable(name);
+    return tb ? RefreshTable(*tb) : false;
+}
+
+// ==================================================================================================
+bool DdbPgReplica::CreateLocal(Table &table, PGresult *res)
+/*!
+  Creates the local table using the column types of the source result.
+*/
+{
+    std::ostringstream sql;
+    sql << "CREATE TABLE IF NOT EXISTS \"" << table.name << "\" (";
+    for(int col=0; col<PQnfields(res); col++) {
+        if(col)
+            sql << ',';
+        sql << '"' << PQfname(res,col) << "\" ";
+        switch(PQftype(res,col)) {
+        case DDB_PGOID_BOOL:
+        case DDB_PGOID_INT2:
+        case DDB_PGOID_INT4:
+        case DDB_PGOID_INT8:
+        case DDB_PGOID_OID:
+            sql << "INTEGER";
+            break;
+        case DDB_PGOID_FLOAT4:
+        case DDB_PGOID_FLOAT8:
+            sql << "REAL";
+            break;
+        case DDB_PGOID_NUMERIC:
+            sql << "NUMERIC";
+            break;
+        default:
+            sql << "TEXT";
+        }
+    }
+    if(table.key.length())
+        sql << ", PRIMARY KEY(\"" << table.key << "\")";
+    sql << ')';
+    return local.UpdateStructure(sql.str());
+}
+
+// ==================================================================================================
+bool DdbPgReplica::RefreshTable(Table &table)
+/*!
+  Copies new and modified rows of the table from the source. Rows are read through a server
+  side cursor fetchSize rows at a time and inserted into the local table within one local
+  transaction. Values are bound as text and converted by the SQLite column affinity. The rows
+  at the watermark of the previous refresh are read again and replaced by their key. The local
+  table is created in the same transaction, so it is marked created only after the commit.
+*/
+{
+    PGconn *conn = source->GetPGConn();
+    if(!conn || !local.IsConnected()) {
+        SetErrorId(5);
+        return false;
+    }
+    std::ostringstream sql;
+    std::string mark = table.mark;
+    bool ownTransaction = !source->IsTransaction();
+    bool created = table.created;
+    bool cleared = table.watermark.length() > 0;
+    bool rv = false;
+    sqlite3_stmt *ins = 0;
+    PGresult *res;
+    char fetch[64];
+
+    sql << "DECLARE ddb_replica_cur NO SCROLL CURSOR FOR SELECT * FROM " << table.name;
+    if(table.watermark.length() && mark.length())
+        sql << " WHERE " << table.watermark << " >= '" << source->CleanUtf8(mark.c_str()) << '\'';
+    if(table.watermark.length())
+        sql << " ORDER BY " << table.watermark << ", " << table.key;
+    sprintf(fetch, "FETCH %d FROM ddb_replica_cur", fetchSize);
+
+    if(ownTransaction) {
+        res = PQexec(conn, "BEGIN READ ONLY");
+        PQclear(res);
+    }
+    res = PQexec(conn, sql.str().c_str());
+    if(PQresultStatus(res) != PGRES_COMMAND_OK) {
+        CS_VAPRT_ERRO("DdbPgReplica::RefreshTable - %s: %s", table.name.c_str(), PQresultErrorMessage(res));
+        PQclear(res);
+        goto REPLICA_REFRESH_END;
+    }
+    PQclear(res);
+    if(!local.StartTransaction())
+        goto REPLICA_CLOSE_CURSOR;
+
+    for(;;) {
+        res = PQexec(conn, fetch);
+        if(PQresultStatus(res) != PGRES_TUPLES_OK) {
+            CS_VAPRT_ERRO("DdbPgReplica::RefreshTable - fetch failed: %s", PQresultErrorMessage(res));
+            PQclear(res);
+            break;
+        }
+        if(!created) {
+            if(!CreateLocal(table, res)) {
+                PQclear(res);
+                break;
+            }
+            created = true;
+        }
+        // A table without watermark is reloaded completely. A file may hold the table already.
+        if(!cleared) {
+            std::string del = "DELETE FROM \"" + table.name + '"';
+            if(local.ExecuteModify(del) < 0) {
+                PQclear(res);
+                break;
+            }
+            cleared = true;
+        }
+        int rows = PQntuples(res);
+        int cols = PQnfields(res);
+        if(!ins) {
+            std::ostringstream insSql;
+            insSql << "INSERT OR REPLACE INTO \"" << table.name << "\" VALUES(";
+            for(int col=0; col<cols; col++)
+                insSql << (col ? ",?" : "?");
+            insSql << ')';
+            if(sqlite3_prepare_v2(local.GetSqlConn(), insSql.str().c_str(), -1, &ins, 0) != SQLITE_OK) {
+                CS_VAPRT_ERRO("DdbPgReplica::RefreshTable - %s", sqlite3_errmsg(local.GetSqlConn()));
+                PQclear(res);
+                break;
+            }
+        }
+        bool copied = true;
+        for(int row=0; row<rows && copied; row++) {
+            for(int col=0; col<cols; col++) {
+                if(PQgetisnull(res,row,col))
+                    sqlite3_bind_null(ins, col+1);
+                else if(PQftype(res,col) == DDB_PGOID_BOOL)
+                    sqlite3_bind_int(ins, col+1, PQgetvalue(res,row,col)[0]=='t' ? 1:0);
+                else
+                    sqlite3_bind_text(ins, col+1, PQgetvalue(res,row,col), PQgetlength(res,row,col), SQLITE_STATIC);
+            }
+            if(sqlite3_step(ins) != SQLITE_DONE) {
+                CS_VAPRT_ERRO("DdbPgReplica::RefreshTable - %s", sqlite3_errmsg(local.GetSqlConn()));
+                copied = false;
+            }
+            sqlite3_reset(ins);
+        }
+        if(copied && rows && table.watermark.length()) {
+            int wcol = PQfnumber(res, table.watermark.c_str());
+            if(wcol>=0 && !PQgetisnull(res,rows-1,wcol))
+                mark = PQgetvalue(res,rows-1,wcol);
+        }
+        PQclear(res);
+        if(!copied)
+            break;
+        if(rows < fetchSize) {
+            rv = true;
+            break;
+        }
+    }
+    if(ins)
+        sqlite3_finalize(ins);
+    if(rv)
+        rv = local.Commit();
+    if(!rv && local.IsTransaction())
+        local.RollBack();
+    if(rv)
+        table.created = true;
+
+ REPLICA_CLOSE_CURSOR:
+    res = PQexec(conn, "CLOSE ddb_replica_cur");
+    PQclear(res);
+ REPLICA_REFRESH_END:
+    if(ownTransaction) {
+        res = PQexec(conn, "COMMIT");
+        PQclear(res);
+    }
+    if(rv) {
+        table.mark = mark;
+        table.dirty = false;
+    }
+    return rv;
+}
+
+// ==================================================================================================
+DirectDatabase* DdbPgReplica::RouteQuery(const DDBSTR &query)
+/*!
+  Selects the local copy if the query is a read that refers to replicated tables only.
+*/
+{
+    if(!local.IsConnected() || source->IsTransaction())
+        return source;
+    if(refreshInterval>0 && time(0)-lastRefresh >= refreshInterval)
+        Refresh();
+    std::vector<std::string> names;
+    if(!ParseTables(query.UTF8(), names) || names.empty())
+        return source;
+    for(std::vector<std::string>::iterator it=names.begin(); it!=names.end(); it++) {
+        Table *tb = FindTable(*it);
+        if(!tb)
+            return source;
+        if((tb->dirty || !tb->created) && !RefreshTable(*tb))
+            return source;
+    }
+    return &local;
+}
+
+// ==================================================================================================
+DirectDatabase* DdbPgReplica::RouteFailed(const DDBSTR &query, DirectDatabase *failed)
+{
+    if(failed != &local)
+        return 0;
+    CS_VAPRT_NOTE("DdbPgReplica - local query failed, retrying at source: %s", query.UTF8());
+    return source;
+}
+
+// ==================================================================================================
+void DdbPgReplica::MarkDirty(const DDBSTR &modify)
+{
+    std::vector<std::string> names;
+    ParseTables(modify.UTF8(), names);
+    for(std::vector<std::string>::iterator it=names.begin(); it!=names.end(); it++) {
+        Table *tb = FindTable(*it);
+        if(tb)
+            tb->dirty = true;
+    }
+}
+
+// ==================================================================================================
+bool DdbPgReplica::ParseTables(const char *sql, std::vector<std::string> &tables)
+/*!
+  Lightweight scan of the SQL statement for the table names. Names following FROM, JOIN,
+  INTO and UPDATE (and comma separated lists after them) are collected. Names are returned in
+  lower case without schema prefix. Function calls and sub-queries in the FROM clause are
+  returned as names too, which makes them non-replicated.
+  \param sql Statement to parse.
+  \param tables Vector where the table names are appended into.
+  \retval bool True if the statement is a read only SELECT.
+*/
+{
+    static const char *stops[] = { "where", "on", "using", "group", "order", "limit", "offset",
+                                   "having", "union", "intersect", "except", "window", "set",
+                                   "values", "returning", "left", "right", "inner", "outer",
+                                   "full", "cross", "natural", "lateral", "select", "for", 0 };
+    bool read=false, first=true, expect=false, after=false;
+    const char *ptr = sql;
+    std::string tok;
+
+    if(!ptr)
+        return false;
+    while(*ptr) {
+        if(isspace((unsigned char)*ptr)) {
+            ptr++;
+            continue;
+        }
+        if(*ptr=='\'') {
+            for(ptr++; *ptr; ptr++) {
+                if(*ptr=='\'') {
+                    if(ptr[1]!='\'')
+                        break;
+                    ptr++;
+                }
+            }
+            if(*ptr)
+                ptr++;
+            after = false;
+            continue;
+        }
+        if(*ptr=='-' && ptr[1]=='-') {
+            while(*ptr && *ptr!='\n')
+                ptr++;
+            continue;
+        }
+        if(*ptr=='"' || isalpha((unsigned char)*ptr) || *ptr=='_') {
+            bool quoted = false;
+            tok.clear();
+            while(*ptr) {
+                if(*ptr=='"') {
+                    const char *end = strchr(ptr+1,'"');
+                    if(!end)
+                        end = ptr+strlen(ptr);
+                    tok.append(ptr+1, end-ptr-1);
+                    ptr = *end ? end+1 : end;
+                    quoted = true;
+                }
+                else if(isalnum((unsigned char)*ptr) || *ptr=='_' || *ptr=='$' || *ptr=='.')
+                    tok += (char)tolower(*ptr++);
+                else
+                    break;
+            }
+            if(first) {
+                read = tok=="select" || tok=="with";
+                first = false;
+            }
+            if(quoted) {
+                if(expect) {
+                    size_t dot = tok.rfind('.');
+                    tables.push_back(dot==std::string::npos ? tok : tok.substr(dot+1));
+                    expect = false;
+                    after = true;
+                }
+                continue;
+            }
+            if(tok=="insert" || tok=="update" || tok=="delete" || tok=="merge" || tok=="truncate")
+                read = false;
+            if(tok=="from" || tok=="join" || tok=="into" || tok=="update") {
+                expect = true;
+                after = false;
+                continue;
+            }
+            bool stop = false;
+            for(int ndx=0; stops[ndx]; ndx++) {
+                if(tok==stops[ndx]) {
+                    stop = true;
+                    break;
+                }
+            }
+            if(stop) {
+                expect = false;
+                after = false;
+            }
+            else if(expect) {
+                size_t dot = tok.rfind('.');
+                tables.push_back(dot==std::string::npos ? tok : tok.substr(dot+1));
+                expect = false;
+                after = true;
+            }
+            continue;
+        }
+        if(*ptr==',' && after)
+            expect = true;
+        else if(*ptr=='(' && expect) {
+            // Sub-query or function in the FROM clause. Mark it as non-replicated.
+            tables.push_back("(");
+            expect = false;
+        }
+        else if(*ptr==';')
+            first = true;
+        ptr++;
+    }
+    return read;
+}
+
+// ==================================================================================================
+bool DdbPgReplica::StartTransaction()
+{
+    return source->StartTransaction();
+}
+
+// ==================================================================================================
+bool DdbPgReplica::Commit()
+{
+    return source->Commit();
+}
+
+// ==================================================================================================
+bool DdbPgReplica::RollBack()
+{
+    return source->RollBack();
+}
+
+// ==================================================================================================
+bool DdbPgReplica::ExecuteIntFunction(const DDBSTR &query, uint32_t &val)
+{
+    DirectDatabase *db = RouteQuery(query);
+    if(db->ExecuteIntFunction(query,val))
+        return true;
+    db = db->GetErrorID() ? RouteFailed(query,db) : 0;
+    return db ? db->ExecuteIntFunction(query,val) : false;
+}
+
+// ==================================================================================================
+bool DdbPgReplica::ExecuteLongFunction(const DDBSTR &query, uint64_t &val)
+{
+    DirectDatabase *db = RouteQuery(query);
+    if(db->ExecuteLongFunction(query,val))
+        return true;
+    db = db->GetErrorID() ? RouteFailed(query,db) : 0;
+    return db ? db->ExecuteLongFunction(query,val) : false;
+}
+
+// ==================================================================================================
+bool DdbPgReplica::ExecuteDoubleFunction(const DDBSTR &query, double &val)
+{
+    DirectDatabase *db = RouteQuery(query);
+    if(db->ExecuteDoubleFunction(query,val))
+        return true;
+    db = db->GetErrorID() ? RouteFailed(query,db) : 0;
+    return db ? db->ExecuteDoubleFunction(query,val) : false;
+}
+
+// ==================================================================================================
+bool DdbPgReplica::ExecuteBoolFunction(const DDBSTR &query, bool &val)
+{
+    DirectDatabase *db = RouteQuery(query);
+    if(db->ExecuteBoolFunction(query,val))
+        return true;
+    db = db->GetErrorID() ? RouteFailed(query,db) : 0;
+    return db ? db->ExecuteBoolFunction(query,val) : false;
+}
+
+// ==================================================================================================
+bool DdbPgReplica::ExecuteStrFunction(const DDBSTR &query, DDBSTR &result)
+{
+    DirectDatabase *db = RouteQuery(query);
+    if(db->ExecuteStrFunction(query,result))
+        return true;
+    db = db->GetErrorID() ? RouteFailed(query,db) : 0;
+    return db ? db->ExecuteStrFunction(query,result) : false;
+}
+
+// ==================================================================================================
+bool DdbPgReplica::ExecuteDateFunction(const DDBSTR &query, DDBTIME &val)
+{
+    DirectDatabase *db = RouteQuery(query);
+    if(db->ExecuteDateFunction(query,val))
+        return true;
+    db = db->GetErrorID() ? RouteFailed(query,db) : 0;
+    return db ? db->ExecuteDateFunction(query,val) : false;
+}
+
+// ==================================================================================================
+int DdbPgReplica::ExecuteModify(const DDBSTR &query)
+{
+    int rv = source->ExecuteModify(query);
+    if(rv != 0)
+        MarkDirty(query);
+    return rv;
+}
+
+// ==================================================================================================
+uint64_t DdbPgReplica::GetInsertId()
+{
+    return source->GetInsertId();
+}
+
+// ==================================================================================================
+bool DdbPgReplica::UpdateStructure(const DDBSTR &command)
+{
+    bool rv = source->UpdateStructure(command);
+    MarkDirty(command);
+    return rv;
+}
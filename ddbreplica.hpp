@@ -0,0 +1,114 @@
+/*! \file ddbreplica.hpp
+ * \brief Local SQLite replica of PostgreSQL reference tables. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#ifndef DDB_REPLICA_H_FILE
+#define DDB_REPLICA_H_FILE
+
+#include <vector>
+#include <string>
+#include <time.h>
+#include "directdatabase.hpp"
+#include "ddbpostgre.hpp"
+#include "ddbsqlite.hpp"
+#include "ddbforward.hpp"
+
+// ==================================================================================================
+//! PostgreSQL connection that answers reads of replicated tables from a local SQLite copy.
+/*! Configured tables are copied from the source into an in-process SQLite database with a
+    server side cursor. Reads (Query and Execute...Function) that reference only replicated
+    tables are executed by the local copy. Everything else, including all modifications and
+    transactions, goes to the source connection.
+
+    Refresh copies rows whose watermark column (updated_at by default) is at least the newest
+    value copied so far. The rows with the same value are copied again, so a row written with
+    that value after the previous refresh is not missed; INSERT OR REPLACE on the key column
+    keeps one copy of each row. A row that is committed later with an older watermark value is
+    not copied. Deletes in the source are not propagated in the watermark mode: deleted rows
+    stay in the local copy. An in-memory copy is loaded again when the replica is connected
+    again; a file-backed copy keeps the deleted rows until the table is dropped from the file.
+    Tables without watermark are reloaded completely, deletes included. Refresh is done on demand with Refresh
+    or periodically when the refresh interval has passed. Periodic refresh is checked on each
+    routed read, no background thread is used. Modifications made through this object mark
+    the affected tables for refresh before their next local read.
+
+    Queries should use SQL understood by both databases. If a routed query fails locally it
+    is retried on the source. Table names are matched without schema prefix.
+    Usage:
+    \code
+    DdbPgReplica rep(&pg);
+    rep.Connect(":memory:");
+    rep.AddTable("country", "id");
+    rep.Refresh();
+    rep.ExecuteStrFunction("SELECT name FROM country WHERE id=246", name);
+    \endcode
+ */
+class DdbPgReplica : public DirectDatabase, public DdbQueryRoute
+{
+public:
+    DdbPgReplica(DdbPostgre *source);
+    ~DdbPgReplica();
+
+    int GetType() { return DDBTYPE_POSTGRES; }
+    bool Connect(const char *constr);
+    bool Disconnect();
+    bool IsConnectOK();
+    bool ResetConnection();
+
+    DdbRowSet* CreateRowSet();
+    DDBSTR GetErrorDescription(DdbRowSet *rs);
+
+    bool StartTransaction();
+    bool Commit();
+    bool RollBack();
+
+    bool ExecuteIntFunction(const DDBSTR &query,uint32_t &val);
+    bool ExecuteLongFunction(const DDBSTR &query,uint64_t &val);
+    bool ExecuteDoubleFunction(const DDBSTR &query, double &val);
+    bool ExecuteBoolFunction(const DDBSTR &query, bool &val);
+    bool ExecuteStrFunction(const DDBSTR &query, DDBSTR &result);
+    bool ExecuteDateFunction(const DDBSTR &query, DDBTIME &val);
+    int ExecuteModify(const DDBSTR &query);
+    uint64_t GetInsertId();
+    bool UpdateStructure(const DDBSTR &command);
+
+    bool AddTable(const char *table, const char *key=0, const char *watermark="updated_at");
+    bool Refresh();
+    bool RefreshTable(const char *table);
+    //! Sets the periodic refresh interval in seconds. Zero (default) refreshes on demand only.
+    void SetRefreshInterval(int seconds) { refreshInterval = seconds; }
+    //! Sets the number of rows fetched from the source cursor at a time. Default is 5000.
+    void SetFetchSize(int rows) { fetchSize = rows>0 ? rows : 1; }
+    DdbSqlite* GetLocal() { return &local; }
+    DdbPostgre* GetSource() { return source; }
+
+    DirectDatabase* RouteQuery(const DDBSTR &query);
+    DirectDatabase* RouteFailed(const DDBSTR &query, DirectDatabase *failed);
+
+    static bool ParseTables(const char *sql, std::vector<std::string> &tables);
+
+protected:
+    //! Replicated table.
+    struct Table {
+        std::string name;       //!< Table name, lower case.
+        std::string key;        //!< Primary key column. Empty if none.
+        std::string watermark;  //!< Column used for incremental refresh. Empty if none.
+        std::string mark;       //!< Newest watermark value copied so far.
+        bool created;           //!< True once the local table has been created.
+        bool dirty;             //!< True if table should be refreshed before next local read.
+    };
+    Table* FindTable(const std::string &name);
+    bool RefreshTable(Table &table);
+    bool CreateLocal(Table &table, PGresult *res);
+    void MarkDirty(const DDBSTR &modify);
+
+    DdbPostgre *source;
+    DdbSqlite local;
+    std::vector<Table> tables;
+    int refreshInterval;
+    int fetchSize;
+    time_t lastRefresh;
+};
+
+#endif
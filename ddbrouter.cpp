@@ -0,0 +1,437 @@
+/*! \file ddbrouter.cpp
+ * \brief Routing of reads into replica connections and writes into the primary. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#include "pch-stop.h"
+#include <string.h>
+#include <ctype.h>
+#include <string>
+#include <cpp4scripts.hpp>
+#include "ddbrouter.hpp"
+
+using namespace std::chrono;
+
+// ==================================================================================================
+DdbRouter::DdbRouter(DirectDatabase *primary_in)
+/*!
+  \param primary_in Connected primary database. Caller keeps the ownership.
+*/
+{
+    primary = primary_in;
+    next = 0;
+    policy = DDB_ROUTE_ROUNDROBIN;
+    stickyTime = 1000;
+    retryDelay = 5000;
+    written = false;
+    flags |= DDB_FLAG_INITIALIZED;
+    feat_support = DDB_FEATURE_TRANSACTIONS;
+    if(primary->IsConnected())
+        flags |= DDB_FLAG_CONNECTED;
+}
+
+// ==================================================================================================
+DdbRouter::~DdbRouter()
+{
+}
+
+// ==================================================================================================
+void DdbRouter::AddReplica(DirectDatabase *replica)
+/*!
+  Adds a replica connection. Caller keeps the ownership.
+*/
+{
+    Replica rep;
+    rep.db = replica;
+    rep.load = 0;
+    rep.down = false;
+    replicas.push_back(rep);
+}
+
+// ==================================================================================================
+bool DdbRouter::Connect(const char *)
+/*!
+  Connections are opened by the caller. This only checks that the primary is connected.
+*/
+{
+    if(!primary->IsConnected()) {
+        SetErrorId(4);
+        return false;
+    }
+    flags |= DDB_FLAG_CONNECTED;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbRouter::Disconnect()
+/*!
+  Stops routing. Connections themselves are left for the caller to close.
+*/
+{
+    flags &= ~(DDB_FLAG_CONNECTED|DDB_FLAG_TRANSACT_ON);
+    return true;
+}
+
+// ==================================================================================================
+bool DdbRouter::IsConnectOK()
+{
+    return primary->IsConnectOK();
+}
+
+// ==================================================================================================
+bool DdbRouter::ResetConnection()
+/*!
+  Resets the primary and the replicas whose connection has been lost.
+*/
+{
+    for(std::vector<Replica>::iterator it=replicas.begin(); it!=replicas.end(); it++) {
+        if(!it->db->IsConnectOK())
+            it->down = !it->db->ResetConnection();
+        else
+            it->down = false;
+        if(it->down)
+            it->retry = steady_clock::now() + milliseconds(retryDelay);
+    }
+    flags &= ~DDB_FLAG_TRANSACT_ON;
+    return primary->ResetConnection();
+}
+
+// ==================================================================================================
+DdbRowSet* DdbRouter::CreateRowSet()
+{
+    if(!primary->IsConnected())
+    {
+        SetErrorId(5);
+        return 0;
+    }
+    return new DdbForwardRowSet(this);
+}
+
+// ==================================================================================================
+DDBSTR DdbRouter::GetErrorDescription(DdbRowSet *rs)
+{
+    DdbForwardRowSet *frs = static_cast<DdbForwardRowSet*>(rs);
+    if(frs && frs->GetTarget())
+        return frs->GetTarget()->GetErrorDescription(0);
+    return primary->GetErrorDescription(0);
+}
+
+// ==================================================================================================
+bool DdbRouter::StartTransaction()
+{
+    if(!primary->StartTransaction())
+        return false;
+    flags |= DDB_FLAG_TRANSACT_ON;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbRouter::Commit()
+{
+    bool rv = primary->Commit();
+    if(!primary->IsTransaction())
+        flags &= ~DDB_FLAG_TRANSACT_ON;
+    Written();
+    return rv;
+}
+
+// ==================================================================================================
+bool DdbRouter::RollBack()
+{
+    bool rv = primary->RollBack();
+    if(!primary->IsTransaction())
+        flags &= ~DDB_FLAG_TRANSACT_ON;
+    return rv;
+}
+
+// ==================================================================================================
+void DdbRouter::Written()
+/*!
+  Starts the read-your-writes period.
+*/
+{
+    written = true;
+    lastWrite = steady_clock::now();
+}
+
+// ==================================================================================================
+DdbRouter::Replica* DdbRouter::FindReplica(DirectDatabase *db)
+{
+    for(std::vector<Replica>::iterator it=replicas.begin(); it!=replicas.end(); it++) {
+        if(it->db == db)
+            return &(*it);
+    }
+    return 0;
+}
+
+// ==================================================================================================
+DirectDatabase* DdbRouter::SelectReplica()
+/*!
+  Selects the replica according to the policy. Lost connections are reset once their retry
+  delay has passed.
+  \retval DirectDatabase* Selected replica or null if none is available.
+*/
+{
+    Replica *best = 0;
+    size_t count = replicas.size();
+    steady_clock::time_point now = steady_clock::now();
+
+    for(size_t ndx=0; ndx<count; ndx++) {
+        size_t pos = (next+ndx) % count;
+        Replica *rep = &replicas[pos];
+        if(rep->down) {
+            if(now < rep->retry)
+                continue;
+            if(!rep->db->ResetConnection()) {
+                CS_PRINT_WARN("DdbRouter::SelectReplica - Replica reconnect failed.");
+                rep->retry = now + milliseconds(retryDelay);
+                continue;
+            }
+            CS_PRINT_NOTE("DdbRouter::SelectReplica - Replica reconnected.");
+            rep->down = false;
+        }
+        if(!best || (policy==DDB_ROUTE_LEASTLOADED && rep->load < best->load)) {
+            best = rep;
+            next = pos+1;
+            if(policy != DDB_ROUTE_LEASTLOADED || best->load == 0)
+                break;
+        }
+    }
+    if(!best)
+        return 0;
+    best->load++;
+    return best->db;
+}
+
+// ==================================================================================================
+DirectDatabase* DdbRouter::RouteQuery(const DDBSTR &query)
+/*!
+  Selects a replica for plain reads outside transactions and the read-your-writes period.
+  Everything else goes to the primary.
+*/
+{
+    if(replicas.empty() || IsTransaction() || primary->IsTransaction())
+        return primary;
+    if(written && duration_cast<milliseconds>(steady_clock::now()-lastWrite).count() < stickyTime)
+        return primary;
+    if(!IsReadQuery(query.UTF8())) {
+        Written();
+        return primary;
+    }
+    DirectDatabase *db = SelectReplica();
+    return db ? db : primary;
+}
+
+// ==================================================================================================
+DirectDatabase* DdbRouter::RouteFailed(const DDBSTR &query, DirectDatabase *failed)
+/*!
+  Retries the failed replica read on the primary. Replica is marked down if its connection
+  has been lost.
+*/
+{
+    Replica *rep = FindReplica(failed);
+    if(!rep)
+        return 0;
+    if(!failed->IsConnectOK()) {
+        CS_PRINT_WARN("DdbRouter - Replica connection lost.");
+        rep->down = true;
+        rep->retry = steady_clock::now() + milliseconds(retryDelay);
+    }
+    CS_VAPRT_NOTE("DdbRouter - replica query failed, retrying at primary: %s", query.UTF8());
+    return primary;
+}
+
+// ==================================================================================================
+void DdbRouter::RouteDone(DirectDatabase *db)
+{
+    Replica *rep = FindReplica(db);
+    if(rep && rep->load>0)
+        rep->load--;
+}
+
+// ==================================================================================================
+bool DdbRouter::IsReadQuery(const char *sql)
+/*!
+  Checks if the statement is a plain read that may be executed by a replica. Statement must
+  start with SELECT, WITH, VALUES, SHOW or TABLE and must not contain INSERT, UPDATE, DELETE,
+  MERGE, TRUNCATE, INTO (SELECT INTO), a locking clause or a sequence function outside the
+  string literals.
+  \param sql Statement to check.
+  \retval bool True if the statement is a read.
+*/
+{
+    static const char *writes[] = { "insert", "update", "delete", "merge", "truncate", "into",
+                                    "share", "nextval", "setval", "lastval", "currval", 0 };
+    static const char *reads[] = { "select", "with", "values", "show", "table", 0 };
+    const char *ptr = sql;
+    bool first=true, read=false;
+    std::string tok;
+
+    if(!ptr)
+        return false;
+    while(*ptr) {
+        if(isspace((unsigned char)*ptr) || *ptr=='(') {
+            ptr++;
+            continue;
+        }
+        if(*ptr=='-' && ptr[1]=='-') {
+            while(*ptr && *ptr!='\n')
+                ptr++;
+            continue;
+        }
+        if(*ptr=='/' && ptr[1]=='*') {
+            const char *end = strstr(ptr+2,"*/");
+            ptr = end ? end+2 : ptr+strlen(ptr);
+            continue;
+        }
+        if(*ptr=='\'' || *ptr=='"') {
+            char quote = *ptr;
+            for(ptr++; *ptr; ptr++) {
+                if(*ptr==quote) {
+                    if(ptr[1]!=quote)
+                        break;
+                    ptr++;
+                }
+            }
+            if(*ptr)
+                ptr++;
+            if(first)
+                return false;
+            continue;
+        }
+        if(isalpha((unsigned char)*ptr) || *ptr=='_') {
+            tok.clear();
+            while(isalnum((unsigned char)*ptr) || *ptr=='_' || *ptr=='$')
+                tok += (char)tolower(*ptr++);
+            const char **list = first ? reads : writes;
+            int ndx;
+            for(ndx=0; list[ndx] && tok!=list[ndx]; ndx++);
+            if(first) {
+                if(!list[ndx])
+                    return false;
+                first = false;
+                read = true;
+            }
+            else if(list[ndx])
+                return false;
+            continue;
+        }
+        if(*ptr==';')
+            first = true;
+        ptr++;
+    }
+    return read;
+}
+
+// ==================================================================================================
+bool DdbRouter::ExecuteIntFunction(const DDBSTR &query, uint32_t &val)
+{
+    DirectDatabase *db = RouteQuery(query);
+    bool rv = db->ExecuteIntFunction(query,val);
+    RouteDone(db);
+    if(rv)
+        return true;
+    db = db->GetErrorID() ? RouteFailed(query,db) : 0;
+    return db ? db->ExecuteIntFunction(query,val) : false;
+}
+
+// ==================================================================================================
+bool DdbRouter::ExecuteLongFunction(const DDBSTR &query, uint64_t &val)
+{
+    DirectDatabase *db = RouteQuery(query);
+    bool rv = db->ExecuteLongFunction(query,val);
+    RouteDone(db);
+    if(rv)
+        return true;
+    db = db->GetErrorID() ? RouteFailed(query,db) : 0;
+    return db ? db->ExecuteLongFunction(query,val) : false;
+}
+
+// ==================================================================================================
+bool DdbRouter::ExecuteDoubleFunction(const DDBSTR &query, double &val)
+{
+    DirectDatabase *db = RouteQuery(query);
+    bool rv = db->ExecuteDoubleFunction(query,val);
+    RouteDone(db);
+    if(rv)
+        return true;
+    db = db->GetErrorID() ? RouteFailed(query,db) : 0;
+    return db ? db->ExecuteDoubleFunction(query,val) : false;
+}
+
+// ==================================================================================================
+bool DdbRouter::ExecuteBoolFunction(const DDBSTR &query, bool &val)
+{
+    DirectDatabase *db = RouteQuery(query);
+    bool rv = db->ExecuteBoolFunction(query,val);
+    RouteDone(db);
+    if(rv)
+        return true;
+    db = db->GetErrorID() ? RouteFailed(query,db) : 0;
+    return db ? db->ExecuteBoolFunction(query,val) : false;
+}
+
+// ==================================================================================================
+bool DdbRouter::ExecuteStrFunction(const DDBSTR &query, DDBSTR &result)
+{
+    DirectDatabase *db = RouteQuery(query);
+    bool rv = db->ExecuteStrFunction(query,result);
+    RouteDone(db);
+    if(rv)
+        return true;
+    db = db->GetErrorID() ? RouteFailed(query,db) : 0;
+    return db ? db->ExecuteStrFunction(query,result) : false;
+}
+
+// ==================================================================================================
+bool DdbRouter::ExecuteDateFunction(const DDBSTR &query, DDBTIME &val)
+{
+    DirectDatabase *db = RouteQuery(query);
+    bool rv = db->ExecuteDateFunction(query,val);
+    RouteDone(db);
+    if(rv)
+        return true;
+    db = db->GetErrorID() ? RouteFailed(query,db) : 0;
+    return db ? db->ExecuteDateFunction(query,val) : false;
+}
+
+// ==================================================================================================
+int DdbRouter::Export(const DDBSTR &query, DdbExportWriter &out)
+/*!
+  Exports from a replica. The export is not retried since part of the output may have been
+  written already.
+*/
+{
+    DirectDatabase *db = RouteQuery(query);
+    int rv = db->Export(query,out);
+    RouteDone(db);
+    Replica *rep = rv < 0 ? FindReplica(db) : 0;
+    if(rep && !db->IsConnectOK()) {
+        CS_PRINT_WARN("DdbRouter - Replica connection lost.");
+        rep->down = true;
+        rep->retry = steady_clock::now() + milliseconds(retryDelay);
+    }
+    return rv;
+}
+
+// ==================================================================================================
+int DdbRouter::ExecuteModify(const DDBSTR &query)
+{
+    int rv = primary->ExecuteModify(query);
+    Written();
+    return rv;
+}
+
+// ==================================================================================================
+uint64_t DdbRouter::GetInsertId()
+{
+    return primary->GetInsertId();
+}
+
+// ==================================================================================================
+bool DdbRouter::UpdateStructure(const DDBSTR &command)
+{
+    bool rv = primary->UpdateStructure(command);
+    Written();
+    return rv;
+}
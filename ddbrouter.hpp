@@ -0,0 +1,116 @@
+/*! \file ddbrouter.hpp
+ * \brief Routing of reads into replica connections and writes into the primary. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#ifndef DDB_ROUTER_H_FILE
+#define DDB_ROUTER_H_FILE
+
+#include <vector>
+#include <chrono>
+#include "directdatabase.hpp"
+#include "ddbforward.hpp"
+
+//! Read is given to the replicas in turns.
+#define DDB_ROUTE_ROUNDROBIN  1
+//! Read is given to the replica with the fewest open queries.
+#define DDB_ROUTE_LEASTLOADED 2
+
+// ==================================================================================================
+//! Database that sends reads to replica connections and everything else to the primary.
+/*! Query and Execute...Function calls that are plain reads (SELECT, WITH ... SELECT, VALUES,
+    SHOW) are executed by one of the replicas. ExecuteModify, UpdateStructure, locking reads
+    (FOR UPDATE / FOR SHARE) and all work inside a transaction go to the primary.
+
+    Read-your-writes: after a write all reads go to the primary for the sticky time
+    (SetStickyTime, default 1000 ms). Set it to cover the replication lag of the replicas.
+
+    If a read fails on a replica it is retried on the primary. A replica whose connection has
+    been lost is skipped for the retry delay (SetRetryDelay, default 5000 ms) after which its
+    connection is reset. If no replica is available reads go to the primary.
+
+    Queries calling functions with side effects other than nextval and setval are not
+    recognized as writes. Run them in a transaction or use GetPrimary for them.
+
+    Router does not own the connections. Connections should be connected before they are
+    given to the router. The router is not thread safe.
+    Usage:
+    \code
+    DdbRouter router(&primary);
+    router.AddReplica(&replica1);
+    router.AddReplica(&replica2);
+    router.SetPolicy(DDB_ROUTE_LEASTLOADED);
+    router.ExecuteModify("UPDATE account SET balance=0 WHERE id=7");  // primary
+    router.ExecuteIntFunction("SELECT balance FROM account WHERE id=7", val); // primary, sticky
+    \endcode
+ */
+class DdbRouter : public DirectDatabase, public DdbQueryRoute
+{
+public:
+    DdbRouter(DirectDatabase *primary);
+    ~DdbRouter();
+
+    int GetType() { return primary->GetType(); }
+    bool Connect(const char *constr);
+    bool Disconnect();
+    bool IsConnectOK();
+    bool ResetConnection();
+
+    DdbRowSet* CreateRowSet();
+    DDBSTR GetErrorDescription(DdbRowSet *rs);
+
+    bool StartTransaction();
+    bool Commit();
+    bool RollBack();
+
+    bool ExecuteIntFunction(const DDBSTR &query,uint32_t &val);
+    bool ExecuteLongFunction(const DDBSTR &query,uint64_t &val);
+    bool ExecuteDoubleFunction(const DDBSTR &query, double &val);
+    bool ExecuteBoolFunction(const DDBSTR &query, bool &val);
+    bool ExecuteStrFunction(const DDBSTR &query, DDBSTR &result);
+    bool ExecuteDateFunction(const DDBSTR &query, DDBTIME &val);
+    int ExecuteModify(const DDBSTR &query);
+    uint64_t GetInsertId();
+    bool UpdateStructure(const DDBSTR &command);
+    int Export(const DDBSTR &query, DdbExportWriter &out);
+
+    void AddReplica(DirectDatabase *replica);
+    //! Sets the replica selection: DDB_ROUTE_ROUNDROBIN (default) or DDB_ROUTE_LEASTLOADED.
+    void SetPolicy(int policy_in) { policy = policy_in; }
+    //! Sets the time in milliseconds the reads stay in the primary after a write.
+    void SetStickyTime(int ms) { stickyTime = ms>=0 ? ms : 0; }
+    //! Sets the time in milliseconds a failed replica is skipped.
+    void SetRetryDelay(int ms) { retryDelay = ms>=0 ? ms : 0; }
+    DirectDatabase* GetPrimary() { return primary; }
+    //! Returns the number of queries currently open in the given replica.
+    int GetLoad(size_t ndx) { return ndx<replicas.size() ? replicas[ndx].load : 0; }
+
+    DirectDatabase* RouteQuery(const DDBSTR &query);
+    DirectDatabase* RouteFailed(const DDBSTR &query, DirectDatabase *failed);
+    void RouteDone(DirectDatabase *db);
+
+    static bool IsReadQuery(const char *sql);
+
+protected:
+    //! Replica connection.
+    struct Replica {
+        DirectDatabase *db;     //!< Replica database.
+        int load;               //!< Number of open queries.
+        bool down;              //!< True if the connection has been lost.
+        std::chrono::steady_clock::time_point retry; //!< When the lost connection is retried.
+    };
+    Replica* FindReplica(DirectDatabase *db);
+    DirectDatabase* SelectReplica();
+    void Written();
+
+    DirectDatabase *primary;
+    std::vector<Replica> replicas;
+    size_t next;                //!< Round robin position.
+    int policy;
+    int stickyTime;
+    int retryDelay;
+    std::chrono::steady_clock::time_point lastWrite; //!< Time of the latest write.
+    bool written;               //!< True once a write has been made.
+};
+
+#endif
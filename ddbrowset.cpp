@@ -6,6 +6,8 @@ Copyright (c) Antti Merenluoto
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <ctype.h>
+#include <new>
 #ifdef DDB_USEWX
 #include <wx/log.h>
 #else
@@ -13,6 +15,7 @@ Copyright (c) Antti Merenluoto
 #include <sstream>
 #endif
 #include "directdatabase.hpp"
+#include "ddbarena.hpp"
 
 // ==================================================================================================
 DdbBoundField::DdbBoundField(short int type_in, void *data_in)
@@ -26,6 +29,7 @@ DdbBoundField::DdbBoundField(short int type_in, void *data_in)
 {
     type = type_in;
     data = data_in;
+    null = false;
     next = 0;
 }
 
@@ -46,6 +50,7 @@ DdbRowSet::DdbRowSet()
 {
     fieldRoot = 0;
     fieldCount = 0;
+    autoDescribe = false;
 }
 
 // ==================================================================================================
@@ -53,6 +58,15 @@ DdbRowSet::~DdbRowSet()
 /*!
     Rowset destructor releases all the bound variables.
 */
+{
+    ClearFields();
+}
+
+// ==================================================================================================
+void DdbRowSet::ClearFields()
+/*!
+  Releases all the bound variables.
+*/
 {
 DdbBoundField *field,*nextf;
 
@@ -64,6 +78,19 @@ DdbBoundField *field,*nextf;
         field = nextf;
     }
     fieldRoot = 0;
+    fieldCount = 0;
+}
+
+// ==================================================================================================
+int DdbRowSet::CountFields()
+/*!
+  Counts the bound variables.
+*/
+{
+    int count = 0;
+    for(DdbBoundField *field=fieldRoot; field; field=field->next)
+        count++;
+    return count;
 }
 
 // ==================================================================================================
@@ -81,6 +108,9 @@ bool DdbRowSet::ValidateBind(short int type, void *data)
         return false;
     if(type == DDBT_BIT)
         return false;
+    // Arrays and JSON are accepted by the backends that support them.
+    if(type >= DDBT_INTARR)
+        return false;
     return true;
 }
 
@@ -144,3 +174,489 @@ bool DdbRowSet::InsertField(DdbBoundField *newField)
     return false;
 }
 
+
+// ==================================================================================================
+bool DdbRowSet::GetNextRow()
+/*!
+  Reads the next row into the bound variables as GetNext. GetNext returns zero also for a row
+  whose values are all NULL; this function tells such a row from the end of the result by the
+  null flags of the fields. The Microsoft DB-Library rowset does not report the NULLs and ends
+  at such a row as GetNext does.
+  \retval bool False at the end of the result or on error.
+*/
+{
+    DdbBoundField *field;
+    for(field=fieldRoot; field; field=field->next)
+        field->null = false;
+    if(GetNext())
+        return true;
+    for(field=fieldRoot; field; field=field->next) {
+        if(field->null)
+            return true;
+    }
+    return false;
+}
+
+// ==================================================================================================
+bool DdbRowSet::IsNull(int field)
+/*!
+  \param field Zero based index of the bound field.
+  \retval bool True if the value of the field in the current row is NULL or the index is
+    invalid.
+*/
+{
+    DdbBoundField *bound = fieldRoot;
+    for(int ndx=0; bound && ndx<field; ndx++)
+        bound = bound->next;
+    return field<0 || !bound || bound->null;
+}
+
+// ==================================================================================================
+int DdbRowSet::CopyNulls(DdbRowSet *source)
+/*!
+  Copies the null flags of the current row from a rowset that reads into the same variables
+  for this rowset, e.g. the rowset of the shard a query was forwarded to.
+  \retval int Number of non-null values.
+*/
+{
+    int count = 0;
+    DdbBoundField *src = source->fieldRoot;
+    for(DdbBoundField *field=fieldRoot; field; field=field->next) {
+        field->null = src ? src->null : true;
+        if(!field->null)
+            count++;
+        if(src)
+            src = src->next;
+    }
+    return count;
+}
+
+// ==================================================================================================
+bool DdbRowSet::SetupRows(DdbResultRows &rows)
+/*!
+  Sets up the row layout from the bound fields. Called after the query so that the fields of
+  the auto-describe mode have been bound.
+  \retval bool False if no fields are bound or a field type can not be stored.
+*/
+{
+    if(!fieldRoot)
+        return false;
+    std::vector<short> types;
+    for(DdbBoundField *field=fieldRoot; field; field=field->next)
+        types.push_back(field->type);
+    return rows.Setup(types);
+}
+
+// ==================================================================================================
+int DdbRowSet::Materialize(const DDBSTR &query, DdbResultRows &rows)
+/*!
+  Executes the query and reads all rows into the arena of the given result. The previous
+  content of the result is released. Bound variables, or the described columns in the
+  auto-describe mode, define the columns; this default implementation also uses them to read
+  the rows with GetNextRow and takes the null flags from the fields. Backends override this to
+  copy the values straight from the driver buffers into the arena.
+  \param query Query to execute.
+  \param rows Result to fill.
+  \retval int Number of rows read or -1 on error. Fails also if the query has no columns.
+*/
+{
+    if(!Query(query))
+        return -1;
+    if(!SetupRows(rows)) {
+        QuitQuery();
+        return -1;
+    }
+    DdbArena *arena = rows.GetArena();
+    while(GetNextRow())
+    {
+        char *row = rows.AddRow();
+        if(!row)
+        {
+            QuitQuery();
+            return -1;
+        }
+        int col = 0;
+        for(DdbBoundField *field=fieldRoot; field; field=field->next, col++)
+        {
+            char *slot = rows.Slot(row,col);
+            if(field->null)
+            {
+                *rows.NullFlag(row,col) = 1;
+#ifndef DDB_USESTL
+                if(field->type == DDBT_TIME || field->type == DDBT_DAY)
+                    new(slot) wxDateTime(wxInvalidDateTime);
+#endif
+                continue;
+            }
+            // DDB_TYPE_USED
+            switch(field->type)
+            {
+            case DDBT_INT:  *(int*)slot = *static_cast<int*>(field->data); break;
+            case DDBT_LONG: *(int64_t*)slot = *static_cast<int64_t*>(field->data); break;
+            case DDBT_NUM:  *(double*)slot = *static_cast<double*>(field->data); break;
+            case DDBT_DEC:  *(DdbDecimal*)slot = *static_cast<DdbDecimal*>(field->data); break;
+            case DDBT_UUID: *(DdbUuid*)slot = *static_cast<DdbUuid*>(field->data); break;
+            case DDBT_BLOB: {
+                DdbBlob *blob = static_cast<DdbBlob*>(field->data);
+                ((DdbStrRef*)slot)->ptr = arena->Copy((const char*)blob->data(), blob->size());
+                ((DdbStrRef*)slot)->len = blob->size();
+                break;
+            }
+            case DDBT_BOOL: *(bool*)slot = *static_cast<bool*>(field->data); break;
+            case DDBT_TIME:
+            case DDBT_DAY:  new(slot) DDBTIME(*static_cast<DDBTIME*>(field->data)); break;
+#ifdef DDB_USESTL
+            case DDBT_CHR:  *(char*)slot = *static_cast<char*>(field->data); break;
+            case DDBT_STR: {
+                std::string *str = static_cast<std::string*>(field->data);
+                ((DdbStrRef*)slot)->ptr = arena->Copy(str->data(), str->length());
+                ((DdbStrRef*)slot)->len = str->length();
+                break;
+            }
+#else
+            case DDBT_CHR:  *(wxUniChar*)slot = *static_cast<wxUniChar*>(field->data); break;
+            case DDBT_STR: {
+                wxScopedCharBuffer utf8 = static_cast<wxString*>(field->data)->utf8_str();
+                ((DdbStrRef*)slot)->ptr = arena->Copy(utf8.data(), utf8.length());
+                ((DdbStrRef*)slot)->len = utf8.length();
+                break;
+            }
+#endif
+            }
+        }
+    }
+    return rows.GetRowCount();
+}
+
+// ==================================================================================================
+static bool HasReturning(const char *sql)
+/*!
+  Returns true if the statement has RETURNING outside the string literals and quoted names.
+*/
+{
+    for(const char *ptr=sql; *ptr; ) {
+        if(*ptr=='\'' || *ptr=='"') {
+            char quote = *ptr++;
+            while(*ptr && *ptr!=quote)
+                ptr++;
+            if(*ptr)
+                ptr++;
+            continue;
+        }
+        if(isalpha((unsigned char)*ptr) || *ptr=='_') {
+            std::string tok;
+            while(isalnum((unsigned char)*ptr) || *ptr=='_')
+                tok += (char)tolower((unsigned char)*ptr++);
+            if(tok == "returning")
+                return true;
+            continue;
+        }
+        ptr++;
+    }
+    return false;
+}
+
+// ==================================================================================================
+bool DdbRowSet::QueryReturning(const DDBSTR &statement, const char *returning)
+/*!
+  Runs an INSERT, UPDATE or DELETE that returns rows with the RETURNING clause. The rows are
+  read with GetNext as with Query.
+  \param statement Statement to run.
+  \param returning Columns of the RETURNING clause. The clause is appended to the statement
+    unless it has one already. Null if the statement has the clause.
+  \retval bool True on success.
+*/
+{
+    if(!returning || !*returning || HasReturning(statement.UTF8()))
+        return Query(statement);
+    std::string sql(statement.UTF8());
+    size_t end = sql.find_last_not_of(" \t\r\n;");
+    sql.resize(end == std::string::npos ? 0 : end+1);
+    sql += " RETURNING ";
+    sql += returning;
+    return Query(DDBSTR(sql.c_str()));
+}
+
+// ==================================================================================================
+bool DdbRowSet::ExecuteInsertReturning(const DDBSTR &insert, const char *returning)
+/*!
+  Runs an insert and reads the generated values, e.g. the key from a sequence or defaults,
+  into the bound variables from the same result. Saves the round trip of GetInsertId.
+  \code
+  int64_t id;
+  rs->Bind(DDBT_LONG, &id);
+  if(!rs->ExecuteInsertReturning("INSERT INTO item(name) VALUES('box')", "id"))
+      return false;
+  \endcode
+  The first returned row is read. The rows of a multi-row insert that follow are read with
+  GetNext, or QuitQuery discards them. Supported by the databases that return the RETURNING
+  rows as a result: PostgreSQL, SQLite 3.35 and MariaDB 10.5 or later.
+  \param insert Statement to run.
+  \param returning Columns of the RETURNING clause. See QueryReturning.
+  \retval bool True if a row was returned.
+*/
+{
+    return QueryReturning(insert, returning) && GetNext() > 0;
+}
+
+// ==================================================================================================
+bool DdbRowSet::SetAutoDescribe(bool on)
+/*!
+  Turns the auto-describe mode on or off. In this mode the caller does not bind the variables.
+  After each query the rowset reads the names and types of the result columns, binds an
+  internal value to each and builds a hash from the names to the indices. GetNext then
+  converts the row as with the positional binding and the values are read with GetInt, GetStr
+  etc. by the column index or name. Use FindColumn to look up the index once per query when
+  reading many rows.
+  \code
+  rs->SetAutoDescribe(true);
+  rs->Query("SELECT * FROM customer");
+  int name = rs->FindColumn("name");
+  while(rs->GetNext())
+      printf("%d %s\n", rs->GetInt("id"), rs->GetStr(name).c_str());
+  \endcode
+  Columns whose type has no DDBT-type counterpart are read as strings.
+  \param on True to turn the mode on.
+  \retval bool False if variables have been bound by the caller. Mode is not changed then.
+*/
+{
+    if(on == autoDescribe)
+        return true;
+    if(on && fieldRoot)
+        return false;
+    autoDescribe = on;
+    ClearFields();
+    columns.clear();
+    columnIndex.clear();
+    return true;
+}
+
+// ==================================================================================================
+void DdbRowSet::BindColumns()
+/*!
+  Binds the values of the described columns and builds the name index. Called by the backends
+  after they have filled the columns from the result metadata.
+*/
+{
+    ClearFields();
+    columnIndex.clear();
+    for(size_t col=0; col<columns.size(); col++)
+    {
+        DdbColumn &column = columns[col];
+        void *data;
+        // DDB_TYPE_USED
+        switch(column.type)
+        {
+        case DDBT_INT:  data = &column.intVal; break;
+        case DDBT_LONG: data = &column.longVal; break;
+        case DDBT_NUM:  data = &column.numVal; break;
+        case DDBT_DEC:  data = &column.decVal; break;
+        case DDBT_UUID: data = &column.uuidVal; break;
+        case DDBT_BLOB: data = &column.blobVal; break;
+        case DDBT_BOOL: data = &column.boolVal; break;
+        case DDBT_TIME:
+        case DDBT_DAY:  data = &column.timeVal; break;
+        case DDBT_CHR:  data = &column.chrVal; break;
+        default:
+            column.type = DDBT_STR;
+            data = &column.strVal;
+            break;
+        }
+        Bind(column.type, data);
+        // First of the duplicate names wins as with the positional columns.
+        columnIndex.insert(std::make_pair(column.name, (int)col));
+    }
+}
+
+// ==================================================================================================
+int DdbRowSet::FindColumn(const char *name)
+/*!
+  \param name Column name as reported by the database (PostgreSQL folds unquoted names to
+    lower case).
+  \retval int Index of the column in the last query or -1 if there is no such column.
+*/
+{
+    if(!name)
+        return -1;
+    std::unordered_map<std::string,int>::const_iterator it = columnIndex.find(name);
+    return it == columnIndex.end() ? -1 : it->second;
+}
+
+// ==================================================================================================
+int DdbRowSet::GetInt(int col)
+/*!
+  Returns the value of the current row as int. Numeric and bool values are converted.
+  \param col Column index. Zero is returned for an invalid index, a null value and the types
+    that do not convert.
+*/
+{
+    if(col < 0 || col >= (int)columns.size())
+        return 0;
+    const DdbColumn &column = columns[col];
+    // DDB_TYPE_USED
+    switch(column.type)
+    {
+    case DDBT_INT:  return column.intVal;
+    case DDBT_LONG: return (int)column.longVal;
+    case DDBT_NUM:  return (int)column.numVal;
+    case DDBT_DEC:  return (int)column.decVal.ToDouble();
+    case DDBT_BOOL: return column.boolVal ? 1 : 0;
+    }
+    return 0;
+}
+
+// ==================================================================================================
+int64_t DdbRowSet::GetLong(int col)
+/*!
+  Returns the value of the current row as int64_t. Other numeric and bool values are converted.
+  \param col Column index. Zero is returned for an invalid index, a null value and the types
+    that do not convert.
+*/
+{
+    if(col < 0 || col >= (int)columns.size())
+        return 0;
+    const DdbColumn &column = columns[col];
+    // DDB_TYPE_USED
+    switch(column.type)
+    {
+    case DDBT_LONG: return column.longVal;
+    case DDBT_INT:  return column.intVal;
+    case DDBT_NUM:  return (int64_t)column.numVal;
+    case DDBT_DEC: {
+        DdbDecimal dec = column.decVal;
+        dec.Rescale(0);
+        return dec.value;
+    }
+    case DDBT_BOOL: return column.boolVal ? 1 : 0;
+    }
+    return 0;
+}
+
+// ==================================================================================================
+double DdbRowSet::GetDouble(int col)
+/*!
+  Returns the value of the current row as double. Integer and bool values are converted.
+  \param col Column index. Zero is returned for an invalid index, a null value and the types
+    that do not convert.
+*/
+{
+    if(col < 0 || col >= (int)columns.size())
+        return 0;
+    const DdbColumn &column = columns[col];
+    // DDB_TYPE_USED
+    switch(column.type)
+    {
+    case DDBT_NUM:  return column.numVal;
+    case DDBT_DEC:  return column.decVal.ToDouble();
+    case DDBT_INT:  return column.intVal;
+    case DDBT_LONG: return (double)column.longVal;
+    case DDBT_BOOL: return column.boolVal ? 1 : 0;
+    }
+    return 0;
+}
+
+// ==================================================================================================
+DdbDecimal DdbRowSet::GetDecimal(int col)
+/*!
+  Returns the value of the current row as decimal. Integers are converted with scale zero.
+  Floating point values are not converted since they are not exact.
+  \param col Column index. Zero is returned for an invalid index, a null value and the types
+    that do not convert.
+*/
+{
+    DdbDecimal dec;
+    dec.Clear();
+    if(col < 0 || col >= (int)columns.size())
+        return dec;
+    const DdbColumn &column = columns[col];
+    // DDB_TYPE_USED
+    switch(column.type)
+    {
+    case DDBT_DEC:  dec = column.decVal; break;
+    case DDBT_INT:  dec.value = column.intVal; break;
+    case DDBT_LONG: dec.value = column.longVal; break;
+    }
+    return dec;
+}
+
+// ==================================================================================================
+bool DdbRowSet::GetBool(int col)
+/*!
+  Returns the value of the current row as bool. Numbers are true if they are not zero.
+  \param col Column index. False is returned for an invalid index and a null value.
+*/
+{
+    if(col < 0 || col >= (int)columns.size())
+        return false;
+    const DdbColumn &column = columns[col];
+    // DDB_TYPE_USED
+    switch(column.type)
+    {
+    case DDBT_BOOL: return column.boolVal;
+    case DDBT_INT:  return column.intVal != 0;
+    case DDBT_LONG: return column.longVal != 0;
+    case DDBT_NUM:  return column.numVal != 0;
+    case DDBT_DEC:  return column.decVal.value != 0;
+    }
+    return false;
+}
+
+// ==================================================================================================
+const DDBSTR& DdbRowSet::GetStr(int col)
+/*!
+  Returns the value of a string column. Other types are not converted into strings.
+  \param col Column index.
+  \retval DDBSTR Value of the current row. Empty for an invalid index, a null value or a column
+    that is not a string.
+*/
+{
+    static const DDBSTR empty;
+    if(col < 0 || col >= (int)columns.size() || columns[col].type != DDBT_STR)
+        return empty;
+    return columns[col].strVal;
+}
+
+// ==================================================================================================
+const DDBTIME& DdbRowSet::GetTime(int col)
+/*!
+  Returns the value of a timestamp or date column.
+  \param col Column index.
+  \retval DDBTIME Value of the current row. Cleared for an invalid index, a null value or a
+    column of other type.
+*/
+{
+    static const DDBTIME empty = DDBTIME();
+    if(col < 0 || col >= (int)columns.size() || (columns[col].type != DDBT_TIME && columns[col].type != DDBT_DAY))
+        return empty;
+    return columns[col].timeVal;
+}
+
+// ==================================================================================================
+const DdbUuid& DdbRowSet::GetUuid(int col)
+/*!
+  Returns the value of a UUID column.
+  \param col Column index.
+  \retval DdbUuid Value of the current row. Nil for an invalid index, a null value or a column
+    of other type.
+*/
+{
+    static const DdbUuid nil = DdbUuid();
+    if(col < 0 || col >= (int)columns.size() || columns[col].type != DDBT_UUID)
+        return nil;
+    return columns[col].uuidVal;
+}
+
+// ==================================================================================================
+const DdbBlob& DdbRowSet::GetBlob(int col)
+/*!
+  Returns the value of a binary column.
+  \param col Column index.
+  \retval DdbBlob Value of the current row. Empty for an invalid index, a null value or a
+    column of other type.
+*/
+{
+    static const DdbBlob empty;
+    if(col < 0 || col >= (int)columns.size() || columns[col].type != DDBT_BLOB)
+        return empty;
+    return columns[col].blobVal;
+}
@@ -0,0 +1,699 @@
+/*! \file ddbshard.cpp
+ * \brief Hash sharding of a database over several connections. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#include "pch-stop.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <cpp4scripts.hpp>
+#include "ddbshard.hpp"
+
+// ==================================================================================================
+DdbShardRouter::DdbShardRouter()
+{
+    current = 0;
+    transact = 0;
+    flags |= DDB_FLAG_INITIALIZED;
+    feat_support = DDB_FEATURE_TRANSACTIONS;
+}
+
+// ==================================================================================================
+DdbShardRouter::~DdbShardRouter()
+{
+}
+
+// ==================================================================================================
+uint64_t DdbShardRouter::HashKey(const char *key, size_t len)
+/*!
+  64-bit FNV-1a hash with a final bit mix so that similar keys spread over the whole ring.
+*/
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for(size_t ndx=0; ndx<len; ndx++) {
+        hash ^= (unsigned char)key[ndx];
+        hash *= 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// ==================================================================================================
+void DdbShardRouter::AddShard(DirectDatabase *db, const char *name, int vnodes)
+/*!
+  Adds a shard into the hash ring. Caller keeps the ownership of the connection.
+  \param db Connected database.
+  \param name Unique and permanent name of the shard, e.g. host name. Shard location in the
+         ring depends on this.
+  \param vnodes Number of points in the ring. Relative weight of the shard.
+*/
+{
+    char point[256];
+    shards.push_back(db);
+    for(int ndx=0; ndx<vnodes; ndx++) {
+        int len = snprintf(point, sizeof(point), "%s#%d", name, ndx);
+        Point pt;
+        pt.hash = HashKey(point, len<(int)sizeof(point) ? len : sizeof(point)-1);
+        pt.db = db;
+        ring.push_back(pt);
+    }
+    std::sort(ring.begin(), ring.end());
+    if(db->IsConnected())
+        flags |= DDB_FLAG_CONNECTED;
+}
+
+// ==================================================================================================
+DirectDatabase* DdbShardRouter::GetShard(const char *key)
+/*!
+  \retval DirectDatabase* Shard of the key. Null if there are no shards.
+*/
+{
+    if(ring.empty() || !key)
+        return 0;
+    Point pt;
+    pt.hash = HashKey(key, strlen(key));
+    std::vector<Point>::iterator it = std::lower_bound(ring.begin(), ring.end(), pt);
+    if(it == ring.end())
+        it = ring.begin();
+    return it->db;
+}
+
+// ==================================================================================================
+bool DdbShardRouter::SetShardKey(const char *key)
+/*!
+  Selects the shard for the following calls.
+  \retval bool False if there are no shards or the key belongs into a different shard than
+          the open transaction.
+*/
+{
+    DirectDatabase *db = GetShard(key);
+    if(!db || (transact && db != transact)) {
+        SetErrorId(25);
+        return false;
+    }
+    current = db;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbShardRouter::SetShardKey(int64_t key)
+/*!
+  Numeric key is hashed in its decimal form, i.e. 42 and "42" select the same shard.
+*/
+{
+    char str[32];
+    snprintf(str, sizeof(str), "%lld", (long long)key);
+    return SetShardKey(str);
+}
+
+// ==================================================================================================
+DirectDatabase* DdbShardRouter::Current()
+{
+    if(!current)
+        SetErrorId(25);
+    return current;
+}
+
+// ==================================================================================================
+int DdbShardRouter::GetType()
+{
+    return shards.empty() ? DDBTYPE_POSTGRES : shards.front()->GetType();
+}
+
+// ==================================================================================================
+bool DdbShardRouter::Connect(const char *)
+/*!
+  Connections are opened by the caller. This only checks that all shards are connected.
+*/
+{
+    for(std::vector<DirectDatabase*>::iterator it=shards.begin(); it!=shards.end(); it++) {
+        if(!(*it)->IsConnected()) {
+            SetErrorId(4);
+            return false;
+        }
+    }
+    flags |= DDB_FLAG_CONNECTED;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbShardRouter::Disconnect()
+{
+    flags &= ~(DDB_FLAG_CONNECTED|DDB_FLAG_TRANSACT_ON);
+    transact = 0;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbShardRouter::IsConnectOK()
+{
+    for(std::vector<DirectDatabase*>::iterator it=shards.begin(); it!=shards.end(); it++) {
+        if(!(*it)->IsConnectOK())
+            return false;
+    }
+    return !shards.empty();
+}
+
+// ==================================================================================================
+bool DdbShardRouter::ResetConnection()
+/*!
+  Resets the shards whose connection has been lost.
+*/
+{
+    bool rv = true;
+    for(std::vector<DirectDatabase*>::iterator it=shards.begin(); it!=shards.end(); it++) {
+        if(!(*it)->IsConnectOK() && !(*it)->ResetConnection())
+            rv = false;
+    }
+    flags &= ~DDB_FLAG_TRANSACT_ON;
+    transact = 0;
+    return rv;
+}
+
+// ==================================================================================================
+DdbRowSet* DdbShardRouter::CreateRowSet()
+/*!
+  Creates rowset that queries the shard selected with SetShardKey at the time of each Query.
+*/
+{
+    if(shards.empty())
+    {
+        SetErrorId(5);
+        return 0;
+    }
+    return new DdbForwardRowSet(this);
+}
+
+// ==================================================================================================
+DdbRowSet* DdbShardRouter::CreateRowSet(const char *key)
+/*!
+  Creates rowset of the key's shard.
+*/
+{
+    DirectDatabase *db = GetShard(key);
+    if(!db)
+    {
+        SetErrorId(25);
+        return 0;
+    }
+    return db->CreateRowSet();
+}
+
+// ==================================================================================================
+DdbScatterRowSet* DdbShardRouter::CreateScatterRowSet(int sortColumn, bool descending)
+/*!
+  Creates rowset that queries all shards.
+  \param sortColumn Zero based index of the bound field the shard results are ordered by.
+         Negative value returns the rows without merging.
+  \param descending True if the shard results are in descending order.
+*/
+{
+    if(shards.empty())
+    {
+        SetErrorId(5);
+        return 0;
+    }
+    return new DdbScatterRowSet(this, sortColumn, descending);
+}
+
+// ==================================================================================================
+DDBSTR DdbShardRouter::GetErrorDescription(DdbRowSet *)
+{
+    if(errorId || !current)
+        return GetLastError();
+    return current->GetErrorDescription(0);
+}
+
+// ==================================================================================================
+DirectDatabase* DdbShardRouter::RouteQuery(const DDBSTR &)
+{
+    return Current();
+}
+
+// ==================================================================================================
+bool DdbShardRouter::StartTransaction()
+/*!
+  Starts the transaction in the selected shard. Transaction does not span shards.
+*/
+{
+    if(transact)
+    {
+        SetErrorId(6);
+        return false;
+    }
+    DirectDatabase *db = Current();
+    if(!db || !db->StartTransaction())
+        return false;
+    transact = db;
+    flags |= DDB_FLAG_TRANSACT_ON;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbShardRouter::Commit()
+{
+    if(!transact)
+    {
+        SetErrorId(7);
+        return false;
+    }
+    bool rv = transact->Commit();
+    transact = 0;
+    flags &= ~DDB_FLAG_TRANSACT_ON;
+    return rv;
+}
+
+// ==================================================================================================
+bool DdbShardRouter::RollBack()
+{
+    if(!transact)
+    {
+        SetErrorId(7);
+        return false;
+    }
+    bool rv = transact->RollBack();
+    transact = 0;
+    flags &= ~DDB_FLAG_TRANSACT_ON;
+    return rv;
+}
+
+// ==================================================================================================
+bool DdbShardRouter::ExecuteIntFunction(const DDBSTR &query, uint32_t &val)
+{
+    DirectDatabase *db = Current();
+    return db ? db->ExecuteIntFunction(query,val) : false;
+}
+
+// ==================================================================================================
+bool DdbShardRouter::ExecuteLongFunction(const DDBSTR &query, uint64_t &val)
+{
+    DirectDatabase *db = Current();
+    return db ? db->ExecuteLongFunction(query,val) : false;
+}
+
+// ==================================================================================================
+bool DdbShardRouter::ExecuteDoubleFunction(const DDBSTR &query, double &val)
+{
+    DirectDatabase *db = Current();
+    return db ? db->ExecuteDoubleFunction(query,val) : false;
+}
+
+// ==================================================================================================
+bool DdbShardRouter::ExecuteBoolFunction(const DDBSTR &query, bool &val)
+{
+    DirectDatabase *db = Current();
+    return db ? db->ExecuteBoolFunction(query,val) : false;
+}
+
+// ==================================================================================================
+bool DdbShardRouter::ExecuteStrFunction(const DDBSTR &query, DDBSTR &result)
+{
+    DirectDatabase *db = Current();
+    return db ? db->ExecuteStrFunction(query,result) : false;
+}
+
+// ==================================================================================================
+bool DdbShardRouter::ExecuteDateFunction(const DDBSTR &query, DDBTIME &val)
+{
+    DirectDatabase *db = Current();
+    return db ? db->ExecuteDateFunction(query,val) : false;
+}
+
+// ==================================================================================================
+int DdbShardRouter::ExecuteModify(const DDBSTR &query)
+{
+    DirectDatabase *db = Current();
+    return db ? db->ExecuteModify(query) : -1;
+}
+
+// ==================================================================================================
+int DdbShardRouter::ExecuteModify(const char *key, const DDBSTR &query)
+/*!
+  Selects the key's shard and executes the modification there.
+*/
+{
+    if(!SetShardKey(key))
+        return -1;
+    return current->ExecuteModify(query);
+}
+
+// ==================================================================================================
+uint64_t DdbShardRouter::GetInsertId()
+{
+    DirectDatabase *db = Current();
+    return db ? db->GetInsertId() : 0;
+}
+
+// ==================================================================================================
+bool DdbShardRouter::UpdateStructure(const DDBSTR &command)
+/*!
+  Executes the command on all shards.
+  \retval bool True if the command succeeded on all shards.
+*/
+{
+    bool rv = !shards.empty();
+    for(std::vector<DirectDatabase*>::iterator it=shards.begin(); it!=shards.end(); it++) {
+        if(!(*it)->UpdateStructure(command)) {
+            CS_VAPRT_ERRO("DdbShardRouter::UpdateStructure - failed on shard %d.",(int)(it-shards.begin()));
+            rv = false;
+        }
+    }
+    return rv;
+}
+
+// ==================================================================================================
+//  DdbScatterRowSet
+// ==================================================================================================
+DdbScatterRowSet::DdbScatterRowSet(DdbShardRouter *router_in, int sortColumn_in, bool descending_in)
+    :DdbRowSet()
+/*!
+    \param router_in Router whose shards are queried.
+    \param sortColumn_in Zero based index of the bound field to merge by. Negative disables merge.
+    \param descending_in True if the shard results are in descending order.
+*/
+{
+    router = router_in;
+    sortColumn = sortColumn_in;
+    descending = descending_in;
+    nullsFirst = descending_in;
+    cur = 0;
+    currentRow = 0;
+    open = false;
+    failed = 0;
+}
+
+// ==================================================================================================
+DdbScatterRowSet::~DdbScatterRowSet()
+/*!
+    Deletes the shard rowsets and their variables.
+*/
+{
+    QuitQuery();
+    for(std::vector<Part>::iterator it=parts.begin(); it!=parts.end(); it++) {
+        delete it->rs;
+        for(size_t ndx=0; ndx<it->values.size(); ndx++)
+            DeleteValue(types[ndx], it->values[ndx]);
+    }
+}
+
+// ==================================================================================================
+void* DdbScatterRowSet::NewValue(short type)
+{
+    // DDB_TYPE_USED
+    switch(type) {
+    case DDBT_INT:  return new int(0);
+    case DDBT_STR:  return new DDBSTR;
+    case DDBT_BOOL: return new bool(false);
+    case DDBT_TIME:
+    case DDBT_DAY:  return new DDBTIME();
+    case DDBT_NUM:  return new double(0);
+    case DDBT_LONG: return new int64_t(0);
+    case DDBT_DEC:  return new DdbDecimal();
+    case DDBT_UUID: return new DdbUuid();
+    case DDBT_BLOB: return new DdbBlob;
+#ifdef DDB_USESTL
+    case DDBT_CHR:  return new char(0);
+#else
+    case DDBT_CHR:  return new wxUniChar();
+#endif
+    }
+    return 0;
+}
+
+// ==================================================================================================
+void DdbScatterRowSet::DeleteValue(short type, void *value)
+{
+    // DDB_TYPE_USED
+    switch(type) {
+    case DDBT_INT:  delete static_cast<int*>(value); break;
+    case DDBT_STR:  delete static_cast<DDBSTR*>(value); break;
+    case DDBT_BOOL: delete static_cast<bool*>(value); break;
+    case DDBT_TIME:
+    case DDBT_DAY:  delete static_cast<DDBTIME*>(value); break;
+    case DDBT_NUM:  delete static_cast<double*>(value); break;
+    case DDBT_LONG: delete static_cast<int64_t*>(value); break;
+    case DDBT_DEC:  delete static_cast<DdbDecimal*>(value); break;
+    case DDBT_UUID: delete static_cast<DdbUuid*>(value); break;
+    case DDBT_BLOB: delete static_cast<DdbBlob*>(value); break;
+#ifdef DDB_USESTL
+    case DDBT_CHR:  delete static_cast<char*>(value); break;
+#else
+    case DDBT_CHR:  delete static_cast<wxUniChar*>(value); break;
+#endif
+    }
+}
+
+// ==================================================================================================
+void DdbScatterRowSet::CopyValue(short type, const void *from, void *to)
+{
+    // DDB_TYPE_USED
+    switch(type) {
+    case DDBT_INT:  *static_cast<int*>(to) = *static_cast<const int*>(from); break;
+    case DDBT_STR:  *static_cast<DDBSTR*>(to) = *static_cast<const DDBSTR*>(from); break;
+    case DDBT_BOOL: *static_cast<bool*>(to) = *static_cast<const bool*>(from); break;
+    case DDBT_TIME:
+    case DDBT_DAY:  *static_cast<DDBTIME*>(to) = *static_cast<const DDBTIME*>(from); break;
+    case DDBT_NUM:  *static_cast<double*>(to) = *static_cast<const double*>(from); break;
+    case DDBT_LONG: *static_cast<int64_t*>(to) = *static_cast<const int64_t*>(from); break;
+    case DDBT_DEC:  *static_cast<DdbDecimal*>(to) = *static_cast<const DdbDecimal*>(from); break;
+    case DDBT_UUID: *static_cast<DdbUuid*>(to) = *static_cast<const DdbUuid*>(from); break;
+    case DDBT_BLOB: *static_cast<DdbBlob*>(to) = *static_cast<const DdbBlob*>(from); break;
+#ifdef DDB_USESTL
+    case DDBT_CHR:  *static_cast<char*>(to) = *static_cast<const char*>(from); break;
+#else
+    case DDBT_CHR:  *static_cast<wxUniChar*>(to) = *static_cast<const wxUniChar*>(from); break;
+#endif
+    }
+}
+
+// ==================================================================================================
+int DdbScatterRowSet::CompareValue(short type, const void *a, const void *b)
+/*!
+  \retval int Negative if a<b, zero if a==b, positive if a>b.
+*/
+{
+    // DDB_TYPE_USED
+    switch(type) {
+    case DDBT_INT: {
+        int va = *static_cast<const int*>(a), vb = *static_cast<const int*>(b);
+        return va<vb ? -1 : (va>vb ? 1 : 0);
+    }
+    case DDBT_NUM: {
+        double va = *static_cast<const double*>(a), vb = *static_cast<const double*>(b);
+        return va<vb ? -1 : (va>vb ? 1 : 0);
+    }
+    case DDBT_LONG: {
+        int64_t va = *static_cast<const int64_t*>(a), vb = *static_cast<const int64_t*>(b);
+        return va<vb ? -1 : (va>vb ? 1 : 0);
+    }
+    case DDBT_DEC:
+        return static_cast<const DdbDecimal*>(a)->Compare(*static_cast<const DdbDecimal*>(b));
+    case DDBT_UUID:
+        return memcmp(static_cast<const DdbUuid*>(a)->bytes, static_cast<const DdbUuid*>(b)->bytes, 16);
+    case DDBT_BLOB: {
+        const DdbBlob *va = static_cast<const DdbBlob*>(a), *vb = static_cast<const DdbBlob*>(b);
+        return *va<*vb ? -1 : (*vb<*va ? 1 : 0);
+    }
+    case DDBT_STR:
+        return static_cast<const DDBSTR*>(a)->compare(*static_cast<const DDBSTR*>(b));
+    case DDBT_BOOL:
+        return (int)*static_cast<const bool*>(a) - (int)*static_cast<const bool*>(b);
+#ifdef DDB_USESTL
+    case DDBT_CHR:
+        return (int)*static_cast<const char*>(a) - (int)*static_cast<const char*>(b);
+    case DDBT_TIME:
+    case DDBT_DAY: {
+        const tm *ta = static_cast<const tm*>(a), *tb = static_cast<const tm*>(b);
+        const int fa[] = { ta->tm_year, ta->tm_mon, ta->tm_mday, ta->tm_hour, ta->tm_min, ta->tm_sec };
+        const int fb[] = { tb->tm_year, tb->tm_mon, tb->tm_mday, tb->tm_hour, tb->tm_min, tb->tm_sec };
+        for(int ndx=0; ndx<6; ndx++) {
+            if(fa[ndx] != fb[ndx])
+                return fa[ndx]<fb[ndx] ? -1 : 1;
+        }
+        return 0;
+    }
+#else
+    case DDBT_CHR: {
+        wxUniChar va = *static_cast<const wxUniChar*>(a), vb = *static_cast<const wxUniChar*>(b);
+        return va<vb ? -1 : (va>vb ? 1 : 0);
+    }
+    case DDBT_TIME:
+    case DDBT_DAY: {
+        const wxDateTime *va = static_cast<const wxDateTime*>(a), *vb = static_cast<const wxDateTime*>(b);
+        if(!va->IsValid() || !vb->IsValid())
+            return (int)va->IsValid() - (int)vb->IsValid();
+        return va->IsEarlierThan(*vb) ? -1 : (va->IsLaterThan(*vb) ? 1 : 0);
+    }
+#endif
+    }
+    return 0;
+}
+
+// ==================================================================================================
+bool DdbScatterRowSet::Prepare()
+/*!
+  Creates the shard rowsets and binds the shard copies of the fields bound after the
+  previous query.
+*/
+{
+    if(parts.empty()) {
+        for(int ndx=0; ndx<router->GetShardCount(); ndx++) {
+            Part part;
+            part.db = router->GetShardAt(ndx);
+            part.rs = part.db->CreateRowSet();
+            part.ok = false;
+            part.head = false;
+            part.headNull = false;
+            if(!part.rs) {
+                failed = part.db;
+                return false;
+            }
+            parts.push_back(part);
+        }
+    }
+    int ndx = 0;
+    for(DdbBoundField *field=fieldRoot; field; field=field->next, ndx++) {
+        if(ndx < (int)types.size())
+            continue;
+        types.push_back(field->type);
+        for(std::vector<Part>::iterator it=parts.begin(); it!=parts.end(); it++) {
+            void *value = NewValue(field->type);
+            it->values.push_back(value);
+            it->rs->Bind(field->type, value);
+        }
+    }
+    return true;
+}
+
+// ==================================================================================================
+bool DdbScatterRowSet::Query(const DDBSTR &query)
+/*!
+  Runs the query on all shards in parallel.
+  \retval bool True if the query succeeded on all shards.
+*/
+{
+    if(!fieldRoot) {
+        CS_PRINT_NOTE("DdbScatterRowSet::Query - Query called without binding variables.");
+        return  false;
+    }
+    QuitQuery();
+    queryStmt = query;
+    failed = 0;
+    if(!Prepare())
+        return false;
+    if(sortColumn >= (int)types.size()) {
+        CS_VAPRT_ERRO("DdbScatterRowSet::Query - Sort column %d has not been bound.",sortColumn);
+        return false;
+    }
+
+    std::vector<std::thread> threads;
+    for(size_t ndx=1; ndx<parts.size(); ndx++) {
+        Part *part = &parts[ndx];
+        threads.push_back(std::thread([part, &query]() { part->ok = part->rs->Query(query); }));
+    }
+    parts[0].ok = parts[0].rs->Query(query);
+    for(std::vector<std::thread>::iterator it=threads.begin(); it!=threads.end(); it++)
+        it->join();
+
+    for(std::vector<Part>::iterator it=parts.begin(); it!=parts.end(); it++) {
+        if(!it->ok) {
+            CS_VAPRT_ERRO("DdbScatterRowSet::Query - failed on shard %d.",(int)(it-parts.begin()));
+            failed = it->db;
+            QuitQuery();
+            return false;
+        }
+    }
+    open = true;
+    cur = 0;
+    currentRow = 0;
+    if(sortColumn >= 0) {
+        for(std::vector<Part>::iterator it=parts.begin(); it!=parts.end(); it++)
+            ReadHead(*it);
+    }
+    return true;
+}
+
+// ==================================================================================================
+bool DdbScatterRowSet::Less(Part &a, Part &b)
+/*!
+  Returns true if the head row of a should be returned before the head row of b. The value
+  of a NULL is whatever the shard left in the variable, so nulls are ordered by the flag only.
+*/
+{
+    if(a.headNull || b.headNull) {
+        if(a.headNull == b.headNull)
+            return false;
+        return nullsFirst ? a.headNull : b.headNull;
+    }
+    int rv = CompareValue(types[sortColumn], a.values[sortColumn], b.values[sortColumn]);
+    return descending ? rv > 0 : rv < 0;
+}
+
+// ==================================================================================================
+void DdbScatterRowSet::ReadHead(Part &part)
+/*!
+  Reads the next row of the shard into its variables for the merge.
+*/
+{
+    part.head = part.rs->GetNextRow();
+    part.headNull = part.head && part.rs->IsNull(sortColumn);
+}
+
+// ==================================================================================================
+void DdbScatterRowSet::CopyRow(Part &part)
+{
+    int ndx = 0;
+    for(DdbBoundField *field=fieldRoot; field; field=field->next, ndx++)
+        CopyValue(field->type, part.values[ndx], field->data);
+    CopyNulls(part.rs);
+}
+
+// ==================================================================================================
+int DdbScatterRowSet::GetNext()
+/*!
+  Copies the next row into the bound variables.
+  \retval int Number of the row read. Zero at the end of the result.
+*/
+{
+    if(!open)
+        return 0;
+    if(sortColumn < 0) {
+        while(cur < parts.size()) {
+            if(parts[cur].rs->GetNextRow()) {
+                CopyRow(parts[cur]);
+                return ++currentRow;
+            }
+            cur++;
+        }
+        QuitQuery();
+        return 0;
+    }
+
+    // Merge: return the smallest head. Shard count is small, so linear scan is enough.
+    Part *best = 0;
+    for(std::vector<Part>::iterator it=parts.begin(); it!=parts.end(); it++) {
+        if(it->head && (!best || Less(*it, *best)))
+            best = &(*it);
+    }
+    if(!best) {
+        QuitQuery();
+        return 0;
+    }
+    CopyRow(*best);
+    ReadHead(*best);
+    return ++currentRow;
+}
+
+// ==================================================================================================
+void DdbScatterRowSet::QuitQuery()
+{
+    for(std::vector<Part>::iterator it=parts.begin(); it!=parts.end(); it++) {
+        it->rs->QuitQuery();
+        it->head = false;
+    }
+    open = false;
+}
@@ -0,0 +1,175 @@
+/*! \file ddbshard.hpp
+ * \brief Hash sharding of a database over several connections. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#ifndef DDB_SHARD_H_FILE
+#define DDB_SHARD_H_FILE
+
+#include <vector>
+#include <string>
+#include "directdatabase.hpp"
+#include "ddbforward.hpp"
+
+//! Default number of points each shard has in the hash ring.
+#define DDB_SHARD_VNODES 128
+
+class DdbScatterRowSet;
+
+// ==================================================================================================
+//! Database that routes each call into one shard selected by consistent hashing of a key.
+/*! Shards are placed into a hash ring with DDB_SHARD_VNODES points each. A key is mapped into
+    the first shard point following the key hash. Adding a shard therefore moves only the keys
+    that fall into its new ranges. Shards are placed by their name, so the order in which they
+    are added does not matter.
+
+    Single key work: select the shard with SetShardKey and use the normal DirectDatabase
+    interface, or use the ExecuteModify and CreateRowSet overloads taking the key. Rowsets
+    created with CreateRowSet() run each query on the shard selected at the time of the Query.
+    A transaction stays in the shard where it was started. Selecting a key from another shard
+    during the transaction fails with error 25. UpdateStructure is executed on all shards.
+
+    Scatter/gather: CreateScatterRowSet returns rowset that runs the query on all shards in
+    parallel and returns the rows of all shards. Rows are returned shard by shard unless
+    a sort column is given. In that case each shard query should be ordered by the same
+    column and the rows are k-way merged into one ordered result. NULL sort values are merged
+    as the largest values as PostgreSQL orders them by default; see
+    DdbScatterRowSet::SetNullsFirst for databases that order them differently.
+
+    Router does not own the connections. Connections should be connected before they are given
+    to the router. The router itself is not thread safe.
+    Usage:
+    \code
+    DdbShardRouter shards;
+    shards.AddShard(&pg1, "pg1");
+    shards.AddShard(&pg2, "pg2");
+    shards.ExecuteModify("tenant-42", "UPDATE invoice SET paid=true WHERE tenant='tenant-42'");
+    DdbRowSet *rs = shards.CreateScatterRowSet(0);
+    rs->Bind(DDBT_STR, &tenant);
+    rs->Bind(DDBT_INT, &count);
+    rs->Query("SELECT tenant, count(*) FROM invoice GROUP BY tenant ORDER BY tenant");
+    \endcode
+ */
+class DdbShardRouter : public DirectDatabase, public DdbQueryRoute
+{
+public:
+    DdbShardRouter();
+    ~DdbShardRouter();
+
+    int GetType();
+    bool Connect(const char *constr);
+    bool Disconnect();
+    bool IsConnectOK();
+    bool ResetConnection();
+
+    DdbRowSet* CreateRowSet();
+    DdbRowSet* CreateRowSet(const char *key);
+    DdbScatterRowSet* CreateScatterRowSet(int sortColumn=-1, bool descending=false);
+    DDBSTR GetErrorDescription(DdbRowSet *rs);
+
+    bool StartTransaction();
+    bool Commit();
+    bool RollBack();
+
+    bool ExecuteIntFunction(const DDBSTR &query,uint32_t &val);
+    bool ExecuteLongFunction(const DDBSTR &query,uint64_t &val);
+    bool ExecuteDoubleFunction(const DDBSTR &query, double &val);
+    bool ExecuteBoolFunction(const DDBSTR &query, bool &val);
+    bool ExecuteStrFunction(const DDBSTR &query, DDBSTR &result);
+    bool ExecuteDateFunction(const DDBSTR &query, DDBTIME &val);
+    int ExecuteModify(const DDBSTR &query);
+    int ExecuteModify(const char *key, const DDBSTR &query);
+    uint64_t GetInsertId();
+    bool UpdateStructure(const DDBSTR &command);
+
+    void AddShard(DirectDatabase *db, const char *name, int vnodes=DDB_SHARD_VNODES);
+    bool SetShardKey(const char *key);
+    bool SetShardKey(int64_t key);
+    DirectDatabase* GetShard(const char *key);
+    //! Returns the shard selected with SetShardKey. Null if none.
+    DirectDatabase* GetCurrent() { return current; }
+    //! Returns the number of shards.
+    int GetShardCount() { return (int)shards.size(); }
+    //! Returns the shard by index.
+    DirectDatabase* GetShardAt(int ndx) { return shards[ndx]; }
+
+    DirectDatabase* RouteQuery(const DDBSTR &query);
+
+    static uint64_t HashKey(const char *key, size_t len);
+
+protected:
+    //! Point in the hash ring.
+    struct Point {
+        uint64_t hash;
+        DirectDatabase *db;
+        bool operator<(const Point &other) const { return hash < other.hash; }
+    };
+    DirectDatabase* Current();
+
+    std::vector<DirectDatabase*> shards;
+    std::vector<Point> ring;    //!< Shard points ordered by the hash.
+    DirectDatabase *current;    //!< Shard of the latest SetShardKey.
+    DirectDatabase *transact;   //!< Shard of the open transaction.
+};
+
+// ==================================================================================================
+//! Rowset that runs the query on all shards in parallel and returns the rows of all of them.
+/*! The rowset keeps one rowset and a copy of the bound variables for each shard. Query is
+    started on all shards in separate threads and the call returns when all of them have
+    completed. If the query fails on any shard the whole query fails.
+
+    Without sort column GetNext returns the rows of the first shard, then the second and so on.
+    With sort column (zero based index of the bound fields) the shard results, which must be
+    ordered by that column, are merged into one ordered result. The merge compares the null
+    flags of the sort column before the values, so the NULL placement must match the ORDER BY
+    of the shard queries: by default NULLs come last in ascending and first in descending
+    order (PostgreSQL default, NULLS LAST / NULLS FIRST).
+    GetNext returns the number of the row read.
+ */
+class DdbScatterRowSet : public DdbRowSet
+{
+public:
+    DdbScatterRowSet(DdbShardRouter *router, int sortColumn=-1, bool descending=false);
+    ~DdbScatterRowSet();
+
+    bool Query(const DDBSTR &query);
+    int GetNext();
+    void QuitQuery();
+
+    //! Returns the shard where the query failed. Null if none.
+    DirectDatabase* GetFailed() { return failed; }
+    //! Sets whether the shard results have the NULL sort values first, e.g. SQLite ascending.
+    void SetNullsFirst(bool first) { nullsFirst = first; }
+
+protected:
+    //! Query in one shard.
+    struct Part {
+        DirectDatabase *db;     //!< Shard database.
+        DdbRowSet *rs;          //!< Rowset created by the shard.
+        std::vector<void*> values; //!< Shard copies of the bound variables.
+        bool ok;                //!< Result of the Query.
+        bool head;              //!< True if values hold a row that has not been returned yet.
+        bool headNull;          //!< True if the sort value of the head row is NULL.
+    };
+    bool Prepare();
+    bool Less(Part &a, Part &b);
+    void ReadHead(Part &part);
+    void CopyRow(Part &part);
+    static void* NewValue(short type);
+    static void DeleteValue(short type, void *value);
+    static void CopyValue(short type, const void *from, void *to);
+    static int CompareValue(short type, const void *a, const void *b);
+
+    DdbShardRouter *router;
+    std::vector<Part> parts;
+    std::vector<short> types;   //!< Types of the bound fields.
+    int sortColumn;
+    bool descending;
+    bool nullsFirst;            //!< True if the NULL sort values come before the other values.
+    size_t cur;                 //!< Shard being read when not merging.
+    int currentRow;
+    bool open;
+    DirectDatabase *failed;
+};
+
+#endif
@@ -0,0 +1,430 @@
+/*! \file ddbshmcache.cpp
+ * \brief Query result cache in a shared memory segment shared by several processes. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#include "pch-stop.h"
+#include <string.h>
+#include <errno.h>
+#ifndef _WIN32
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <signal.h>
+#endif
+#include <cpp4scripts.hpp>
+#include "ddbshmcache.hpp"
+
+static const char g_magic[8] = { 'D','D','B','S','H','M','C','1' };
+
+// ==================================================================================================
+DdbSharedCache::DdbSharedCache()
+{
+    base = 0;
+    size = 0;
+    control = 0;
+    update = 0;
+}
+
+// ==================================================================================================
+DdbSharedCache::~DdbSharedCache()
+{
+    Detach();
+}
+
+// ==================================================================================================
+bool DdbSharedCache::Create(const char *name, size_t size_in)
+/*!
+  Creates a new empty segment. Existing segment with the same name is removed first. Processes
+  that still have the old segment mapped keep using it until they attach again.
+  \param name Name of the segment, e.g. "/myapp-cache".
+  \param size_in Size of the segment in bytes. Half of it, less the directory, is available
+    for the results of one version.
+  \retval bool True on success.
+*/
+{
+    Detach();
+#ifdef _WIN32
+    CS_PRINT_ERRO("DdbSharedCache::Create - Shared cache is not supported on Windows.");
+    return false;
+#else
+    size_t header = Align(sizeof(Control));
+    if(size_in < header + 2*Align(sizeof(Slot)+4096)) {
+        CS_VAPRT_ERRO("DdbSharedCache::Create - Size %zu is too small.", size_in);
+        return false;
+    }
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR|O_CREAT|O_EXCL, 0600);
+    if(fd < 0) {
+        CS_VAPRT_ERRO("DdbSharedCache::Create - Unable to create %s: %s", name, strerror(errno));
+        return false;
+    }
+    if(ftruncate(fd, (off_t)size_in)) {
+        CS_VAPRT_ERRO("DdbSharedCache::Create - Unable to size %s: %s", name, strerror(errno));
+        close(fd);
+        shm_unlink(name);
+        return false;
+    }
+    bool ok = Map(fd, size_in);
+    close(fd);
+    if(!ok) {
+        shm_unlink(name);
+        return false;
+    }
+    // The new segment is zero filled, which is the initial value of all counters.
+    control->size = size_in;
+    control->slotSize = ((size_in - header)/2) & ~(uint64_t)63;
+    control->layout = DDB_SHM_VERSION;
+    for(uint32_t ndx=0; ndx<2; ndx++)
+        GetSlot(ndx)->used = Align(sizeof(Slot));
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(control->magic, g_magic, sizeof(g_magic));
+    return true;
+#endif
+}
+
+// ==================================================================================================
+bool DdbSharedCache::Attach(const char *name)
+/*!
+  Maps an existing segment created by Create.
+  \retval bool False if the segment does not exist or it is not a cache segment.
+*/
+{
+    Detach();
+#ifdef _WIN32
+    CS_PRINT_ERRO("DdbSharedCache::Attach - Shared cache is not supported on Windows.");
+    return false;
+#else
+    int fd = shm_open(name, O_RDWR, 0);
+    if(fd < 0) {
+        CS_VAPRT_WARN("DdbSharedCache::Attach - Unable to open %s: %s", name, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) || st.st_size < (off_t)Align(sizeof(Control))) {
+        CS_VAPRT_WARN("DdbSharedCache::Attach - %s is not a cache segment.", name);
+        close(fd);
+        return false;
+    }
+    bool ok = Map(fd, (size_t)st.st_size);
+    close(fd);
+    if(!ok)
+        return false;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(memcmp(control->magic, g_magic, sizeof(g_magic)) || control->layout != DDB_SHM_VERSION
+       || control->size != size || Align(sizeof(Control)) + 2*control->slotSize > size)
+    {
+        CS_VAPRT_WARN("DdbSharedCache::Attach - %s is not a valid cache segment.", name);
+        Detach();
+        return false;
+    }
+    return true;
+#endif
+}
+
+// ==================================================================================================
+bool DdbSharedCache::Map(int fd, size_t size_in)
+{
+#ifndef _WIN32
+    void *map = mmap(0, size_in, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED) {
+        CS_VAPRT_ERRO("DdbSharedCache::Map - Unable to map the segment: %s", strerror(errno));
+        return false;
+    }
+    base = (char*)map;
+    size = size_in;
+    control = (Control*)base;
+    return true;
+#else
+    return false;
+#endif
+}
+
+// ==================================================================================================
+void DdbSharedCache::Detach()
+/*!
+  Unmaps the segment. An update in progress is canceled. Readers of this object must have been
+  destroyed before.
+*/
+{
+    if(!base)
+        return;
+    CancelUpdate();
+#ifndef _WIN32
+    munmap(base, size);
+#endif
+    base = 0;
+    size = 0;
+    control = 0;
+}
+
+// ==================================================================================================
+bool DdbSharedCache::Remove(const char *name)
+/*!
+  Removes the segment name. Mapped segments stay valid until they are detached.
+*/
+{
+#ifndef _WIN32
+    return shm_unlink(name) == 0;
+#else
+    return false;
+#endif
+}
+
+// ==================================================================================================
+bool DdbSharedCache::BeginUpdate(bool keep)
+/*!
+  Starts filling a new version into the inactive slot. Waits until the readers of the slot, who
+  still use the previous version, have finished. The slot is never overwritten while it is
+  pinned: if the readers have not finished in DDB_SHM_READER_WAIT ms the update fails and the
+  current version stays active. A reader process that dies with a pin blocks the updates until
+  the segment is created again.
+  \param keep If true the results of the current version are copied into the new version so
+    that only the changed results need to be Put.
+  \retval bool False if another process is updating, the old readers did not finish or the
+    cache is not attached.
+*/
+{
+    if(!control)
+        return false;
+    if(update)
+        return true;
+#ifndef _WIN32
+    int32_t pid = (int32_t)getpid();
+    int32_t owner = 0;
+    if(!control->writer.compare_exchange_strong(owner, pid)) {
+        // Take over if the previous updater has died in the middle of an update.
+        if(owner == pid || kill(owner, 0) == 0 || errno != ESRCH
+           || !control->writer.compare_exchange_strong(owner, pid))
+        {
+            CS_VAPRT_WARN("DdbSharedCache::BeginUpdate - Process %d is updating.", owner);
+            return false;
+        }
+    }
+#endif
+    uint32_t active = control->active.load();
+    Slot *slot = GetSlot(1-active);
+    int waited = 0;
+    while(slot->readers.load() != 0) {
+        if(waited >= DDB_SHM_READER_WAIT) {
+            CS_VAPRT_WARN("DdbSharedCache::BeginUpdate - %u readers of the previous version did not finish.",
+                          slot->readers.load());
+            control->writer.store(0);
+            return false;
+        }
+#ifndef _WIN32
+        usleep(1000);
+#endif
+        waited++;
+    }
+    if(keep && control->version.load()) {
+        Slot *current = GetSlot(active);
+        memcpy(slot->entries, current->entries, sizeof(slot->entries));
+        memcpy((char*)slot + Align(sizeof(Slot)), (char*)current + Align(sizeof(Slot)), current->used - Align(sizeof(Slot)));
+        slot->count = current->count;
+        slot->used = current->used;
+    } else {
+        slot->count = 0;
+        slot->used = Align(sizeof(Slot));
+    }
+    update = slot;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbSharedCache::Put(const char *key, DdbResultTable &table)
+/*!
+  Stores the table into the version being updated. Result with the same key is replaced.
+  \param key Name of the result. At most DDB_SHM_KEYLEN-1 characters.
+  \retval bool False if no update is in progress, the key is too long or the result does not
+    fit into the remaining space.
+*/
+{
+    if(!update)
+        return false;
+    if(!key || strlen(key) >= DDB_SHM_KEYLEN) {
+        CS_PRINT_WARN("DdbSharedCache::Put - Invalid key.");
+        return false;
+    }
+    DdbSnapshotWriter::Serialize(table, buffer);
+    uint64_t offset = (update->used+7) & ~(uint64_t)7;
+    if(offset + buffer.size() > control->slotSize) {
+        CS_VAPRT_WARN("DdbSharedCache::Put - %s (%zu bytes) does not fit. %zu bytes free.",
+                      key, buffer.size(), GetFree());
+        return false;
+    }
+    uint32_t ndx;
+    for(ndx=0; ndx<update->count; ndx++) {
+        if(!strcmp(update->entries[ndx].key, key))
+            break;
+    }
+    if(ndx == DDB_SHM_ENTRIES) {
+        CS_VAPRT_WARN("DdbSharedCache::Put - Entry table is full. %s was not stored.", key);
+        return false;
+    }
+    // Space of a replaced result is not reused before the next full update.
+    memcpy((char*)update + offset, buffer.data(), buffer.size());
+    Entry &entry = update->entries[ndx];
+    strcpy(entry.key, key);
+    entry.offset = offset;
+    entry.size = buffer.size();
+    update->used = offset + buffer.size();
+    if(ndx == update->count)
+        update->count++;
+    return true;
+}
+
+// ==================================================================================================
+int DdbSharedCache::Put(const char *key, DdbRowSet *rs, const DDBSTR &query)
+/*!
+  Runs the query with the rowset and stores the result. Rowset should have the result columns
+  bound.
+  \retval int Number of rows stored or -1 on error.
+*/
+{
+    if(!update)
+        return -1;
+    DdbResultTable table;
+    int rows = table.Load(rs, query);
+    if(rows < 0)
+        return -1;
+    return Put(key, table) ? rows : -1;
+}
+
+// ==================================================================================================
+bool DdbSharedCache::CommitUpdate()
+/*!
+  Publishes the updated slot as the new version. Readers created after this see the new data.
+*/
+{
+    if(!update)
+        return false;
+    uint64_t version = control->version.load() + 1;
+    update->version = version;
+    control->active.store(update == GetSlot(0) ? 0 : 1);
+    control->version.store(version);
+    control->writer.store(0);
+    update = 0;
+    return true;
+}
+
+// ==================================================================================================
+void DdbSharedCache::CancelUpdate()
+/*!
+  Abandons the update. The current version stays active.
+*/
+{
+    if(!update)
+        return;
+    update = 0;
+    control->writer.store(0);
+}
+
+// ==================================================================================================
+uint64_t DdbSharedCache::GetVersion()
+/*!
+  Returns the version of the active data. Zero if nothing has been committed. Readers can
+  compare this to DdbCacheReader::GetVersion to find out whether a newer version exists.
+*/
+{
+    return control ? control->version.load() : 0;
+}
+
+// ==================================================================================================
+size_t DdbSharedCache::GetFree()
+/*!
+  Returns the free space of the update in progress or the capacity if no update is active.
+*/
+{
+    if(!control)
+        return 0;
+    if(!update)
+        return GetCapacity();
+    return (size_t)(control->slotSize - update->used);
+}
+
+// ==================================================================================================
+DdbCacheReader::DdbCacheReader(DdbSharedCache *cache_in)
+/*!
+  Pins the active version of the cache.
+  \param cache_in Attached cache.
+*/
+{
+    cache = cache_in;
+    slot = 0;
+    Pin();
+}
+
+// ==================================================================================================
+DdbCacheReader::~DdbCacheReader()
+{
+    Unpin();
+}
+
+// ==================================================================================================
+void DdbCacheReader::Pin()
+/*!
+  Increments the reader count of the active slot. If an update was published in between, the
+  count is returned and the new slot is tried, so the updater never overwrites a pinned slot.
+*/
+{
+    if(!cache || !cache->control)
+        return;
+    DdbSharedCache::Control *control = cache->control;
+    for(;;) {
+        uint32_t active = control->active.load();
+        DdbSharedCache::Slot *candidate = cache->GetSlot(active);
+        candidate->readers.fetch_add(1);
+        if(control->active.load() == active) {
+            slot = candidate;
+            return;
+        }
+        candidate->readers.fetch_sub(1);
+    }
+}
+
+// ==================================================================================================
+void DdbCacheReader::Unpin()
+{
+    if(!slot)
+        return;
+    slot->readers.fetch_sub(1);
+    slot = 0;
+}
+
+// ==================================================================================================
+bool DdbCacheReader::Refresh()
+/*!
+  Releases the pinned version and pins the current one. Snapshots received from Get before
+  this call must not be used any more.
+  \retval bool True if the version changed.
+*/
+{
+    uint64_t version = GetVersion();
+    Unpin();
+    Pin();
+    return GetVersion() != version;
+}
+
+// ==================================================================================================
+bool DdbCacheReader::Get(const char *key, DdbSnapshot &snap)
+/*!
+  Presents the cached result as a snapshot. Nothing is copied.
+  \param key Name of the result.
+  \param snap Receives the result. Valid as long as this reader pins the version.
+  \retval bool False if the result is not in the pinned version.
+*/
+{
+    if(!slot || !slot->version)
+        return false;
+    for(uint32_t ndx=0; ndx<slot->count && ndx<DDB_SHM_ENTRIES; ndx++) {
+        const DdbSharedCache::Entry &entry = slot->entries[ndx];
+        if(!strncmp(entry.key, key, DDB_SHM_KEYLEN)) {
+            if(entry.offset + entry.size > cache->control->slotSize)
+                return false;
+            return snap.Attach((const char*)slot + entry.offset, (size_t)entry.size);
+        }
+    }
+    return false;
+}
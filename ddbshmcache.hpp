@@ -0,0 +1,151 @@
+/*! \file ddbshmcache.hpp
+ * \brief Query result cache in a shared memory segment shared by several processes. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#ifndef DDB_SHMCACHE_H_FILE
+#define DDB_SHMCACHE_H_FILE
+
+#include <atomic>
+#include <vector>
+#include "directdatabase.hpp"
+#include "ddbtable.hpp"
+#include "ddbsnapshot.hpp"
+
+//! Maximum number of cached results in one segment.
+#define DDB_SHM_ENTRIES 128
+//! Maximum length of the cache key including the terminating null.
+#define DDB_SHM_KEYLEN 64
+//! Shared memory layout version.
+#define DDB_SHM_VERSION 1
+//! Time in milliseconds the update waits for the readers of the old data.
+#define DDB_SHM_READER_WAIT 2000
+
+class DdbCacheReader;
+
+// ==================================================================================================
+//! Immutable query results shared by processes through a POSIX shared memory segment.
+/*! The segment is created once per host (e.g. by the parent of pre-forked workers) with a
+    fixed size. It holds two data slots. One process fills the inactive slot with
+    BeginUpdate, Put and CommitUpdate. Commit publishes the slot with a single atomic store and
+    increments the version. Readers never lock: DdbCacheReader pins the active slot for the
+    duration of its life and the results are read in place as DdbSnapshot views. Entries use
+    the snapshot format whose offsets are relative to the entry start, so the segment may be
+    mapped at a different address in every process.
+
+    The next update waits until the readers of the slot it is about to overwrite have
+    finished. It fails if they have not finished in DDB_SHM_READER_WAIT ms. A result that does not fit into the slot (half
+    of the segment less the directory) is rejected and the update continues without it.
+    \code
+    // Parent, before forking the workers.
+    DdbSharedCache cache;
+    cache.Create("/myapp-ref", 64*1024*1024);
+    cache.BeginUpdate();
+    cache.Put("country", rs, "SELECT code, name FROM country");
+    cache.CommitUpdate();
+
+    // Worker.
+    DdbCacheReader reader(&cache);
+    DdbSnapshot country;
+    if(reader.Get("country", country))
+        name = country.GetStr(row, 1);
+    \endcode
+    Only one process may update at a time. A concurrent BeginUpdate fails. Not available on
+    Windows.
+ */
+class DdbSharedCache
+{
+    friend class DdbCacheReader;
+public:
+    DdbSharedCache();
+    ~DdbSharedCache();
+
+    bool Create(const char *name, size_t size);
+    bool Attach(const char *name);
+    void Detach();
+    static bool Remove(const char *name);
+    //! Returns true if the segment is mapped.
+    bool IsAttached() { return control!=0; }
+
+    bool BeginUpdate(bool keep=false);
+    bool Put(const char *key, DdbResultTable &table);
+    int Put(const char *key, DdbRowSet *rs, const DDBSTR &query);
+    bool CommitUpdate();
+    void CancelUpdate();
+
+    uint64_t GetVersion();
+    //! Returns the space available for the results of one version.
+    size_t GetCapacity() { return control ? (size_t)control->slotSize - Align(sizeof(Slot)) : 0; }
+    size_t GetFree();
+
+    //! Directory entry of one cached result.
+    struct Entry {
+        char key[DDB_SHM_KEYLEN];
+        uint64_t offset;                    //!< Offset of the snapshot from the start of the slot.
+        uint64_t size;
+    };
+    //! Header of one data slot. Entries follow it.
+    struct Slot {
+        std::atomic<uint32_t> readers;      //!< Number of readers that have pinned this slot.
+        uint32_t count;                     //!< Number of entries in use.
+        uint64_t used;                      //!< End of the last entry from the start of the slot.
+        uint64_t version;                   //!< Version of the data in this slot.
+        Entry entries[DDB_SHM_ENTRIES];
+    };
+    //! Start of the segment.
+    struct Control {
+        char magic[8];
+        uint32_t layout;                    //!< DDB_SHM_VERSION.
+        uint32_t reserved;
+        uint64_t size;                      //!< Size of the whole segment.
+        uint64_t slotSize;                  //!< Size of each slot including the header.
+        std::atomic<uint64_t> version;      //!< Version of the active slot. Zero if empty.
+        std::atomic<uint32_t> active;       //!< Index of the active slot.
+        std::atomic<int32_t> writer;        //!< Process id of the updater or zero.
+    };
+
+protected:
+    bool Map(int fd, size_t size);
+    Slot* GetSlot(uint32_t ndx) { return (Slot*)(base + Align(sizeof(Control)) + ndx*control->slotSize); }
+    static size_t Align(size_t size) { return (size+63) & ~(size_t)63; }
+
+    char *base;                 //!< Start of the mapping.
+    size_t size;
+    Control *control;
+    Slot *update;               //!< Slot being filled. Null if no update is in progress.
+    std::vector<char> buffer;   //!< Serialization buffer of Put.
+
+private:
+    DdbSharedCache(const DdbSharedCache&);
+    void operator=(const DdbSharedCache&);
+};
+
+// ==================================================================================================
+//! Pins the current version of a shared cache for reading.
+/*! Snapshots received from Get stay valid until the reader is destroyed or Refresh is called.
+    Keep the reader short lived (e.g. one request) so that updates are not delayed.
+ */
+class DdbCacheReader
+{
+public:
+    DdbCacheReader(DdbSharedCache *cache);
+    ~DdbCacheReader();
+
+    bool Get(const char *key, DdbSnapshot &snap);
+    bool Refresh();
+    //! Returns the version of the pinned data or zero if the cache is empty.
+    uint64_t GetVersion() { return slot ? slot->version : 0; }
+
+protected:
+    void Pin();
+    void Unpin();
+
+    DdbSharedCache *cache;
+    DdbSharedCache::Slot *slot;     //!< Pinned slot or null.
+
+private:
+    DdbCacheReader(const DdbCacheReader&);
+    void operator=(const DdbCacheReader&);
+};
+
+#endif
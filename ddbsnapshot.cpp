@@ -0,0 +1,350 @@
+/*! \file ddbsnapshot.cpp
+ * \brief Columnar snapshot files of query results and their memory mapped reader. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#include "pch-stop.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef _WIN32
+  #include <io.h>
+#else
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+#include <cpp4scripts.hpp>
+#include "ddbsnapshot.hpp"
+
+static const char g_magic[8] = { 'D','D','B','S','N','A','P','1' };
+
+// ==================================================================================================
+static uint64_t Align8(uint64_t offset)
+{
+    return (offset+7) & ~(uint64_t)7;
+}
+
+// ==================================================================================================
+static void Put(std::vector<char> &out, uint64_t offset, const void *data, size_t len)
+{
+    if(len)
+        memcpy(&out[offset], data, len);
+}
+
+// ==================================================================================================
+size_t DdbSnapshotWriter::Serialize(DdbResultTable &table, std::vector<char> &out)
+/*!
+  Serializes the table in the snapshot format into the buffer. All offsets are relative to
+  the start of the buffer so the result can be placed anywhere in memory.
+  \retval size_t Size of the serialized snapshot.
+*/
+{
+    DdbSnapshot::Header header;
+    std::vector<DdbSnapshot::Column> dir(table.GetColumnCount());
+    uint32_t rows = table.GetRowCount();
+    size_t nullSize = ((rows+63)/64)*sizeof(uint64_t);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, g_magic, sizeof(g_magic));
+    header.version = DDB_SNAPSHOT_VERSION;
+    header.columns = table.GetColumnCount();
+    header.rows = rows;
+    header.created = (int64_t)time(0);
+
+    // Compute the layout first so that the buffer is allocated once.
+    uint64_t offset = Align8(sizeof(header) + dir.size()*sizeof(DdbSnapshot::Column));
+    for(int col=0; col<table.GetColumnCount(); col++) {
+        DdbSnapshot::Column &entry = dir[col];
+        memset(&entry, 0, sizeof(entry));
+        entry.type = table.GetType(col);
+        // DDB_TYPE_USED
+        switch(entry.type) {
+        case DDBT_NUM:  entry.dataSize = rows*sizeof(double); break;
+        case DDBT_DEC:  entry.scale = (int16_t)table.GetScale(col);
+                        entry.dataSize = rows*sizeof(int64_t); break;
+        case DDBT_LONG:
+        case DDBT_TIME:
+        case DDBT_DAY:  entry.dataSize = rows*sizeof(int64_t); break;
+        default:        entry.dataSize = rows*sizeof(int32_t); break;
+        }
+        entry.data = offset;
+        offset = Align8(offset + entry.dataSize);
+        entry.nulls = offset;
+        offset = Align8(offset + nullSize);
+        if(entry.type == DDBT_STR) {
+            const std::vector<std::string> &dict = table.GetDictionary(col);
+            entry.dict = offset;
+            entry.dictCount = dict.size();
+            offset += dict.size()*sizeof(uint64_t);
+            for(size_t ndx=0; ndx<dict.size(); ndx++)
+                offset += dict[ndx].length()+1;
+            offset = Align8(offset);
+        }
+    }
+    out.assign(offset, 0);
+
+    Put(out, 0, &header, sizeof(header));
+    Put(out, sizeof(header), dir.data(), dir.size()*sizeof(DdbSnapshot::Column));
+    for(int col=0; col<table.GetColumnCount(); col++) {
+        DdbSnapshot::Column &entry = dir[col];
+        switch(entry.type) {
+        case DDBT_NUM:  Put(out, entry.data, table.GetDoubles(col), entry.dataSize); break;
+        case DDBT_LONG:
+        case DDBT_DEC:
+        case DDBT_TIME:
+        case DDBT_DAY:  Put(out, entry.data, table.GetLongs(col), entry.dataSize); break;
+        default:        Put(out, entry.data, table.GetInts(col), entry.dataSize); break;
+        }
+        Put(out, entry.nulls, table.GetNulls(col), nullSize);
+        if(entry.type == DDBT_STR) {
+            const std::vector<std::string> &dict = table.GetDictionary(col);
+            uint64_t pos = entry.dict + dict.size()*sizeof(uint64_t);
+            for(size_t ndx=0; ndx<dict.size(); ndx++) {
+                Put(out, entry.dict + ndx*sizeof(uint64_t), &pos, sizeof(pos));
+                Put(out, pos, dict[ndx].c_str(), dict[ndx].length()+1);
+                pos += dict[ndx].length()+1;
+            }
+        }
+    }
+    return out.size();
+}
+
+// ==================================================================================================
+bool DdbSnapshotWriter::Write(const char *path, DdbResultTable &table)
+/*!
+  Writes the table into the snapshot file.
+  \param path Target file. It is replaced once the new file has been written completely.
+  \param table Table to write.
+  \retval bool True on success.
+*/
+{
+    std::vector<char> data;
+    Serialize(table, data);
+
+    std::string tmp(path);
+    tmp += ".tmp";
+    FILE *fp = fopen(tmp.c_str(), "wb");
+    if(!fp) {
+        CS_VAPRT_ERRO("DdbSnapshotWriter::Write - Unable to create %s", tmp.c_str());
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), fp) == data.size();
+    ok = fflush(fp)==0 && ok;
+#ifndef _WIN32
+    ok = ok && fsync(fileno(fp))==0;
+#endif
+    ok = fclose(fp)==0 && ok;
+    if(!ok) {
+        CS_VAPRT_ERRO("DdbSnapshotWriter::Write - Write to %s failed.", tmp.c_str());
+        remove(tmp.c_str());
+        return false;
+    }
+#ifdef _WIN32
+    remove(path);
+#endif
+    if(rename(tmp.c_str(), path)) {
+        CS_VAPRT_ERRO("DdbSnapshotWriter::Write - Unable to rename %s", tmp.c_str());
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// ==================================================================================================
+int DdbSnapshotWriter::Write(const char *path, DdbRowSet *rs, const DDBSTR &query)
+/*!
+  Runs the query with the rowset and writes the result into the snapshot file. Rowset should
+  have the result columns bound.
+  \retval int Number of rows written or -1 on error.
+*/
+{
+    DdbResultTable table;
+    int rows = table.Load(rs, query);
+    if(rows < 0)
+        return -1;
+    return Write(path, table) ? rows : -1;
+}
+
+// ==================================================================================================
+DdbSnapshot::DdbSnapshot()
+{
+    base = 0;
+    size = 0;
+    header = 0;
+    dir = 0;
+    mapped = false;
+    owned = false;
+}
+
+// ==================================================================================================
+DdbSnapshot::~DdbSnapshot()
+{
+    Close();
+}
+
+// ==================================================================================================
+bool DdbSnapshot::Open(const char *path)
+/*!
+  Maps the snapshot file into the memory. Previously opened file is closed.
+  \retval bool False if the file does not exist or it is not a valid snapshot.
+*/
+{
+    Close();
+#ifdef _WIN32
+    // No mapping on Windows: the file is read into memory.
+    FILE *fp = fopen(path, "rb");
+    if(!fp)
+        return false;
+    fseek(fp, 0, SEEK_END);
+    size = (size_t)ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *buffer = (char*) malloc(size ? size : 1);
+    if(!buffer || fread(buffer, 1, size, fp) != size) {
+        free(buffer);
+        fclose(fp);
+        return false;
+    }
+    fclose(fp);
+    base = buffer;
+    mapped = false;
+    owned = true;
+#else
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return false;
+    struct stat st;
+    if(fstat(fd, &st) || st.st_size < (off_t)sizeof(Header)) {
+        close(fd);
+        CS_VAPRT_WARN("DdbSnapshot::Open - %s is not a snapshot.", path);
+        return false;
+    }
+    size = (size_t)st.st_size;
+    void *map = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) {
+        CS_VAPRT_ERRO("DdbSnapshot::Open - Unable to map %s", path);
+        size = 0;
+        return false;
+    }
+    base = (const char*)map;
+    mapped = true;
+    owned = true;
+#endif
+    header = (const Header*)base;
+    dir = (const Column*)(base + sizeof(Header));
+    if(!Validate()) {
+        CS_VAPRT_WARN("DdbSnapshot::Open - %s is not a valid snapshot.", path);
+        Close();
+        return false;
+    }
+    return true;
+}
+
+// ==================================================================================================
+bool DdbSnapshot::Attach(const char *data, size_t len)
+/*!
+  Presents a snapshot that is already in memory, e.g. in a shared memory segment. The memory
+  is not copied and it must stay valid and unchanged while the snapshot is used.
+  \param data Start of the snapshot. Must be aligned to 8 bytes.
+  \param len Size of the snapshot.
+  \retval bool False if the memory does not hold a valid snapshot.
+*/
+{
+    Close();
+    if(!data || len < sizeof(Header) || ((uintptr_t)data & 7))
+        return false;
+    base = data;
+    size = len;
+    mapped = false;
+    owned = false;
+    header = (const Header*)base;
+    dir = (const Column*)(base + sizeof(Header));
+    if(!Validate()) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+// ==================================================================================================
+static bool InRange(uint64_t offset, uint64_t len, uint64_t size)
+/*!
+  Checks that a range is inside the snapshot without overflowing.
+*/
+{
+    return offset <= size && len <= size - offset;
+}
+
+// ==================================================================================================
+bool DdbSnapshot::Validate()
+/*!
+  Checks that the header and the column directory refer to the inside of the file, that the
+  dictionary strings are terminated inside it and that the string codes are in the dictionary.
+  The values are read once, so this is linear in the size of the snapshot. The rows are read
+  with 32-bit indexes, so a larger row count is rejected. The sizes are compared by division so
+  that a crafted file can not overflow them.
+*/
+{
+    if(size < sizeof(Header) || memcmp(header->magic, g_magic, sizeof(g_magic)) || header->version != DDB_SNAPSHOT_VERSION)
+        return false;
+    if(!InRange(sizeof(Header), (uint64_t)header->columns*sizeof(Column), size))
+        return false;
+    uint64_t rows = header->rows;
+    if(rows > INT32_MAX)
+        return false;
+    for(uint32_t col=0; col<header->columns; col++) {
+        const Column &entry = dir[col];
+        uint64_t width = entry.type==DDBT_NUM ? sizeof(double) :
+            (DdbResultTable::IsLong(entry.type) ? sizeof(int64_t) : sizeof(int32_t));
+        if(entry.dataSize % width || entry.dataSize / width != rows || !InRange(entry.data, entry.dataSize, size)
+           || (entry.data&7) || entry.scale < 0 || entry.scale > DDB_DECIMAL_DIGITS)
+            return false;
+        if(!InRange(entry.nulls, ((rows+63)/64)*sizeof(uint64_t), size) || (entry.nulls&7))
+            return false;
+        if(entry.type == DDBT_STR) {
+            if(entry.dictCount == 0 || entry.dictCount > size/sizeof(uint64_t) || (entry.dict&7)
+               || !InRange(entry.dict, entry.dictCount*sizeof(uint64_t), size))
+                return false;
+            // Strings follow each other, so each one must end right before the next one.
+            const uint64_t *strings = (const uint64_t*)(base + entry.dict);
+            uint64_t start = entry.dict + entry.dictCount*sizeof(uint64_t);
+            for(uint64_t ndx=0; ndx<entry.dictCount; ndx++) {
+                if(strings[ndx] < start || strings[ndx] >= size)
+                    return false;
+                if(ndx && base[strings[ndx]-1] != 0)
+                    return false;
+                start = strings[ndx]+1;
+            }
+            if(!memchr(base + strings[entry.dictCount-1], 0, size - strings[entry.dictCount-1]))
+                return false;
+            const int32_t *codes = (const int32_t*)(base + entry.data);
+            for(uint64_t row=0; row<rows; row++) {
+                if(codes[row] < 0 || (uint64_t)codes[row] >= entry.dictCount)
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+// ==================================================================================================
+void DdbSnapshot::Close()
+{
+    if(!base)
+        return;
+    if(owned) {
+#ifdef _WIN32
+        free((void*)base);
+#else
+        if(mapped)
+            munmap((void*)base, size);
+#endif
+    }
+    base = 0;
+    size = 0;
+    header = 0;
+    dir = 0;
+}
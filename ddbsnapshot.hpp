@@ -0,0 +1,135 @@
+/*! \file ddbsnapshot.hpp
+ * \brief Columnar snapshot files of query results and their memory mapped reader. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#ifndef DDB_SNAPSHOT_H_FILE
+#define DDB_SNAPSHOT_H_FILE
+
+#include <time.h>
+#include <vector>
+#include "directdatabase.hpp"
+#include "ddbtable.hpp"
+
+//! Snapshot file format version.
+#define DDB_SNAPSHOT_VERSION 1
+
+// ==================================================================================================
+//! Writes query results into snapshot files.
+/*! File layout, all sections aligned to 8 bytes and stored in the native byte order:
+    - Header: magic "DDBSNAP1", version, column count, row count, creation time.
+    - Column directory: type and the offsets of the value array, null bitmap and dictionary.
+    - Value arrays as in DdbResultTable: int32, double, int64 or int32 string codes.
+    - Null bitmaps as uint64 words.
+    - Dictionaries: uint64 offsets of the strings followed by the null terminated strings.
+
+    The file is written into a temporary file that is renamed over the target once complete,
+    so readers never see a partial file. A service can therefore refresh the snapshot in the
+    background and reopen it when ready.
+ */
+class DdbSnapshotWriter
+{
+public:
+    static bool Write(const char *path, DdbResultTable &table);
+    static int Write(const char *path, DdbRowSet *rs, const DDBSTR &query);
+    static size_t Serialize(DdbResultTable &table, std::vector<char> &out);
+};
+
+// ==================================================================================================
+//! Read only view of a snapshot file.
+/*! The file is mapped into the memory and the accessors read the mapped arrays directly.
+    Nothing is copied or parsed when the file is opened, so opening takes the same time
+    regardless of the file size. Accessors follow the DdbResultTable interface except that
+    strings are returned as null terminated pointers into the file.
+    \code
+    DdbSnapshot snap;
+    if(!snap.Open("/var/cache/app/country.snap")) {
+        table.Load(rs, query);
+        DdbSnapshotWriter::Write("/var/cache/app/country.snap", table);
+    }
+    for(int row=0; row<snap.GetRowCount(); row++)
+        printf("%d %s\n", snap.GetInt(row,0), snap.GetStr(row,1));
+    \endcode
+ */
+class DdbSnapshot
+{
+public:
+    DdbSnapshot();
+    ~DdbSnapshot();
+
+    bool Open(const char *path);
+    bool Attach(const char *data, size_t len);
+    void Close();
+    //! Returns true if a snapshot is open.
+    bool IsOpen() { return base!=0; }
+    //! Returns the time the snapshot was written.
+    time_t GetCreated() { return (time_t)header->created; }
+
+    //! Returns the number of rows.
+    int GetRowCount() { return (int)header->rows; }
+    //! Returns the number of columns.
+    int GetColumnCount() { return (int)header->columns; }
+    //! Returns the DDBT-type of the column.
+    short GetType(int col) { return dir[col].type; }
+    bool IsNull(uint32_t row, int col) { return (GetNulls(col)[row>>6] >> (row&63)) & 1; }
+
+    int GetInt(uint32_t row, int col) { return GetInts(col)[row]; }
+    bool GetBool(uint32_t row, int col) { return GetInts(col)[row] != 0; }
+    double GetDouble(uint32_t row, int col) { return GetDoubles(col)[row]; }
+    int64_t GetLong(uint32_t row, int col) { return GetLongs(col)[row]; }
+    int64_t GetTime(uint32_t row, int col) { return GetTimes(col)[row]; }
+    const char* GetStr(uint32_t row, int col) { return GetDictStr(col, GetInts(col)[row]); }
+
+    //! Returns the values of an int, bool, char or string (codes) column.
+    const int32_t* GetInts(int col) { return (const int32_t*)(base + dir[col].data); }
+    //! Returns the values of a numeric column.
+    const double* GetDoubles(int col) { return (const double*)(base + dir[col].data); }
+    //! Returns the values of a long, decimal (unscaled) or time column.
+    const int64_t* GetLongs(int col) { return (const int64_t*)(base + dir[col].data); }
+    //! Returns the values of a time column.
+    const int64_t* GetTimes(int col) { return (const int64_t*)(base + dir[col].data); }
+    //! Returns the scale of a decimal column. Zero for the other types.
+    int GetScale(int col) { return dir[col].scale; }
+    //! Returns the null bitmap of the column.
+    const uint64_t* GetNulls(int col) { return (const uint64_t*)(base + dir[col].nulls); }
+    //! Returns the number of distinct strings of a string column.
+    int GetDictSize(int col) { return (int)dir[col].dictCount; }
+    //! Returns the dictionary string of the code.
+    const char* GetDictStr(int col, int code) { return base + ((const uint64_t*)(base + dir[col].dict))[code]; }
+
+    //! File header.
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t columns;
+        uint64_t rows;
+        int64_t created;
+    };
+    //! Column directory entry. Offsets are from the start of the file.
+    struct Column {
+        int16_t type;
+        int16_t scale;          //!< Scale of a decimal column.
+        uint32_t reserved2;
+        uint64_t data;
+        uint64_t dataSize;
+        uint64_t nulls;
+        uint64_t dict;          //!< Offset of the dictionary offset table. Zero if not a string.
+        uint64_t dictCount;
+    };
+
+protected:
+    bool Validate();
+
+    const char *base;       //!< Start of the mapping.
+    size_t size;            //!< Size of the mapping.
+    const Header *header;
+    const Column *dir;
+    bool mapped;            //!< True if base is a mapping, false if it was read into memory.
+    bool owned;             //!< True if base is released by Close.
+
+private:
+    DdbSnapshot(const DdbSnapshot&);
+    void operator=(const DdbSnapshot&);
+};
+
+#endif
@@ -0,0 +1,500 @@
+/*! \file ddbsqlite.cpp
+ * \brief SQLite implementation of the DirectDatabase interface. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#if defined(DDB_USEWX)
+  #include <wx/wxprec.h>
+  #ifndef WX_PRECOMP
+    #include <wx/wx.h>
+  #endif
+#endif
+#include "pch-stop.h"
+#ifdef __linux
+  #include <string.h>
+  #include <stdlib.h>
+#endif
+#include <cpp4scripts.hpp>
+#define __DDB_SQLITE__
+#include "directdatabase.hpp"
+#include "ddbexport.hpp"
+
+// ==================================================================================================
+DdbSqlite::DdbSqlite()
+/*!
+  Constructs database object for the SQLite databases. SQLite does not need any
+  initialization so the initialization flag is simply set.
+*/
+{
+    flags |= DDB_FLAG_INITIALIZED;
+    feat_support |= DDB_FEATURE_TRANSACTIONS|DDB_FEATURE_AUTOTRIM;
+    feat_on      |= DDB_FEATURE_TRANSACTIONS;
+    connection = 0;
+    openFlags = SQLITE_OPEN_READWRITE|SQLITE_OPEN_CREATE|SQLITE_OPEN_URI;
+}
+
+// ==================================================================================================
+DdbSqlite::~DdbSqlite()
+/*!
+    Closes the database connection.
+*/
+{
+    if(flags & DDB_FLAG_CONNECTED)
+        Disconnect();
+}
+
+// ==================================================================================================
+bool DdbSqlite::Connect(const char *constr)
+{
+    return Connect(constr, SQLITE_OPEN_READWRITE|SQLITE_OPEN_CREATE|SQLITE_OPEN_URI);
+}
+
+// ==================================================================================================
+bool DdbSqlite::Connect(const char *constr, int open_flags)
+/*!
+  Opens the given database file.
+  \param constr Database file name or SQLite URI.
+  \param open_flags SQLITE_OPEN_... flags for sqlite3_open_v2. Use SQLITE_OPEN_READONLY for
+         read-only connections.
+  \retval bool True on success.
+*/
+{
+    if(!constr || !*constr)
+    {
+        SetErrorId(3);
+        return false;
+    }
+    if(flags & DDB_FLAG_CONNECTED)
+        Disconnect();
+    if(sqlite3_open_v2(constr, &connection, open_flags, 0) != SQLITE_OK)
+    {
+        CS_VAPRT_ERRO("DdbSqlite::Connect - %s", connection ? sqlite3_errmsg(connection) : "out of memory");
+        sqlite3_close(connection);
+        connection = 0;
+        SetErrorId(4);
+        return false;
+    }
+    dbName = constr;
+    openFlags = open_flags;
+    flags |= DDB_FLAG_CONNECTED;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbSqlite::Disconnect()
+{
+    if(connection)
+        sqlite3_close_v2(connection);
+    connection = 0;
+    flags &= ~(DDB_FLAG_CONNECTED|DDB_FLAG_TRANSACT_ON);
+    return true;
+}
+
+// ==================================================================================================
+bool DdbSqlite::IsConnectOK()
+{
+    return connection ? true : false;
+}
+
+// ==================================================================================================
+bool DdbSqlite::ResetConnection()
+{
+    DDBSTR file = dbName;
+    Disconnect();
+    return Connect(file.UTF8(), openFlags);
+}
+
+// ==================================================================================================
+bool DdbSqlite::Cancel()
+/*!
+  Interrupts the statement running on the connection with sqlite3_interrupt. May be called from
+  another thread but not concurrently with Disconnect.
+*/
+{
+    if(!connection)
+        return false;
+    sqlite3_interrupt(connection);
+    return true;
+}
+
+// ==================================================================================================
+bool DdbSqlite::SetBusyTimeout(int ms)
+/*!
+  Sets the time SQLite waits for a locked database before the statement fails with
+  SQLITE_BUSY.
+  \param ms Timeout in milliseconds. Zero turns the busy handler off.
+*/
+{
+    if(!connection)
+    {
+        SetErrorId(5);
+        return false;
+    }
+    return sqlite3_busy_timeout(connection, ms) == SQLITE_OK;
+}
+
+// ==================================================================================================
+DdbRowSet* DdbSqlite::CreateRowSet()
+{
+    if(!(flags&DDB_FLAG_CONNECTED))
+    {
+        SetErrorId(5);
+        return 0;
+    }
+    return new DdbSqliteRowSet(this);
+}
+
+// ==================================================================================================
+DDBSTR DdbSqlite::GetErrorDescription(DdbRowSet *)
+{
+    DDBSTR errorMsg;
+
+    errorMsg = GetLastError();
+    if(connection)
+    {
+        errorMsg += "\n";
+        errorMsg += sqlite3_errmsg(connection);
+    }
+    return errorMsg;
+}
+
+// ==================================================================================================
+bool DdbSqlite::ExecuteCommand(const char *command, const char *caller)
+/*!
+  Executes one or more SQL commands that do not return rows.
+  \param command SQL to execute.
+  \param caller Name of the calling function for the error log.
+  \retval bool True on success.
+*/
+{
+    char *emsg = 0;
+    if(sqlite3_exec(connection, command, 0, 0, &emsg) != SQLITE_OK)
+    {
+        CS_VAPRT_ERRO("%s failed: %s", caller, emsg ? emsg : sqlite3_errmsg(connection));
+        sqlite3_free(emsg);
+        return false;
+    }
+    return true;
+}
+
+// ==================================================================================================
+bool DdbSqlite::StartTransaction()
+{
+    if(!(flags&DDB_FLAG_CONNECTED))
+    {
+        SetErrorId(5);
+        return false;
+    }
+    if(flags&DDB_FLAG_TRANSACT_ON)
+    {
+        SetErrorId(6);
+        return false;
+    }
+    if(!ExecuteCommand("BEGIN", "DdbSqlite::StartTransaction"))
+        return false;
+    flags |= DDB_FLAG_TRANSACT_ON;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbSqlite::Commit()
+{
+    if(!(flags&DDB_FLAG_CONNECTED))
+    {
+        SetErrorId(5);
+        return false;
+    }
+    if(!(flags&DDB_FLAG_TRANSACT_ON))
+    {
+        SetErrorId(7);
+        return false;
+    }
+    if(!ExecuteCommand("COMMIT", "DdbSqlite::Commit"))
+    {
+        // Failed commit leaves the transaction open unless SQLite rolled it back already.
+        if(sqlite3_get_autocommit(connection))
+            flags &= ~DDB_FLAG_TRANSACT_ON;
+        return false;
+    }
+    flags &= ~DDB_FLAG_TRANSACT_ON;
+    return true;
+}
+
+// ==================================================================================================
+bool DdbSqlite::RollBack()
+{
+    if(!(flags&DDB_FLAG_CONNECTED))
+    {
+        SetErrorId(5);
+        return false;
+    }
+    if(!(flags&DDB_FLAG_TRANSACT_ON))
+    {
+        SetErrorId(7);
+        return false;
+    }
+    flags &= ~DDB_FLAG_TRANSACT_ON;
+    if(sqlite3_get_autocommit(connection))
+        return true; // Already rolled back by SQLite due to an error.
+    return ExecuteCommand("ROLLBACK", "DdbSqlite::RollBack");
+}
+
+// ==================================================================================================
+sqlite3_stmt* DdbSqlite::ExecuteFunction(const DDBSTR &query, const char *caller)
+/*!
+  Common query logic for the Execute...Function family. Prepares the query and steps it to the
+  first row.
+  \param query Query to perform
+  \param caller Name of the calling function for the error log.
+  \retval sqlite3_stmt* Statement positioned at the first row. Null on error, when the result is
+  empty or when the first field is NULL. Caller must finalize the returned statement.
+*/
+{
+    sqlite3_stmt *stmt = 0;
+    errorId = 0;
+    if(query.LENGTH()==0)
+        return 0;
+    if(!connection)
+    {
+        SetErrorId(5);
+        return 0;
+    }
+    if(sqlite3_prepare_v2(connection, query.UTF8(), -1, &stmt, 0) != SQLITE_OK)
+    {
+        CS_VAPRT_ERRO("%s failed: %s", caller, sqlite3_errmsg(connection));
+        errorId = 19;
+        return 0;
+    }
+    int rc = sqlite3_step(stmt);
+    if(rc != SQLITE_ROW)
+    {
+        if(rc != SQLITE_DONE)
+        {
+            CS_VAPRT_ERRO("%s failed: %s", caller, sqlite3_errmsg(connection));
+            errorId = 19;
+        }
+        sqlite3_finalize(stmt);
+        return 0;
+    }
+    if(sqlite3_column_type(stmt,0) == SQLITE_NULL)
+    {
+        sqlite3_finalize(stmt);
+        return 0;
+    }
+    return stmt;
+}
+
+// ==================================================================================================
+bool DdbSqlite::ExecuteIntFunction(const DDBSTR &query, uint32_t &val)
+{
+    sqlite3_stmt *stmt = ExecuteFunction(query, "DdbSqlite::ExecuteIntFunction");
+    if(!stmt)
+        return false;
+    val = (uint32_t) sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return true;
+}
+
+// ==================================================================================================
+bool DdbSqlite::ExecuteLongFunction(const DDBSTR &query, uint64_t &val)
+{
+    sqlite3_stmt *stmt = ExecuteFunction(query, "DdbSqlite::ExecuteLongFunction");
+    if(!stmt)
+        return false;
+    val = (uint64_t) sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return true;
+}
+
+// ==================================================================================================
+bool DdbSqlite::ExecuteDoubleFunction(const DDBSTR &query, double &val)
+{
+    sqlite3_stmt *stmt = ExecuteFunction(query, "DdbSqlite::ExecuteDoubleFunction");
+    if(!stmt)
+        return false;
+    val = sqlite3_column_double(stmt, 0);
+    sqlite3_finalize(stmt);
+    return true;
+}
+
+// ==================================================================================================
+bool DdbSqlite::ExecuteBoolFunction(const DDBSTR &query, bool &val)
+{
+    sqlite3_stmt *stmt = ExecuteFunction(query, "DdbSqlite::ExecuteBoolFunction");
+    if(!stmt)
+        return false;
+    if(sqlite3_column_type(stmt,0) == SQLITE_TEXT)
+    {
+        const char *resultStr = (const char*) sqlite3_column_text(stmt, 0);
+        val = resultStr[0] && strchr("tTyY1", resultStr[0]) ? true:false;
+    }
+    else
+        val = sqlite3_column_int64(stmt, 0) != 0;
+    sqlite3_finalize(stmt);
+    return true;
+}
+
+// ==================================================================================================
+bool DdbSqlite::ExecuteStrFunction(const DDBSTR &query, DDBSTR &answer)
+{
+    sqlite3_stmt *stmt = ExecuteFunction(query, "DdbSqlite::ExecuteStrFunction");
+    if(!stmt)
+        return false;
+    const char *resultStr = (const char*) sqlite3_column_text(stmt, 0);
+#ifdef DDB_USESTL
+    answer.assign(resultStr, sqlite3_column_bytes(stmt, 0));
+    if( (feat_on&DDB_FEATURE_AUTOTRIM)>0 )
+        DirectDatabase::TrimTail(&answer);
+#else
+    answer = wxString::FromUTF8Unchecked(resultStr);
+    if( (feat_on&DDB_FEATURE_AUTOTRIM)>0 )
+        answer.Trim();
+#endif
+    sqlite3_finalize(stmt);
+    return true;
+}
+
+// ==================================================================================================
+bool DdbSqlite::ExecuteDateFunction(const DDBSTR &query, DDBTIME &val)
+{
+    sqlite3_stmt *stmt = ExecuteFunction(query, "DdbSqlite::ExecuteDateFunction");
+    if(!stmt)
+        return false;
+    const char *resultStr = (const char*) sqlite3_column_text(stmt, 0);
+#ifdef DDB_USESTL
+    ExtractTimestamp(resultStr,&val);
+#else
+    tm tmData;
+    if(ExtractTimestamp(resultStr,&tmData))
+        val.Set(tmData);
+#endif
+    sqlite3_finalize(stmt);
+    return true;
+}
+
+// ------------------------------------------------------------------------------------------
+bool DdbSqlite::ExtractTimestamp(const char *result, struct tm *tmPtr)
+/*!
+  SQLite has no date type. Dates are expected to be stored as ISO-8601 text,
+  i.e. 'YYYY-MM-DD HH:MM:SS' as returned by SQLite date functions.
+*/
+{
+    char *dummy;
+    size_t len = result ? strlen(result) : 0;
+    memset(tmPtr,0,sizeof(tm));
+    if(len>=10) {
+        tmPtr->tm_year = strtol(result,&dummy,10)-1900;
+        tmPtr->tm_mon  = strtol(result+5,&dummy,10)-1;
+        tmPtr->tm_mday = strtol(result+8,&dummy,10);
+        if(len >=19)
+        {
+            tmPtr->tm_hour = strtol(result+11,&dummy,10);
+            tmPtr->tm_min  = strtol(result+14,&dummy,10);
+            tmPtr->tm_sec  = strtol(result+17,&dummy,10);
+        }
+        tmPtr->tm_isdst = -1;
+        return true;
+    }
+    CS_PRINT_NOTE("DdbSqlite::ExtractTimestamp - Empty date detected.");
+    return false;
+}
+
+// ==================================================================================================
+int DdbSqlite::ExecuteModify(const DDBSTR &modify)
+{
+    if(modify.LENGTH()==0)
+        return -1;
+    if(!connection)
+    {
+        SetErrorId(5);
+        return -1;
+    }
+    if(!ExecuteCommand(modify.UTF8(), "DdbSqlite::ExecuteModify"))
+    {
+        errorId = 18;
+        return -1;
+    }
+    return sqlite3_changes(connection);
+}
+
+// ==================================================================================================
+bool DdbSqlite::UpdateStructure(const DDBSTR &command)
+{
+    if(command.LENGTH()==0)
+        return false;
+    if(!connection)
+    {
+        SetErrorId(5);
+        return false;
+    }
+    if(!ExecuteCommand(command.UTF8(), "DdbSqlite::UpdateStructure"))
+    {
+        errorId = 21;
+        return false;
+    }
+    return true;
+}
+
+// ==================================================================================================
+uint64_t DdbSqlite::GetInsertId()
+{
+    if(!connection)
+        return 0;
+    return (uint64_t) sqlite3_last_insert_rowid(connection);
+}
+
+// ==================================================================================================
+int DdbSqlite::Export(const DDBSTR &query, DdbExportWriter &out)
+/*!
+  Streams the query result into the writer. Values are passed from the statement buffers as
+  SQLite produces the rows. Integers and reals are written as JSON numbers.
+  \retval int Number of rows exported or -1 on error.
+*/
+{
+    if(!connection) {
+        SetErrorId(5);
+        return -1;
+    }
+    if(query.LENGTH()==0)
+        return -1;
+    sqlite3_stmt *stmt = 0;
+    if(sqlite3_prepare_v2(connection, query.UTF8(), -1, &stmt, 0) != SQLITE_OK || !stmt)
+    {
+        CS_VAPRT_ERRO("DdbSqlite::Export failed: %s", sqlite3_errmsg(connection));
+        SetErrorId(19);
+        return -1;
+    }
+    int fields = sqlite3_column_count(stmt);
+    std::vector<std::string> names;
+    for(int col=0; col<fields; col++)
+        names.push_back(sqlite3_column_name(stmt, col));
+    out.SetColumns(names);
+
+    int rows = 0;
+    int rc;
+    while((rc = sqlite3_step(stmt)) == SQLITE_ROW && out.IsOK())
+    {
+        out.BeginRow();
+        for(int col=0; col<fields; col++)
+        {
+            int type = sqlite3_column_type(stmt, col);
+            if(type == SQLITE_NULL) {
+                out.Null();
+                continue;
+            }
+            const char *value = (const char*)sqlite3_column_text(stmt, col);
+            int len = sqlite3_column_bytes(stmt, col);
+            out.Field(value, len, type==SQLITE_INTEGER || type==SQLITE_FLOAT ? DDB_FIELD_NUMBER : DDB_FIELD_TEXT);
+        }
+        out.EndRow();
+        rows++;
+    }
+    sqlite3_finalize(stmt);
+    if(rc != SQLITE_DONE && rc != SQLITE_ROW)
+    {
+        CS_VAPRT_ERRO("DdbSqlite::Export failed: %s", sqlite3_errmsg(connection));
+        SetErrorId(19);
+        return -1;
+    }
+    return out.IsOK() ? rows : -1;
+}
@@ -1,69 +1,90 @@
-/*******************************************************************************
-File: ddbsqlite.hpp
-$Revision: $
-
-Copyright (c) Menacon Inc
-*******************************************************************************/
-
-#ifndef DDB_SQLITE_H_FILE
-#define DDB_SQLITE_H_FILE
-
-#include <ibase.h>
-
-// ==================================================================================================
-//! Class defines PostgreSQL specific implementation to DirectDatabase-interface.
-class DdbSqlite : public DirectDatabase
-{
-public:
-    DdbSqlite();
-    ~DdbSqlite();
-
-    bool Connect(int timeout=0);
-    bool Disconnect();
-
-    DdbRowSet* CreateRowSet();
-    DDBSTR GetErrorDescription(DdbRowSet *rs);
-
-    bool StartTransaction();
-    bool Commit();
-    bool RollBack();
-
-    bool ExecuteIntFunction(const DDBSTR &query,int &val);
-    bool ExecuteDoubleFunction(const DDBSTR &query, double &val);
-    bool ExecuteBoolFunction(const DDBSTR &query, bool &val);
-    bool ExecuteStrFunction(const DDBSTR &query, DDBSTR &result);
-    bool ExecuteDateFunction(const DDBSTR &query, DDBTIME &val);
-    int ExecuteModify(const DDBSTR &query);
-    bool UpdateStructure(const DDBSTR &command);
-
-protected:
-    void LogError(ISC_STATUS_ARRAY);
-
-};
-
-// ==================================================================================================
-//! Class defines PostgreSQL specific implementation to DdbRowSet-interface.
-class DdbSqliteRowSet : public DdbRowSet
-{
-    friend class DdbSqlite;
-public:
-    ~DdbSqliteRowSet();
-
-    bool Query(const DDBSTR &query);
-    int GetNext();
-
-protected:
-    DdbSqliteRowSet(DirectDatabase*);
-
-    DdbSqlite* db;            //!< Pointer to databse object.
-    int         maxRows;        //!< Total number of records in the current query.
-    int         currentRow;     //!< The number of the current row in the rowset.
-    isc_stmt_handle result;     //!< Query result handle.
-};
-
-inline isc_db_handle DdbSqlite::GetFBConn()
-{
-    return connection;
-}
-
-#endif
+/*! \file ddbsqlite.hpp
+ * \brief SQLite implementation of the DirectDatabase interface. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#ifndef DDB_SQLITE_H_FILE
+#define DDB_SQLITE_H_FILE
+
+#include <sqlite3.h>
+
+// ==================================================================================================
+//! Class defines SQLite specific implementation to DirectDatabase-interface.
+/*! Connection string is the database file name or an SQLite URI (file:...). Database file
+    is created if it does not exist unless other open flags are given.
+ */
+class DdbSqlite : public DirectDatabase
+{
+public:
+    DdbSqlite();
+    ~DdbSqlite();
+
+    int GetType() { return DDBTYPE_SQLITE; }
+    bool Connect(const char *constr);
+    bool Connect(const char *constr, int openFlags);
+    bool Disconnect();
+    bool IsConnectOK();
+    bool ResetConnection();
+
+    DdbRowSet* CreateRowSet();
+    sqlite3* GetSqlConn();
+    DDBSTR GetErrorDescription(DdbRowSet *rs);
+
+    bool StartTransaction();
+    bool Commit();
+    bool RollBack();
+
+    bool ExecuteIntFunction(const DDBSTR &query,uint32_t &val);
+    bool ExecuteLongFunction(const DDBSTR &query,uint64_t &val);
+    bool ExecuteDoubleFunction(const DDBSTR &query, double &val);
+    bool ExecuteBoolFunction(const DDBSTR &query, bool &val);
+    bool ExecuteStrFunction(const DDBSTR &query, DDBSTR &result);
+    bool ExecuteDateFunction(const DDBSTR &query, DDBTIME &val);
+    int ExecuteModify(const DDBSTR &query);
+    uint64_t GetInsertId();
+    bool UpdateStructure(const DDBSTR &command);
+    int Export(const DDBSTR &query, DdbExportWriter &out);
+    bool Cancel();
+
+    bool SetBusyTimeout(int ms);
+    static bool ExtractTimestamp(const char *result, struct tm *);
+
+protected:
+    sqlite3_stmt* ExecuteFunction(const DDBSTR &query, const char *caller);
+    bool ExecuteCommand(const char *command, const char *caller);
+
+    sqlite3    *connection;
+    int         openFlags;      //!< Flags used to open the connection. Needed by reset.
+};
+
+// ==================================================================================================
+//! Class defines SQLite specific implementation to DdbRowSet-interface.
+class DdbSqliteRowSet : public DdbRowSet
+{
+    friend class DdbSqlite;
+public:
+    ~DdbSqliteRowSet();
+
+    bool Query(const DDBSTR &query);
+    int GetNext();
+    void QuitQuery();
+    int Materialize(const DDBSTR &query, DdbResultRows &rows);
+
+protected:
+    DdbSqliteRowSet(DirectDatabase*);
+    void Describe(bool hasRow);
+    bool ReadDecimal(int col, DdbDecimal *dec);
+    bool ReadUuid(int col, DdbUuid *uuid);
+
+    DdbSqlite*    db;           //!< Pointer to databse object.
+    sqlite3_stmt *stmt;         //!< Current statement. Null if there is no result pending.
+    int           maxFields;    //!< Number of columns in the current result.
+    int           currentRow;   //!< The number of the current row in the rowset.
+};
+
+inline sqlite3* DdbSqlite::GetSqlConn()
+{
+    return connection;
+}
+
+#endif
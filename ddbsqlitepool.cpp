@@ -0,0 +1,284 @@
+/*! \file ddbsqlitepool.cpp
+ * \brief Concurrent SQLite access with N read-only connections and one writer. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#include "pch-stop.h"
+#include <cpp4scripts.hpp>
+#define __DDB_SQLITE__
+#include "ddbsqlitepool.hpp"
+
+// ==================================================================================================
+DdbSqlitePool::DdbSqlitePool()
+{
+    writer = 0;
+    writerBusy = false;
+    groupMax = 256;
+    errorId = 0;
+}
+
+// ==================================================================================================
+DdbSqlitePool::~DdbSqlitePool()
+{
+    Close();
+}
+
+// ==================================================================================================
+bool DdbSqlitePool::Open(const char *file, int readerCount, int busyTimeout)
+/*!
+  Opens the writer connection, switches the database into WAL mode and opens the readers.
+  \param file Database file name or SQLite URI.
+  \param readerCount Number of read-only connections. Typically number of cores.
+  \param busyTimeout Milliseconds to wait for locks before failing with SQLITE_BUSY.
+  \retval bool True on success.
+*/
+{
+    if(writer)
+        Close();
+    if(readerCount<1)
+        readerCount = 1;
+
+    writer = new DdbSqlite();
+    if(!writer->Connect(file, SQLITE_OPEN_READWRITE|SQLITE_OPEN_CREATE|SQLITE_OPEN_URI|SQLITE_OPEN_NOMUTEX))
+        goto POOL_OPEN_ERROR;
+    writer->SetBusyTimeout(busyTimeout);
+    if(!writer->UpdateStructure("PRAGMA journal_mode=WAL"))
+        goto POOL_OPEN_ERROR;
+
+    for(int ndx=0; ndx<readerCount; ndx++) {
+        DdbSqlite *reader = new DdbSqlite();
+        readers.push_back(reader);
+        if(!reader->Connect(file, SQLITE_OPEN_READONLY|SQLITE_OPEN_URI|SQLITE_OPEN_NOMUTEX))
+            goto POOL_OPEN_ERROR;
+        reader->SetBusyTimeout(busyTimeout);
+        idle.push_back(reader);
+    }
+    errorId = 0;
+    return true;
+
+ POOL_OPEN_ERROR:
+    CS_VAPRT_ERRO("DdbSqlitePool::Open - unable to open %s", file);
+    errorId = 4;
+    Close();
+    return false;
+}
+
+// ==================================================================================================
+void DdbSqlitePool::Close()
+/*!
+  Closes all connections. Caller must make sure that no other thread uses the pool.
+*/
+{
+    for(std::vector<DdbSqlite*>::iterator it=readers.begin(); it!=readers.end(); it++)
+        delete *it;
+    readers.clear();
+    idle.clear();
+    if(writer) {
+        delete writer;
+        writer = 0;
+    }
+}
+
+// ==================================================================================================
+DdbSqlite* DdbSqlitePool::AcquireReader()
+/*!
+  Reserves an idle read-only connection for the calling thread. Waits if all readers are busy.
+  \retval DdbSqlite* Reader connection. Null if the pool is not open.
+*/
+{
+    std::unique_lock<std::mutex> lock(readMutex);
+    if(readers.empty()) {
+        errorId = 24;
+        return 0;
+    }
+    while(idle.empty())
+        readCond.wait(lock);
+    DdbSqlite *reader = idle.back();
+    idle.pop_back();
+    return reader;
+}
+
+// ==================================================================================================
+void DdbSqlitePool::ReleaseReader(DdbSqlite *reader)
+{
+    if(!reader)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(readMutex);
+        idle.push_back(reader);
+    }
+    readCond.notify_one();
+}
+
+// ==================================================================================================
+DdbSqlite* DdbSqlitePool::LockWriter()
+/*!
+  Gives the calling thread exclusive use of the writer connection, e.g. for an explicit
+  multi-statement transaction. Queued ExecuteModify calls wait until UnlockWriter is called.
+  \retval DdbSqlite* Writer connection. Null if the pool is not open.
+*/
+{
+    std::unique_lock<std::mutex> lock(writeMutex);
+    if(!writer) {
+        errorId = 24;
+        return 0;
+    }
+    while(writerBusy)
+        writeCond.wait(lock);
+    writerBusy = true;
+    return writer;
+}
+
+// ==================================================================================================
+void DdbSqlitePool::UnlockWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        writerBusy = false;
+    }
+    writeCond.notify_all();
+}
+
+// ==================================================================================================
+int DdbSqlitePool::ExecuteModify(const DDBSTR &query)
+/*!
+  Queues the modification for the writer and waits until it has been committed. If the writer
+  is idle the calling thread commits everything that is currently queued in one transaction.
+  \retval int Number of rows modified. -1 on error.
+*/
+{
+    if(!writer) {
+        errorId = 24;
+        return -1;
+    }
+    WriteRequest req;
+    req.query = &query;
+    req.result = -1;
+    req.done = false;
+
+    std::unique_lock<std::mutex> lock(writeMutex);
+    writeQueue.push_back(&req);
+    while(!req.done) {
+        if(writerBusy) {
+            writeCond.wait(lock);
+            continue;
+        }
+        // Become the batch leader.
+        writerBusy = true;
+        std::vector<WriteRequest*> batch;
+        while(!writeQueue.empty() && batch.size()<groupMax) {
+            batch.push_back(writeQueue.front());
+            writeQueue.pop_front();
+        }
+        lock.unlock();
+        ExecuteBatch(batch);
+        lock.lock();
+        for(std::vector<WriteRequest*>::iterator it=batch.begin(); it!=batch.end(); it++)
+            (*it)->done = true;
+        writerBusy = false;
+        writeCond.notify_all();
+    }
+    return req.result;
+}
+
+// ==================================================================================================
+void DdbSqlitePool::ExecuteBatch(std::vector<WriteRequest*> &batch)
+/*!
+  Executes the batch in one transaction. Called by the batch leader without holding the queue
+  mutex. If SQLite aborts the whole transaction (e.g. disk full) the statements that were
+  already executed are reported as failed and the rest continue in a new transaction.
+*/
+{
+    size_t first = 0;
+    if(batch.size()==1) {
+        batch[0]->result = writer->ExecuteModify(*batch[0]->query);
+        return;
+    }
+    if(!writer->StartTransaction()) {
+        for(size_t ndx=0; ndx<batch.size(); ndx++)
+            batch[ndx]->result = -1;
+        return;
+    }
+    for(size_t ndx=0; ndx<batch.size(); ndx++) {
+        batch[ndx]->result = writer->ExecuteModify(*batch[ndx]->query);
+        if(batch[ndx]->result<0 && sqlite3_get_autocommit(writer->GetSqlConn())) {
+            CS_PRINT_WARN("DdbSqlitePool::ExecuteBatch - transaction aborted by SQLite.");
+            writer->RollBack();
+            for(size_t fail=first; fail<ndx; fail++)
+                batch[fail]->result = -1;
+            first = ndx+1;
+            if(!writer->StartTransaction()) {
+                for(size_t rest=first; rest<batch.size(); rest++)
+                    batch[rest]->result = -1;
+                return;
+            }
+        }
+    }
+    if(!writer->Commit()) {
+        CS_PRINT_ERRO("DdbSqlitePool::ExecuteBatch - group commit failed.");
+        if(writer->IsTransaction())
+            writer->RollBack();
+        for(size_t fail=first; fail<batch.size(); fail++)
+            batch[fail]->result = -1;
+    }
+}
+
+// ==================================================================================================
+bool DdbSqlitePool::UpdateStructure(const DDBSTR &command)
+{
+    DdbSqlite *wr = LockWriter();
+    if(!wr)
+        return false;
+    bool rv = wr->UpdateStructure(command);
+    UnlockWriter();
+    return rv;
+}
+
+// ==================================================================================================
+bool DdbSqlitePool::ExecuteIntFunction(const DDBSTR &query, uint32_t &val)
+{
+    DdbSqliteReader rd(*this);
+    return rd.Get() ? rd->ExecuteIntFunction(query,val) : false;
+}
+
+// ==================================================================================================
+bool DdbSqlitePool::ExecuteLongFunction(const DDBSTR &query, uint64_t &val)
+{
+    DdbSqliteReader rd(*this);
+    return rd.Get() ? rd->ExecuteLongFunction(query,val) : false;
+}
+
+// ==================================================================================================
+bool DdbSqlitePool::ExecuteDoubleFunction(const DDBSTR &query, double &val)
+{
+    DdbSqliteReader rd(*this);
+    return rd.Get() ? rd->ExecuteDoubleFunction(query,val) : false;
+}
+
+// ==================================================================================================
+bool DdbSqlitePool::ExecuteBoolFunction(const DDBSTR &query, bool &val)
+{
+    DdbSqliteReader rd(*this);
+    return rd.Get() ? rd->ExecuteBoolFunction(query,val) : false;
+}
+
+// ==================================================================================================
+bool DdbSqlitePool::ExecuteStrFunction(const DDBSTR &query, DDBSTR &result)
+{
+    DdbSqliteReader rd(*this);
+    return rd.Get() ? rd->ExecuteStrFunction(query,result) : false;
+}
+
+// ==================================================================================================
+int DdbSqlitePool::Export(const DDBSTR &query, DdbExportWriter &out)
+{
+    DdbSqliteReader rd(*this);
+    return rd.Get() ? rd->Export(query,out) : -1;
+}
+
+// ==================================================================================================
+bool DdbSqlitePool::ExecuteDateFunction(const DDBSTR &query, DDBTIME &val)
+{
+    DdbSqliteReader rd(*this);
+    return rd.Get() ? rd->ExecuteDateFunction(query,val) : false;
+}
@@ -0,0 +1,122 @@
+/*! \file ddbsqlitepool.hpp
+ * \brief Concurrent SQLite access with N read-only connections and one writer. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#ifndef DDB_SQLITEPOOL_H_FILE
+#define DDB_SQLITEPOOL_H_FILE
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "directdatabase.hpp"
+#include "ddbsqlite.hpp"
+
+// ==================================================================================================
+//! Thread safe access layer for one SQLite database file.
+/*! The database is switched into WAL journal mode so that readers do not block the writer and
+    vice versa. Pool owns one read-write connection and a number of read-only connections.
+
+    Reads are dispatched to an idle reader connection. If all readers are busy the caller waits
+    until one is released. Use DdbSqliteReader to hold a reader for a rowset query.
+
+    Writes are serialized through the writer connection. ExecuteModify calls arriving while the
+    writer is busy are queued. The thread that finds the writer idle becomes the batch leader:
+    it executes all queued statements within one transaction and commits them together (group
+    commit). This way one fsync is shared by all statements in the batch. Statements of the
+    batch are not isolated from each other. A statement that fails with an ordinary error,
+    e.g. a constraint violation, is undone alone and the rest of the batch is committed. If
+    SQLite aborts the whole transaction (e.g. disk full or I/O error), the statements executed
+    before it in the batch are rolled back and return -1 as well; the statements after it
+    continue in a new transaction. If the group commit fails every statement of that
+    transaction returns -1.
+
+    DdbSqlite objects handed out by the pool must not be deleted or disconnected by the caller.
+ */
+class DdbSqlitePool
+{
+public:
+    DdbSqlitePool();
+    ~DdbSqlitePool();
+
+    bool Open(const char *file, int readerCount, int busyTimeout=5000);
+    void Close();
+    bool IsOpen() { return writer!=0; }
+    int GetReaderCount() { return (int)readers.size(); }
+    //! Returns the latest error code. Zero on success.
+    int GetErrorID() { return errorId; }
+
+    DdbSqlite* AcquireReader();
+    void ReleaseReader(DdbSqlite *reader);
+    DdbSqlite* LockWriter();
+    void UnlockWriter();
+    //! Sets the maximum number of statements committed in one group. Default is 256.
+    void SetGroupCommitMax(size_t max) { groupMax = max>0 ? max : 1; }
+
+    // Reads. These are executed by an idle reader connection.
+    bool ExecuteIntFunction(const DDBSTR &query,uint32_t &val);
+    bool ExecuteLongFunction(const DDBSTR &query,uint64_t &val);
+    bool ExecuteDoubleFunction(const DDBSTR &query, double &val);
+    bool ExecuteBoolFunction(const DDBSTR &query, bool &val);
+    bool ExecuteStrFunction(const DDBSTR &query, DDBSTR &result);
+    bool ExecuteDateFunction(const DDBSTR &query, DDBTIME &val);
+
+    // Writes. These are serialized through the writer connection.
+    int ExecuteModify(const DDBSTR &query);
+    bool UpdateStructure(const DDBSTR &command);
+    int Export(const DDBSTR &query, DdbExportWriter &out);
+
+protected:
+    //! One queued ExecuteModify call.
+    struct WriteRequest {
+        const DDBSTR *query;    //!< Statement to execute.
+        int result;             //!< ExecuteModify result.
+        bool done;              //!< True once the batch containing this request is committed.
+    };
+    void ExecuteBatch(std::vector<WriteRequest*> &batch);
+
+    DdbSqlite *writer;                      //!< The only read-write connection.
+    std::vector<DdbSqlite*> readers;        //!< All read-only connections.
+    std::vector<DdbSqlite*> idle;           //!< Read-only connections currently available.
+    std::mutex readMutex;
+    std::condition_variable readCond;
+
+    std::deque<WriteRequest*> writeQueue;   //!< Modifications waiting for the writer.
+    bool writerBusy;                        //!< True while a batch leader or LockWriter owns the writer.
+    size_t groupMax;                        //!< Maximum number of statements in one commit.
+    std::mutex writeMutex;
+    std::condition_variable writeCond;
+    std::atomic<int> errorId;               //!< Written by any thread without the mutexes.
+};
+
+// ==================================================================================================
+//! Holds a reader connection from the pool for the life time of the object.
+/*! Create rowsets from the connection while the reader is held:
+    \code
+    DdbSqliteReader rd(pool);
+    DdbRowSet *rs = rd->CreateRowSet();
+    ...
+    delete rs;
+    \endcode
+    Rowsets must be deleted before the reader is released.
+ */
+class DdbSqliteReader
+{
+public:
+    DdbSqliteReader(DdbSqlitePool &p) : pool(p) { reader = pool.AcquireReader(); }
+    ~DdbSqliteReader() { if(reader) pool.ReleaseReader(reader); }
+
+    DdbSqlite* Get() { return reader; }
+    DdbSqlite* operator->() { return reader; }
+
+protected:
+    DdbSqliteReader(const DdbSqliteReader &);
+    void operator=(const DdbSqliteReader &);
+
+    DdbSqlitePool &pool;
+    DdbSqlite *reader;
+};
+
+#endif
@@ -0,0 +1,495 @@
+/*! \file ddbsqliters.cpp
+ * \brief SQLite implementation of the DdbRowSet interface. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#if defined(DDB_USEWX)
+  #include <wx/wxprec.h>
+  #ifndef WX_PRECOMP
+    #include <wx/wx.h>
+  #endif
+#endif
+#include "pch-stop.h"
+
+#if defined(DDB_USEWX)
+  #include "wx/datetime.h"
+#endif
+#ifdef __linux
+  #include <string.h>
+#endif
+#include <stdlib.h>
+#include <ctype.h>
+#include <new>
+#include <cpp4scripts.hpp>
+#define __DDB_SQLITE__
+#include "directdatabase.hpp"
+#include "ddbarena.hpp"
+
+// ==================================================================================================
+DdbSqliteRowSet::DdbSqliteRowSet(DirectDatabase *db_in)
+    :DdbRowSet()
+/*!
+    Initializes member variables to default values.
+    \param db_in Pointer to database object.
+*/
+{
+    stmt = 0;
+    maxFields = 0;
+    currentRow = 0;
+    db = (DdbSqlite*) db_in;
+}
+
+// ==================================================================================================
+DdbSqliteRowSet::~DdbSqliteRowSet()
+/*!
+    Finalizes the pending statement if it still exists.
+*/
+{
+    if(stmt)
+        sqlite3_finalize(stmt);
+}
+
+// ==================================================================================================
+bool DdbSqliteRowSet::Query(const DDBSTR &query)
+/*!
+  Prepares the query and steps it to the first row. SQLite produces rows one at a time so
+  the result is not buffered on the client side.
+*/
+{
+    if(!fieldRoot && !autoDescribe) {
+        CS_PRINT_NOTE("DdbSqliteRowSet::Query - Query called without binding variables.");
+        db->SetErrorId(9);
+        return  false;
+    }
+    if(query.LENGTH()==0) {
+        CS_PRINT_WARN("DdbSqliteRowSet::Query - Empty query string. Aborted.");
+        return false;
+    }
+    queryStmt = query;
+    QuitQuery();
+
+    sqlite3 *conn = db->GetSqlConn();
+    if(sqlite3_prepare_v2(conn, queryStmt.UTF8(), -1, &stmt, 0) != SQLITE_OK)
+    {
+        CS_VAPRT_ERRO("DdbSqliteRowSet::Query failed: %s", sqlite3_errmsg(conn));
+        db->SetErrorId(8);
+        stmt = 0;
+        return false;
+    }
+    int rc = sqlite3_step(stmt);
+    if(autoDescribe)
+        Describe(rc == SQLITE_ROW);
+    if(rc != SQLITE_ROW)
+    {
+        sqlite3_finalize(stmt);
+        stmt = 0;
+        if(rc != SQLITE_DONE)
+        {
+            CS_VAPRT_ERRO("DdbSqliteRowSet::Query failed: %s", sqlite3_errmsg(conn));
+            db->SetErrorId(8);
+            return false;
+        }
+        return true; // Empty result.
+    }
+    maxFields = sqlite3_column_count(stmt);
+    currentRow = 0;
+    if(!autoDescribe && CountFields() != maxFields)
+        CS_VAPRT_WARN("DdbSqliteRowSet::Query - %d variables bound for %d columns: %.200s",
+                      CountFields(), maxFields, queryStmt.UTF8());
+    return true;
+}
+
+// ==================================================================================================
+void DdbSqliteRowSet::Describe(bool hasRow)
+/*!
+  Describes the columns of the statement and binds them. The type is derived from the declared
+  column type with the SQLite affinity rules. Expressions have no declared type; the storage
+  class of the value in the first row is used for them.
+  \param hasRow True if the statement is positioned on the first row.
+*/
+{
+    int count = sqlite3_column_count(stmt);
+    columns.resize(count);
+    for(int col=0; col<count; col++) {
+        DdbColumn &column = columns[col];
+        const char *name = sqlite3_column_name(stmt, col);
+        column.name = name ? name : "";
+        column.dbType = hasRow ? sqlite3_column_type(stmt, col) : SQLITE_NULL;
+        const char *declared = sqlite3_column_decltype(stmt, col);
+        // DDB_TYPE_USED
+        if(declared) {
+            std::string decl(declared);
+            for(size_t ndx=0; ndx<decl.length(); ndx++)
+                decl[ndx] = toupper((unsigned char)decl[ndx]);
+            if(decl.find("BOOL") != std::string::npos)
+                column.type = DDBT_BOOL;
+            else if(decl.find("DATETIME") != std::string::npos || decl.find("TIMESTAMP") != std::string::npos)
+                column.type = DDBT_TIME;
+            else if(decl.find("DATE") != std::string::npos)
+                column.type = DDBT_DAY;
+            else if(decl.find("UUID") != std::string::npos || decl.find("GUID") != std::string::npos)
+                column.type = DDBT_UUID;
+            else if(decl.find("BIGINT") != std::string::npos || decl.find("INT8") != std::string::npos)
+                column.type = DDBT_LONG;
+            else if(decl.find("INT") != std::string::npos)
+                column.type = DDBT_INT;
+            else if(decl.find("BLOB") != std::string::npos)
+                column.type = DDBT_BLOB;
+            else if(decl.find("CHAR") != std::string::npos || decl.find("CLOB") != std::string::npos
+                    || decl.find("TEXT") != std::string::npos)
+                column.type = DDBT_STR;
+            else if(decl.find("DEC") != std::string::npos || decl.find("NUMERIC") != std::string::npos)
+                column.type = DDBT_DEC;
+            else if(decl.find("REAL") != std::string::npos || decl.find("FLOA") != std::string::npos
+                    || decl.find("DOUB") != std::string::npos || decl.find("NUM") != std::string::npos)
+                column.type = DDBT_NUM;
+            else
+                column.type = DDBT_STR;
+        }
+        else if(column.dbType == SQLITE_INTEGER)
+            column.type = DDBT_LONG;
+        else if(column.dbType == SQLITE_FLOAT)
+            column.type = DDBT_NUM;
+        else if(column.dbType == SQLITE_BLOB)
+            column.type = DDBT_BLOB;
+        else
+            column.type = DDBT_STR;
+    }
+    BindColumns();
+}
+
+// ==================================================================================================
+int DdbSqliteRowSet::GetNext()
+{
+    int nField,count;
+    DdbBoundField *field;
+    const char *resultStr;
+
+    if(!stmt)
+        return 0;
+
+    bool trim = db->IsFeatureOn(DDB_FEATURE_AUTOTRIM);
+    field = fieldRoot;
+    nField = 0;
+    count = 0;
+    while(field && nField < maxFields)
+    {
+        bool isNull = sqlite3_column_type(stmt, nField) == SQLITE_NULL;
+        field->null = isNull;
+        // Use type to convert the data. DDB_TYPE_USED
+        switch(field->type)
+        {
+        case DDBT_INT:
+            if(isNull)
+                *(static_cast<int*>(field->data)) = 0;
+            else
+            {
+                *(static_cast<int*>(field->data)) = sqlite3_column_int(stmt, nField);
+                count++;
+            }
+            break;
+        case DDBT_STR:
+            if(isNull)
+                static_cast<DDBSTR*>(field->data)->CLEAR();
+            else
+            {
+                resultStr = (const char*) sqlite3_column_text(stmt, nField);
+#ifdef DDB_USESTL
+                static_cast<std::string*>(field->data)->assign(resultStr, sqlite3_column_bytes(stmt, nField));
+                if(trim)
+                    DirectDatabase::TrimTail(static_cast<std::string*>(field->data));
+#else
+                *(static_cast<wxString*>(field->data)) = wxString::FromUTF8Unchecked(resultStr);
+                if(trim)
+                    static_cast<wxString*>(field->data)->Trim();
+#endif
+                count++;
+            }
+            break;
+        case DDBT_BOOL:
+            if(isNull)
+                *(static_cast<bool*>(field->data)) = false;
+            else
+            {
+                if(sqlite3_column_type(stmt, nField) == SQLITE_TEXT) {
+                    resultStr = (const char*) sqlite3_column_text(stmt, nField);
+                    *(static_cast<bool*>(field->data)) = resultStr[0] && strchr("tTyY1", resultStr[0]) ? true:false;
+                }
+                else
+                    *(static_cast<bool*>(field->data)) = sqlite3_column_int64(stmt, nField) != 0;
+                count++;
+            }
+            break;
+
+        case DDBT_TIME:
+        case DDBT_DAY:
+#ifdef DDB_USESTL
+            if(isNull)
+                memset(field->data,0,sizeof(tm));
+            else {
+                DdbSqlite::ExtractTimestamp((const char*)sqlite3_column_text(stmt, nField),(tm*)field->data);
+                count++;
+            }
+#else
+            if(isNull)
+                *(static_cast<wxDateTime*>(field->data)) = wxInvalidDateTime;
+            else {
+                tm tmData;
+                if(DdbSqlite::ExtractTimestamp((const char*)sqlite3_column_text(stmt, nField),&tmData))
+                    static_cast<wxDateTime*>(field->data)->Set(tmData);
+                count++;
+            }
+#endif
+            break;
+
+        case DDBT_NUM:
+            if(isNull)
+                *(static_cast<double*>(field->data)) = 0;
+            else
+            {
+                *(static_cast<double*>(field->data)) = sqlite3_column_double(stmt, nField);
+                count++;
+            }
+            break;
+        case DDBT_CHR:
+            resultStr = isNull ? "" : (const char*) sqlite3_column_text(stmt, nField);
+#ifdef DDB_USESTL
+            *(static_cast<char*>(field->data)) = resultStr[0];
+#else
+            *(static_cast<wxUniChar*>(field->data)) = resultStr[0];
+#endif
+            count++;
+            break;
+        case DDBT_LONG:
+            if(isNull)
+                *(static_cast<int64_t*>(field->data)) = 0;
+            else
+            {
+                *(static_cast<int64_t*>(field->data)) = sqlite3_column_int64(stmt, nField);
+                count++;
+            }
+            break;
+        case DDBT_DEC:
+            if(isNull)
+                static_cast<DdbDecimal*>(field->data)->Clear();
+            else
+            {
+                if(!ReadDecimal(nField, static_cast<DdbDecimal*>(field->data)))
+                    CS_VAPRT_WARN("DdbSqliteRowSet::GetNext - Decimal parse failed for %.60s",
+                                  (const char*)sqlite3_column_text(stmt, nField));
+                count++;
+            }
+            break;
+        case DDBT_UUID:
+            if(isNull)
+                static_cast<DdbUuid*>(field->data)->Clear();
+            else
+            {
+                if(!ReadUuid(nField, static_cast<DdbUuid*>(field->data)))
+                    CS_PRINT_WARN("DdbSqliteRowSet::GetNext - Value is not a UUID.");
+                count++;
+            }
+            break;
+        case DDBT_BLOB:
+            if(isNull)
+                static_cast<DdbBlob*>(field->data)->clear();
+            else
+            {
+                const uint8_t *bytes = (const uint8_t*) sqlite3_column_blob(stmt, nField);
+                static_cast<DdbBlob*>(field->data)->assign(bytes, bytes + sqlite3_column_bytes(stmt, nField));
+                count++;
+            }
+            break;
+        }
+
+        field = field->next;
+        nField++;
+    }
+    currentRow++;
+
+    // Advance to the next row. Finalize once the result has been read to the end.
+    int rc = sqlite3_step(stmt);
+    if(rc != SQLITE_ROW)
+    {
+        if(rc != SQLITE_DONE)
+        {
+            CS_VAPRT_ERRO("DdbSqliteRowSet::GetNext failed: %s", sqlite3_errmsg(db->GetSqlConn()));
+            db->SetErrorId(20);
+        }
+        sqlite3_finalize(stmt);
+        stmt = 0;
+    }
+    return count;
+}
+
+// ==================================================================================================
+bool DdbSqliteRowSet::ReadDecimal(int col, DdbDecimal *dec)
+/*!
+  Reads a decimal value. Integers are taken as they are. Text and real values are parsed from
+  the text; SQLite prints the reals with 15 significant digits.
+  \retval bool False if the value is not a number or it does not fit.
+*/
+{
+    if(sqlite3_column_type(stmt, col) == SQLITE_INTEGER) {
+        dec->value = sqlite3_column_int64(stmt, col);
+        dec->scale = 0;
+        return true;
+    }
+    const char *text = (const char*) sqlite3_column_text(stmt, col);
+    return dec->Parse(text, sqlite3_column_bytes(stmt, col));
+}
+
+// ==================================================================================================
+bool DdbSqliteRowSet::ReadUuid(int col, DdbUuid *uuid)
+/*!
+  Reads a UUID stored either as a 16 byte blob or as text.
+  \retval bool False if the value is not a UUID.
+*/
+{
+    if(sqlite3_column_type(stmt, col) == SQLITE_BLOB) {
+        if(sqlite3_column_bytes(stmt, col) != sizeof(uuid->bytes)) {
+            uuid->Clear();
+            return false;
+        }
+        memcpy(uuid->bytes, sqlite3_column_blob(stmt, col), sizeof(uuid->bytes));
+        return true;
+    }
+    const char *text = (const char*) sqlite3_column_text(stmt, col);
+    return uuid->Parse(text, sqlite3_column_bytes(stmt, col));
+}
+
+// ==================================================================================================
+void DdbSqliteRowSet::QuitQuery()
+{
+    if(!stmt)
+        return;
+    sqlite3_finalize(stmt);
+    stmt = 0;
+    maxFields = 0;
+    currentRow = 0;
+}
+
+// ==================================================================================================
+int DdbSqliteRowSet::Materialize(const DDBSTR &query, DdbResultRows &rows)
+/*!
+  Executes the query and copies the column values directly into the arena without going
+  through the bound variables. Null values are flagged. In the auto-describe mode the columns
+  are described by the query before the layout is set up.
+  \retval int Number of rows read or -1 on error.
+*/
+{
+    if(!Query(query))
+        return -1;
+    if(!SetupRows(rows)) {
+        QuitQuery();
+        db->SetErrorId(9);
+        return -1;
+    }
+    bool trim = db->IsFeatureOn(DDB_FEATURE_AUTOTRIM);
+    int cols = rows.GetColumnCount();
+    if(cols > maxFields)
+        cols = maxFields;
+    DdbArena *arena = rows.GetArena();
+    while(stmt)
+    {
+        char *row = rows.AddRow();
+        if(!row)
+        {
+            QuitQuery();
+            return -1;
+        }
+        for(int col=0; col<cols; col++)
+        {
+            int ctype = sqlite3_column_type(stmt, col);
+            if(ctype == SQLITE_NULL)
+            {
+                *rows.NullFlag(row,col) = 1;
+#ifndef DDB_USESTL
+                if(rows.GetType(col) == DDBT_TIME || rows.GetType(col) == DDBT_DAY)
+                    new(rows.Slot(row,col)) wxDateTime(wxInvalidDateTime);
+#endif
+                continue;
+            }
+            char *slot = rows.Slot(row,col);
+            const char *value;
+            // DDB_TYPE_USED
+            switch(rows.GetType(col))
+            {
+            case DDBT_INT:
+                *(int*)slot = sqlite3_column_int(stmt, col);
+                break;
+            case DDBT_STR: {
+                value = (const char*) sqlite3_column_text(stmt, col);
+                size_t len = sqlite3_column_bytes(stmt, col);
+                while(trim && len>0 && value[len-1]==' ')
+                    len--;
+                ((DdbStrRef*)slot)->ptr = arena->Copy(value, len);
+                ((DdbStrRef*)slot)->len = len;
+                break;
+            }
+            case DDBT_BOOL:
+                if(ctype == SQLITE_TEXT) {
+                    value = (const char*) sqlite3_column_text(stmt, col);
+                    *(bool*)slot = value[0] && strchr("tTyY1", value[0]);
+                }
+                else
+                    *(bool*)slot = sqlite3_column_int64(stmt, col) != 0;
+                break;
+            case DDBT_TIME:
+            case DDBT_DAY:
+#ifdef DDB_USESTL
+                DdbSqlite::ExtractTimestamp((const char*)sqlite3_column_text(stmt, col),(tm*)slot);
+#else
+                {
+                    tm tmData;
+                    if(DdbSqlite::ExtractTimestamp((const char*)sqlite3_column_text(stmt, col),&tmData))
+                        new(slot) wxDateTime(tmData);
+                    else
+                        new(slot) wxDateTime(wxInvalidDateTime);
+                }
+#endif
+                break;
+            case DDBT_NUM:
+                *(double*)slot = sqlite3_column_double(stmt, col);
+                break;
+            case DDBT_CHR:
+                value = (const char*) sqlite3_column_text(stmt, col);
+#ifdef DDB_USESTL
+                *(char*)slot = value[0];
+#else
+                *(wxUniChar*)slot = value[0];
+#endif
+                break;
+            case DDBT_LONG:
+                *(int64_t*)slot = sqlite3_column_int64(stmt, col);
+                break;
+            case DDBT_DEC:
+                ReadDecimal(col, (DdbDecimal*)slot);
+                break;
+            case DDBT_UUID:
+                ReadUuid(col, (DdbUuid*)slot);
+                break;
+            case DDBT_BLOB: {
+                value = (const char*) sqlite3_column_blob(stmt, col);
+                size_t len = sqlite3_column_bytes(stmt, col);
+                ((DdbStrRef*)slot)->ptr = arena->Copy(value, len);
+                ((DdbStrRef*)slot)->len = len;
+                break;
+            }
+            }
+        }
+        int rc = sqlite3_step(stmt);
+        if(rc != SQLITE_ROW)
+        {
+            if(rc != SQLITE_DONE)
+            {
+                CS_VAPRT_ERRO("DdbSqliteRowSet::Materialize failed: %s", sqlite3_errmsg(db->GetSqlConn()));
+                db->SetErrorId(20);
+                QuitQuery();
+                return -1;
+            }
+            QuitQuery();
+        }
+    }
+    return rows.GetRowCount();
+}
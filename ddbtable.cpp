@@ -0,0 +1,685 @@
+/*! \file ddbtable.cpp
+ * \brief Columnar in-memory result table with filter, sort, group and aggregate primitives. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#include "pch-stop.h"
+#include <algorithm>
+#include <unordered_map>
+#include <cpp4scripts.hpp>
+#include "ddbtable.hpp"
+
+// ==================================================================================================
+//  Filter loops. Each loop writes every index into the output and advances the output position
+//  only for the matching rows. This keeps the loop free of branches.
+// ==================================================================================================
+//! Index source that runs through all rows.
+struct DdbAllRows {
+    uint32_t operator()(uint32_t k) const { return k; }
+};
+//! Index source that runs through a selection.
+struct DdbSelRows {
+    const uint32_t *sel;
+    uint32_t operator()(uint32_t k) const { return sel[k]; }
+};
+
+static inline uint32_t NotNull(const uint64_t *nulls, uint32_t row)
+{
+    return (uint32_t)(~(nulls[row>>6] >> (row&63)) & 1);
+}
+
+#define DDB_FILTER_LOOP(cond)                                       \
+    for(uint32_t k=0; k<count; k++) {                               \
+        uint32_t row = idx(k);                                      \
+        out[n] = row;                                               \
+        n += (uint32_t)(data[row] cond value) & NotNull(nulls,row); \
+    }                                                               \
+    break;
+
+template<class T, class V, class I>
+static uint32_t FilterLoop(const T *data, const uint64_t *nulls, uint32_t count, int op, V value,
+                           I idx, uint32_t *out)
+{
+    uint32_t n = 0;
+    switch(op) {
+    case DDB_CMP_EQ: DDB_FILTER_LOOP(==)
+    case DDB_CMP_NE: DDB_FILTER_LOOP(!=)
+    case DDB_CMP_LT: DDB_FILTER_LOOP(<)
+    case DDB_CMP_LE: DDB_FILTER_LOOP(<=)
+    case DDB_CMP_GT: DDB_FILTER_LOOP(>)
+    case DDB_CMP_GE: DDB_FILTER_LOOP(>=)
+    }
+    return n;
+}
+
+template<class T, class V>
+static int Filter(const std::vector<T> &data, const std::vector<uint64_t> &nulls, uint32_t rows,
+                  int op, V value, DdbSelection &sel, bool refine)
+{
+    uint32_t n;
+    if(refine) {
+        // Output never runs ahead of the input so the selection is filtered in place.
+        DdbSelRows idx;
+        idx.sel = sel.data();
+        n = FilterLoop(data.data(), nulls.data(), (uint32_t)sel.size(), op, value, idx, sel.data());
+    }
+    else {
+        sel.resize(rows);
+        n = FilterLoop(data.data(), nulls.data(), rows, op, value, DdbAllRows(), sel.data());
+    }
+    sel.resize(n);
+    return (int)n;
+}
+
+// ==================================================================================================
+static double Pow10(int scale)
+{
+    double pow = 1;
+    while(scale-- > 0)
+        pow *= 10;
+    return pow;
+}
+
+// ==================================================================================================
+int64_t DdbResultTable::TimeValue(const DDBTIME &value)
+/*!
+  Converts the time into seconds since 1970-01-01 00:00 without time zone conversion.
+*/
+{
+#ifdef DDB_USESTL
+    if(value.tm_year==0 && value.tm_mon==0 && value.tm_mday==0)
+        return 0;
+    // Days from the civil date, proleptic Gregorian calendar.
+    int64_t y = value.tm_year + 1900;
+    int64_t m = value.tm_mon + 1;
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y-399) / 400;
+    int64_t yoe = y - era*400;
+    int64_t doy = (153*(m + (m > 2 ? -3 : 9)) + 2)/5 + value.tm_mday-1;
+    int64_t doe = yoe*365 + yoe/4 - yoe/100 + doy;
+    int64_t days = era*146097 + doe - 719468;
+    return days*86400 + value.tm_hour*3600 + value.tm_min*60 + value.tm_sec;
+#else
+    return value.IsValid() ? (int64_t)value.GetTicks() : 0;
+#endif
+}
+
+// ==================================================================================================
+void DdbResultTable::Clear()
+{
+    columns.clear();
+    rowCount = 0;
+}
+
+// ==================================================================================================
+bool DdbResultTable::Load(DdbResultRows &rows)
+/*!
+  Converts the materialized rows into columns. Previous content is cleared.
+  \retval bool False if a column is of type DDBT_UUID or DDBT_BLOB, which are not supported,
+    or if the decimals of a column do not fit in 18 digits with a common scale.
+*/
+{
+    Clear();
+    for(int col=0; col<rows.GetColumnCount(); col++) {
+        if(rows.GetType(col) == DDBT_UUID || rows.GetType(col) == DDBT_BLOB) {
+            CS_VAPRT_ERRO("DdbResultTable::Load - Type of column %d is not supported.",col);
+            return false;
+        }
+    }
+    rowCount = rows.GetRowCount();
+    columns.resize(rows.GetColumnCount());
+    for(int col=0; col<rows.GetColumnCount(); col++) {
+        Column &column = columns[col];
+        column.type = rows.GetType(col);
+        column.scale = 0;
+        column.nulls.assign((rowCount+63)/64, 0);
+        for(uint32_t row=0; row<rowCount; row++) {
+            if(rows.IsNull(row,col))
+                column.nulls[row>>6] |= (uint64_t)1 << (row&63);
+        }
+        // DDB_TYPE_USED
+        switch(column.type) {
+        case DDBT_INT:
+            column.ints.resize(rowCount);
+            for(uint32_t row=0; row<rowCount; row++)
+                column.ints[row] = rows.GetInt(row,col);
+            break;
+        case DDBT_BOOL:
+            column.ints.resize(rowCount);
+            for(uint32_t row=0; row<rowCount; row++)
+                column.ints[row] = rows.GetBool(row,col) ? 1 : 0;
+            break;
+        case DDBT_CHR:
+            column.ints.resize(rowCount);
+            for(uint32_t row=0; row<rowCount; row++)
+                column.ints[row] = (int32_t)rows.GetChar(row,col);
+            break;
+        case DDBT_NUM:
+            column.nums.resize(rowCount);
+            for(uint32_t row=0; row<rowCount; row++)
+                column.nums[row] = rows.GetDouble(row,col);
+            break;
+        case DDBT_LONG:
+            column.longs.resize(rowCount);
+            for(uint32_t row=0; row<rowCount; row++)
+                column.longs[row] = rows.GetLong(row,col);
+            break;
+        case DDBT_DEC:
+            // All values of the column get the largest scale so that they compare as integers.
+            for(uint32_t row=0; row<rowCount; row++) {
+                if(!rows.IsNull(row,col) && rows.GetDecimal(row,col).scale > column.scale)
+                    column.scale = rows.GetDecimal(row,col).scale;
+            }
+            column.longs.resize(rowCount);
+            for(uint32_t row=0; row<rowCount; row++) {
+                if(rows.IsNull(row,col)) {
+                    column.longs[row] = 0;
+                    continue;
+                }
+                DdbDecimal dec = rows.GetDecimal(row,col);
+                if(!dec.Rescale(column.scale)) {
+                    CS_VAPRT_ERRO("DdbResultTable::Load - Decimal of row %u in column %d does not fit with scale %d.",
+                                  row, col, column.scale);
+                    Clear();
+                    return false;
+                }
+                column.longs[row] = dec.value;
+            }
+            break;
+        case DDBT_TIME:
+        case DDBT_DAY:
+            column.longs.resize(rowCount);
+            for(uint32_t row=0; row<rowCount; row++)
+                column.longs[row] = rows.IsNull(row,col) ? 0 : TimeValue(rows.GetTime(row,col));
+            break;
+        case DDBT_STR: {
+            std::unordered_map<std::string,int32_t> codes;
+            std::string key;
+            column.ints.resize(rowCount);
+            for(uint32_t row=0; row<rowCount; row++) {
+                const DdbStrRef &str = rows.GetStr(row,col);
+                if(str.IsNull()) {
+                    column.ints[row] = 0;
+                    continue;
+                }
+                key.assign(str.ptr, str.len);
+                std::unordered_map<std::string,int32_t>::iterator it = codes.find(key);
+                if(it == codes.end()) {
+                    it = codes.insert(std::make_pair(key, (int32_t)column.dict.size())).first;
+                    column.dict.push_back(key);
+                }
+                column.ints[row] = it->second;
+            }
+            // Null rows use code zero. Make sure it exists.
+            if(column.dict.empty())
+                column.dict.push_back(std::string());
+            std::vector<int32_t> order(column.dict.size());
+            for(size_t ndx=0; ndx<order.size(); ndx++)
+                order[ndx] = (int32_t)ndx;
+            const std::vector<std::string> &dict = column.dict;
+            std::sort(order.begin(), order.end(), [&dict](int32_t a, int32_t b) { return dict[a] < dict[b]; });
+            column.rank.resize(order.size());
+            for(size_t ndx=0; ndx<order.size(); ndx++)
+                column.rank[order[ndx]] = (int32_t)ndx;
+            break;
+        }
+        }
+    }
+    return true;
+}
+
+// ==================================================================================================
+int DdbResultTable::Load(DdbRowSet *rs, const DDBSTR &query)
+/*!
+  Materializes the query with the rowset and loads the result. Rowset should have the result
+  columns bound.
+  \retval int Number of rows or -1 on error.
+*/
+{
+    DdbResultRows rows;
+    if(rs->Materialize(query, rows) < 0) {
+        Clear();
+        return -1;
+    }
+    if(!Load(rows))
+        return -1;
+    return (int)rowCount;
+}
+
+// ==================================================================================================
+bool DdbResultTable::Valid(int col, bool numeric)
+{
+    if(col<0 || col>=(int)columns.size()) {
+        CS_VAPRT_ERRO("DdbResultTable - Column %d does not exist.",col);
+        return false;
+    }
+    if(numeric && columns[col].type==DDBT_STR) {
+        CS_VAPRT_ERRO("DdbResultTable - Column %d is not numeric.",col);
+        return false;
+    }
+    return true;
+}
+
+// ==================================================================================================
+double DdbResultTable::Value(const Column &column, uint32_t row)
+{
+    if(column.type == DDBT_NUM)
+        return column.nums[row];
+    if(column.type == DDBT_DEC)
+        return (double)column.longs[row] / Pow10(column.scale);
+    if(IsLong(column.type))
+        return (double)column.longs[row];
+    return column.ints[row];
+}
+
+// ==================================================================================================
+DdbDecimal DdbResultTable::GetDecimal(uint32_t row, int col)
+/*!
+  Returns the value of a decimal column with the scale of the column.
+*/
+{
+    DdbDecimal dec;
+    dec.value = columns[col].longs[row];
+    dec.scale = columns[col].scale;
+    return dec;
+}
+
+// ==================================================================================================
+int DdbResultTable::FindCode(int col, const char *value)
+/*!
+  \retval int Dictionary code of the string or -1 if the column does not have the value.
+*/
+{
+    const std::vector<std::string> &dict = columns[col].dict;
+    for(size_t ndx=0; ndx<dict.size(); ndx++) {
+        if(dict[ndx] == value)
+            return (int)ndx;
+    }
+    return -1;
+}
+
+// ==================================================================================================
+void DdbResultTable::SelectAll(DdbSelection &sel)
+{
+    sel.resize(rowCount);
+    for(uint32_t row=0; row<rowCount; row++)
+        sel[row] = row;
+}
+
+// ==================================================================================================
+int DdbResultTable::FilterInt(int col, int op, int64_t value, DdbSelection &sel, bool refine)
+/*!
+  Selects the rows whose int, long, decimal, bool, char or time value compares true against the
+  value.
+  \param col Column index.
+  \param op One of DDB_CMP_...
+  \param value Value to compare with. Time columns use seconds since 1970 and decimal columns
+    the unscaled value, i.e. the value times 10^GetScale.
+  \param sel Selection to write. With refine=true the rows already in the selection are filtered.
+  \param refine True to filter the given selection instead of all rows.
+  \retval int Number of selected rows or -1 if the column is not an integer column.
+*/
+{
+    if(!Valid(col,true) || columns[col].type==DDBT_NUM)
+        return -1;
+    Column &column = columns[col];
+    if(IsLong(column.type))
+        return Filter(column.longs, column.nulls, rowCount, op, value, sel, refine);
+    // Compare in 32 bits so that the loop works on the native width. Constant outside the
+    // range matches either all non-null rows or none.
+    if(value > INT32_MAX || value < INT32_MIN) {
+        bool all = op==DDB_CMP_NE;
+        if(op==DDB_CMP_LT || op==DDB_CMP_LE)
+            all = value > INT32_MAX;
+        if(op==DDB_CMP_GT || op==DDB_CMP_GE)
+            all = value < INT32_MIN;
+        if(all)
+            return FilterNull(col, false, sel, refine);
+        sel.clear();
+        return 0;
+    }
+    return Filter(column.ints, column.nulls, rowCount, op, (int32_t)value, sel, refine);
+}
+
+// ==================================================================================================
+int DdbResultTable::FilterDouble(int col, int op, double value, DdbSelection &sel, bool refine)
+/*!
+  Selects the rows whose numeric value compares true against the value.
+  \retval int Number of selected rows or -1 if the column is not a numeric column.
+*/
+{
+    if(!Valid(col,true) || columns[col].type!=DDBT_NUM)
+        return -1;
+    return Filter(columns[col].nums, columns[col].nulls, rowCount, op, value, sel, refine);
+}
+
+// ==================================================================================================
+int DdbResultTable::FilterStr(int col, int op, const char *value, DdbSelection &sel, bool refine)
+/*!
+  Selects the rows whose string compares true against the value. The value is translated
+  once into its dictionary code or rank and the rows are compared as integers.
+  \retval int Number of selected rows or -1 if the column is not a string column.
+*/
+{
+    if(!Valid(col,false) || columns[col].type!=DDBT_STR)
+        return -1;
+    Column &column = columns[col];
+    if(op==DDB_CMP_EQ || op==DDB_CMP_NE) {
+        int code = FindCode(col, value);
+        if(code < 0) {
+            if(op == DDB_CMP_EQ) {
+                sel.clear();
+                return 0;
+            }
+            return FilterNull(col, false, sel, refine);
+        }
+        return Filter(column.ints, column.nulls, rowCount, op, (int32_t)code, sel, refine);
+    }
+    // Ordering: map the codes into ranks and compare the rank against the value position.
+    std::string str(value);
+    std::vector<int32_t> ranks(rowCount);
+    for(uint32_t row=0; row<rowCount; row++)
+        ranks[row] = column.rank[column.ints[row]];
+    int32_t below=0;
+    bool equal = false;
+    for(size_t ndx=0; ndx<column.dict.size(); ndx++) {
+        if(column.dict[ndx] < str)
+            below++;
+        else if(column.dict[ndx] == str)
+            equal = true;
+    }
+    // Values less than str have ranks 0..below-1 and str itself, if present, has rank below.
+    if(!equal) {
+        if(op == DDB_CMP_LE)
+            op = DDB_CMP_LT;
+        else if(op == DDB_CMP_GT)
+            op = DDB_CMP_GE;
+    }
+    return Filter(ranks, column.nulls, rowCount, op, below, sel, refine);
+}
+
+// ==================================================================================================
+int DdbResultTable::FilterNull(int col, bool isNull, DdbSelection &sel, bool refine)
+/*!
+  Selects the null (isNull=true) or non-null rows.
+*/
+{
+    if(!Valid(col,false))
+        return -1;
+    const uint64_t *nulls = columns[col].nulls.data();
+    uint32_t n = 0, want = isNull ? 0 : 1;
+    if(refine) {
+        for(size_t k=0; k<sel.size(); k++) {
+            uint32_t row = sel[k];
+            sel[n] = row;
+            n += NotNull(nulls,row) == want;
+        }
+    }
+    else {
+        sel.resize(rowCount);
+        for(uint32_t row=0; row<rowCount; row++) {
+            sel[n] = row;
+            n += NotNull(nulls,row) == want;
+        }
+    }
+    sel.resize(n);
+    return (int)n;
+}
+
+// ==================================================================================================
+int DdbResultTable::Count(int col, const DdbSelection *sel)
+/*!
+  \retval int Number of non-null values. Negative column counts the rows.
+*/
+{
+    if(col < 0)
+        return sel ? (int)sel->size() : (int)rowCount;
+    if(!Valid(col,false))
+        return 0;
+    const uint64_t *nulls = columns[col].nulls.data();
+    int count = 0;
+    if(sel) {
+        for(size_t k=0; k<sel->size(); k++)
+            count += NotNull(nulls,(*sel)[k]);
+    }
+    else {
+        for(uint32_t row=0; row<rowCount; row++)
+            count += NotNull(nulls,row);
+    }
+    return count;
+}
+
+// ==================================================================================================
+double DdbResultTable::Sum(int col, const DdbSelection *sel)
+/*!
+  Sums the column. Null values are stored as zero so they need no checking.
+*/
+{
+    if(!Valid(col,true))
+        return 0;
+    Column &column = columns[col];
+    if(column.type == DDBT_NUM) {
+        const double *data = column.nums.data();
+        // Four independent accumulators let the additions run in parallel.
+        double acc[4] = { 0, 0, 0, 0 };
+        if(sel) {
+            const uint32_t *rows = sel->data();
+            size_t count = sel->size(), k = 0;
+            for(; k+4<=count; k+=4) {
+                acc[0] += data[rows[k]];
+                acc[1] += data[rows[k+1]];
+                acc[2] += data[rows[k+2]];
+                acc[3] += data[rows[k+3]];
+            }
+            for(; k<count; k++)
+                acc[0] += data[rows[k]];
+        }
+        else {
+            uint32_t row = 0;
+            for(; row+4<=rowCount; row+=4) {
+                acc[0] += data[row];
+                acc[1] += data[row+1];
+                acc[2] += data[row+2];
+                acc[3] += data[row+3];
+            }
+            for(; row<rowCount; row++)
+                acc[0] += data[row];
+        }
+        return (acc[0]+acc[1]) + (acc[2]+acc[3]);
+    }
+    if(IsLong(column.type)) {
+        double sum = 0;
+        if(sel) {
+            for(size_t k=0; k<sel->size(); k++)
+                sum += (double)column.longs[(*sel)[k]];
+        }
+        else {
+            for(uint32_t row=0; row<rowCount; row++)
+                sum += (double)column.longs[row];
+        }
+        return column.type == DDBT_DEC ? sum / Pow10(column.scale) : sum;
+    }
+    const int32_t *data = column.ints.data();
+    int64_t sum = 0;
+    if(sel) {
+        for(size_t k=0; k<sel->size(); k++)
+            sum += data[(*sel)[k]];
+    }
+    else {
+        for(uint32_t row=0; row<rowCount; row++)
+            sum += data[row];
+    }
+    return (double)sum;
+}
+
+// ==================================================================================================
+double DdbResultTable::Min(int col, const DdbSelection *sel)
+/*!
+  \retval double Smallest non-null value. Zero if there are none.
+*/
+{
+    if(!Valid(col,true))
+        return 0;
+    Column &column = columns[col];
+    const uint64_t *nulls = column.nulls.data();
+    bool found = false;
+    double min = 0;
+    uint32_t count = sel ? (uint32_t)sel->size() : rowCount;
+    for(uint32_t k=0; k<count; k++) {
+        uint32_t row = sel ? (*sel)[k] : k;
+        if(!NotNull(nulls,row))
+            continue;
+        double value = Value(column,row);
+        if(!found || value < min)
+            min = value;
+        found = true;
+    }
+    return min;
+}
+
+// ==================================================================================================
+double DdbResultTable::Max(int col, const DdbSelection *sel)
+/*!
+  \retval double Largest non-null value. Zero if there are none.
+*/
+{
+    if(!Valid(col,true))
+        return 0;
+    Column &column = columns[col];
+    const uint64_t *nulls = column.nulls.data();
+    bool found = false;
+    double max = 0;
+    uint32_t count = sel ? (uint32_t)sel->size() : rowCount;
+    for(uint32_t k=0; k<count; k++) {
+        uint32_t row = sel ? (*sel)[k] : k;
+        if(!NotNull(nulls,row))
+            continue;
+        double value = Value(column,row);
+        if(!found || value > max)
+            max = value;
+        found = true;
+    }
+    return max;
+}
+
+// ==================================================================================================
+double DdbResultTable::Avg(int col, const DdbSelection *sel)
+/*!
+  \retval double Average of the non-null values. Zero if there are none.
+*/
+{
+    int count = Count(col, sel);
+    return count ? Sum(col, sel)/count : 0;
+}
+
+// ==================================================================================================
+void DdbResultTable::Sort(int col, DdbSelection &sel, bool descending)
+/*!
+  Sorts the selected rows by the column. Sort is stable and nulls are placed last. Strings are
+  sorted by their dictionary rank, i.e. byte wise.
+*/
+{
+    if(!Valid(col,false))
+        return;
+    Column &column = columns[col];
+    const uint64_t *nulls = column.nulls.data();
+    if(column.type == DDBT_STR) {
+        // Sort by rank. Nulls get a rank after all values.
+        std::vector<int32_t> key(rowCount);
+        int32_t last = (int32_t)column.dict.size();
+        for(uint32_t row=0; row<rowCount; row++)
+            key[row] = NotNull(nulls,row) ? column.rank[column.ints[row]] : last;
+        if(descending)
+            std::stable_sort(sel.begin(), sel.end(), [&key,last](uint32_t a, uint32_t b) {
+                if(key[b]==last) return key[a]!=last;
+                return key[a]!=last && key[a] > key[b];
+            });
+        else
+            std::stable_sort(sel.begin(), sel.end(), [&key](uint32_t a, uint32_t b) { return key[a] < key[b]; });
+        return;
+    }
+    if(IsLong(column.type)) {
+        // Compared as integers, so large values keep their order.
+        const int64_t *data = column.longs.data();
+        std::stable_sort(sel.begin(), sel.end(), [data,nulls,descending](uint32_t a, uint32_t b) {
+            uint32_t va = NotNull(nulls,a), vb = NotNull(nulls,b);
+            if(!va || !vb)
+                return va > vb;
+            return descending ? data[a] > data[b] : data[a] < data[b];
+        });
+        return;
+    }
+    DdbResultTable *table = this;
+    std::stable_sort(sel.begin(), sel.end(), [table,&column,nulls,descending](uint32_t a, uint32_t b) {
+        uint32_t va = NotNull(nulls,a), vb = NotNull(nulls,b);
+        if(!va || !vb)
+            return va > vb;
+        double da = table->Value(column,a), db = table->Value(column,b);
+        return descending ? da > db : da < db;
+    });
+}
+
+// ==================================================================================================
+bool DdbResultTable::GroupBy(int keyCol, int valueCol, std::vector<DdbGroup> &groups, const DdbSelection *sel)
+/*!
+  Groups the rows by the key column and aggregates the value column within each group. Rows
+  with null key form a group of their own. Groups are listed in the order of appearance.
+  \param keyCol Key column. Any type except DDBT_NUM.
+  \param valueCol Column to aggregate. Negative value only counts the rows.
+  \param groups Vector where the groups are written into.
+  \param sel Rows to group. Null groups all rows.
+  \retval bool False if the columns are not valid.
+*/
+{
+    groups.clear();
+    if(!Valid(keyCol,false) || columns[keyCol].type==DDBT_NUM || (valueCol>=0 && !Valid(valueCol,true)))
+        return false;
+    Column &key = columns[keyCol];
+    Column *value = valueCol>=0 ? &columns[valueCol] : 0;
+    const uint64_t *nulls = key.nulls.data();
+    bool isLong = IsLong(key.type);
+    // String codes and small integers index the group table directly, others go through a hash map.
+    std::vector<int32_t> direct;
+    if(key.type == DDBT_STR)
+        direct.assign(key.dict.size(), -1);
+    std::unordered_map<int64_t,int32_t> hashed;
+    int32_t nullGroup = -1;
+
+    uint32_t count = sel ? (uint32_t)sel->size() : rowCount;
+    for(uint32_t k=0; k<count; k++) {
+        uint32_t row = sel ? (*sel)[k] : k;
+        int32_t *slot;
+        if(!NotNull(nulls,row))
+            slot = &nullGroup;
+        else if(key.type == DDBT_STR)
+            slot = &direct[key.ints[row]];
+        else {
+            int64_t kv = isLong ? key.longs[row] : key.ints[row];
+            std::unordered_map<int64_t,int32_t>::iterator it = hashed.find(kv);
+            if(it == hashed.end())
+                it = hashed.insert(std::make_pair(kv,(int32_t)-1)).first;
+            slot = &it->second;
+        }
+        if(*slot < 0) {
+            DdbGroup group;
+            group.row = row;
+            group.count = 0;
+            group.values = 0;
+            group.sum = group.min = group.max = 0;
+            *slot = (int32_t)groups.size();
+            groups.push_back(group);
+        }
+        DdbGroup &group = groups[*slot];
+        group.count++;
+        if(value && NotNull(value->nulls.data(),row)) {
+            double v = Value(*value,row);
+            if(!group.values || v < group.min)
+                group.min = v;
+            if(!group.values || v > group.max)
+                group.max = v;
+            group.sum += v;
+            group.values++;
+        }
+    }
+    return true;
+}
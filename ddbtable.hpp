@@ -0,0 +1,140 @@
+/*! \file ddbtable.hpp
+ * \brief Columnar in-memory result table with filter, sort, group and aggregate primitives. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#ifndef DDB_TABLE_H_FILE
+#define DDB_TABLE_H_FILE
+
+#include <vector>
+#include <string>
+#include "directdatabase.hpp"
+#include "ddbarena.hpp"
+
+// Comparison operators for the filters.
+#define DDB_CMP_EQ 1
+#define DDB_CMP_NE 2
+#define DDB_CMP_LT 3
+#define DDB_CMP_LE 4
+#define DDB_CMP_GT 5
+#define DDB_CMP_GE 6
+
+//! List of row indexes produced by the filters and consumed by the other operations.
+typedef std::vector<uint32_t> DdbSelection;
+
+//! One group produced by DdbResultTable::GroupBy.
+struct DdbGroup
+{
+    uint32_t row;       //!< First row of the group. Use it to read the key value.
+    int count;          //!< Number of rows in the group.
+    int values;         //!< Number of non-null values that were aggregated.
+    double sum;
+    double min;
+    double max;
+};
+
+// ==================================================================================================
+//! Query result stored column by column.
+/*! Each column is one contiguous array: int32 for DDBT_INT, DDBT_BOOL and DDBT_CHR, double for
+    DDBT_NUM and int64 for DDBT_LONG, DDBT_DEC, DDBT_TIME and DDBT_DAY. Times are seconds since
+    1970 (local time taken as is). Decimals are unscaled values with the largest scale found in
+    the column (see GetScale), so they stay exact; a column whose values do not fit in 18 digits
+    at that scale is not loaded. Strings are dictionary encoded: the column holds int32 codes into a table of distinct
+    values. Null values are marked in a bitmap per column and their slot holds zero.
+
+    Filters compare one column against a constant and write the matching row indexes into a
+    selection. With refine=true the filter keeps only those rows of the given selection that
+    match, so that filters can be chained. Null never matches. Aggregates, Sort and GroupBy take
+    an optional selection; without it all rows are used. The loops run over the plain arrays
+    without per row calls or branches, which lets the compiler vectorize them.
+
+    The table is filled from DdbResultRows (see DdbRowSet::Materialize) or directly with Load.
+    \code
+    DdbResultTable table;
+    table.Load(rs, "SELECT region, amount, paid FROM invoice");
+    DdbSelection sel;
+    table.FilterInt(2, DDB_CMP_EQ, 1, sel);
+    table.FilterDouble(1, DDB_CMP_GT, 100.0, sel, true);
+    std::vector<DdbGroup> groups;
+    table.GroupBy(0, 1, groups, &sel);
+    \endcode
+ */
+class DdbResultTable
+{
+public:
+    DdbResultTable() { rowCount = 0; }
+
+    bool Load(DdbResultRows &rows);
+    int Load(DdbRowSet *rs, const DDBSTR &query);
+    void Clear();
+
+    //! Returns the number of rows.
+    int GetRowCount() { return (int)rowCount; }
+    //! Returns the number of columns.
+    int GetColumnCount() { return (int)columns.size(); }
+    //! Returns the DDBT-type of the column.
+    short GetType(int col) { return columns[col].type; }
+    bool IsNull(uint32_t row, int col) { return (columns[col].nulls[row>>6] >> (row&63)) & 1; }
+
+    int GetInt(uint32_t row, int col) { return columns[col].ints[row]; }
+    bool GetBool(uint32_t row, int col) { return columns[col].ints[row] != 0; }
+    double GetDouble(uint32_t row, int col) { return columns[col].nums[row]; }
+    int64_t GetLong(uint32_t row, int col) { return columns[col].longs[row]; }
+    DdbDecimal GetDecimal(uint32_t row, int col);
+    int64_t GetTime(uint32_t row, int col) { return columns[col].longs[row]; }
+    const std::string& GetStr(uint32_t row, int col) { return columns[col].dict[columns[col].ints[row]]; }
+
+    //! Returns the values of an int, bool, char or string (codes) column.
+    const int32_t* GetInts(int col) { return columns[col].ints.data(); }
+    //! Returns the values of a numeric column.
+    const double* GetDoubles(int col) { return columns[col].nums.data(); }
+    //! Returns the values of a long, decimal (unscaled) or time column.
+    const int64_t* GetLongs(int col) { return columns[col].longs.data(); }
+    //! Returns the values of a time column.
+    const int64_t* GetTimes(int col) { return columns[col].longs.data(); }
+    //! Returns the scale of a decimal column. Zero for the other types.
+    int GetScale(int col) { return columns[col].scale; }
+    //! Returns true if the values of the type are stored as int64.
+    static bool IsLong(short type) { return type==DDBT_LONG || type==DDBT_DEC || type==DDBT_TIME || type==DDBT_DAY; }
+    //! Returns the null bitmap of the column. Bit (row%64) of word row/64 is set for null.
+    const uint64_t* GetNulls(int col) { return columns[col].nulls.data(); }
+    //! Returns the distinct values of a string column. Index is the code.
+    const std::vector<std::string>& GetDictionary(int col) { return columns[col].dict; }
+    int FindCode(int col, const char *value);
+
+    void SelectAll(DdbSelection &sel);
+    int FilterInt(int col, int op, int64_t value, DdbSelection &sel, bool refine=false);
+    int FilterDouble(int col, int op, double value, DdbSelection &sel, bool refine=false);
+    int FilterStr(int col, int op, const char *value, DdbSelection &sel, bool refine=false);
+    int FilterNull(int col, bool isNull, DdbSelection &sel, bool refine=false);
+
+    int Count(int col, const DdbSelection *sel=0);
+    double Sum(int col, const DdbSelection *sel=0);
+    double Min(int col, const DdbSelection *sel=0);
+    double Max(int col, const DdbSelection *sel=0);
+    double Avg(int col, const DdbSelection *sel=0);
+
+    void Sort(int col, DdbSelection &sel, bool descending=false);
+    bool GroupBy(int keyCol, int valueCol, std::vector<DdbGroup> &groups, const DdbSelection *sel=0);
+
+protected:
+    //! One column. Only the array of the column type is used.
+    struct Column {
+        short type;
+        int scale;                      //!< Scale of a DEC column.
+        std::vector<int32_t> ints;      //!< INT, BOOL, CHR and string codes.
+        std::vector<double> nums;       //!< NUM.
+        std::vector<int64_t> longs;     //!< LONG, DEC (unscaled), TIME and DAY.
+        std::vector<uint64_t> nulls;    //!< Null bitmap.
+        std::vector<std::string> dict;  //!< Distinct strings.
+        std::vector<int32_t> rank;      //!< Sort order of the dictionary entries.
+    };
+    double Value(const Column &column, uint32_t row);
+    bool Valid(int col, bool numeric);
+    static int64_t TimeValue(const DDBTIME &value);
+
+    std::vector<Column> columns;
+    uint32_t rowCount;
+};
+
+#endif
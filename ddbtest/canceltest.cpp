@@ -0,0 +1,120 @@
+/*******************************************************************************
+canceltest.cpp
+Copyright (c) Antti Merenluoto
+
+Tests canceling PostgreSQL queries that run outside the plain Exec: a hedged read waiting for
+a peer and, when built with C++20 coroutines, an abandoned row stream.
+  canceltest "host=localhost dbname=test"
+*******************************************************************************/
+
+#include <iostream>
+#include <thread>
+#include <cpp4scripts.hpp>
+#define __DDB_POSTGRE__
+#include "../directdatabase.hpp"
+#include "../ddbhedge.hpp"
+#include "../ddbcoro.hpp"
+using namespace std;
+using namespace std::chrono;
+
+//! Longest time in ms a canceled query may take to return.
+const int g_limit = 5000;
+
+int Elapsed(steady_clock::time_point start)
+{
+    return (int)duration_cast<milliseconds>(steady_clock::now() - start).count();
+}
+
+bool TestHedge(const char *conn)
+{
+    DdbHedgedPostgre pg;
+    DdbPostgre peer;
+    uint32_t pid, ownPid, value;
+
+    if(!pg.Connect(conn) || !peer.Connect(conn)) {
+        cout << "#!# Connect failed." << endl;
+        return false;
+    }
+    pg.AddPeer(&peer);
+    pg.SetMaxHedgeRate(0);
+    // The reads go to the members in turn: this one to pg, the next to the peer.
+    ownPid = (uint32_t)PQbackendPID(pg.GetPGConn());
+    if(!pg.ExecuteIntFunction("SELECT pg_backend_pid()", pid) || pid != ownPid) {
+        cout << "#!# First read was not sent to the own connection." << endl;
+        return false;
+    }
+    thread canceler([&pg] { this_thread::sleep_for(milliseconds(300)); pg.Cancel(); });
+    steady_clock::time_point start = steady_clock::now();
+    bool ok = pg.ExecuteIntFunction("SELECT 1 FROM pg_sleep(60)", value);
+    int ms = Elapsed(start);
+    canceler.join();
+    cout << "Hedged read on the peer returned in " << ms << " ms" << endl;
+    if(ok || !pg.IsCanceled() || ms > g_limit) {
+        cout << "#!# Hedged read on the peer was not canceled." << endl;
+        return false;
+    }
+    if(!pg.ExecuteIntFunction("SELECT 2", value) || value != 2) {
+        cout << "#!# Connection was not usable after the cancel." << endl;
+        return false;
+    }
+    return true;
+}
+
+#ifdef DDB_COROUTINES
+DdbTask<void> ReadOne(DdbPgAsync &async, DdbEpollExecutor &loop, int &ms, bool &gotRow)
+{
+    steady_clock::time_point start;
+    {
+        DdbPgRowStream rows = async.Rows("SELECT g, pg_sleep(0.01) FROM generate_series(1,1000000) g");
+        gotRow = co_await rows.Next();
+        start = steady_clock::now();
+    }   // The stream is destroyed here and the rest of the rows are abandoned.
+    ms = Elapsed(start);
+    loop.Stop();
+}
+
+bool TestStream(const char *conn)
+{
+    DdbPostgre pg;
+    uint32_t value;
+    int ms = -1;
+    bool gotRow = false;
+
+    if(!pg.Connect(conn)) {
+        cout << "#!# Connect failed." << endl;
+        return false;
+    }
+    DdbEpollExecutor loop;
+    DdbPgAsync async(&pg, &loop);
+    loop.Spawn(ReadOne(async, loop, ms, gotRow));
+    loop.Run();
+    cout << "Aborted stream finished in " << ms << " ms" << endl;
+    if(!gotRow || ms < 0 || ms > g_limit) {
+        cout << "#!# Aborted stream was not canceled." << endl;
+        return false;
+    }
+    if(async.IsBusy() || !pg.ExecuteIntFunction("SELECT 2", value) || value != 2) {
+        cout << "#!# Connection was not usable after the abort." << endl;
+        return false;
+    }
+    return true;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    if(argc<2) {
+        cout << "Usage: canceltest [connection]" << endl;
+        return 1;
+    }
+    if(!TestHedge(argv[1]))
+        return 1;
+#ifdef DDB_COROUTINES
+    if(!TestStream(argv[1]))
+        return 1;
+#else
+    cout << "Coroutines are not available. Stream test skipped." << endl;
+#endif
+    cout << "Done." << endl;
+    return 0;
+}
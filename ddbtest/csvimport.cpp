@@ -0,0 +1,93 @@
+/*******************************************************************************
+csvimport.cpp
+Copyright (c) Antti Merenluoto
+
+Imports a CSV file into a PostgreSQL table with parallel COPY sessions:
+  csvimport [options] "host=localhost dbname=test" table file.csv
+Options:
+  -j N          Number of parallel sessions (default 4).
+  -header       First line holds the column names.
+  -columns LIST Comma separated target columns.
+  -delim C      Field delimiter (default ,). Use \t for tab.
+  -single       Import in one transaction.
+  -errors FILE  Write the rejected rows into FILE.
+  -max N        Number of rejected rows tolerated (default 0).
+*******************************************************************************/
+
+#include <iostream>
+#include <string.h>
+#include <stdlib.h>
+#include <cpp4scripts.hpp>
+#define __DDB_POSTGRE__
+#include "../directdatabase.hpp"
+#include "../ddbimport.hpp"
+using namespace std;
+
+void Progress(void *, uint64_t done, uint64_t total, int64_t rows)
+{
+    cerr << "\r" << (total ? done*100/total : 100) << "% " << rows << " rows" << flush;
+}
+
+int main(int argc, char **argv)
+{
+    int jobs = 4;
+    int maxErrors = 0;
+    bool header = false, single = false;
+    const char *columns = 0, *errors = 0;
+    char delim = ',';
+    int arg = 1;
+    for(; arg<argc && argv[arg][0]=='-'; arg++) {
+        if(!strcmp(argv[arg],"-header"))
+            header = true;
+        else if(!strcmp(argv[arg],"-single"))
+            single = true;
+        else if(arg+1 < argc && !strcmp(argv[arg],"-j"))
+            jobs = atoi(argv[++arg]);
+        else if(arg+1 < argc && !strcmp(argv[arg],"-columns"))
+            columns = argv[++arg];
+        else if(arg+1 < argc && !strcmp(argv[arg],"-delim")) {
+            arg++;
+            delim = strcmp(argv[arg],"\\t") ? argv[arg][0] : '\t';
+        }
+        else if(arg+1 < argc && !strcmp(argv[arg],"-errors"))
+            errors = argv[++arg];
+        else if(arg+1 < argc && !strcmp(argv[arg],"-max"))
+            maxErrors = atoi(argv[++arg]);
+        else {
+            cout << "#!# Unknown option " << argv[arg] << endl;
+            return 1;
+        }
+    }
+    if(argc-arg < 3) {
+        cout << "Usage: csvimport [-j N] [-header] [-columns LIST] [-delim C] [-single] [-errors FILE] [-max N] [connection] [table] [file]" << endl;
+        return 1;
+    }
+    if(jobs < 1 || single)
+        jobs = 1;
+    vector<DdbPostgre*> sessions;
+    for(int ndx=0; ndx<jobs; ndx++) {
+        DdbPostgre *pg = new DdbPostgre();
+        if(!pg->Connect(argv[arg])) {
+            cout << "#!# Connect failed." << endl;
+            return 1;
+        }
+        sessions.push_back(pg);
+    }
+    DdbCsvImport import(sessions, argv[arg+1], columns);
+    import.SetHeader(header);
+    import.SetDelimiter(delim);
+    import.SetSingleTransaction(single);
+    import.SetMaxErrors(maxErrors);
+    import.SetProgressCallback(Progress, 0);
+    if(errors && !import.SetErrorFile(errors))
+        return 1;
+    int64_t rows = import.Run(argv[arg+2]);
+    cerr << endl;
+    const vector<DdbImportError> &list = import.GetErrors();
+    for(size_t ndx=0; ndx<list.size(); ndx++)
+        cout << "Line " << list[ndx].line << ": " << list[ndx].reason << endl;
+    cout << import.GetRows() << " rows imported, " << import.GetErrorCount() << " rejected." << endl;
+    for(size_t ndx=0; ndx<sessions.size(); ndx++)
+        delete sessions[ndx];
+    return rows < 0 ? 1 : 0;
+}
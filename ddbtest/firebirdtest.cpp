@@ -0,0 +1,135 @@
+/*******************************************************************************
+firebirdtest.cpp
+Copyright (c) Antti Merenluoto
+
+Tests the Firebird backend. With the embedded engine the test needs only a file path, e.g.
+  firebirdtest "database=/tmp/fbtest.fdb user=SYSDBA create=yes"
+*******************************************************************************/
+
+#include <iostream>
+#include <sstream>
+#include <cpp4scripts.hpp>
+#define __DDB_FIREBIRD__
+#include "../directdatabase.hpp"
+using namespace std;
+
+const char *g_create_table =
+"CREATE TABLE ddb_demo ("\
+"id integer NOT NULL PRIMARY KEY"\
+",ts timestamp"\
+",data varchar(255)"\
+",tf smallint"\
+",val double precision"\
+",note blob sub_type text"\
+")";
+
+const int ROWS = 5000;
+
+int main(int argc, char **argv)
+{
+    int id, count;
+    uint32_t total;
+    bool tf;
+    double val;
+    string data, note;
+    tm ts;
+    stringstream text;
+
+    if(argc<2) {
+        cout << "Usage: firebirdtest [connection string]" << endl;
+        return 1;
+    }
+    DdbFirebird db;
+    if(!db.Connect(argv[1])) {
+        cout << "#!# Connect failed: " << db.GetErrorDescription(0) << endl;
+        return 1;
+    }
+    db.UpdateStructure("DROP TABLE ddb_demo");
+    if(!db.UpdateStructure(g_create_table)) {
+        cout << "#!# Unable to create table: " << db.GetErrorDescription(0) << endl;
+        return 1;
+    }
+
+    // Bulk insert
+    cout << "Batch insert of " << ROWS << " rows... ";
+    DdbFirebirdBatch *batch = db.CreateBatch("INSERT INTO ddb_demo(id,ts,data,tf,val,note) VALUES(?,?,?,?,?,?)");
+    batch->Bind(DDBT_INT,&id);
+    batch->Bind(DDBT_TIME,&ts);
+    batch->Bind(DDBT_STR,&data);
+    batch->Bind(DDBT_BOOL,&tf);
+    batch->Bind(DDBT_NUM,&val);
+    batch->Bind(DDBT_STR,&note);
+    time_t now = time(0);
+    ts = *localtime(&now);
+    for(id=1; id<=ROWS; id++) {
+        text.str("");
+        text << "Test item " << id;
+        data = text.str();
+        note = data + " note";
+        tf = id%2 == 1;
+        val = id*1.5;
+        if(!batch->Add()) {
+            cout << "#!# Add failed: " << db.GetErrorDescription(0) << endl;
+            delete batch;
+            return 1;
+        }
+    }
+    count = batch->Execute();
+    delete batch;
+    if(count != ROWS) {
+        cout << "#!# Batch inserted " << count << " rows: " << db.GetErrorDescription(0) << endl;
+        return 1;
+    }
+    cout << "OK\n";
+
+    if(!db.ExecuteIntFunction("SELECT count(*) FROM ddb_demo",total) || total != ROWS) {
+        cout << "#!# Count mismatch: " << total << endl;
+        return 1;
+    }
+    if(db.ExecuteModify("UPDATE ddb_demo SET data=NULL WHERE mod(id,10)=0") != ROWS/10) {
+        cout << "#!# Update count mismatch: " << db.GetErrorDescription(0) << endl;
+        return 1;
+    }
+
+    // Read twice with the same rowset to reuse the prepared statement.
+    DdbRowSet *rs = db.CreateRowSet();
+    rs->Bind(DDBT_INT,&id);
+    rs->Bind(DDBT_TIME,&ts);
+    rs->Bind(DDBT_STR,&data);
+    rs->Bind(DDBT_BOOL,&tf);
+    rs->Bind(DDBT_NUM,&val);
+    rs->Bind(DDBT_STR,&note);
+    for(int pass=0; pass<2; pass++) {
+        if(!rs->Query("SELECT id,ts,data,tf,val,note FROM ddb_demo ORDER BY id")) {
+            cout << "#!# Query failed: " << db.GetErrorDescription(rs) << endl;
+            delete rs;
+            return 1;
+        }
+        count = 0;
+        while(rs->GetNext()) {
+            count++;
+            if(id != count || tf != (id%2==1) || val != id*1.5 || (id%10==0) != data.empty() || note.empty()) {
+                cout << "#!# Row " << count << " mismatch: " << id << " " << data << endl;
+                delete rs;
+                return 1;
+            }
+        }
+        cout << "Pass " << pass+1 << ": " << count << " rows read.\n";
+        if(count != ROWS) {
+            delete rs;
+            return 1;
+        }
+    }
+    delete rs;
+
+    db.StartTransaction();
+    db.ExecuteModify("DELETE FROM ddb_demo");
+    db.RollBack();
+    if(!db.ExecuteIntFunction("SELECT count(*) FROM ddb_demo",total) || total != ROWS) {
+        cout << "#!# Rollback failed: " << total << endl;
+        return 1;
+    }
+    db.UpdateStructure("DROP TABLE ddb_demo");
+    cout << "Done." << endl;
+    return 0;
+}
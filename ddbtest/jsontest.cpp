@@ -0,0 +1,160 @@
+/*******************************************************************************
+jsontest.cpp
+Copyright (c) Antti Merenluoto
+
+Tests the streaming JSON reader and the path extraction used for the DDBT_JSON columns.
+No database is needed:
+  jsontest
+*******************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <string.h>
+#include <cpp4scripts.hpp>
+#include "../directdatabase.hpp"
+using namespace std;
+
+// ==================================================================================================
+//! Handler that writes the events into a string. Stops at the key given in stopKey.
+class EventLog : public DdbJsonHandler
+{
+public:
+    string log;
+    string stopKey;
+
+    void StartDocument() { log.clear(); }
+    bool StartObject() { log += "{"; return true; }
+    bool EndObject() { log += "}"; return true; }
+    bool StartArray() { log += "["; return true; }
+    bool EndArray() { log += "]"; return true; }
+    bool Key(const char *str, size_t len) {
+        log += "K:" + string(str, len) + " ";
+        return stopKey != string(str, len);
+    }
+    bool String(const char *str, size_t len) { log += "S:" + string(str, len) + " "; return true; }
+    bool Number(const char *str, size_t len) { log += "N:" + string(str, len) + " "; return true; }
+    bool Bool(bool value) { log += value ? "true " : "false "; return true; }
+    bool Null() { log += "null "; return true; }
+};
+
+int g_failures = 0;
+
+void Check(bool ok, const char *what)
+{
+    if(!ok) {
+        cout << "#!# " << what << endl;
+        g_failures++;
+    }
+}
+
+//! Parses the text and compares the event log.
+void Expect(const char *text, const char *events, const char *stopKey="")
+{
+    DdbJsonReader reader;
+    EventLog handler;
+    handler.stopKey = stopKey;
+    handler.StartDocument();
+    bool ok = reader.Parse(text, strlen(text), handler);
+    if(!ok || handler.log != events) {
+        cout << "#!# " << text << " gave '" << handler.log << "' instead of '" << events << "'" << endl;
+        g_failures++;
+    }
+}
+
+//! Parses invalid text and compares the error offset.
+void ExpectError(const char *text, size_t offset)
+{
+    DdbJsonReader reader;
+    EventLog handler;
+    bool ok = reader.Parse(text, strlen(text), handler);
+    if(ok || reader.GetErrorOffset() != offset) {
+        cout << "#!# " << text << " error offset " << reader.GetErrorOffset() << " instead of " << offset
+             << (ok ? " (parsed)" : "") << endl;
+        g_failures++;
+    }
+}
+
+void TestReader()
+{
+    Expect("{\"a\":1,\"b\":[true,false,null],\"c\":{}}",
+           "{K:a N:1 K:b [true false null ]K:c {}}");
+    Expect(" [ -0.5e+3 , \"x\" , [] ] ", "[N:-0.5e+3 S:x []]");
+    // Escapes are unescaped into UTF-8.
+    Expect("[\"q\\\"b\\\\s\\/n\\nt\\t\"]", "[S:q\"b\\s/n\nt\t ]");
+    Expect("[\"\\u0041\\u00e9\\u20ac\"]", "[S:A\xc3\xa9\xe2\x82\xac ]");
+    // Surrogate pair into one 4 byte character.
+    Expect("[\"\\ud83d\\ude00\"]", "[S:\xf0\x9f\x98\x80 ]");
+    // The handler stops the parsing at a key. The rest, even if invalid, is not read.
+    Expect("{\"a\":1,\"stop\":2,\"c\":3}", "{K:a N:1 K:stop ", "stop");
+    Expect("{\"stop\":[,,,", "{K:stop ", "stop");
+
+    ExpectError("{\"a\":1,}", 7);
+    ExpectError("[1 2]", 3);
+    ExpectError("[01]", 2);
+    ExpectError("[1.]", 1);
+    ExpectError("{\"a\" 1}", 5);
+    ExpectError("[\"ab", 1);
+    ExpectError("[tru]", 1);
+    ExpectError("[1]]", 3);
+    // Lone and reversed surrogates.
+    ExpectError("[\"\\ud83d\"]", 1);
+    ExpectError("[\"\\ude00\\ud83d\"]", 1);
+    ExpectError("[\"\\ud83d\\u0041\"]", 1);
+    ExpectError("[\"a\nb\"]", 1);
+}
+
+void TestPaths()
+{
+    DdbJsonReader reader;
+    DdbJsonPaths paths;
+    string name, flag;
+    int qty;
+    int64_t id;
+    double price, precise;
+    DdbDecimal total;
+    bool paid;
+
+    Check(paths.Bind("$.customer.name", DDBT_STR, &name), "Bind with $. failed");
+    Check(paths.Bind("items[1].qty", DDBT_INT, &qty), "Bind of an array path failed");
+    Check(paths.Bind("id", DDBT_LONG, &id), "Bind of id failed");
+    Check(paths.Bind("items[0].price", DDBT_NUM, &price), "Bind of price failed");
+    Check(paths.Bind("total", DDBT_DEC, &total), "Bind of total failed");
+    Check(paths.Bind("paid", DDBT_BOOL, &paid), "Bind of paid failed");
+    Check(paths.Bind("precise", DDBT_NUM, &precise), "Bind of precise failed");
+    Check(!paths.Bind("", DDBT_INT, &qty), "Empty path was accepted");
+    Check(!paths.Bind("x", DDBT_TIME, &qty), "Unsupported type was accepted");
+
+    const char *doc =
+        "{\"id\":9007199254740993,\"customer\":{\"name\":\"Ann \\u00c5\",\"tags\":[\"a\",{\"name\":\"no\"}]},"
+        "\"items\":[{\"price\":12.5,\"qty\":1},{\"price\":3,\"qty\":4}],\"total\":\"24.50\",\"paid\":true,"
+        "\"precise\":0.1000000000000000000000000000000000000000000000000000000000000000000000001}";
+    paths.StartDocument();
+    Check(reader.Parse(doc, strlen(doc), paths), "Path document did not parse");
+    Check(paths.GetFoundCount() == 7, "Not all paths were found");
+    Check(name == "Ann \xc3\x85", "customer.name");
+    Check(qty == 4, "items[1].qty");
+    Check(id == 9007199254740993LL, "id lost precision");
+    Check(price == 12.5, "items[0].price");
+    Check(total.value == 2450 && total.scale == 2, "total");
+    Check(paid, "paid");
+    Check(precise > 0.09 && precise < 0.11, "Number of more than 64 characters was not converted");
+
+    // A missing or null value clears the variable.
+    const char *partial = "{\"customer\":{\"name\":null},\"items\":[{\"qty\":7}]}";
+    paths.StartDocument();
+    Check(reader.Parse(partial, strlen(partial), paths), "Partial document did not parse");
+    Check(paths.GetFoundCount() == 0 && name.empty() && qty == 0 && id == 0 && !paid,
+          "Missing values were not cleared");
+}
+
+int main()
+{
+    TestReader();
+    TestPaths();
+    if(g_failures) {
+        cout << "#!# " << g_failures << " checks failed." << endl;
+        return 1;
+    }
+    cout << "Done." << endl;
+    return 0;
+}
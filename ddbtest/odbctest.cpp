@@ -0,0 +1,138 @@
+/*******************************************************************************
+odbctest.cpp
+Copyright (c) Antti Merenluoto
+
+Tests the ODBC backend. Runs locally with the SQLite ODBC driver, e.g.
+  odbctest "DRIVER=SQLite3;Database=/tmp/odbctest.db"
+*******************************************************************************/
+
+#include <iostream>
+#include <sstream>
+#include <cpp4scripts.hpp>
+#define __DDB_ODBC__
+#include "../directdatabase.hpp"
+using namespace std;
+
+const char *g_create_table =
+"CREATE TABLE ddb_demo ("\
+"id int NOT NULL"\
+",ts timestamp"\
+",data varchar(255)"\
+",tf boolean"\
+",val double precision"\
+",PRIMARY KEY(id)"\
+")";
+
+const int ROWS = 1000;
+
+int main(int argc, char **argv)
+{
+    int id, count;
+    uint32_t total;
+    bool tf;
+    double val;
+    string data;
+    tm ts;
+    stringstream query;
+
+    if(argc<2) {
+        cout << "Usage: odbctest [connection string]" << endl;
+        return 1;
+    }
+    DdbOdbc db;
+    if(!db.Connect(argv[1])) {
+        cout << "#!# Connect failed: " << db.GetErrorDescription(0) << endl;
+        return 1;
+    }
+    db.UpdateStructure("DROP TABLE ddb_demo");
+    if(!db.UpdateStructure(g_create_table)) {
+        cout << "#!# Unable to create table: " << db.GetErrorDescription(0) << endl;
+        return 1;
+    }
+
+    cout << "Inserting " << ROWS << " rows in transaction... ";
+    db.StartTransaction();
+    for(id=1; id<=ROWS; id++) {
+        query.str("");
+        query << "INSERT INTO ddb_demo(id,ts,data,tf,val) VALUES(" << id << ",CURRENT_TIMESTAMP,";
+        if(id%10)
+            query << "'Test item " << id << "'";
+        else
+            query << "NULL";
+        query << "," << (id%2) << "," << id*1.5 << ")";
+        if(db.ExecuteModify(query.str()) != 1) {
+            cout << "#!# Insert failed: " << db.GetErrorDescription(0) << endl;
+            db.RollBack();
+            return 1;
+        }
+    }
+    db.Commit();
+    cout << "OK\n";
+
+    if(!db.ExecuteIntFunction("SELECT count(*) FROM ddb_demo",total) || total != ROWS) {
+        cout << "#!# Count mismatch: " << total << endl;
+        return 1;
+    }
+
+    // Read with block cursor and then row by row.
+    for(int pass=0; pass<2; pass++) {
+        db.SetRowArraySize(pass==0 ? DDB_ODBC_ROWARRAY : 1);
+        DdbRowSet *rs = db.CreateRowSet();
+        rs->Bind(DDBT_INT,&id);
+        rs->Bind(DDBT_TIME,&ts);
+        rs->Bind(DDBT_STR,&data);
+        rs->Bind(DDBT_BOOL,&tf);
+        rs->Bind(DDBT_NUM,&val);
+        if(!rs->Query("SELECT id,ts,data,tf,val FROM ddb_demo ORDER BY id")) {
+            cout << "#!# Query failed: " << db.GetErrorDescription(rs) << endl;
+            delete rs;
+            return 1;
+        }
+        count = 0;
+        while(rs->GetNext()) {
+            count++;
+            if(id != count || tf != (id%2==1) || val != id*1.5 || (id%10==0) != data.empty()) {
+                cout << "#!# Row " << count << " mismatch: " << id << " " << data << endl;
+                delete rs;
+                return 1;
+            }
+        }
+        delete rs;
+        cout << "Pass " << pass+1 << ": " << count << " rows read.\n";
+        if(count != ROWS)
+            return 1;
+    }
+
+    // Array insert: all rows with one execute.
+    cout << "Array insert of " << ROWS << " rows... ";
+    int ids[ROWS];
+    string texts[ROWS];
+    double vals[ROWS];
+    DdbOdbcParamArray params(ROWS);
+    params.Bind(DDBT_INT,ids);
+    params.Bind(DDBT_STR,texts);
+    params.Bind(DDBT_NUM,vals);
+    for(int row=0; row<ROWS; row++) {
+        ids[row] = ROWS+row+1;
+        query.str("");
+        query << "Array item " << row;
+        texts[row] = query.str();
+        vals[row] = row*0.5;
+        if(row%10 == 0)
+            params.SetNull(1,row);
+    }
+    count = db.ExecuteArray("INSERT INTO ddb_demo(id,data,val) VALUES(?,?,?)",params);
+    if(count != ROWS) {
+        cout << "#!# Array insert returned " << count << ": " << db.GetErrorDescription(0) << endl;
+        return 1;
+    }
+    if(!db.ExecuteIntFunction("SELECT count(*) FROM ddb_demo WHERE data IS NULL AND id>1000",total) || total != ROWS/10) {
+        cout << "#!# Null count mismatch: " << total << endl;
+        return 1;
+    }
+    cout << "OK\n";
+
+    db.UpdateStructure("DROP TABLE ddb_demo");
+    cout << "Done." << endl;
+    return 0;
+}
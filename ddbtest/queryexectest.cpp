@@ -0,0 +1,204 @@
+/*******************************************************************************
+queryexectest.cpp
+Copyright (c) Antti Merenluoto
+
+Tests DdbQueryExecutor and DdbQuerySession with in-memory SQLite connections: work stealing,
+session affinity, sessions holding all the connections while other jobs wait, and the jobs
+left waiting when the executor stops.
+  queryexectest
+*******************************************************************************/
+
+#include <iostream>
+#include <set>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cpp4scripts.hpp>
+#define __DDB_SQLITE__
+#include "../directdatabase.hpp"
+#include "../ddbqueryexec.hpp"
+using namespace std;
+using namespace std::chrono;
+
+//! Longest time a job may take before the test counts it as stuck.
+const seconds g_limit(5);
+
+void AddConnections(DdbQueryExecutor &exec, int count)
+{
+    for(int ndx=0; ndx<count; ndx++) {
+        DdbSqlite *db = new DdbSqlite();
+        db->Connect(":memory:");
+        exec.AddConnection(db);
+    }
+}
+
+template<typename R>
+bool Ready(future<R> &result)
+{
+    return result.wait_for(g_limit) == future_status::ready;
+}
+
+bool TestStealing()
+{
+    DdbQueryExecutor exec;
+    AddConnections(exec, 2);
+    exec.Start(2);
+
+    // Jobs submitted by a job go to its own queue, so the other worker has to steal them.
+    mutex guard;
+    set<thread::id> threads;
+    vector<future<int> > children;
+    future<bool> parent = exec.Submit([&](DirectDatabase *) {
+        for(int ndx=0; ndx<20; ndx++) {
+            children.push_back(exec.Submit([&](DirectDatabase *db) {
+                this_thread::sleep_for(milliseconds(10));
+                lock_guard<mutex> lock(guard);
+                threads.insert(this_thread::get_id());
+                uint32_t val = 0;
+                db->ExecuteIntFunction("SELECT 1", val);
+                return (int)val;
+            }));
+        }
+        return true;
+    });
+    if(!Ready(parent) || !parent.get()) {
+        cout << "#!# Parent job did not finish." << endl;
+        return false;
+    }
+    for(size_t ndx=0; ndx<children.size(); ndx++) {
+        if(!Ready(children[ndx]) || children[ndx].get() != 1) {
+            cout << "#!# Child job " << ndx << " failed." << endl;
+            return false;
+        }
+    }
+    cout << "Child jobs ran on " << threads.size() << " workers" << endl;
+    if(threads.size() != 2) {
+        cout << "#!# Child jobs were not stolen." << endl;
+        return false;
+    }
+    return true;
+}
+
+bool TestAffinity()
+{
+    DdbQueryExecutor exec;
+    AddConnections(exec, 3);
+    exec.Start();
+
+    DdbQuerySession session(exec);
+    vector<future<DirectDatabase*> > used;
+    session.Submit([](DirectDatabase *db) { return db->StartTransaction(); });
+    for(int ndx=0; ndx<10; ndx++) {
+        used.push_back(session.Submit([](DirectDatabase *db) {
+            return db->IsTransaction() ? db : (DirectDatabase*)0;
+        }));
+        // Other jobs meanwhile must not get the session's connection.
+        exec.ExecuteModify("SELECT 1");
+    }
+    future<bool> commit = session.Submit([](DirectDatabase *db) { return db->Commit(); });
+    session.Close();
+    DirectDatabase *first = 0;
+    for(size_t ndx=0; ndx<used.size(); ndx++) {
+        DirectDatabase *db = Ready(used[ndx]) ? used[ndx].get() : 0;
+        if(!db || (first && db != first)) {
+            cout << "#!# Session job " << ndx << " ran outside the session's transaction." << endl;
+            return false;
+        }
+        first = db;
+    }
+    if(!Ready(commit) || !commit.get()) {
+        cout << "#!# Session commit failed." << endl;
+        return false;
+    }
+    return true;
+}
+
+bool TestSessionsHoldAll()
+{
+    DdbQueryExecutor exec;
+    AddConnections(exec, 2);
+    exec.Start(2);
+
+    // Both connections are held by the sessions.
+    DdbQuerySession s1(exec), s2(exec);
+    future<bool> held1 = s1.Submit([](DirectDatabase *) { return true; });
+    future<bool> held2 = s2.Submit([](DirectDatabase *) { return true; });
+    if(!Ready(held1) || !Ready(held2)) {
+        cout << "#!# Sessions did not get the connections." << endl;
+        return false;
+    }
+    // These wait for a connection. They must not keep the workers from the session jobs.
+    vector<future<int> > waiting;
+    for(int ndx=0; ndx<4; ndx++)
+        waiting.push_back(exec.ExecuteModify("SELECT 1"));
+    future<int> more1 = s1.ExecuteModify("SELECT 1");
+    future<int> more2 = s2.ExecuteModify("SELECT 1");
+    if(!Ready(more1) || !Ready(more2)) {
+        cout << "#!# Session jobs were stuck behind the jobs waiting for a connection." << endl;
+        return false;
+    }
+    s1.Close();
+    s2.Close();
+    for(size_t ndx=0; ndx<waiting.size(); ndx++) {
+        if(!Ready(waiting[ndx])) {
+            cout << "#!# Waiting job did not get a released connection." << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TestStop()
+{
+    DdbQueryExecutor exec;
+    AddConnections(exec, 1);
+    exec.Start(1);
+
+    DdbQuerySession session(exec);
+    future<bool> held = session.Submit([](DirectDatabase *) { return true; });
+    if(!Ready(held)) {
+        cout << "#!# Session did not get the connection." << endl;
+        return false;
+    }
+    DdbQuerySession waitingSession(exec);
+    future<int> waiting = exec.ExecuteModify("SELECT 1");
+    future<int> waitingInSession = waitingSession.ExecuteModify("SELECT 1");
+    this_thread::sleep_for(milliseconds(100));
+    exec.Stop();
+    future<int> late = exec.ExecuteModify("SELECT 1");
+    session.Close();
+    waitingSession.Close();
+
+    future<int> *results[] = { &waiting, &waitingInSession, &late };
+    for(int ndx=0; ndx<3; ndx++) {
+        bool failed = false;
+        try {
+            if(!Ready(*results[ndx])) {
+                cout << "#!# Job " << ndx << " was left pending by Stop." << endl;
+                return false;
+            }
+            results[ndx]->get();
+        }
+        catch(const runtime_error &) {
+            failed = true;
+        }
+        catch(const exception &ex) {
+            cout << "#!# Job " << ndx << " failed with " << ex.what() << endl;
+            return false;
+        }
+        if(!failed) {
+            cout << "#!# Job " << ndx << " ran after Stop." << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    if(!TestStealing() || !TestAffinity() || !TestSessionsHoldAll() || !TestStop())
+        return 1;
+    cout << "Done." << endl;
+    return 0;
+}
@@ -0,0 +1,78 @@
+/*******************************************************************************
+routertest.cpp
+Copyright (c) Antti Merenluoto
+
+Tests the read/write routing with two PostgreSQL instances, e.g. a primary and a streaming
+replica running on ports 5432 and 5433:
+  routertest "host=localhost port=5432 dbname=test" "host=localhost port=5433 dbname=test"
+Instances do not need to replicate. Routing is checked from the server port.
+*******************************************************************************/
+
+#include <iostream>
+#include <thread>
+#include <cpp4scripts.hpp>
+#define __DDB_POSTGRE__
+#include "../directdatabase.hpp"
+#include "../ddbrouter.hpp"
+using namespace std;
+
+const char *g_port = "SELECT current_setting('port')::int";
+
+int main(int argc, char **argv)
+{
+    uint32_t port, primaryPort, replicaPort;
+    int count;
+
+    if(argc<3) {
+        cout << "Usage: routertest [primary connection] [replica connection]" << endl;
+        return 1;
+    }
+    DdbPostgre primary, replica;
+    if(!primary.Connect(argv[1]) || !replica.Connect(argv[2])) {
+        cout << "#!# Connect failed." << endl;
+        return 1;
+    }
+    primary.ExecuteIntFunction(g_port, primaryPort);
+    replica.ExecuteIntFunction(g_port, replicaPort);
+    if(primaryPort == replicaPort) {
+        cout << "#!# Instances should run in different ports." << endl;
+        return 1;
+    }
+    DdbRouter router(&primary);
+    router.AddReplica(&replica);
+    router.SetStickyTime(200);
+
+    router.ExecuteIntFunction(g_port, port);
+    cout << "Read routed to " << (port==replicaPort ? "replica" : "primary") << endl;
+    if(port != replicaPort)
+        return 1;
+
+    router.UpdateStructure("CREATE TEMP TABLE ddb_router(id int)");
+    router.ExecuteIntFunction(g_port, port);
+    cout << "Read after write routed to " << (port==replicaPort ? "replica" : "primary") << endl;
+    if(port != primaryPort)
+        return 1;
+    this_thread::sleep_for(chrono::milliseconds(250));
+
+    DdbRowSet *rs = router.CreateRowSet();
+    rs->Bind(DDBT_INT, &count);
+    if(!rs->Query(g_port) || !rs->GetNext() || (uint32_t)count != replicaPort) {
+        cout << "#!# Rowset was not routed to the replica." << endl;
+        delete rs;
+        return 1;
+    }
+    rs->QuitQuery();
+
+    router.StartTransaction();
+    if(!rs->Query(g_port) || !rs->GetNext() || (uint32_t)count != primaryPort) {
+        cout << "#!# Transaction read was not routed to the primary." << endl;
+        router.RollBack();
+        delete rs;
+        return 1;
+    }
+    rs->QuitQuery();
+    router.Commit();
+    delete rs;
+    cout << "Done." << endl;
+    return 0;
+}
@@ -0,0 +1,125 @@
+/*******************************************************************************
+shardtest.cpp
+Copyright (c) Antti Merenluoto
+
+Tests the scatter/gather merge of DdbShardRouter with three in-memory SQLite shards. The
+sort column has NULL values in every shard.
+  shardtest
+*******************************************************************************/
+
+#include <iostream>
+#include <stdio.h>
+#include <cpp4scripts.hpp>
+#define __DDB_SQLITE__
+#include "../directdatabase.hpp"
+#include "../ddbshard.hpp"
+using namespace std;
+
+const int g_rows = 300;
+
+//! Reads the merged result and checks that it is ordered as the ORDER BY of the shards.
+bool CheckMerge(DdbShardRouter &router, const char *query, bool descending, bool nullsFirst)
+{
+    int id, val, prev = 0, count = 0, nulls = 0;
+    bool prevNull = false;
+
+    DdbScatterRowSet *rs = router.CreateScatterRowSet(1, descending);
+    rs->SetNullsFirst(nullsFirst);
+    rs->Bind(DDBT_INT, &id);
+    rs->Bind(DDBT_INT, &val);
+    if(!rs->Query(query)) {
+        cout << "#!# Scatter query failed: " << query << endl;
+        delete rs;
+        return false;
+    }
+    while(rs->GetNextRow()) {
+        bool isNull = rs->IsNull(1);
+        if(count > 0) {
+            bool ordered;
+            if(isNull || prevNull)
+                ordered = isNull == prevNull || isNull != nullsFirst;
+            else
+                ordered = descending ? val <= prev : val >= prev;
+            if(!ordered) {
+                cout << "#!# Row " << count << " out of order: " << query << endl;
+                delete rs;
+                return false;
+            }
+        }
+        prev = val;
+        prevNull = isNull;
+        nulls += isNull;
+        count++;
+    }
+    delete rs;
+    cout << count << " rows, " << nulls << " nulls merged: " << query << endl;
+    if(count != g_rows || nulls != g_rows/10) {
+        cout << "#!# Wrong number of rows." << endl;
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    DdbSqlite shard[3];
+    DdbShardRouter router;
+    char name[20], key[20], sql[100];
+    uint32_t count;
+
+    for(int ndx=0; ndx<3; ndx++) {
+        if(!shard[ndx].Connect(":memory:")) {
+            cout << "#!# Connect failed." << endl;
+            return 1;
+        }
+        sprintf(name, "shard%d", ndx);
+        router.AddShard(&shard[ndx], name);
+    }
+    if(!router.UpdateStructure("CREATE TABLE ddb_shard(id int, val int)")) {
+        cout << "#!# Create failed." << endl;
+        return 1;
+    }
+    // Every tenth value is NULL. The others repeat so that equal values meet in the merge.
+    for(int id=0; id<g_rows; id++) {
+        sprintf(key, "key-%d", id);
+        if(id%10 == 0)
+            sprintf(sql, "INSERT INTO ddb_shard VALUES(%d,NULL)", id);
+        else
+            sprintf(sql, "INSERT INTO ddb_shard VALUES(%d,%d)", id, (id*37)%50);
+        if(router.ExecuteModify(key, sql) != 1) {
+            cout << "#!# Insert failed." << endl;
+            return 1;
+        }
+    }
+    for(int ndx=0; ndx<3; ndx++) {
+        shard[ndx].ExecuteIntFunction("SELECT count(*) FROM ddb_shard WHERE val IS NULL", count);
+        if(count == 0) {
+            cout << "#!# Shard " << ndx << " has no NULL values." << endl;
+            return 1;
+        }
+    }
+
+    if(!CheckMerge(router, "SELECT id, val FROM ddb_shard ORDER BY val NULLS LAST", false, false)
+       || !CheckMerge(router, "SELECT id, val FROM ddb_shard ORDER BY val DESC NULLS FIRST", true, true)
+       || !CheckMerge(router, "SELECT id, val FROM ddb_shard ORDER BY val", false, true)
+       || !CheckMerge(router, "SELECT id, val FROM ddb_shard ORDER BY val DESC", true, false))
+        return 1;
+
+    // Without a sort column the shards are read one after another.
+    int id, val;
+    DdbScatterRowSet *rs = router.CreateScatterRowSet();
+    rs->Bind(DDBT_INT, &id);
+    rs->Bind(DDBT_INT, &val);
+    count = 0;
+    if(rs->Query("SELECT id, val FROM ddb_shard")) {
+        while(rs->GetNextRow())
+            count++;
+    }
+    delete rs;
+    if(count != g_rows) {
+        cout << "#!# Unsorted scatter returned " << count << " rows." << endl;
+        return 1;
+    }
+    cout << "Done." << endl;
+    return 0;
+}
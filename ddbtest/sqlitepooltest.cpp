@@ -0,0 +1,128 @@
+/*******************************************************************************
+sqlitepooltest.cpp
+Copyright (c) Antti Merenluoto
+
+Tests DdbSqlitePool with concurrent readers on one WAL database while writer threads insert
+rows through the group commit. The database file is created and removed by the test:
+  sqlitepooltest /tmp/pooltest.db
+*******************************************************************************/
+
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <stdio.h>
+#include <cpp4scripts.hpp>
+#define __DDB_SQLITE__
+#include "../directdatabase.hpp"
+#include "../ddbsqlitepool.hpp"
+using namespace std;
+
+const int g_readers = 4;
+const int g_writers = 3;
+const int g_rows = 500;     //!< Rows inserted by each writer.
+
+atomic<bool> g_writing;
+atomic<int> g_failures;
+
+void Writer(DdbSqlitePool *pool, int id)
+{
+    char sql[100];
+    for(int ndx=0; ndx<g_rows; ndx++) {
+        sprintf(sql, "INSERT INTO ddb_pool(writer,seq) VALUES(%d,%d)", id, ndx);
+        if(pool->ExecuteModify(sql) != 1) {
+            cout << "#!# Insert failed, error " << pool->GetErrorID() << endl;
+            g_failures++;
+            return;
+        }
+    }
+}
+
+void Reader(DdbSqlitePool *pool, int &reads)
+{
+    uint32_t count, last = 0;
+    int seq, rows;
+    reads = 0;
+    do {
+        // A reader sees a snapshot, so the count never goes back.
+        if(!pool->ExecuteIntFunction("SELECT count(*) FROM ddb_pool", count) || count < last) {
+            cout << "#!# Count read failed or went back: " << count << " < " << last << endl;
+            g_failures++;
+            return;
+        }
+        last = count;
+        // The rowset sees the same snapshot until the query ends.
+        DdbSqliteReader rd(*pool);
+        DdbRowSet *rs = rd->CreateRowSet();
+        rs->Bind(DDBT_INT, &seq);
+        rows = 0;
+        if(rs->Query("SELECT seq FROM ddb_pool")) {
+            while(rs->GetNext())
+                rows++;
+        }
+        else
+            g_failures++;
+        delete rs;
+        if((uint32_t)rows < last) {
+            cout << "#!# Rowset read " << rows << " rows after a count of " << last << endl;
+            g_failures++;
+            return;
+        }
+        reads++;
+    } while(g_writing);
+}
+
+int main(int argc, char **argv)
+{
+    if(argc<2) {
+        cout << "Usage: sqlitepooltest [database file]" << endl;
+        return 1;
+    }
+    remove(argv[1]);
+    DdbSqlitePool pool;
+    if(!pool.Open(argv[1], g_readers)) {
+        cout << "#!# Pool open failed." << endl;
+        return 1;
+    }
+    if(!pool.UpdateStructure("CREATE TABLE ddb_pool(writer int, seq int)")) {
+        cout << "#!# Create failed." << endl;
+        return 1;
+    }
+    DDBSTR mode;
+    {
+        DdbSqliteReader rd(pool);
+        if(!rd->ExecuteStrFunction("PRAGMA journal_mode", mode) || mode != "wal") {
+            cout << "#!# Database is not in WAL mode: " << mode << endl;
+            return 1;
+        }
+    }
+
+    g_writing = true;
+    g_failures = 0;
+    vector<int> reads(g_readers);
+    vector<thread> readers, writers;
+    for(int ndx=0; ndx<g_readers; ndx++)
+        readers.push_back(thread(Reader, &pool, ref(reads[ndx])));
+    for(int ndx=0; ndx<g_writers; ndx++)
+        writers.push_back(thread(Writer, &pool, ndx));
+    for(size_t ndx=0; ndx<writers.size(); ndx++)
+        writers[ndx].join();
+    g_writing = false;
+    for(size_t ndx=0; ndx<readers.size(); ndx++) {
+        readers[ndx].join();
+        cout << "Reader " << ndx << " made " << reads[ndx] << " reads" << endl;
+    }
+
+    uint32_t count, distinct;
+    pool.ExecuteIntFunction("SELECT count(*) FROM ddb_pool", count);
+    pool.ExecuteIntFunction("SELECT count(DISTINCT writer*100000+seq) FROM ddb_pool", distinct);
+    cout << "Rows " << count << ", distinct " << distinct << endl;
+    if(g_failures || count != g_writers*g_rows || distinct != count) {
+        cout << "#!# Concurrent access failed." << endl;
+        return 1;
+    }
+    pool.Close();
+    remove(argv[1]);
+    cout << "Done." << endl;
+    return 0;
+}
@@ -0,0 +1,291 @@
+/*! \file ddbtypes.cpp
+ * \brief Value types of the DDBT_LONG, DDBT_DEC, DDBT_UUID and DDBT_BLOB fields. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#include "pch-stop.h"
+#include <string.h>
+#include <stdlib.h>
+#if defined(__SSE2__) || defined(_M_X64)
+  #include <emmintrin.h>
+  #define DDB_HEX_SSE2
+#endif
+#include "ddbtypes.hpp"
+
+static const int64_t g_pow10[DDB_DECIMAL_DIGITS+1] = {
+    1LL, 10LL, 100LL, 1000LL, 10000LL, 100000LL, 1000000LL, 10000000LL, 100000000LL,
+    1000000000LL, 10000000000LL, 100000000000LL, 1000000000000LL, 10000000000000LL,
+    100000000000000LL, 1000000000000000LL, 10000000000000000LL, 100000000000000000LL,
+    1000000000000000000LL
+};
+
+//! Value of a hex digit or -1.
+static inline int HexNibble(char ch)
+{
+    if(ch >= '0' && ch <= '9')
+        return ch - '0';
+    ch |= 0x20;
+    if(ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    return -1;
+}
+
+// ==================================================================================================
+bool DdbDecimal::Parse(const char *str, size_t len)
+/*!
+  Parses a decimal number, e.g. "-1234.50". An exponent ("1.5e3") is accepted for the values
+  that the databases print from floating point columns.
+  \param str Text of the number. Need not be null terminated.
+  \param len Length of the text.
+  \retval bool False if the text is not a number or it does not fit. Value is zero then.
+*/
+{
+    const char *end = str + len;
+    uint64_t mag = 0;
+    int digits = 0, sc = 0;
+    bool neg = false, point = false, any = false;
+
+    Clear();
+    while(str < end && *str == ' ')
+        str++;
+    if(str < end && (*str == '-' || *str == '+'))
+        neg = *str++ == '-';
+    for(; str < end; str++) {
+        char ch = *str;
+        if(ch >= '0' && ch <= '9') {
+            any = true;
+            if(digits == DDB_DECIMAL_DIGITS) {
+                if(!point)
+                    return false;
+                continue;
+            }
+            mag = mag*10 + (ch - '0');
+            if(mag)
+                digits++;
+            if(point)
+                sc++;
+        }
+        else if(ch == '.' && !point)
+            point = true;
+        else
+            break;
+    }
+    if(!any)
+        return false;
+    if(str < end && (*str == 'e' || *str == 'E')) {
+        char buffer[8];
+        size_t elen = end - str - 1;
+        if(elen == 0 || elen >= sizeof(buffer))
+            return false;
+        memcpy(buffer, str+1, elen);
+        buffer[elen] = 0;
+        char *eend;
+        sc -= (int)strtol(buffer, &eend, 10);
+        str += 1 + (eend - buffer);
+    }
+    while(str < end && *str == ' ')
+        str++;
+    if(str != end)
+        return false;
+    for(; sc < 0; sc++) {
+        if(mag > (uint64_t)(g_pow10[DDB_DECIMAL_DIGITS]/10*9))
+            return false;
+        mag *= 10;
+    }
+    for(; sc > DDB_DECIMAL_DIGITS; sc--)
+        mag /= 10;
+    if(mag > (uint64_t)INT64_MAX)
+        return false;
+    value = neg ? -(int64_t)mag : (int64_t)mag;
+    scale = sc;
+    return true;
+}
+
+// ==================================================================================================
+int DdbDecimal::Format(char *buffer, size_t size) const
+/*!
+  Prints the number with all the digits of the scale, e.g. "12.50".
+  \param buffer Output buffer. DDB_DECIMAL_TEXT bytes is always enough.
+  \retval int Length of the text or -1 if it does not fit.
+*/
+{
+    char tmp[DDB_DECIMAL_TEXT];
+    uint64_t mag = value < 0 ? (uint64_t)0 - (uint64_t)value : (uint64_t)value;
+    int len = 0;
+    do {
+        if(len == scale && scale > 0)
+            tmp[len++] = '.';
+        tmp[len++] = (char)('0' + mag%10);
+        mag /= 10;
+    } while(mag || len <= scale);
+    if(value < 0)
+        tmp[len++] = '-';
+    if((size_t)len >= size)
+        return -1;
+    for(int ndx=0; ndx<len; ndx++)
+        buffer[ndx] = tmp[len-1-ndx];
+    buffer[len] = 0;
+    return len;
+}
+
+// ==================================================================================================
+double DdbDecimal::ToDouble() const
+{
+    return (double)value / (double)g_pow10[scale];
+}
+
+// ==================================================================================================
+bool DdbDecimal::Rescale(int newScale)
+/*!
+  Changes the scale. Digits are truncated when the scale is reduced.
+  \retval bool False if the value does not fit with the new scale. Value is not changed then.
+*/
+{
+    if(newScale < 0 || newScale > DDB_DECIMAL_DIGITS)
+        return false;
+    if(newScale < scale)
+        value /= g_pow10[scale-newScale];
+    else if(newScale > scale) {
+        int64_t mul = g_pow10[newScale-scale];
+        if(value > INT64_MAX/mul || value < INT64_MIN/mul)
+            return false;
+        value *= mul;
+    }
+    scale = newScale;
+    return true;
+}
+
+// ==================================================================================================
+int DdbDecimal::Compare(const DdbDecimal &other) const
+/*!
+  Compares the numeric values regardless of the scales.
+  \retval int Negative if this is less than other, zero if equal and positive if greater.
+*/
+{
+    DdbDecimal a = *this, b = other;
+    int common = a.scale > b.scale ? a.scale : b.scale;
+    if(!a.Rescale(common) || !b.Rescale(common)) {
+        double da = ToDouble(), db = other.ToDouble();
+        return da<db ? -1 : (da>db ? 1 : 0);
+    }
+    return a.value<b.value ? -1 : (a.value>b.value ? 1 : 0);
+}
+
+// ==================================================================================================
+bool DdbUuid::Parse(const char *str, size_t len)
+/*!
+  Parses the text form of a UUID. The hyphens and braces are optional, as in PostgreSQL.
+  \retval bool False if the text does not have exactly 32 hex digits. UUID is nil then.
+*/
+{
+    int count = 0;
+    Clear();
+    for(size_t ndx=0; ndx<len; ndx++) {
+        char ch = str[ndx];
+        if(ch == '-' || ch == '{' || ch == '}')
+            continue;
+        int nibble = HexNibble(ch);
+        if(nibble < 0 || count == 32) {
+            Clear();
+            return false;
+        }
+        bytes[count/2] |= count%2 ? nibble : nibble<<4;
+        count++;
+    }
+    if(count != 32) {
+        Clear();
+        return false;
+    }
+    return true;
+}
+
+// ==================================================================================================
+void DdbUuid::Format(char *buffer) const
+/*!
+  Prints the UUID in the canonical form, e.g. "a0eebc99-9c0b-4ef8-bb6d-6bb9bd380a11".
+  \param buffer Output buffer of DDB_UUID_TEXT bytes.
+*/
+{
+    static const char digits[] = "0123456789abcdef";
+    char *out = buffer;
+    for(int ndx=0; ndx<16; ndx++) {
+        if(ndx==4 || ndx==6 || ndx==8 || ndx==10)
+            *out++ = '-';
+        *out++ = digits[bytes[ndx]>>4];
+        *out++ = digits[bytes[ndx]&15];
+    }
+    *out = 0;
+}
+
+// ==================================================================================================
+bool DdbUuid::IsNil() const
+{
+    for(int ndx=0; ndx<16; ndx++) {
+        if(bytes[ndx])
+            return false;
+    }
+    return true;
+}
+
+// ==================================================================================================
+void DdbUuid::Clear()
+{
+    memset(bytes, 0, sizeof(bytes));
+}
+
+#ifdef DDB_HEX_SSE2
+// ==================================================================================================
+static inline bool HexDecode16(const char *hex, __m128i &values)
+/*!
+  Converts 16 hex digits into 16 nibbles with SSE2.
+  \retval bool False if any of the characters is not a hex digit.
+*/
+{
+    __m128i text = _mm_loadu_si128((const __m128i*)hex);
+    __m128i lower = _mm_or_si128(text, _mm_set1_epi8(0x20));
+    // Signed compares. Bytes above 127 are negative and fail both ranges.
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(text, _mm_set1_epi8('0'-1)),
+                                  _mm_cmplt_epi8(text, _mm_set1_epi8('9'+1)));
+    __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a'-1)),
+                                  _mm_cmplt_epi8(lower, _mm_set1_epi8('f'+1)));
+    if(_mm_movemask_epi8(_mm_or_si128(digit, alpha)) != 0xFFFF)
+        return false;
+    values = _mm_or_si128(_mm_and_si128(digit, _mm_sub_epi8(text, _mm_set1_epi8('0'))),
+                          _mm_and_si128(alpha, _mm_sub_epi8(lower, _mm_set1_epi8('a'-10))));
+    // Each 16-bit lane has the high nibble in the low byte. Combine into a byte in the lane.
+    values = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(values, _mm_set1_epi16(0x00FF)), 4),
+                          _mm_srli_epi16(values, 8));
+    return true;
+}
+#endif
+
+// ==================================================================================================
+size_t DdbHexDecode(const char *hex, size_t len, uint8_t *out)
+/*!
+  Converts hex digits into bytes. With SSE2 32 digits are converted per round. Used for the
+  PostgreSQL bytea values that are received as "\x0123..".
+  \param hex Hex digits, two per byte. Upper and lower case are accepted.
+  \param len Number of digits. Must be even.
+  \param out Output buffer of len/2 bytes.
+  \retval size_t Number of bytes or DDB_DECODE_ERROR if the text has an invalid character.
+*/
+{
+    if(len%2)
+        return DDB_DECODE_ERROR;
+    size_t count = len/2, ndx = 0;
+#ifdef DDB_HEX_SSE2
+    for(; ndx+16 <= count; ndx += 16) {
+        __m128i first, second;
+        if(!HexDecode16(hex+2*ndx, first) || !HexDecode16(hex+2*ndx+16, second))
+            return DDB_DECODE_ERROR;
+        _mm_storeu_si128((__m128i*)(out+ndx), _mm_packus_epi16(first, second));
+    }
+#endif
+    for(; ndx < count; ndx++) {
+        int high = HexNibble(hex[2*ndx]), low = HexNibble(hex[2*ndx+1]);
+        if(high < 0 || low < 0)
+            return DDB_DECODE_ERROR;
+        out[ndx] = (uint8_t)(high<<4 | low);
+    }
+    return count;
+}
@@ -0,0 +1,60 @@
+/*! \file ddbtypes.hpp
+ * \brief Value types of the DDBT_LONG, DDBT_DEC, DDBT_UUID and DDBT_BLOB fields. */
+// Copyright (c) Menacon Oy
+/********************************************************************************/
+
+#ifndef DDB_TYPES_H_FILE
+#define DDB_TYPES_H_FILE
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+//! Largest scale and number of significant digits of DdbDecimal.
+#define DDB_DECIMAL_DIGITS 18
+//! Buffer size that holds any DdbDecimal as text.
+#define DDB_DECIMAL_TEXT 48
+//! Buffer size that holds DdbUuid as text.
+#define DDB_UUID_TEXT 37
+//! Returned by the decoders for invalid input.
+#define DDB_DECODE_ERROR ((size_t)-1)
+
+// ==================================================================================================
+//! Fixed point decimal number, value / 10^scale. Bound with DDBT_DEC.
+/*! Holds up to 18 significant digits exactly, e.g. money amounts that must not go through
+    double. The scale follows the text received from the database, so 12.50 from a NUMERIC(10,2)
+    column is value 1250 with scale 2. Digits beyond the 18th decimal are truncated; a value
+    with more than 18 integer digits does not parse.
+ */
+struct DdbDecimal
+{
+    int64_t value;      //!< Unscaled value.
+    int scale;          //!< Number of digits after the decimal point. 0..DDB_DECIMAL_DIGITS.
+
+    bool Parse(const char *str, size_t len);
+    int Format(char *buffer, size_t size) const;
+    double ToDouble() const;
+    bool Rescale(int newScale);
+    int Compare(const DdbDecimal &other) const;
+    //! Sets the value to zero.
+    void Clear() { value = 0; scale = 0; }
+};
+
+// ==================================================================================================
+//! 16 byte UUID in the network byte order. Bound with DDBT_UUID.
+struct DdbUuid
+{
+    uint8_t bytes[16];
+
+    bool Parse(const char *str, size_t len);
+    void Format(char *buffer) const;
+    bool IsNil() const;
+    void Clear();
+};
+
+//! Binary value bound with DDBT_BLOB.
+typedef std::vector<uint8_t> DdbBlob;
+
+size_t DdbHexDecode(const char *hex, size_t len, uint8_t *out);
+
+#endif
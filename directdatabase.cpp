@@ -16,6 +16,7 @@ Copyright (c) Antti Merenluoto
 #include <cpp4scripts.hpp>
 
 #include "directdatabase.hpp"
+#include "ddbexport.hpp"
 
 // =================================================================================================
 DirectDatabase::DirectDatabase()
@@ -29,6 +30,8 @@ DirectDatabase::DirectDatabase()
     errorId = 0;
     flags = 0;
     port = 0;
+    nestLevel = 0;
+    nestOuter = false;
 
     /* Depending on the client's I18N settings the numeric values use period or comma
        as decimal separator. By default databases use the period.
@@ -109,7 +112,7 @@ bool DirectDatabase::Initialize(const DDBSTR &server,const DDBSTR &db,const DDBS
 // =================================================================================================
 DDBSTR DirectDatabase::GetLastError()
 {
-#define MAX_ERRORS 24
+#define MAX_ERRORS 30
 const CHR_T *errorStr[MAX_ERRORS] = {
     /* 000 */ _T("Success"),
     /* 001 */ _T("Undefined error number"),
@@ -134,7 +137,13 @@ const CHR_T *errorStr[MAX_ERRORS] = {
     /* 020 */ _T("Rowset - GetNext function was unsuccesful."),
     /* 021 */ _T("DB - Update structure (CREATE, DROP, ALTER TABLE or VIEW) command was unsuccessful."),
     /* 022 */ _T("DB - GetInsertId failed. Operation not supported or last statement was not an INSERT command."),
-    /* 023 */ _T("DB - Initialization failure.")
+    /* 023 */ _T("DB - Initialization failure."),
+    /* 024 */ _T("Pool - Connection pool has not been opened."),
+    /* 025 */ _T("Shard - Shard key has not been selected or it belongs to other shard than the transaction."),
+    /* 026 */ _T("DB - Operation is not supported by this database."),
+    /* 027 */ _T("DB - Query was canceled or it did not complete before the deadline."),
+    /* 028 */ _T("DB - Connection is busy with another asynchronous query."),
+    /* 029 */ _T("DB - Transaction could not be started or committed. A failed commit is rolled back.")
 };
     DDBSTR str;
     if(errorId >= MAX_ERRORS)
@@ -341,6 +350,155 @@ double DirectDatabase::ExecuteDoubleFunction(const DDBSTR &query)
         return -1;
     return retval;
 }
+// =================================================================================================
+int DirectDatabase::ExecuteInsertReturning(const DDBSTR &insert, std::vector<int64_t> &ids, const char *column)
+/*!
+  Runs a multi-row insert and returns the generated keys in the order of the returned rows.
+  \code
+  std::vector<int64_t> ids;
+  db->ExecuteInsertReturning("INSERT INTO item(name) VALUES('a'),('b'),('c')", ids, "id");
+  \endcode
+  \param insert Statement to run. See DdbRowSet::QueryReturning.
+  \param ids Receives the keys. Rows with NULL key are skipped.
+  \param column Key column for the RETURNING clause. Null (default) if the statement has the
+    clause, as with DdbRowSet::ExecuteInsertReturning.
+  \retval int Number of keys or -1 on error.
+*/
+{
+    int64_t id;
+    ids.clear();
+    DdbRowSet *rs = CreateRowSet();
+    if(!rs)
+        return -1;
+    if(!rs->Bind(DDBT_LONG, &id) || !rs->QueryReturning(insert, column)) {
+        delete rs;
+        return -1;
+    }
+    while(rs->GetNextRow()) {
+        if(!rs->fieldRoot->null)
+            ids.push_back(id);
+    }
+    delete rs;
+    return (int)ids.size();
+}
+
+// =================================================================================================
+bool DirectDatabase::Savepoint(const char *command, int level)
+{
+    char sql[64];
+    snprintf(sql, sizeof(sql), "%s ddb_sp_%d", command, level);
+    if(ExecuteModify(DDBSTR(sql)) < 0)
+    {
+        CS_VAPRT_ERRO("DirectDatabase::Savepoint - %s failed.",sql);
+        return false;
+    }
+    return true;
+}
+
+// =================================================================================================
+bool DirectDatabase::BeginNested()
+/*!
+  Starts a transaction or, if one is already on, a nested level inside it. Nested levels are
+  savepoints of the one server transaction. Each call must be paired with CommitNested or
+  RollBackNested. If the outer transaction was started with StartTransaction it is left to the
+  caller to commit.
+  \retval bool True on success.
+*/
+{
+    if(!IsTransaction())
+    {
+        nestLevel = 0;
+        if(!StartTransaction())
+            return false;
+        nestOuter = true;
+        nestLevel = 1;
+        return true;
+    }
+    if(nestLevel == 0)
+        nestOuter = false;
+    if(!Savepoint("SAVEPOINT", nestLevel+1))
+        return false;
+    nestLevel++;
+    return true;
+}
+
+// =================================================================================================
+bool DirectDatabase::CommitNested()
+/*!
+  Ends the innermost level. Nested level is released into the enclosing level, the outermost
+  level commits the transaction.
+*/
+{
+    if(nestLevel == 0 || !IsTransaction())
+    {
+        nestLevel = 0;
+        SetErrorId(7);
+        return false;
+    }
+    if(nestLevel == 1 && nestOuter)
+    {
+        nestLevel = 0;
+        return Commit();
+    }
+    bool ok = Savepoint("RELEASE SAVEPOINT", nestLevel);
+    nestLevel--;
+    return ok;
+}
+
+// =================================================================================================
+bool DirectDatabase::RollBackNested()
+/*!
+  Cancels the work done on the innermost level. The enclosing levels continue normally. The
+  outermost level rolls back the transaction.
+*/
+{
+    if(nestLevel == 0 || !IsTransaction())
+    {
+        nestLevel = 0;
+        SetErrorId(7);
+        return false;
+    }
+    if(nestLevel == 1 && nestOuter)
+    {
+        nestLevel = 0;
+        return RollBack();
+    }
+    bool ok = Savepoint("ROLLBACK TO SAVEPOINT", nestLevel) && Savepoint("RELEASE SAVEPOINT", nestLevel);
+    nestLevel--;
+    return ok;
+}
+
+// ==================================================================================================
+int DirectDatabase::Export(const DDBSTR &, DdbExportWriter &)
+{
+    CS_PRINT_WARN("DirectDatabase::Export - Export is not supported by this database.");
+    SetErrorId(26);
+    return -1;
+}
+
+// ==================================================================================================
+int DirectDatabase::ExportQuery(const DDBSTR &query, int fd, int format, int options)
+/*!
+  Streams the query result into the file descriptor.
+  \code
+  int fd = open("customers.csv", O_WRONLY|O_CREAT|O_TRUNC, 0644);
+  db->ExportQuery("SELECT * FROM customer", fd, DDB_EXPORT_CSV, DDB_EXPORT_HEADER);
+  close(fd);
+  \endcode
+  \param query Query to export.
+  \param fd File descriptor to write to. It is not closed.
+  \param format DDB_EXPORT_CSV, DDB_EXPORT_TSV or DDB_EXPORT_JSONL.
+  \param options Combination of DDB_EXPORT_HEADER and DDB_EXPORT_NOCOPY.
+  \retval int Number of rows exported or -1 on error.
+*/
+{
+    DdbExportWriter out(fd, format, options);
+    int rows = Export(query, out);
+    if(!out.Flush())
+        return -1;
+    return rows;
+}
+
 #ifdef DDB_USESTL
 void DirectDatabase::TrimTail(std::string *target)
 {
@@ -18,6 +18,10 @@ Copyright (c) Antti Merenluoto
 #include <fstream>
 #endif
 #include <stdint.h>
+#include <vector>
+#include <unordered_map>
+#include "ddbtypes.hpp"
+#include "ddbjson.hpp"
 
 // Log feature uses STL string streams despite the library setting
 #include <sstream>
@@ -29,6 +33,7 @@ const int DDBTYPE_MYSQL    = 2;
 const int DDBTYPE_ODBC     = 3;
 const int DDBTYPE_SQLITE   = 4;
 const int DDBTYPE_MSSQL    = 5;
+const int DDBTYPE_FIREBIRD = 6;
 
 // OBSOLETE from 2006-8-20: #include <directdb/ddb_setup.hpp>
 /* You may use either the STL library or wxWidgets library type variables. Either DDB_USESTL or DDB_USEWX
@@ -76,7 +81,18 @@ const short int DDBT_TIME = 5; // Timestamp: Date and time
 const short int DDBT_NUM  = 6; // Numeric (double)
 const short int DDBT_DAY  = 7; // Date only
 const short int DDBT_CHR  = 8; // Single character
-const short int DDBT_MAX  = 8;
+const short int DDBT_LONG = 9; // 64bit int (int64_t)
+const short int DDBT_DEC  = 10; // Fixed point decimal (DdbDecimal)
+const short int DDBT_UUID = 11; // 16 byte UUID (DdbUuid)
+const short int DDBT_BLOB = 12; // Binary data (DdbBlob)
+// Array types. Supported by PostgreSQL only (see DdbPosgtgreRowSet::Bind).
+const short int DDBT_INTARR  = 13; // std::vector<int>
+const short int DDBT_LONGARR = 14; // std::vector<int64_t>
+const short int DDBT_NUMARR  = 15; // std::vector<double>
+const short int DDBT_STRARR  = 16; // std::vector<std::string> in UTF-8
+// JSON document read with a handler. PostgreSQL and MySQL only.
+const short int DDBT_JSON = 17; // DdbJsonHandler*
+const short int DDBT_MAX  = 17;
 
 const short int DDB_CLEAN_MAX = 10; // Max number of escapes allowed to Clean.. functions
 
@@ -105,15 +121,41 @@ public:
 
     short int type;             //!< Field type. One of DDBT... constants
     void *data;                 //!< Pointer to client data buffer.
+    bool null;                  //!< True if the value of the current row is NULL. Set by GetNext.
     DdbBoundField *next;      //!< Pointer to next bound field. Null signifies end of the list.
 };
 
+//! Column of a query result described by the auto-describe mode (see DdbRowSet::SetAutoDescribe).
+struct DdbColumn
+{
+    std::string name;           //!< Column name as reported by the database.
+    short int type;             //!< DDBT-type the values are converted into.
+    unsigned int dbType;        //!< Database specific type id, e.g. the PostgreSQL type OID.
+    // Value of the current row. GetNext converts the value into the member matching the type.
+    int intVal;
+    int64_t longVal;
+    double numVal;
+    DdbDecimal decVal;
+    DdbUuid uuidVal;
+    DdbBlob blobVal;
+    bool boolVal;
+    DDBSTR strVal;
+    DDBTIME timeVal;
+#ifdef DDB_USESTL
+    char chrVal;
+#else
+    wxUniChar chrVal;
+#endif
+};
+
 // =============================================================================
 //  ABSTRACT CLASSES
 // =============================================================================
 
 // Forward declarations.
 class DdbRowSet;
+class DdbResultRows;
+class DdbExportWriter;
 
 // ==================================================================================================
 //! Database class represents the connection to the database.
@@ -127,6 +169,12 @@ class DdbRowSet;
 class DirectDatabase
 {
     friend class DdbPosgtgreRowSet;
+    friend class DdbSqliteRowSet;
+    friend class DdbOdbcRowSet;
+    friend class DdbFirebirdRowSet;
+    friend class DdbFirebirdBatch;
+    friend class DdbPgAsync;
+    friend class DdbPgRowStream;
 public:
     DirectDatabase();
     DirectDatabase(DirectDatabase &) {};
@@ -321,9 +369,12 @@ public:
         In PostgreSQL field type is SEQUENCE,
         in MySql the field type is AUTO INCREMENT.
         For other databases this function returns 0. Please see further details from your database manual.
-        \retval unsigned int Auto increment field value from last insert.
+        In PostgreSQL this is an extra round trip; see ExecuteInsertReturning.
+        \retval uint64_t Auto increment field value from last insert.
      */
-    virtual unsigned long GetInsertId()=0;
+    virtual uint64_t GetInsertId()=0;
+
+    int ExecuteInsertReturning(const DDBSTR &insert, std::vector<int64_t> &ids, const char *column=0);
 
     /*! Used to update database structure commands like CREATE, DROP and ALTER TABLE.
       \param command SQL command to execute.
@@ -331,6 +382,22 @@ public:
      */
     virtual bool UpdateStructure(const DDBSTR &command)=0;
 
+    /*! Runs the query and streams the result into the export writer. Implementations pass the
+        values from the result buffers of the driver without converting them into bound
+        variables. Default implementation is not supported and returns -1.
+      \param query Query to export.
+      \param out Writer that formats and writes the rows.
+      \retval int Number of rows exported or -1 on error.
+     */
+    virtual int Export(const DDBSTR &query, DdbExportWriter &out);
+
+    /*! Cancels the query that is running on this connection. Unlike the other functions this
+        one may be called from another thread. The default implementation does nothing.
+      \retval bool True if the cancel request was sent.
+     */
+    virtual bool Cancel() { return false; }
+    int ExportQuery(const DDBSTR &query, int fd, int format, int options=0);
+
     /*! Returns true if comma is used as a decimal separator in running environment. This means that when
         floating point numbers are printed the comma should be changed to period. PrintNumber-function does this
         automatically depending on the running environemnt.
@@ -340,6 +407,12 @@ public:
      */
     bool IsTransaction() { return (flags&DDB_FLAG_TRANSACT_ON)!=0; }
 
+    bool BeginNested();
+    bool CommitNested();
+    bool RollBackNested();
+    //! Returns the number of open BeginNested levels.
+    int GetNestLevel() { return nestLevel; }
+
     bool IsConnected();
     bool IsFeatureOn(const unsigned short int ft) { return (ft&feat_on)>0?true:false; }
     virtual int IsFeatureSupported(const int);
@@ -360,6 +433,7 @@ public:
 
 protected:
     void SetErrorId(int id);
+    bool Savepoint(const char *command, int level);
     void reallocateScratch(size_t size) {
         if(size<=scratch_size) return;
         delete[] scratch_buffer;
@@ -378,6 +452,8 @@ protected:
     unsigned long errorId;    //!< Error id from the last database operation. Zero if all OK.
     short int flags;          //!< Operation flags. Combination of DDBFLAG_...
     bool commaDecimal;        //!< True if comma is decimal separator, false otherwise.
+    int nestLevel;            //!< Number of open BeginNested levels.
+    bool nestOuter;           //!< True if the outermost level was started by BeginNested.
     CHR_T *scratch_buffer;    //!< Buffer for the string cleaning
     size_t scratch_size;      //!< size for the current buffer.
 };
@@ -429,10 +505,13 @@ public:
         the query since some of the field values could have been NULLs. In this case the bound
         data is cleared (actual operation depends on the data type). If return value is zero
         then there is no more rows in the result set (= no fields converted). Bound variables
-        remain unaltered in this case.
-        \sa QuitQuery
+        remain unaltered in this case. Use GetNextRow to read the rows whose values are all
+        NULL.
+        \sa QuitQuery, GetNextRow
       */
     virtual int GetNext() = 0;
+    bool GetNextRow();
+    bool IsNull(int field);
 
     /*! Releases the query results. GetNext calls this automatically once query results have been
         read to the end. If partial result set is read this function should be called to make
@@ -443,14 +522,99 @@ public:
     /*! Returns number of fields currently bound */
     int GetFieldCount() { return fieldCount; }
 
+    virtual int Materialize(const DDBSTR &query, DdbResultRows &rows);
+
+    bool QueryReturning(const DDBSTR &statement, const char *returning);
+    bool ExecuteInsertReturning(const DDBSTR &insert, const char *returning=0);
+
+    // Auto-describe mode.
+    bool SetAutoDescribe(bool on);
+    //! Returns true if the auto-describe mode is on.
+    bool IsAutoDescribe() { return autoDescribe; }
+    //! Returns the number of columns described for the last query.
+    int GetColumnCount() { return (int)columns.size(); }
+    //! Returns the description of a column. Index must be valid.
+    const DdbColumn& GetColumn(int col) { return columns[col]; }
+    int FindColumn(const char *name);
+
+    int GetInt(int col);
+    int64_t GetLong(int col);
+    double GetDouble(int col);
+    DdbDecimal GetDecimal(int col);
+    bool GetBool(int col);
+    const DDBSTR& GetStr(int col);
+    const DDBTIME& GetTime(int col);
+    const DdbUuid& GetUuid(int col);
+    const DdbBlob& GetBlob(int col);
+    //! Returns the value of the named column as int. See GetInt(int).
+    int GetInt(const char *name) { return GetInt(FindColumn(name)); }
+    //! Returns the value of the named column as int64_t. See GetLong(int).
+    int64_t GetLong(const char *name) { return GetLong(FindColumn(name)); }
+    //! Returns the value of the named column as double. See GetDouble(int).
+    double GetDouble(const char *name) { return GetDouble(FindColumn(name)); }
+    //! Returns the value of the named column as decimal. See GetDecimal(int).
+    DdbDecimal GetDecimal(const char *name) { return GetDecimal(FindColumn(name)); }
+    //! Returns the value of the named column as bool. See GetBool(int).
+    bool GetBool(const char *name) { return GetBool(FindColumn(name)); }
+    //! Returns the value of the named string column. See GetStr(int).
+    const DDBSTR& GetStr(const char *name) { return GetStr(FindColumn(name)); }
+    //! Returns the value of the named time column. See GetTime(int).
+    const DDBTIME& GetTime(const char *name) { return GetTime(FindColumn(name)); }
+    //! Returns the value of the named UUID column. See GetUuid(int).
+    const DdbUuid& GetUuid(const char *name) { return GetUuid(FindColumn(name)); }
+    //! Returns the value of the named binary column. See GetBlob(int).
+    const DdbBlob& GetBlob(const char *name) { return GetBlob(FindColumn(name)); }
+
 protected:
     DdbRowSet();
     bool InsertField(DdbBoundField *newField);
     bool ValidateBind(short int type, void *data);
+    int CopyNulls(DdbRowSet *source);
+    bool SetupRows(DdbResultRows &rows);
+    void ClearFields();
+    void BindColumns();
+    int CountFields();
 
     DDBSTR queryStmt;            //!< Query statement.
     DdbBoundField *fieldRoot;    //!< First field of the bound field list.
     int fieldCount;              //!< Number of fields bound for this row set.
+    bool autoDescribe;           //!< True if the fields are bound from the result columns.
+    std::vector<DdbColumn> columns;                     //!< Columns of the last query in auto-describe mode.
+    std::unordered_map<std::string,int> columnIndex;    //!< Column name to index.
+};
+
+// ==================================================================================================
+//! Scope guard for DirectDatabase::BeginNested.
+/*! Level is rolled back when the guard goes out of scope unless Commit has been called.
+    \code
+    DdbTransactionScope scope(db);
+    if(db->ExecuteModify(...) < 0)
+        return false;  // Rolled back by the destructor.
+    return scope.Commit();
+    \endcode
+ */
+class DdbTransactionScope
+{
+public:
+    DdbTransactionScope(DirectDatabase *db_in) { db = db_in; active = db->BeginNested(); }
+    ~DdbTransactionScope() { RollBack(); }
+    //! Returns true if the level was started and has not been ended yet.
+    bool IsActive() { return active; }
+    bool Commit() {
+        if(!active) return false;
+        active = false;
+        return db->CommitNested();
+    }
+    bool RollBack() {
+        if(!active) return false;
+        active = false;
+        return db->RollBackNested();
+    }
+private:
+    DdbTransactionScope(const DdbTransactionScope&);
+    void operator=(const DdbTransactionScope&);
+    DirectDatabase *db;
+    bool active;
 };
 
 // =============================================================================
@@ -542,7 +706,7 @@ inline bool DirectDatabase::SetFeature(const int feature_new)
 #include "ddbpostgre.hpp"
 #endif
 
-#ifdef __DDB_ODBCWIN__
+#if defined(__DDB_ODBC__) || defined(__DDB_ODBCWIN__)
 #include "ddbodbc.hpp"
 #endif
 
@@ -550,8 +714,8 @@ inline bool DirectDatabase::SetFeature(const int feature_new)
 #include "ddbfirebird.hpp"
 #endif
 
-#ifdef __DDB_SQLLITE__
-#include "ddbsqllite.hpp"
+#ifdef __DDB_SQLITE__
+#include "ddbsqlite.hpp"
 #endif
 
 #if defined(__DDB_MICROSOFT__) && defined(_WIN32)